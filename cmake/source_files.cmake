@@ -66,6 +66,7 @@ SET(LCB_CORE_CXXSRC
     src/errmap.cc
     src/getconfig.cc
     src/handler.cc
+    src/hedging.cc
     src/hostlist.cc
     src/http/http.cc
     src/http/http_io.cc
@@ -79,8 +80,10 @@ SET(LCB_CORE_CXXSRC
     src/n1ql/n1ql.cc
     src/n1ql/query_handle.cc
     src/n1ql/query_utils.cc
+    src/nearcache.cc
     src/newconfig.cc
     src/nodeinfo.cc
+    src/nodescore.cc
     src/operations/cbflush.cc
     src/operations/counter.cc
     src/operations/durability-seqno.cc
@@ -98,12 +101,15 @@ SET(LCB_CORE_CXXSRC
     src/operations/subdoc.cc
     src/operations/touch.cc
     src/operations/unlock.cc
+    src/retrybudget.cc
     src/retrychk.cc
     src/retryq.cc
     src/rnd.cc
+    src/rtgroup.cc
     src/search/search.cc
     src/search/search_handle.cc
     src/settings.cc
+    src/submitq.cc
     src/utilities.cc
     src/views/view.cc
     src/views/view_handle.cc
@@ -1272,6 +1272,13 @@ typedef enum {
 
 /**
  * Tell the server that the library supports reordering the execution of the commands
+ *
+ * When the server accepts, commands for different documents may complete in any
+ * order. The library still writes a mutation only once all earlier commands for
+ * the same document have completed, and a read only once earlier mutations of
+ * the document have completed, so operations on a single document behave as if
+ * they were executed in the order they were scheduled.
+ *
  * @cntl_arg_both{int (as boolean)}
  * @volatile
  */
@@ -1326,11 +1333,445 @@ typedef enum {
  */
 #define LCB_CNTL_ENABLE_OP_METRICS 0x67
 
+/**
+ * @brief Number of connections to each KV node
+ *
+ * A single connection is served by a single thread on the server, and its
+ * throughput is further limited by TLS. With more than one connection,
+ * commands are spread across them: all commands for the same vBucket are
+ * written on the same connection, so that operations on a single document
+ * are executed in the order they were scheduled. Reads are written on the
+ * least busy connection instead, as long as no mutations are in flight on
+ * the connection of their vBucket; a read may therefore observe a mutation
+ * which was scheduled after it.
+ *
+ * The setting is applied to connections to nodes added to the cluster map
+ * after it changes, and must be between 1 (the default) and 64.
+ *
+ * The queue depth of each connection is reported in lcb_SERVERMETRICS.
+ *
+ * Use `kv_connections_per_node` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_CONNECTIONS_PER_NODE 0x68
+
+/**
+ * @brief Minimum size of values to send without copying them
+ *
+ * Values passed to lcb_cmdstore_value_nocopy() or
+ * lcb_cmdstore_value_iov_nocopy() which are at least this large (in bytes)
+ * are sent straight from the application's buffers with `MSG_ZEROCOPY`,
+ * rather than being copied into the kernel. As the kernel may keep
+ * referencing the buffers until the data has been acknowledged by the
+ * server, the lcb_pktflushed_callback for such a value is delayed until it has
+ * released them.
+ *
+ * Zero-copy sends are only available on Linux, with event-based I/O plugins
+ * (e.g. libevent, libev or select) and without TLS; values are sent the usual
+ * way otherwise. They only pay off for values of a few hundred kilobytes or
+ * more. The default is 0, which disables them.
+ *
+ * Use `kv_zerocopy_threshold` in the connection string.
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_ZEROCOPY_THRESHOLD 0x69
+
+/**
+ * @brief Counters for the buffers holding decompressed values
+ * @see LCB_CNTL_INFLATE_STATS
+ */
+typedef struct {
+    lcb_U64 requests;     /**< Buffers requested, i.e. values decompressed */
+    lcb_U64 reused;       /**< Buffers reused from the pool */
+    lcb_U64 allocated;    /**< Buffers allocated from the heap */
+    lcb_U64 oversized;    /**< Buffers allocated from the heap because they are too large to be pooled */
+    lcb_U64 outstanding;  /**< Buffers in use, including those retained with lcb_respget_value_retain() */
+    lcb_U64 pooled_bytes; /**< Memory kept in the pool for reuse */
+} lcb_INFLATE_STATS;
+
+/**
+ * @brief Allocation counters for decompressed values
+ *
+ * Values received compressed are decompressed (see @ref LCB_CNTL_COMPRESSION_OPTS)
+ * into buffers which are pooled by size, rather than allocated for each
+ * response. This returns counters about those allocations; a high ratio of
+ * `allocated` to `requests` suggests the values are too large to be pooled.
+ *
+ * @cntl_arg_getonly{lcb_INFLATE_STATS*}
+ * @volatile
+ */
+#define LCB_CNTL_INFLATE_STATS 0x6a
+
+/**
+ * @brief Adaptive compression of outgoing values
+ *
+ * When enabled, the compression ratio and CPU time of the values compressed
+ * (see @ref LCB_CNTL_COMPRESSION_OPTS) are tracked for each collection. Once
+ * compression stops paying off for a collection, its values are sent without
+ * attempting to compress them, and compression is periodically attempted
+ * again in case their contents changed. The number of values skipped this way
+ * is reported in lcb_METRICS::compression_skipped.
+ *
+ * Use `compression_adaptive` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_COMPRESSION_ADAPTIVE 0x6b
+
+/**
+ * @brief How long collections reported as unknown are remembered
+ *
+ * Once the server reports that a scope or collection does not exist, commands
+ * for it fail immediately with the same error, rather than looking it up
+ * again, until this time has elapsed or a newer collections manifest is seen.
+ *
+ * Use `collections_unknown_ttl` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` disables this feature.
+ * @volatile
+ */
+#define LCB_CNTL_COLLECTIONS_UNKNOWN_TTL 0x6c
+
+/**
+ * @brief Ask the server to push cluster map changes
+ *
+ * When the server accepts, it notifies the library of new configurations on
+ * the KV connections as soon as they are applied, and background polling
+ * (see @ref LCB_CNTL_CONFIG_POLL_INTERVAL) is skipped while such a connection
+ * is established. Polling remains in use for servers which do not support it.
+ *
+ * Use `enable_config_push` in the connection string
+ *
+ * @cntl_arg_both{int (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_ENABLE_CONFIG_PUSH 0x6d
+
+/**
+ * @brief Share the response of GETs for the same key
+ *
+ * When enabled, a GET for a document which is already being retrieved, and
+ * whose response has not arrived yet, is not sent to the server. Instead it
+ * receives the response of the request in flight, along with every other
+ * command waiting for it. Only plain GETs from the same collection are
+ * combined: commands which lock or touch the document, or which are issued
+ * on behalf of another user, are always sent. The command joining a request
+ * shares its timeout, and the number of commands answered this way is
+ * reported in lcb_METRICS::get_collapsed.
+ *
+ * Because the response may have been produced before the command was
+ * issued, enable this only when the application does not rely on reading
+ * its own mutations of frequently requested documents.
+ *
+ * Use `get_single_flight` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_GET_SINGLE_FLIGHT 0x6e
+
+/**
+ * @brief Memory available to the near cache of document values
+ *
+ * When set, the values returned by GETs are kept in memory, up to this many
+ * bytes, and later GETs for the same documents return them without
+ * contacting the server (see @ref LCB_CNTL_NEAR_CACHE_TTL). Values are
+ * dropped when a mutation of the document by this instance completes, and
+ * the least recently used ones are evicted when the cache is full. Commands
+ * which lock or touch the document, or which are issued on behalf of another
+ * user, always contact the server. The number of hits, misses and evictions
+ * is reported in lcb_METRICS.
+ *
+ * Mutations by other clients are not seen until the value expires, so this
+ * is meant for documents which rarely change.
+ *
+ * Use `near_cache_size` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` (the default) disables the cache.
+ * @volatile
+ */
+#define LCB_CNTL_NEAR_CACHE_SIZE 0x6f
+
+/**
+ * @brief How long values are returned from the near cache
+ *
+ * This is the maximum time since the value was read, or last confirmed by
+ * the server (see @ref LCB_CNTL_NEAR_CACHE_REVALIDATE), after which a GET
+ * contacts the server again.
+ *
+ * Use `near_cache_ttl` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_NEAR_CACHE_TTL 0x70
+
+/**
+ * @brief Confirm the values of the near cache with the server
+ *
+ * When enabled, a value which is returned from the near cache after half of
+ * @ref LCB_CNTL_NEAR_CACHE_TTL has elapsed is confirmed in the background by
+ * comparing its CAS with the one on the server. If it is unchanged, the value
+ * is kept for another @ref LCB_CNTL_NEAR_CACHE_TTL, otherwise it is dropped.
+ * This keeps frequently read values in the cache without reading them again.
+ *
+ * Use `near_cache_revalidate` in the connection string
+ *
+ * @cntl_arg_both{int* (as boolean)}
+ * @volatile
+ */
+#define LCB_CNTL_NEAR_CACHE_REVALIDATE 0x71
+
+/**
+ * @brief Percentage of GETs which may be hedged with a replica read
+ *
+ * When set, a GET which is not answered within @ref LCB_CNTL_GET_HEDGE_DELAY
+ * is sent again to a replica of the document, and the first successful
+ * response is returned to the callback. A response of the active node which
+ * reports the document as missing is returned as well, while its timeouts
+ * and transient failures wait for the replica. Up to this percentage of GETs send
+ * a replica read, so that a slow node does not get its load doubled. Only
+ * plain GETs are hedged: commands which lock or touch the document, which
+ * are issued on behalf of another user, or which join another GET (see
+ * @ref LCB_CNTL_GET_SINGLE_FLIGHT), are sent once. The number of replica
+ * reads sent, and of those which answered first, is reported in
+ * lcb_METRICS.
+ *
+ * A replica may not have received the latest mutation of the document yet,
+ * so enable this only when the application tolerates slightly stale reads.
+ *
+ * Use `get_hedge_budget` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` (the default) disables hedging.
+ * @volatile
+ */
+#define LCB_CNTL_GET_HEDGE_BUDGET 0x72
+
+/**
+ * @brief Time after which a GET is hedged with a replica read
+ *
+ * Using a value of `0` (the default), the delay is the 95th percentile of
+ * the latencies of the last GETs answered by the node, and GETs are not
+ * hedged until enough of them were answered.
+ *
+ * Use `get_hedge_delay` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ * @volatile
+ */
+#define LCB_CNTL_GET_HEDGE_DELAY 0x73
+
+/**
+ * @brief Responsiveness of a data node
+ * @see LCB_CNTL_NODE_SCORE
+ */
+typedef struct {
+    int index;       /**< **Input** Index of the server in the configuration */
+    lcb_U64 latency; /**< **Output** Peak-EWMA of the response times, in microseconds */
+    lcb_U32 pending; /**< **Output** Commands awaiting a response from the node */
+    lcb_U64 score;   /**< **Output** `latency` multiplied by `pending` plus one */
+} lcb_NODE_SCORE;
+
+/**
+ * @brief Get the score used to rank a data node
+ *
+ * The response times of each node are tracked as a moving average which
+ * jumps to any slower response, and decays towards faster ones over about a
+ * second. Weighted by the number of commands awaiting a response, it ranks
+ * the nodes when any of them may serve a read: lcb_getreplica() in
+ * LCB_REPLICA_MODE_ANY mode, and the replica read of a hedged GET (see
+ * @ref LCB_CNTL_GET_HEDGE_BUDGET), try the replica with the lowest score
+ * first. A node which did not respond yet has a score of zero.
+ *
+ * @cntl_arg_getonly{lcb_NODE_SCORE*}
+ * @volatile
+ */
+#define LCB_CNTL_NODE_SCORE 0x74
+
+/**
+ * @brief Percentage of successful responses which may be retried
+ *
+ * When set, commands which the server answered with an error which is
+ * retried, such as a temporary failure or an error which the error map asks
+ * to retry, are retried only while the budget allows it: every successful response from a
+ * node earns this percentage of a retry, for the node and for the instance,
+ * and every retry spends one of both. Up to ten retries may be saved up.
+ * Once the budget is spent, such commands fail at once with
+ * LCB_ERR_RETRY_BUDGET_EXHAUSTED, rather than adding to the load of a node
+ * which is already struggling. The number of those is reported in
+ * lcb_METRICS. Retries after network errors, or after a change of the
+ * cluster map, are not limited.
+ *
+ * Use `retry_budget` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` (the default) does not limit retries.
+ * @volatile
+ */
+#define LCB_CNTL_RETRY_BUDGET 0x75
+
+/**
+ * @brief Largest number of commands in flight on a KV connection
+ *
+ * When set, each KV connection adapts the number of commands it writes
+ * without having received their response to the load of the server. The
+ * limit starts at this value, and is halved whenever the server rejects a
+ * command because it is rate limited, temporarily failing or busy. Every
+ * other response brings it back up, by one command for each limit's worth
+ * of responses. Commands over the limit wait in the library (counting
+ * towards their timeout) instead of being written, so that a tenant which
+ * exceeds its quota backs off without each command being rejected. The
+ * number of such commands is reported in lcb_SERVERMETRICS.
+ *
+ * Use `kv_adaptive_window` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` (the default) does not limit commands in flight.
+ * @volatile
+ */
+#define LCB_CNTL_KV_ADAPTIVE_WINDOW 0x76
+
+/**
+ * @brief Limits on the commands queued for sending
+ * @see LCB_CNTL_PIPELINE_WATERMARKS
+ */
+typedef struct {
+    lcb_U32 high_bytes;   /**< Queued bytes at which the queue is congested, 0 for no limit */
+    lcb_U32 low_bytes;    /**< Queued bytes at or below which a congested queue drains */
+    lcb_U32 high_packets; /**< Queued commands at which the queue is congested, 0 for no limit */
+    lcb_U32 low_packets;  /**< Queued commands at or below which a congested queue drains */
+} lcb_QUEUE_WATERMARKS;
+
+/**
+ * @brief Limit the commands queued for each KV connection
+ *
+ * Commands scheduled for a node are queued until it answers them, however
+ * slowly it drains them. With these limits set, a connection becomes
+ * congested once the size or number of the commands queued on it (scheduled
+ * but not yet answered, failed or timed out) reaches a high watermark. New
+ * commands for it then fail at once with LCB_ERR_QUEUE_CONGESTED, and the
+ * callback set with lcb_set_congestion_callback() is invoked. The connection
+ * stays congested until both the size and the number of its commands fall
+ * back to the low watermarks, which is reported through the same callback, so
+ * that the application may pause and resume its producers. Commands which are
+ * retried or sent again after a configuration change are not rejected.
+ *
+ * The low watermark must not exceed the high one. Setting both high
+ * watermarks to `0` (the default) does not limit commands.
+ *
+ * @cntl_arg_both{lcb_QUEUE_WATERMARKS*}
+ * @see LCB_CNTL_INSTANCE_WATERMARKS
+ * @volatile
+ */
+#define LCB_CNTL_PIPELINE_WATERMARKS 0x77
+
+/**
+ * @brief Limit the commands queued for all KV connections of the instance
+ *
+ * As @ref LCB_CNTL_PIPELINE_WATERMARKS, for the commands queued on all the
+ * connections together. The congestion callback receives a server index of
+ * `-1` for these limits.
+ *
+ * @cntl_arg_both{lcb_QUEUE_WATERMARKS*}
+ * @volatile
+ */
+#define LCB_CNTL_INSTANCE_WATERMARKS 0x78
+
+/**
+ * @brief Interactive commands written for each bulk command
+ *
+ * While both interactive and bulk commands (see lcb_PRIORITY) wait to be
+ * written on a KV connection, one bulk command is written after this many
+ * interactive ones, so that bulk commands make progress under a steady
+ * stream of interactive ones. Only one bulk command is written at a time.
+ *
+ * Use `kv_priority_weight` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * The default is 8. Using a value of `0` writes bulk commands in the order
+ * they are scheduled, as interactive ones.
+ * @volatile
+ */
+#define LCB_CNTL_KV_PRIORITY_WEIGHT 0x79
+
+/**
+ * @brief Latencies of the KV commands of a priority class
+ * @see LCB_CNTL_KV_PRIORITY_TIMINGS
+ */
+typedef struct {
+    int priority;                     /**< **Input** Priority class, an lcb_PRIORITY */
+    struct lcb_histogram_st *timings; /**< **Output** Latencies of its commands, NULL without timings */
+} lcb_PRIORITY_TIMINGS;
+
+/**
+ * @brief Get the latency histogram of the commands of a priority class
+ *
+ * Once lcb_enable_timings() is called, the latency of each KV command is
+ * also recorded in the histogram of its priority class, which may be read
+ * with lcb_histogram_read(). The histogram remains owned by the instance, and
+ * is destroyed by lcb_disable_timings().
+ *
+ * @cntl_arg_getonly{lcb_PRIORITY_TIMINGS*}
+ * @volatile
+ */
+#define LCB_CNTL_KV_PRIORITY_TIMINGS 0x7A
+
+/**
+ * @brief Time for which writing scheduled KV commands may be deferred
+ *
+ * When set, leaving a scheduling context (see lcb_sched_leave(), which is
+ * implied when scheduling a command outside of one) does not write the
+ * commands at once, but within this many microseconds, so that the commands
+ * scheduled meanwhile by independent callers share the same writes. The
+ * commands of a connection are written at once when they reach
+ * @ref LCB_CNTL_KV_FLUSH_BYTES, and lcb_sched_flush() writes all of them.
+ *
+ * The number of commands sent with each write is reported in
+ * lcb_METRICS::packets_per_write.
+ *
+ * Use `kv_flush_delay` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * Using a value of `0` (the default) writes the commands when leaving the
+ * scheduling context.
+ * @volatile
+ */
+#define LCB_CNTL_KV_FLUSH_DELAY 0x7B
+
+/**
+ * @brief Size of the deferred commands of a KV connection written at once
+ *
+ * @see LCB_CNTL_KV_FLUSH_DELAY
+ *
+ * Use `kv_flush_bytes` in the connection string
+ *
+ * @cntl_arg_both{lcb_U32*}
+ *
+ * The default is 16384 bytes.
+ * @volatile
+ */
+#define LCB_CNTL_KV_FLUSH_BYTES 0x7C
+
 /**
  * This is not a command, but rather an indicator of the last item.
  * @internal
  */
-#define LCB_CNTL__MAX 0x68
+#define LCB_CNTL__MAX 0x7D
 /**@}*/
 
 #ifdef __cplusplus
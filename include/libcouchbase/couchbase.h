@@ -540,6 +540,23 @@ typedef enum {
     LCB_DURABILITYLEVEL_PERSIST_TO_MAJORITY = 0x03
 } lcb_DURABILITY_LEVEL;
 
+/**
+ * @volatile
+ * Priority classes of key-value commands.
+ *
+ * Commands of both classes are sent on the same connections, but bulk
+ * commands give way to interactive ones: they are written one at a time, and
+ * only when no interactive command is waiting or after a number of them were
+ * written (see @ref LCB_CNTL_KV_PRIORITY_WEIGHT). A large bulk value thus
+ * delays an interactive command by at most the time to send it, rather than
+ * the time to send every bulk value scheduled before it.
+ */
+typedef enum {
+    LCB_PRIORITY_INTERACTIVE = 0, /**< Latency-sensitive commands (the default) */
+    LCB_PRIORITY_BULK = 1,        /**< Throughput-oriented commands, such as loading large values */
+    LCB_PRIORITY__MAX
+} lcb_PRIORITY;
+
 typedef void lcb_CMDBASE;
 typedef void lcb_RESPBASE;
 
@@ -706,6 +723,8 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_key(lcb_CMDGET *cmd, const char *key, siz
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_expiry(lcb_CMDGET *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_locktime(lcb_CMDGET *cmd, uint32_t duration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_timeout(lcb_CMDGET *cmd, uint32_t timeout);
+/** @volatile @see lcb_PRIORITY */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_priority(lcb_CMDGET *cmd, lcb_PRIORITY priority);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -997,6 +1016,27 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_collection(lcb_CMDSTORE *cmd, const cha
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_key(lcb_CMDSTORE *cmd, const char *key, size_t key_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value(lcb_CMDSTORE *cmd, const char *value, size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len);
+/**
+ * @uncommitted
+ * @brief Set the value without copying it
+ *
+ * Unlike lcb_cmdstore_value(), the library refers to the application's buffer
+ * rather than copying it. The buffer must remain valid, and must not be
+ * modified, until the lcb_pktflushed_callback has been invoked with the
+ * cookie of the operation; this may happen after the store callback. Large
+ * values may then also be sent without copying them into the kernel, see
+ * @ref LCB_CNTL_KV_ZEROCOPY_THRESHOLD.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_nocopy(lcb_CMDSTORE *cmd, const char *value, size_t value_len);
+/**
+ * @uncommitted
+ * @brief Like lcb_cmdstore_value_nocopy(), for a value made up of several buffers
+ *
+ * Only the buffers have to remain valid until the lcb_pktflushed_callback;
+ * the IOV array itself is copied.
+ */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_nocopy(lcb_CMDSTORE *cmd, const lcb_IOV *value,
+                                                          size_t value_len);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_preserve_expiry(lcb_CMDSTORE *cmd, int should_preserve);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_cas(lcb_CMDSTORE *cmd, uint64_t cas);
@@ -1005,6 +1045,8 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_datatype(lcb_CMDSTORE *cmd, uint8_t dat
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_durability(lcb_CMDSTORE *cmd, lcb_DURABILITY_LEVEL level);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_durability_observe(lcb_CMDSTORE *cmd, int persist_to, int replicate_to);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_timeout(lcb_CMDSTORE *cmd, uint32_t timeout);
+/** @volatile @see lcb_PRIORITY */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_priority(lcb_CMDSTORE *cmd, lcb_PRIORITY priority);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
@@ -2036,13 +2078,224 @@ void lcb_sched_fail(lcb_INSTANCE *instance);
  * application must explicitly call lcb_sched_flush(). This may be considered
  * more performant in the cases where multiple discreet operations are scheduled
  * in an lcb_sched_enter()/lcb_sched_leave() pair. With implicit flush enabled,
- * each call to lcb_sched_leave() will possibly invoke system repeatedly.
+ * each call to lcb_sched_leave() will possibly invoke system repeatedly,
+ * unless @ref LCB_CNTL_KV_FLUSH_DELAY defers the flush to share it with the
+ * commands scheduled shortly after.
  */
 LIBCOUCHBASE_API
 void lcb_sched_flush(lcb_INSTANCE *instance);
 
+/**
+ * @volatile
+ * @brief Congestion callback, invoked when a queue of commands crosses its
+ * watermarks
+ *
+ * @param instance The instance
+ * @param server_index The index of the server whose connection became
+ * congested or drained, or -1 for the limits of the whole instance
+ * @param congested Non-zero if new commands for the server (or any server)
+ * now fail with LCB_ERR_QUEUE_CONGESTED, zero once they are accepted again
+ *
+ * The callback may be invoked while commands are scheduled or while responses
+ * are processed. With several connections to each node, it is invoked for
+ * each connection.
+ *
+ * @see LCB_CNTL_PIPELINE_WATERMARKS, LCB_CNTL_INSTANCE_WATERMARKS
+ */
+typedef void (*lcb_congestion_callback)(lcb_INSTANCE *instance, int server_index, int congested);
+
+/**
+ * @volatile
+ * @brief Set the callback notified when queues of commands become congested or drain
+ *
+ * @param instance the instance
+ * @param callback the callback to set. If `NULL`, return the existing callback
+ * @return The existing (and previous) callback.
+ */
+LIBCOUCHBASE_API
+lcb_congestion_callback lcb_set_congestion_callback(lcb_INSTANCE *instance, lcb_congestion_callback callback);
+
+/**
+ * @volatile
+ * @brief Queue for scheduling operations from other threads
+ *
+ * An instance must be driven from a single thread, the one running its event
+ * loop. A submission queue allows any other thread to hand work over to that
+ * thread without locking around the instance: lcb_submitq_post() may be
+ * called from any thread, and the posted callback is invoked on the event
+ * loop thread, where it may schedule operations. Submissions posted while the
+ * loop thread is busy are run together once it wakes up.
+ *
+ * Operation callbacks are invoked on the event loop thread as usual. To hand
+ * their results back to another thread, they may use lcb_submitq_complete(),
+ * and that thread then calls lcb_submitq_poll().
+ *
+ * The event loop must keep running for submissions to be processed, which
+ * is the case when the application owns the event loop (see
+ * lcb_create_io_ops()): lcb_wait() returns as soon as no operations are
+ * pending.
+ *
+ * @code{.c}
+ * // on the event loop thread
+ * lcb_SUBMITQ *queue;
+ * lcb_submitq_create(instance, &queue);
+ * event_base_dispatch(evbase);
+ *
+ * // on any other thread
+ * static void do_get(lcb_INSTANCE *instance, void *arg)
+ * {
+ *     struct request *req = arg;
+ *     lcb_get(instance, req, req->cmd);
+ * }
+ * lcb_submitq_post(queue, do_get, req);
+ * @endcode
+ */
+typedef struct lcb_SUBMITQ_st lcb_SUBMITQ;
+
+/** Callback invoked on the event loop thread for each submission */
+typedef void (*lcb_SUBMIT_CALLBACK)(lcb_INSTANCE *instance, void *arg);
+
+/** Callback invoked by lcb_submitq_poll() for each completion */
+typedef void (*lcb_COMPLETION_CALLBACK)(void *arg);
+
+/**
+ * @volatile
+ * @brief Create a submission queue for the instance
+ *
+ * Must be called from the event loop thread. The queue must be destroyed
+ * with lcb_submitq_destroy() before the instance is.
+ *
+ * @param instance the instance
+ * @param[out] queue the new queue
+ * @return LCB_SUCCESS, or an error if the wakeup descriptor could not be
+ * created
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_SUBMITQ **queue);
+
+/**
+ * @volatile
+ * @brief Post a submission from any thread
+ *
+ * The callback is invoked on the event loop thread, in the order submissions
+ * were posted from each thread.
+ *
+ * @param queue the queue
+ * @param callback the callback which schedules the operations
+ * @param arg the argument passed to the callback
+ * @return LCB_SUCCESS, or LCB_ERR_NO_MEMORY
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_post(lcb_SUBMITQ *queue, lcb_SUBMIT_CALLBACK callback, void *arg);
+
+/**
+ * @volatile
+ * @brief Hand a completion over to the thread calling lcb_submitq_poll()
+ *
+ * Typically called from an operation callback, on the event loop thread.
+ *
+ * @param queue the queue
+ * @param callback the callback to invoke from lcb_submitq_poll()
+ * @param arg the argument passed to the callback
+ * @return LCB_SUCCESS, or LCB_ERR_NO_MEMORY
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_complete(lcb_SUBMITQ *queue, lcb_COMPLETION_CALLBACK callback, void *arg);
+
+/**
+ * @volatile
+ * @brief Invoke the completions handed over with lcb_submitq_complete()
+ *
+ * Only a single thread may poll the queue at a time.
+ *
+ * @param queue the queue
+ * @return the number of completions invoked
+ */
+LIBCOUCHBASE_API
+size_t lcb_submitq_poll(lcb_SUBMITQ *queue);
+
+/**
+ * @volatile
+ * @brief Destroy a submission queue
+ *
+ * Must be called from the event loop thread, outside of a submission
+ * callback, once no other thread may post to the queue. Pending submissions
+ * are run first; completions which were not polled are discarded.
+ *
+ * @param queue the queue
+ */
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue);
+
 /**@} (Group: Adanced Scheduling) */
 
+/**
+ * @ingroup lcb-public-api
+ * @defgroup lcb-rtgroup Runtime Groups
+ * @brief Share one cluster map between instances running on different threads
+ *
+ * @details
+ * An application may run one instance per thread (each with its own event
+ * loop) to scale across cores. Without further coordination each of them
+ * fetches, parses and polls the cluster map on its own, and resolves
+ * collection identifiers on its own.
+ *
+ * Instances joined to a runtime group share a single read-only copy of the
+ * cluster map, their collection cache and their credentials. Whenever a
+ * member receives a newer configuration, the other members apply it on their
+ * own thread; members which connect after the group has a configuration do
+ * not fetch one. Only one member polls for configuration updates in the
+ * background.
+ *
+ * Members must connect to the same bucket. Since the cluster map is shared,
+ * the vbucket remapping heuristic is disabled for members
+ * (see @ref LCB_CNTL_VBUCKET_NOREMAP): they only follow configurations received
+ * from the cluster.
+ *
+ * @addtogroup lcb-rtgroup
+ * @{
+ */
+typedef struct lcb_RUNTIME_GROUP_st lcb_RUNTIME_GROUP;
+
+/**
+ * @volatile
+ * @brief Create a runtime group
+ * @param[out] group the new group
+ * @return LCB_SUCCESS
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_runtime_group_create(lcb_RUNTIME_GROUP **group);
+
+/**
+ * @volatile
+ * @brief Release the group
+ *
+ * The group is freed once all its members have been destroyed as well.
+ * @param group the group
+ */
+LIBCOUCHBASE_API
+void lcb_runtime_group_destroy(lcb_RUNTIME_GROUP *group);
+
+/**
+ * @volatile
+ * @brief Add an instance to a group
+ *
+ * Must be called after lcb_create() and before lcb_connect(). The instance
+ * leaves the group when it is destroyed. Instances of a group may be joined
+ * and destroyed from any thread, but each instance must otherwise only be used
+ * from its own thread.
+ *
+ * @param group the group
+ * @param instance an instance connecting to a bucket
+ * @return LCB_SUCCESS, or LCB_ERR_INVALID_ARGUMENT if the instance is already
+ * connecting, is not connecting to a bucket, or connects to another bucket than
+ * the other members of the group.
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_runtime_group_join(lcb_RUNTIME_GROUP *group, lcb_INSTANCE *instance);
+
+/**@} (Group: Runtime Groups) */
+
 /* @ingroup lcb-public-api
  * @defgroup lcb-destroy Destroying
  * @brief Library destruction routines
@@ -3336,6 +3589,8 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_access_deleted(lcb_CMDSUBDOC *cmd, int
  */
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_create_as_deleted(lcb_CMDSUBDOC *cmd, int flag);
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_timeout(lcb_CMDSUBDOC *cmd, uint32_t timeout);
+/** @volatile @see lcb_PRIORITY */
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_priority(lcb_CMDSUBDOC *cmd, lcb_PRIORITY priority);
 /**
  * @internal Internal: This should never be used and is not supported.
  */
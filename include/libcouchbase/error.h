@@ -205,7 +205,9 @@ X(LCB_ERR_CONNECT_ERROR,                    1051, LCB_ERROR_TYPE_SDK, LCB_ERROR_
 X(LCB_ERR_EMPTY_KEY,                        1052, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_INPUT, "An empty key was passed to an operation") \
 X(LCB_ERR_HTTP,                             1053, LCB_ERROR_TYPE_SDK, 0, "HTTP Operation failed. Inspect status code for details") \
 X(LCB_ERR_QUERY,                            1054, LCB_ERROR_TYPE_SDK, 0, "Query execution failed. Inspect raw response object for information") \
-X(LCB_ERR_TOPOLOGY_CHANGE,                  1055, LCB_ERROR_TYPE_SDK, 0, "Topology Change (internal)")
+X(LCB_ERR_TOPOLOGY_CHANGE,                  1055, LCB_ERROR_TYPE_SDK, 0, "Topology Change (internal)") \
+X(LCB_ERR_RETRY_BUDGET_EXHAUSTED,           1056, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_TRANSIENT, "The server was overloaded, and the command was not retried because too many commands were retried recently. See LCB_CNTL_RETRY_BUDGET") \
+X(LCB_ERR_QUEUE_CONGESTED,                  1057, LCB_ERROR_TYPE_SDK, LCB_ERROR_FLAG_TRANSIENT, "Too many commands are queued for the node or the instance. Wait for the congestion callback to report that the queue drained. See LCB_CNTL_PIPELINE_WATERMARKS")
 /* clang-format on */
 
 /** Error codes returned by the library. */
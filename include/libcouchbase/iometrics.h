@@ -30,6 +30,8 @@ typedef struct lcb_IOMETRICS_st {
     lcb_SIZE io_error;
     lcb_SIZE bytes_sent;
     lcb_SIZE bytes_received;
+    /** Number of writes issued to the socket */
+    lcb_SIZE writes;
 } lcb_IOMETRICS;
 
 typedef struct lcb_SERVERMETRICS_st {
@@ -62,6 +64,37 @@ typedef struct lcb_SERVERMETRICS_st {
 
     /** Number of NOT_MY_VBUCKET replies received */
     lcb_SIZE packets_nmv;
+
+    /**
+     * Number of connections to this server.
+     * @see LCB_CNTL_KV_CONNECTIONS_PER_NODE
+     *
+     * This and the per-connection arrays below are refreshed whenever the
+     * metrics are retrieved with LCB_CNTL_METRICS.
+     */
+    lcb_SIZE nconnections;
+
+    /** Number of commands awaiting a response, for each connection */
+    const lcb_SIZE *connection_packets_pending;
+
+    /** Number of bytes waiting to be written, for each connection */
+    const lcb_SIZE *connection_bytes_queued;
+
+    /** Number of cluster map change notifications received */
+    lcb_SIZE packets_config_push;
+
+    /**
+     * Number of commands failed with LCB_ERR_RETRY_BUDGET_EXHAUSTED, because
+     * the retry budget of this server was spent.
+     */
+    lcb_SIZE packets_retry_rejected;
+
+    /**
+     * Number of commands which waited to be written because the connection
+     * had too many commands in flight.
+     * @see LCB_CNTL_KV_ADAPTIVE_WINDOW
+     */
+    lcb_SIZE packets_throttled;
 } lcb_SERVERMETRICS;
 
 typedef struct lcb_METRICS_st {
@@ -70,6 +103,65 @@ typedef struct lcb_METRICS_st {
 
     /** Number of times a packet entered the retry queue */
     lcb_SIZE packets_retried;
+
+    /**
+     * Number of values for which compression was attempted before sending
+     * them.
+     * @see LCB_CNTL_COMPRESSION_OPTS
+     */
+    lcb_SIZE compression_attempted;
+
+    /** Number of values sent compressed, out of those attempted */
+    lcb_SIZE compression_succeeded;
+
+    /**
+     * Number of values sent without attempting to compress them, because
+     * compression did not pay off for their collection.
+     * @see LCB_CNTL_COMPRESSION_ADAPTIVE
+     */
+    lcb_SIZE compression_skipped;
+
+    /**
+     * Number of GETs which were not sent, because they received the response
+     * of a GET for the same key which was already in flight.
+     * @see LCB_CNTL_GET_SINGLE_FLIGHT
+     */
+    lcb_SIZE get_collapsed;
+
+    /**
+     * Number of GETs which were answered from the near cache, and which had
+     * to contact the server.
+     * @see LCB_CNTL_NEAR_CACHE_SIZE
+     */
+    lcb_SIZE near_cache_hits;
+    lcb_SIZE near_cache_misses;
+
+    /** Number of values evicted from the near cache to make room for others */
+    lcb_SIZE near_cache_evictions;
+
+    /**
+     * Number of replica reads sent for GETs which were not answered in time,
+     * and number of those whose response was returned to the callback.
+     * @see LCB_CNTL_GET_HEDGE_BUDGET
+     */
+    lcb_SIZE get_hedges_issued;
+    lcb_SIZE get_hedges_won;
+
+    /**
+     * Number of commands failed with LCB_ERR_RETRY_BUDGET_EXHAUSTED instead of
+     * being retried.
+     * @see LCB_CNTL_RETRY_BUDGET
+     */
+    lcb_SIZE retries_rejected;
+
+    /**
+     * Number of times writing scheduled commands was deferred, and the number
+     * of KV commands sent with each write to the servers. The latter is
+     * refreshed whenever the metrics are retrieved with LCB_CNTL_METRICS.
+     * @see LCB_CNTL_KV_FLUSH_DELAY
+     */
+    lcb_SIZE flushes_deferred;
+    double packets_per_write;
 } lcb_METRICS;
 
 #ifdef __cplusplus
@@ -253,6 +253,20 @@ void lcb_backbuf_ref(lcb_BACKBUF buf);
  */
 LIBCOUCHBASE_API
 void lcb_backbuf_unref(lcb_BACKBUF buf);
+
+/**
+ * @uncommitted
+ * Retain the buffer which backs the value of a GET response, so that the
+ * value returned by lcb_respget_value() remains valid after the callback
+ * returns. If the value was received compressed, this is the buffer into
+ * which it was inflated; either way, the value is not copied.
+ *
+ * @param resp the response, from within its callback
+ * @param[out] buf the buffer, to be released with lcb_backbuf_unref()
+ * @return LCB_ERR_INVALID_ARGUMENT if the response has no value
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_respget_value_retain(const lcb_RESPGET *resp, lcb_BACKBUF *buf);
 /**@}*/
 
 /**@}*/
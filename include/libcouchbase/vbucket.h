@@ -169,7 +169,7 @@ typedef struct lcbvb_CONFIG_st {
     lcbvb_VBUCKET *vbuckets;    /* vbucket map */
     lcbvb_VBUCKET *ffvbuckets;  /* fast-forward map */
     lcbvb_CONTINUUM *continuum; /* ketama continuums */
-    int *randbuf;               /* Used for random server selection */
+    int *randbuf;               /* Unused, kept for compatibility */
     uint64_t caps;              /**< Bucket capabilities */
     uint64_t ccaps;             /**< Cluster capabilities */
 } lcbvb_CONFIG;
@@ -234,6 +234,24 @@ int lcbvb_load_json(lcbvb_CONFIG *vbc, const char *data);
 LIBCOUCHBASE_API
 int lcbvb_load_json_ex(lcbvb_CONFIG *vbc, const char *data, const char *source, char **network);
 
+/**
+ * @volatile
+ * Read the revision of a JSON configuration without parsing all of it.
+ *
+ * Only the top-level members of the configuration are scanned (nested values
+ * are skipped over without being parsed), so that a configuration which is not
+ * newer than the current one can be discarded cheaply.
+ *
+ * @param data the configuration
+ * @param ndata its size
+ * @param[out] revepoch the `revEpoch` member, or -1 if not present
+ * @param[out] revid the `rev` member, or -1 if not present
+ * @return 0 on success, nonzero if the configuration is not a JSON object or
+ * its top-level members could not be scanned
+ */
+LIBCOUCHBASE_API
+int lcbvb_peek_revision(const char *data, size_t ndata, int64_t *revepoch, int64_t *revid);
+
 /**@brief Serialize the current config as a JSON string.
  * @volatile
  * Serialize the current configuration as a JSON string. The string returned is
@@ -348,6 +366,25 @@ int lcbvb_nmv_remap_ex(lcbvb_CONFIG *cfg, int vbid, int bad, int use_heuristics)
 LIBCOUCHBASE_API
 int lcbvb_map_key(lcbvb_CONFIG *cfg, const void *key, lcb_SIZE n, int *vbid, int *srvix);
 
+/**
+ * @volatile
+ *
+ * Map several keys to their vBuckets and servers at once, as lcbvb_map_key()
+ * does for each of them. This allows e.g. grouping a large number of commands
+ * by the node they will be sent to before scheduling them.
+ *
+ * @param cfg The configuration object
+ * @param keys Array of `nkeys` keys
+ * @param sizes Array of `nkeys` key lengths
+ * @param nkeys Number of keys
+ * @param[out] vbids Array of `nkeys` entries receiving the vBuckets. May be NULL
+ * @param[out] srvixs Array of `nkeys` entries receiving the server indexes
+ * @return 0 for now
+ */
+LIBCOUCHBASE_API
+int lcbvb_map_keys(lcbvb_CONFIG *cfg, const void *const *keys, const lcb_SIZE *sizes, lcb_SIZE nkeys, int *vbids,
+                   int *srvixs);
+
 /**
  * @committed
  *
@@ -518,6 +555,16 @@ typedef struct {
     int sequence_changed;
     /** Whether the number of the replicas has changed */
     int n_repl_changed;
+    /**
+     * Array of `nvb` flags, nonzero for each vBucket whose master is a
+     * different node in the new configuration. Nodes are matched by address,
+     * so a node which only changed its position in the server list does not
+     * move its vBuckets. NULL if the maps cannot be compared (e.g. the number
+     * of vBuckets changed, or the buckets are not vBucket based)
+     */
+    unsigned char *vb_moved;
+    /** Number of nonzero entries in `vb_moved` */
+    int n_vb_moved;
 } lcbvb_CONFIGDIFF, VBUCKET_CONFIG_DIFF;
 
 /** @brief Convenience enum to determine the mode of change */
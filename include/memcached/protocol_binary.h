@@ -813,6 +813,21 @@ typedef union {
     uint8_t bytes[sizeof(protocol_binary_response_header)];
 } protocol_binary_response_subdoc_multi_mutation;
 
+/**
+ * Definition of the commands the server sends to the client (with the
+ * PROTOCOL_BINARY_SREQ magic) once PROTOCOL_BINARY_FEATURE_DUPLEX is enabled.
+ */
+typedef enum {
+    /**
+     * Sent when a new cluster map is applied, if the client enabled
+     * PROTOCOL_BINARY_FEATURE_CLUSTERMAP_CHANGE_NOTIFICATION. The extras hold the
+     * revision (4 bytes) or the epoch and the revision (8 bytes each), the key
+     * is the name of the bucket, and the value is the cluster map (if any).
+     * The client does not reply to it.
+     */
+    PROTOCOL_BINARY_CMD_SERVER_CLUSTERMAP_CHANGE_NOTIFICATION = 0x01
+} protocol_binary_server_command;
+
 /**
  * Definition of hello's features.
  */
@@ -840,7 +855,7 @@ typedef enum {
 } protocol_binary_hello_features;
 
 #define MEMCACHED_FIRST_HELLO_FEATURE 0x01
-#define MEMCACHED_TOTAL_HELLO_FEATURES 15
+#define MEMCACHED_TOTAL_HELLO_FEATURES 17
 
 // clang-format off
 #define protocol_feature_2_text(a) \
@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * @file
+ * io_uring integration with libcouchbase
+ */
+
+/**
+ * @ingroup lcb-io-plugin-api
+ * @defgroup lcb-iouring io_uring
+ * @brief Linux io_uring completion-based I/O
+ *
+ * @details
+ * lcb_create_iouring_io_opts() creates a completion-model I/O table backed by
+ * a private io_uring instance. Sends and receives scheduled by the library
+ * during one iteration of the event loop are submitted, together with the
+ * wait for their completions, in a single `io_uring_enter(2)` call.
+ *
+ * The plugin requires Linux 5.11 or newer. Registered (fixed) socket
+ * descriptors and descriptor-based cancellation are used when the running
+ * kernel supports them.
+ *
+ * @addtogroup lcb-iouring
+ * @{
+ */
+#ifndef LIBCOUCHBASE_IOURING_IO_OPTS_H
+#define LIBCOUCHBASE_IOURING_IO_OPTS_H 1
+
+#include <libcouchbase/couchbase.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Create an instance of an event handler that utilizes io_uring for
+ * socket I/O.
+ *
+ * @param version Set this to 0.
+ * @param[out] io a pointer to a newly created and initialized event handler
+ * @param arg unused, pass NULL
+ * @return status of the operation. LCB_ERR_UNSUPPORTED_OPERATION is returned
+ *         if the running kernel does not provide the required io_uring features
+ */
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_iouring_io_opts(int version, lcb_io_opt_t *io, void *arg);
+#ifdef __cplusplus
+}
+#endif
+
+/**@}*/
+#endif
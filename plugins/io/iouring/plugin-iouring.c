@@ -0,0 +1,1084 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Completion-model plugin for Linux, using io_uring.
+ *
+ * The ring is driven directly through the system calls, so that no additional
+ * library is required. Each iteration of the loop does the following:
+ *
+ * 1. Writes requested via write2() since the previous iteration are gathered,
+ *    per socket, into a single SENDMSG. Only one SENDMSG is outstanding per
+ *    socket, which keeps the stream in order (and takes care of short writes).
+ * 2. All queued SQEs are submitted, and the loop waits for completions (or the
+ *    next timer), with a single io_uring_enter().
+ * 3. Completions are dispatched, and expired timers are run.
+ *
+ * Sockets are installed in a sparse registered file table, if the kernel
+ * supports one, so that operations need not look up the descriptor.
+ */
+
+#define LCB_IOPS_V12_NO_DEPRECATE
+
+#include "internal.h"
+#include "iouring_io_opts.h"
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/** Requested size of the submission queue */
+#define IOUR_NENTRIES 256
+/** Size of the registered file table */
+#define IOUR_NFILES 1024
+/** Maximum number of IOVs for a single receive */
+#define IOUR_MAXRDIOV 32
+/** Maximum number of IOVs gathered into a single send */
+#define IOUR_MAXWRIOV 64
+/** Write requests with up to this many IOVs do not need an extra allocation */
+#define IOUR_INLWRIOV 32
+
+enum { IOUR_OP_READ = 1, IOUR_OP_SEND, IOUR_OP_CONNECT, IOUR_OP_CANCEL };
+
+typedef struct iour_LOOP iour_LOOP;
+typedef struct iour_SOCKET iour_SOCKET;
+
+/** Header of every object used as the user_data of an SQE */
+typedef struct {
+    int type;
+    iour_SOCKET *sock;
+} iour_OP;
+
+typedef struct {
+    lcb_list_t list;
+    lcb_ioC_write2_callback callback;
+    void *uarg;
+    struct iovec *iov;
+    unsigned niov;
+    unsigned cur; /**< First IOV which has not been sent completely */
+    struct iovec iov_inl[IOUR_INLWRIOV];
+} iour_WRITE;
+
+typedef struct {
+    iour_OP op;
+    lcb_io_connect_cb callback;
+    struct sockaddr_storage addr;
+} iour_CONNECT;
+
+struct iour_SOCKET {
+    lcb_sockdata_t base;
+    lcb_list_t list;  /**< Node in iour_LOOP::sockets */
+    lcb_list_t dirty; /**< Node in iour_LOOP::dirty */
+    int is_dirty;
+    int fd;
+    int slot; /**< Index in the registered file table, or -1 */
+    int closed;
+    int entered;   /**< Inside a completion callback for this socket */
+    unsigned nops; /**< Operations queued or in flight on this socket */
+
+    iour_OP rdop;
+    struct msghdr rdmsg;
+    struct iovec rdiov[IOUR_MAXRDIOV];
+    lcb_ioC_read2_callback rdcb;
+    void *rdarg;
+
+    iour_OP wrop;
+    struct msghdr wrmsg;
+    struct iovec wriov[IOUR_MAXWRIOV];
+    lcb_list_t wqueue; /**< iour_WRITE requests not yet sent completely, in order */
+    int sending;
+
+    iour_OP cancelop;
+};
+
+typedef struct {
+    lcb_list_t list;
+    int active;
+    hrtime_t exptime;
+    void *cb_data;
+    lcb_ioE_callback handler;
+} iour_TIMER;
+
+struct iour_LOOP {
+    struct lcb_io_opt_st base;
+    int ringfd;
+
+    /* Submission queue */
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned sq_nentries;
+    unsigned sq_ntail; /**< Tail including SQEs not yet published to the kernel */
+    struct io_uring_sqe *sqes;
+
+    /* Completion queue */
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+
+    int *free_slots; /**< Unused registered file slots. NULL if not supported */
+    unsigned nfree_slots;
+
+    unsigned nops; /**< Operations queued or in flight */
+    lcb_list_t sockets;
+    lcb_list_t dirty; /**< Sockets with writes to schedule, or which were closed */
+    lcb_list_t timers;
+    lcb_list_t wfree; /**< Cached iour_WRITE structures */
+    int event_loop;
+};
+
+#define IOUR_SET_ERROR(io, err) LCB_IOPS_ERRNO(&(io)->base) = (err)
+
+/******************************************************************************
+ ** Ring Management                                                          **
+ ******************************************************************************/
+static int ring_setup(iour_LOOP *io)
+{
+    struct io_uring_params params;
+    char *sq, *cq;
+
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CLAMP | IORING_SETUP_COOP_TASKRUN;
+    io->ringfd = (int)syscall(__NR_io_uring_setup, IOUR_NENTRIES, &params);
+    if (io->ringfd < 0 && errno == EINVAL) {
+        /* Older kernel, which does not know about some of the flags */
+        memset(&params, 0, sizeof(params));
+        io->ringfd = (int)syscall(__NR_io_uring_setup, IOUR_NENTRIES, &params);
+    }
+    if (io->ringfd < 0) {
+        return -1;
+    }
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0) {
+        /* Needed to wait for completions with a timeout */
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    io->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    io->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (io->cq_ring_size > io->sq_ring_size) {
+            io->sq_ring_size = io->cq_ring_size;
+        }
+        io->cq_ring_size = 0;
+    }
+
+    io->sq_ring = mmap(NULL, io->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ringfd,
+                       IORING_OFF_SQ_RING);
+    if (io->sq_ring == MAP_FAILED) {
+        io->sq_ring = NULL;
+        return -1;
+    }
+    if (io->cq_ring_size) {
+        io->cq_ring = mmap(NULL, io->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ringfd,
+                           IORING_OFF_CQ_RING);
+        if (io->cq_ring == MAP_FAILED) {
+            io->cq_ring = NULL;
+            return -1;
+        }
+    }
+    io->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    io->sqes = mmap(NULL, io->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, io->ringfd,
+                    IORING_OFF_SQES);
+    if (io->sqes == MAP_FAILED) {
+        io->sqes = NULL;
+        return -1;
+    }
+
+    sq = io->sq_ring;
+    cq = io->cq_ring ? io->cq_ring : io->sq_ring;
+    io->sq_head = (unsigned *)(sq + params.sq_off.head);
+    io->sq_tail = (unsigned *)(sq + params.sq_off.tail);
+    io->sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+    io->sq_array = (unsigned *)(sq + params.sq_off.array);
+    io->sq_nentries = params.sq_entries;
+    io->sq_ntail = *io->sq_tail;
+    io->cq_head = (unsigned *)(cq + params.cq_off.head);
+    io->cq_tail = (unsigned *)(cq + params.cq_off.tail);
+    io->cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+    io->cqes = (struct io_uring_cqe *)(cq + params.cq_off.cqes);
+    return 0;
+}
+
+static void ring_teardown(iour_LOOP *io)
+{
+    if (io->sqes) {
+        munmap(io->sqes, io->sqes_size);
+    }
+    if (io->cq_ring) {
+        munmap(io->cq_ring, io->cq_ring_size);
+    }
+    if (io->sq_ring) {
+        munmap(io->sq_ring, io->sq_ring_size);
+    }
+    if (io->ringfd >= 0) {
+        close(io->ringfd);
+    }
+}
+
+/**
+ * Hand the queued SQEs to the kernel and, if `wait_nr` is set, wait for a
+ * completion or until `ts` elapses.
+ */
+static int ring_enter(iour_LOOP *io, unsigned wait_nr, struct __kernel_timespec *ts)
+{
+    struct io_uring_getevents_arg arg;
+    unsigned to_submit;
+    long rv;
+
+    __atomic_store_n(io->sq_tail, io->sq_ntail, __ATOMIC_RELEASE);
+    to_submit = io->sq_ntail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE);
+
+    memset(&arg, 0, sizeof(arg));
+    arg.sigmask_sz = _NSIG / 8;
+    arg.ts = (uintptr_t)ts;
+    rv = syscall(__NR_io_uring_enter, io->ringfd, to_submit, wait_nr, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                 &arg, sizeof(arg));
+    if (rv < 0 && errno != ETIME && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        IOUR_SET_ERROR(io, errno);
+        return -1;
+    }
+    return 0;
+}
+
+static struct io_uring_sqe *ring_get_sqe(iour_LOOP *io)
+{
+    struct io_uring_sqe *sqe;
+    unsigned idx;
+
+    if (io->sq_ntail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) >= io->sq_nentries) {
+        /* Full. Submit what we have without waiting for anything */
+        if (ring_enter(io, 0, NULL) != 0 ||
+            io->sq_ntail - __atomic_load_n(io->sq_head, __ATOMIC_ACQUIRE) >= io->sq_nentries) {
+            IOUR_SET_ERROR(io, EBUSY);
+            return NULL;
+        }
+    }
+    idx = io->sq_ntail & *io->sq_mask;
+    io->sq_array[idx] = idx;
+    io->sq_ntail++;
+    io->nops++;
+    sqe = &io->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+static void sqe_set_socket(struct io_uring_sqe *sqe, iour_SOCKET *sock, iour_OP *op)
+{
+    if (sock->slot >= 0) {
+        sqe->fd = sock->slot;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = sock->fd;
+    }
+    sqe->user_data = (uintptr_t)op;
+    sock->nops++;
+}
+
+/******************************************************************************
+ ** Registered Files                                                         **
+ ******************************************************************************/
+static void files_setup(iour_LOOP *io)
+{
+    struct io_uring_rsrc_register reg;
+    unsigned ii;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.nr = IOUR_NFILES;
+    reg.flags = IORING_RSRC_REGISTER_SPARSE;
+    if (syscall(__NR_io_uring_register, io->ringfd, IORING_REGISTER_FILES2, &reg, sizeof(reg)) != 0) {
+        /* Not supported; use plain descriptors */
+        return;
+    }
+    io->free_slots = malloc(IOUR_NFILES * sizeof(*io->free_slots));
+    if (!io->free_slots) {
+        syscall(__NR_io_uring_register, io->ringfd, IORING_UNREGISTER_FILES, NULL, 0);
+        return;
+    }
+    for (ii = 0; ii < IOUR_NFILES; ii++) {
+        io->free_slots[ii] = IOUR_NFILES - ii - 1;
+    }
+    io->nfree_slots = IOUR_NFILES;
+}
+
+static int files_update(iour_LOOP *io, int slot, int fd)
+{
+    struct io_uring_files_update upd;
+    memset(&upd, 0, sizeof(upd));
+    upd.offset = slot;
+    upd.fds = (uintptr_t)&fd;
+    return syscall(__NR_io_uring_register, io->ringfd, IORING_REGISTER_FILES_UPDATE, &upd, 1) == 1 ? 0 : -1;
+}
+
+static int files_add(iour_LOOP *io, int fd)
+{
+    int slot;
+    if (!io->nfree_slots) {
+        return -1;
+    }
+    slot = io->free_slots[io->nfree_slots - 1];
+    if (files_update(io, slot, fd) != 0) {
+        return -1;
+    }
+    io->nfree_slots--;
+    return slot;
+}
+
+static void files_remove(iour_LOOP *io, int slot)
+{
+    if (slot < 0) {
+        return;
+    }
+    files_update(io, slot, -1);
+    io->free_slots[io->nfree_slots++] = slot;
+}
+
+/******************************************************************************
+ ** Writes                                                                   **
+ ******************************************************************************/
+static iour_WRITE *write_alloc(iour_LOOP *io, unsigned niov)
+{
+    iour_WRITE *w;
+    if (!LCB_LIST_IS_EMPTY(&io->wfree)) {
+        w = LCB_LIST_ITEM(lcb_list_shift(&io->wfree), iour_WRITE, list);
+    } else if ((w = malloc(sizeof(*w))) == NULL) {
+        return NULL;
+    }
+    if (niov > IOUR_INLWRIOV) {
+        w->iov = malloc(niov * sizeof(*w->iov));
+        if (!w->iov) {
+            lcb_list_append(&io->wfree, &w->list);
+            return NULL;
+        }
+    } else {
+        w->iov = w->iov_inl;
+    }
+    w->niov = niov;
+    w->cur = 0;
+    return w;
+}
+
+static void write_release(iour_LOOP *io, iour_WRITE *w)
+{
+    if (w->iov != w->iov_inl) {
+        free(w->iov);
+    }
+    lcb_list_append(&io->wfree, &w->list);
+}
+
+/** Invoke (and release) every write request in `list` */
+static void write_callbacks(iour_LOOP *io, iour_SOCKET *sock, lcb_list_t *list, int status)
+{
+    while (!LCB_LIST_IS_EMPTY(list)) {
+        iour_WRITE *w = LCB_LIST_ITEM(lcb_list_shift(list), iour_WRITE, list);
+        lcb_ioC_write2_callback callback = w->callback;
+        void *uarg = w->uarg;
+        write_release(io, w);
+        callback(&sock->base, status, uarg);
+    }
+}
+
+static void write_fail_all(iour_LOOP *io, iour_SOCKET *sock, int err)
+{
+    lcb_list_t failed;
+    lcb_list_init(&failed);
+    while (!LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+        lcb_list_append(&failed, lcb_list_shift(&sock->wqueue));
+    }
+    if (!LCB_LIST_IS_EMPTY(&failed)) {
+        IOUR_SET_ERROR(io, err);
+        write_callbacks(io, sock, &failed, -1);
+    }
+}
+
+static void sock_mark_dirty(iour_LOOP *io, iour_SOCKET *sock)
+{
+    if (!sock->is_dirty) {
+        sock->is_dirty = 1;
+        lcb_list_append(&io->dirty, &sock->dirty);
+    }
+}
+
+/** Gather the queued writes of the socket into a single SENDMSG */
+static int schedule_send(iour_LOOP *io, iour_SOCKET *sock)
+{
+    struct io_uring_sqe *sqe;
+    lcb_list_t *ll;
+    unsigned niov = 0;
+
+    LCB_LIST_FOR(ll, &sock->wqueue)
+    {
+        iour_WRITE *w = LCB_LIST_ITEM(ll, iour_WRITE, list);
+        unsigned ii;
+        for (ii = w->cur; ii < w->niov && niov < IOUR_MAXWRIOV; ii++) {
+            sock->wriov[niov++] = w->iov[ii];
+        }
+        if (niov == IOUR_MAXWRIOV) {
+            break;
+        }
+    }
+
+    if ((sqe = ring_get_sqe(io)) == NULL) {
+        return -1;
+    }
+    memset(&sock->wrmsg, 0, sizeof(sock->wrmsg));
+    sock->wrmsg.msg_iov = sock->wriov;
+    sock->wrmsg.msg_iovlen = niov;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->addr = (uintptr_t)&sock->wrmsg;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe_set_socket(sqe, sock, &sock->wrop);
+    sock->sending = 1;
+    return 0;
+}
+
+static void send_done(iour_LOOP *io, iour_SOCKET *sock, int res)
+{
+    lcb_list_t done;
+    size_t left;
+
+    sock->sending = 0;
+    if (res < 0) {
+        /* The stream is unusable now */
+        write_fail_all(io, sock, -res);
+        return;
+    }
+
+    lcb_list_init(&done);
+    left = (size_t)res;
+    while (!LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+        iour_WRITE *w = LCB_LIST_ITEM(sock->wqueue.next, iour_WRITE, list);
+        while (w->cur < w->niov) {
+            struct iovec *iov = &w->iov[w->cur];
+            if (iov->iov_len > left) {
+                iov->iov_base = (char *)iov->iov_base + left;
+                iov->iov_len -= left;
+                left = 0;
+                break;
+            }
+            left -= iov->iov_len;
+            w->cur++;
+        }
+        if (w->cur < w->niov) {
+            break;
+        }
+        lcb_list_delete(&w->list);
+        lcb_list_append(&done, &w->list);
+    }
+    if (!LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+        sock_mark_dirty(io, sock);
+    }
+    write_callbacks(io, sock, &done, 0);
+}
+
+/******************************************************************************
+ ** Sockets                                                                  **
+ ******************************************************************************/
+static void sock_maybe_free(iour_LOOP *io, iour_SOCKET *sock)
+{
+    if (!sock->closed || sock->nops || sock->is_dirty || !LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+        return;
+    }
+    files_remove(io, sock->slot);
+    close(sock->fd);
+    lcb_list_delete(&sock->list);
+    free(sock);
+}
+
+static void flush_dirty(iour_LOOP *io)
+{
+    while (!LCB_LIST_IS_EMPTY(&io->dirty)) {
+        iour_SOCKET *sock = LCB_LIST_ITEM(lcb_list_shift(&io->dirty), iour_SOCKET, dirty);
+        sock->is_dirty = 0;
+        if (sock->closed) {
+            write_fail_all(io, sock, ECANCELED);
+            sock_maybe_free(io, sock);
+        } else if (!sock->sending && !LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+            if (schedule_send(io, sock) != 0) {
+                write_fail_all(io, sock, LCB_IOPS_ERRNO(&io->base));
+            }
+        }
+    }
+}
+
+static lcb_sockdata_t *create_socket(lcb_io_opt_t iobase, int domain, int type, int protocol)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_SOCKET *sock;
+    int fd;
+
+    fd = socket(domain, type | SOCK_NONBLOCK | SOCK_CLOEXEC, protocol);
+    if (fd < 0) {
+        IOUR_SET_ERROR(io, errno);
+        return NULL;
+    }
+    sock = calloc(1, sizeof(*sock));
+    if (!sock) {
+        close(fd);
+        IOUR_SET_ERROR(io, ENOMEM);
+        return NULL;
+    }
+    sock->fd = fd;
+    sock->base.socket = fd;
+    sock->slot = files_add(io, fd);
+    sock->rdop.type = IOUR_OP_READ;
+    sock->rdop.sock = sock;
+    sock->wrop.type = IOUR_OP_SEND;
+    sock->wrop.sock = sock;
+    sock->cancelop.type = IOUR_OP_CANCEL;
+    sock->cancelop.sock = sock;
+    lcb_list_init(&sock->wqueue);
+    lcb_list_append(&io->sockets, &sock->list);
+    return &sock->base;
+}
+
+static unsigned int close_socket(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+
+    if (sock->closed) {
+        return 0;
+    }
+    sock->closed = 1;
+    if (sock->nops) {
+        /* Pending operations are completed (with an error) by the kernel */
+        struct io_uring_sqe *sqe = ring_get_sqe(io);
+        if (sqe) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL | IORING_ASYNC_CANCEL_FD;
+            if (sock->slot >= 0) {
+                sqe->cancel_flags |= IORING_ASYNC_CANCEL_FD_FIXED;
+            }
+            sqe_set_socket(sqe, sock, &sock->cancelop);
+            sqe->flags &= ~IOSQE_FIXED_FILE;
+        } else {
+            shutdown(sock->fd, SHUT_RDWR);
+        }
+    }
+    if (!sock->nops && LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+        /* Nothing refers to the socket anymore. If we're inside one of its
+         * callbacks, it is released once the callback returns */
+        if (sock->is_dirty) {
+            sock->is_dirty = 0;
+            lcb_list_delete(&sock->dirty);
+        }
+        if (!sock->entered) {
+            sock_maybe_free(io, sock);
+        }
+        return 0;
+    }
+    /* Any unsent writes are failed from within the loop */
+    sock_mark_dirty(io, sock);
+    return 0;
+}
+
+static int start_connect(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, const struct sockaddr *name,
+                         unsigned int namelen, lcb_io_connect_cb callback)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    struct io_uring_sqe *sqe;
+    iour_CONNECT *conn;
+
+    if (namelen > sizeof(conn->addr)) {
+        IOUR_SET_ERROR(io, EINVAL);
+        return -1;
+    }
+    if ((conn = calloc(1, sizeof(*conn))) == NULL) {
+        IOUR_SET_ERROR(io, ENOMEM);
+        return -1;
+    }
+    if ((sqe = ring_get_sqe(io)) == NULL) {
+        free(conn);
+        return -1;
+    }
+    conn->op.type = IOUR_OP_CONNECT;
+    conn->op.sock = sock;
+    conn->callback = callback;
+    memcpy(&conn->addr, name, namelen);
+    sqe->opcode = IORING_OP_CONNECT;
+    sqe->addr = (uintptr_t)&conn->addr;
+    sqe->off = namelen;
+    sqe_set_socket(sqe, sock, &conn->op);
+    return 0;
+}
+
+static int start_write2(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, struct lcb_iovec_st *iov, lcb_size_t niov,
+                        void *uarg, lcb_ioC_write2_callback callback)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    iour_WRITE *w;
+    unsigned ii;
+
+    if (sock->closed) {
+        IOUR_SET_ERROR(io, EBADF);
+        return -1;
+    }
+    if ((w = write_alloc(io, niov)) == NULL) {
+        IOUR_SET_ERROR(io, ENOMEM);
+        return -1;
+    }
+    for (ii = 0; ii < niov; ii++) {
+        w->iov[ii].iov_base = iov[ii].iov_base;
+        w->iov[ii].iov_len = iov[ii].iov_len;
+    }
+    w->callback = callback;
+    w->uarg = uarg;
+    lcb_list_append(&sock->wqueue, &w->list);
+    /* The actual send is prepared right before the ring is entered, so that
+     * everything written during this iteration goes out together */
+    sock_mark_dirty(io, sock);
+    return 0;
+}
+
+static int start_read(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, lcb_IOV *iov, lcb_size_t niov, void *uarg,
+                      lcb_ioC_read2_callback callback)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    struct io_uring_sqe *sqe;
+    unsigned ii;
+
+    if (sock->closed) {
+        IOUR_SET_ERROR(io, EBADF);
+        return -1;
+    }
+    if ((sqe = ring_get_sqe(io)) == NULL) {
+        return -1;
+    }
+    if (niov > IOUR_MAXRDIOV) {
+        niov = IOUR_MAXRDIOV;
+    }
+    for (ii = 0; ii < niov; ii++) {
+        sock->rdiov[ii].iov_base = iov[ii].iov_base;
+        sock->rdiov[ii].iov_len = iov[ii].iov_len;
+    }
+    memset(&sock->rdmsg, 0, sizeof(sock->rdmsg));
+    sock->rdmsg.msg_iov = sock->rdiov;
+    sock->rdmsg.msg_iovlen = niov;
+    sock->rdcb = callback;
+    sock->rdarg = uarg;
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->addr = (uintptr_t)&sock->rdmsg;
+    sqe->len = 1;
+    sqe_set_socket(sqe, sock, &sock->rdop);
+    return 0;
+}
+
+static int get_nameinfo(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, struct lcb_nameinfo_st *ni)
+{
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    socklen_t len;
+
+    len = (socklen_t)*ni->local.len;
+    getsockname(sock->fd, ni->local.name, &len);
+    *ni->local.len = (int)len;
+    len = (socklen_t)*ni->remote.len;
+    getpeername(sock->fd, ni->remote.name, &len);
+    *ni->remote.len = (int)len;
+    (void)iobase;
+    return 0;
+}
+
+static int check_closed(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, int flags)
+{
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    char buf = 0;
+    ssize_t rv;
+
+    (void)iobase;
+    do {
+        rv = recv(sock->fd, &buf, 1, MSG_PEEK | MSG_DONTWAIT);
+    } while (rv < 0 && errno == EINTR);
+
+    if (rv == 1) {
+        return (flags & LCB_IO_SOCKCHECK_PEND_IS_ERROR) ? LCB_IO_SOCKCHECK_STATUS_CLOSED : LCB_IO_SOCKCHECK_STATUS_OK;
+    } else if (rv == 0) {
+        return LCB_IO_SOCKCHECK_STATUS_CLOSED;
+    } else if (errno == EAGAIN) {
+        return LCB_IO_SOCKCHECK_STATUS_OK;
+    } else {
+        return LCB_IO_SOCKCHECK_STATUS_CLOSED;
+    }
+}
+
+static int cntl_socket(lcb_io_opt_t iobase, lcb_sockdata_t *sockbase, int mode, int option, void *arg)
+{
+    iour_SOCKET *sock = (iour_SOCKET *)sockbase;
+    int level, optname, rv;
+    socklen_t len = sizeof(int);
+
+    switch (option) {
+        case LCB_IO_CNTL_TCP_NODELAY:
+            level = IPPROTO_TCP;
+            optname = TCP_NODELAY;
+            break;
+        case LCB_IO_CNTL_TCP_KEEPALIVE:
+            level = SOL_SOCKET;
+            optname = SO_KEEPALIVE;
+            break;
+        default:
+            LCB_IOPS_ERRNO(iobase) = ENOTSUP;
+            return -1;
+    }
+    if (mode == LCB_IO_CNTL_GET) {
+        rv = getsockopt(sock->fd, level, optname, arg, &len);
+    } else {
+        rv = setsockopt(sock->fd, level, optname, arg, len);
+    }
+    if (rv != 0) {
+        LCB_IOPS_ERRNO(iobase) = errno;
+        return -1;
+    }
+    return 0;
+}
+
+/******************************************************************************
+ ** Completions                                                              **
+ ******************************************************************************/
+static void complete_op(iour_LOOP *io, iour_OP *op, int res)
+{
+    iour_SOCKET *sock = op->sock;
+
+    sock->nops--;
+    sock->entered = 1;
+    switch (op->type) {
+        case IOUR_OP_READ: {
+            lcb_ioC_read2_callback callback = sock->rdcb;
+            lcb_SSIZE nread = res;
+            if (res < 0) {
+                IOUR_SET_ERROR(io, -res);
+                nread = -1;
+            }
+            sock->rdcb = NULL;
+            callback(&sock->base, nread, sock->rdarg);
+            break;
+        }
+
+        case IOUR_OP_SEND:
+            send_done(io, sock, res);
+            break;
+
+        case IOUR_OP_CONNECT: {
+            iour_CONNECT *conn = (iour_CONNECT *)op;
+            if (res < 0) {
+                IOUR_SET_ERROR(io, -res);
+            }
+            conn->callback(&sock->base, res < 0 ? -1 : 0);
+            free(conn);
+            break;
+        }
+
+        case IOUR_OP_CANCEL:
+            if (res == -EINVAL) {
+                /* Descriptor-based cancellation is not supported. Shutting
+                 * down the socket completes whatever is still pending */
+                shutdown(sock->fd, SHUT_RDWR);
+            }
+            break;
+
+        default:
+            lcb_assert(0 && "unknown io_uring operation");
+            break;
+    }
+    sock->entered = 0;
+    sock_maybe_free(io, sock);
+}
+
+static void ring_reap(iour_LOOP *io)
+{
+    unsigned head;
+    while ((head = *io->cq_head) != __atomic_load_n(io->cq_tail, __ATOMIC_ACQUIRE)) {
+        struct io_uring_cqe *cqe = &io->cqes[head & *io->cq_mask];
+        iour_OP *op = (iour_OP *)(uintptr_t)cqe->user_data;
+        int res = cqe->res;
+
+        /* Release the entry first; the callback may submit more */
+        __atomic_store_n(io->cq_head, head + 1, __ATOMIC_RELEASE);
+        io->nops--;
+        complete_op(io, op, res);
+    }
+}
+
+/******************************************************************************
+ ** Timers                                                                   **
+ ******************************************************************************/
+static int timer_cmp_asc(lcb_list_t *a, lcb_list_t *b)
+{
+    iour_TIMER *ta = LCB_LIST_ITEM(a, iour_TIMER, list);
+    iour_TIMER *tb = LCB_LIST_ITEM(b, iour_TIMER, list);
+    if (ta->exptime > tb->exptime) {
+        return 1;
+    } else if (ta->exptime < tb->exptime) {
+        return -1;
+    } else {
+        return 0;
+    }
+}
+
+static void *create_timer(lcb_io_opt_t iobase)
+{
+    (void)iobase;
+    return calloc(1, sizeof(iour_TIMER));
+}
+
+static void cancel_timer(lcb_io_opt_t iobase, void *timer)
+{
+    iour_TIMER *tm = timer;
+    if (tm->active) {
+        tm->active = 0;
+        lcb_list_delete(&tm->list);
+    }
+    (void)iobase;
+}
+
+static void destroy_timer(lcb_io_opt_t iobase, void *timer)
+{
+    cancel_timer(iobase, timer);
+    free(timer);
+}
+
+static int schedule_timer(lcb_io_opt_t iobase, void *timer, lcb_U32 usec, void *cb_data, lcb_ioE_callback handler)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    iour_TIMER *tm = timer;
+
+    cancel_timer(iobase, timer);
+    tm->exptime = gethrtime() + (usec * (hrtime_t)1000);
+    tm->cb_data = cb_data;
+    tm->handler = handler;
+    tm->active = 1;
+    lcb_list_add_sorted(&io->timers, &tm->list, timer_cmp_asc);
+    return 0;
+}
+
+static iour_TIMER *pop_next_timer(iour_LOOP *io, hrtime_t now)
+{
+    iour_TIMER *ret;
+
+    if (LCB_LIST_IS_EMPTY(&io->timers)) {
+        return NULL;
+    }
+    ret = LCB_LIST_ITEM(io->timers.next, iour_TIMER, list);
+    if (ret->exptime > now) {
+        return NULL;
+    }
+    lcb_list_shift(&io->timers);
+    ret->active = 0;
+    return ret;
+}
+
+static int get_next_timeout(iour_LOOP *io, struct __kernel_timespec *ts, hrtime_t now)
+{
+    iour_TIMER *first;
+    hrtime_t delta = 0;
+
+    if (LCB_LIST_IS_EMPTY(&io->timers)) {
+        return 0;
+    }
+    first = LCB_LIST_ITEM(io->timers.next, iour_TIMER, list);
+    if (now < first->exptime) {
+        delta = first->exptime - now;
+    }
+    ts->tv_sec = (long long)(delta / 1000000000);
+    ts->tv_nsec = (long long)(delta % 1000000000);
+    return 1;
+}
+
+/******************************************************************************
+ ** Event Loop                                                               **
+ ******************************************************************************/
+static void run_loop(iour_LOOP *io, int is_tick)
+{
+    io->event_loop = !is_tick;
+    do {
+        struct __kernel_timespec ts;
+        iour_TIMER *tm;
+        hrtime_t now;
+        int has_timers;
+
+        flush_dirty(io);
+        has_timers = get_next_timeout(io, &ts, gethrtime());
+        if (io->nops == 0 && !has_timers) {
+            break;
+        }
+
+        /* Everything queued during the previous iteration is submitted here,
+         * in the same call which waits for the next completion */
+        if (ring_enter(io, io->event_loop ? 1 : 0, has_timers ? &ts : NULL) != 0) {
+            break;
+        }
+        ring_reap(io);
+
+        now = gethrtime();
+        while ((tm = pop_next_timer(io, now))) {
+            tm->handler(-1, 0, tm->cb_data);
+        }
+    } while (io->event_loop);
+}
+
+static void run_event_loop(lcb_io_opt_t iobase)
+{
+    run_loop((iour_LOOP *)iobase, 0);
+}
+
+static void tick_event_loop(lcb_io_opt_t iobase)
+{
+    run_loop((iour_LOOP *)iobase, 1);
+}
+
+static void stop_event_loop(lcb_io_opt_t iobase)
+{
+    ((iour_LOOP *)iobase)->event_loop = 0;
+}
+
+static void iops_dtor(lcb_io_opt_t iobase)
+{
+    iour_LOOP *io = (iour_LOOP *)iobase;
+    lcb_list_t *ll, *nn;
+    unsigned ntries;
+
+    /* Close all sockets first, so that the pending operations complete (with
+     * an error), and drain the queue. This should not block for long */
+    LCB_LIST_FOR(ll, &io->sockets)
+    {
+        iour_SOCKET *sock = LCB_LIST_ITEM(ll, iour_SOCKET, list);
+        close_socket(iobase, &sock->base);
+        if (sock->nops) {
+            shutdown(sock->fd, SHUT_RDWR);
+        }
+    }
+    for (ntries = 0; ntries < 100 && (io->nops || !LCB_LIST_IS_EMPTY(&io->dirty)); ntries++) {
+        struct __kernel_timespec ts = {0, 10000000};
+        flush_dirty(io);
+        if (io->nops && ring_enter(io, 1, &ts) != 0) {
+            break;
+        }
+        ring_reap(io);
+    }
+
+    /* Destroy all remaining sockets */
+    LCB_LIST_SAFE_FOR(ll, nn, &io->sockets)
+    {
+        iour_SOCKET *sock = LCB_LIST_ITEM(ll, iour_SOCKET, list);
+        while (!LCB_LIST_IS_EMPTY(&sock->wqueue)) {
+            write_release(io, LCB_LIST_ITEM(lcb_list_shift(&sock->wqueue), iour_WRITE, list));
+        }
+        close(sock->fd);
+        free(sock);
+    }
+    LCB_LIST_SAFE_FOR(ll, nn, &io->timers)
+    {
+        destroy_timer(iobase, LCB_LIST_ITEM(ll, iour_TIMER, list));
+    }
+    LCB_LIST_SAFE_FOR(ll, nn, &io->wfree)
+    {
+        free(LCB_LIST_ITEM(ll, iour_WRITE, list));
+    }
+    ring_teardown(io);
+    free(io->free_slots);
+    free(io);
+}
+
+static void get_procs(int version, lcb_loop_procs *loop, lcb_timer_procs *timer, lcb_bsd_procs *bsd, lcb_ev_procs *ev,
+                      lcb_completion_procs *iocp, lcb_iomodel_t *model)
+{
+    *model = LCB_IOMODEL_COMPLETION;
+    loop->start = run_event_loop;
+    loop->stop = stop_event_loop;
+    loop->tick = tick_event_loop;
+
+    timer->create = create_timer;
+    timer->cancel = cancel_timer;
+    timer->schedule = schedule_timer;
+    timer->destroy = destroy_timer;
+
+    iocp->socket = create_socket;
+    iocp->close = close_socket;
+    iocp->connect = start_connect;
+    iocp->nameinfo = get_nameinfo;
+    iocp->read2 = start_read;
+    iocp->write2 = start_write2;
+    iocp->is_closed = check_closed;
+    iocp->cntl = cntl_socket;
+
+    /** Stuff we don't use */
+    iocp->read = NULL;
+    iocp->write = NULL;
+    iocp->wballoc = NULL;
+    iocp->wbfree = NULL;
+    iocp->serve = NULL;
+
+    (void)version;
+    (void)bsd;
+    (void)ev;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_create_iouring_io_opts(int version, lcb_io_opt_t *ioret, void *arg)
+{
+    iour_LOOP *io;
+
+    if (version != 0) {
+        return LCB_ERR_PLUGIN_VERSION_MISMATCH;
+    }
+    io = calloc(1, sizeof(*io));
+    if (!io) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    io->ringfd = -1;
+    lcb_list_init(&io->sockets);
+    lcb_list_init(&io->dirty);
+    lcb_list_init(&io->timers);
+    lcb_list_init(&io->wfree);
+
+    if (ring_setup(io) != 0) {
+        lcb_STATUS rc = errno == ENOMEM ? LCB_ERR_NO_MEMORY : LCB_ERR_UNSUPPORTED_OPERATION;
+        ring_teardown(io);
+        free(io);
+        return rc;
+    }
+    files_setup(io);
+
+    io->base.version = 2;
+    io->base.dlhandle = NULL;
+    io->base.destructor = iops_dtor;
+    io->base.v.v2.need_cleanup = 0;
+    io->base.v.v2.get_procs = get_procs;
+    io->base.v.v2.cookie = io;
+
+    *ioret = &io->base;
+    (void)arg;
+    return LCB_SUCCESS;
+}
@@ -20,6 +20,7 @@
 #include <libcouchbase/auth.h>
 
 #ifdef __cplusplus
+#include <atomic>
 #include <string>
 #include <map>
 
@@ -206,7 +207,8 @@ class Authenticator
     }
 
   private:
-    size_t refcount_{1};
+    /* Shared by the instances of a runtime group, which may run on different threads */
+    std::atomic<size_t> refcount_{1};
 
     std::map<std::string, std::string> buckets_{};
     std::string username_;
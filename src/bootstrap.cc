@@ -17,7 +17,9 @@
 
 #define LCB_BOOTSTRAP_DEFINE_STRUCT 1
 #include "internal.h"
+#include "collections.h"
 #include "defer.h"
+#include "rtgroup.h"
 
 #define LOGARGS(instance, lvl) instance->settings, "bootstrap", LCB_LOG_##lvl, __FILE__, __LINE__
 
@@ -105,6 +107,10 @@ void Bootstrap::config_callback(EventType event, ConfigInfo *info)
             if ((LCBVB_CAPS(LCBT_VBCONFIG(instance)) & LCBVB_CAP_COLLECTIONS) == 0) {
                 LCBT_SETTING(parent, use_collections) = 0;
             }
+            if (LCBT_SETTING(parent, use_collections) && lcb::rtgroup_is_poller(parent)) {
+                /* The members of a runtime group share the collection cache */
+                collcache_prefetch(instance);
+            }
 
             if (LCBVB_CAPS(LCBT_VBCONFIG(instance)) & LCBVB_CAP_DURABLE_WRITE) {
                 LCBT_SETTING(parent, enable_durable_write) = 1;
@@ -164,17 +170,33 @@ void Bootstrap::clconfig_lsn(EventType e, ConfigInfo *i)
 void Bootstrap::check_bgpoll()
 {
     if (parent->cur_configinfo == nullptr || parent->cur_configinfo->get_origin() != lcb::clconfig::CLCONFIG_CCCP ||
-        LCBT_SETTING(parent, config_poll_interval) == 0) {
+        LCBT_SETTING(parent, config_poll_interval) == 0 || !lcb::rtgroup_is_poller(parent)) {
         tmpoll.cancel();
     } else {
         tmpoll.rearm(LCBT_SETTING(parent, config_poll_interval));
     }
 }
 
+/* Whether a data node is connected which notifies us of new configurations */
+static bool has_config_push(lcb_INSTANCE *instance)
+{
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        const lcb::Server *server = instance->get_server(ii);
+        if (server->is_connected() && server->supports_config_push()) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void Bootstrap::bgpoll()
 {
-    lcb_log(LOGARGS(parent, TRACE), "Background-polling for new configuration");
-    bootstrap(BS_REFRESH_ALWAYS);
+    if (has_config_push(parent)) {
+        lcb_log(LOGARGS(parent, TRACE), "Not polling for new configuration, changes are pushed by the cluster");
+    } else {
+        lcb_log(LOGARGS(parent, TRACE), "Background-polling for new configuration");
+        bootstrap(BS_REFRESH_ALWAYS);
+    }
     check_bgpoll();
 }
 
@@ -280,6 +302,9 @@ lcb_STATUS Bootstrap::bootstrap(unsigned options)
         parent->confmon->prepare();
         tm.rearm(LCBT_SETTING(parent, config_timeout));
         lcb_aspend_add(&parent->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+        if (lcb::rtgroup_bootstrap(parent)) {
+            return LCB_SUCCESS;
+        }
     }
 
     /* Reset the counters */
@@ -58,6 +58,7 @@ struct CccpProvider : public Provider {
         mcio_error(LCB_ERR_TIMEOUT);
     }
     lcb_STATUS update(const char *host, const char *data);
+    bool is_stale(const char *data) const;
     void request_config();
     void on_io_read();
 
@@ -204,11 +205,39 @@ lcb_STATUS lcb::clconfig::cccp_update(Provider *provider, const char *host, cons
     return static_cast<CccpProvider *>(provider)->update(host, data);
 }
 
+bool CccpProvider::is_stale(const char *data) const
+{
+    const ConfigInfo *current = parent->get_config();
+    int64_t revepoch, revid;
+    if (current == nullptr || current->vbc->bname == nullptr || current->vbc->revid < 0) {
+        return false;
+    }
+    if (lcbvb_peek_revision(data, strlen(data), &revepoch, &revid) != 0 || revid < 0) {
+        return false;
+    }
+    /* The same rules as ConfigInfo::compare() */
+    if (revepoch > current->vbc->revepoch || revid > current->vbc->revid) {
+        return false;
+    }
+    lcb_log(LOGARGS(this, TRACE),
+            LOGFMT "Not parsing configuration, not newer than the current one. A.rev=%" PRId64 ":%" PRId64
+                   ", B.rev=%" PRId64 ":%" PRId64,
+            LOGID(this), current->vbc->revepoch, current->vbc->revid, revepoch, revid);
+    return true;
+}
+
 lcb_STATUS CccpProvider::update(const char *host, const char *data)
 {
     lcbvb_CONFIG *vbc;
     int rv;
     ConfigInfo *new_config;
+
+    if (is_stale(data)) {
+        /* As if it had been parsed, and ignored for not being newer */
+        parent->stop();
+        return LCB_SUCCESS;
+    }
+
     vbc = lcbvb_create();
 
     if (!vbc) {
@@ -19,6 +19,7 @@
 #define LCB_CLCONFIG_H
 
 #include "hostlist.h"
+#include <atomic>
 #include <list>
 #include <utility>
 #include <lcbio/timer-ng.h>
@@ -593,8 +594,8 @@ class ConfigInfo
     /** Comparative clock with which to compare */
     uint64_t cmpclock;
 
-    /** Reference counter */
-    unsigned int refcount;
+    /** Reference counter. Atomic, as a runtime group shares configs between threads */
+    std::atomic<unsigned int> refcount;
 
     /** Origin provider type which produced this config */
     Method origin;
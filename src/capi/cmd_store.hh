@@ -232,15 +232,50 @@ struct lcb_CMDSTORE_ {
     lcb_STATUS value(std::string value)
     {
         value_ = std::move(value);
+        value_ref_.clear();
         return LCB_SUCCESS;
     }
 
+    /**
+     * Refer to the value in the application's buffers rather than copying it.
+     * The buffers must stay valid until the packet has been flushed.
+     */
+    lcb_STATUS value_ref(const lcb_IOV *iov, std::size_t iov_len)
+    {
+        value_.clear();
+        value_ref_.assign(iov, iov + iov_len);
+        return LCB_SUCCESS;
+    }
+
+    bool value_is_referenced() const
+    {
+        return !value_ref_.empty();
+    }
+
+    const std::vector<lcb_IOV> &value_ref() const
+    {
+        return value_ref_;
+    }
+
+    std::size_t value_size() const
+    {
+        if (value_ref_.empty()) {
+            return value_.size();
+        }
+        std::size_t total_size = 0;
+        for (const auto &iov : value_ref_) {
+            total_size += iov.iov_len;
+        }
+        return total_size;
+    }
+
     lcb_STATUS value(const lcb_IOV *iov, std::size_t iov_len)
     {
         std::size_t total_size = 0;
         for (std::size_t i = 0; i < iov_len; ++i) {
             total_size += iov[i].iov_len;
         }
+        value_ref_.clear();
         value_.reserve(total_size);
         for (std::size_t i = 0; i < iov_len; ++i) {
             if (iov[i].iov_len > 0 && iov[i].iov_base != nullptr) {
@@ -316,6 +351,20 @@ struct lcb_CMDSTORE_ {
         return static_cast<std::uint32_t>(timeout_.count());
     }
 
+    lcb_STATUS priority(lcb_PRIORITY priority)
+    {
+        if (priority < LCB_PRIORITY_INTERACTIVE || priority >= LCB_PRIORITY__MAX) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        priority_ = priority;
+        return LCB_SUCCESS;
+    }
+
+    lcb_PRIORITY priority() const
+    {
+        return priority_;
+    }
+
     lcbtrace_SPAN *parent_span() const
     {
         return parent_span_;
@@ -396,12 +445,14 @@ struct lcb_CMDSTORE_ {
     lcb::collection_qualifier collection_{};
     std::chrono::microseconds timeout_{0};
     std::chrono::nanoseconds start_time_{0};
+    lcb_PRIORITY priority_{LCB_PRIORITY_INTERACTIVE};
     lcbtrace_SPAN *parent_span_{nullptr};
     void *cookie_{nullptr};
     lcb_STORE_OPERATION operation_{LCB_STORE_UPSERT};
     std::uint32_t expiry_{0};
     std::string key_{};
     std::string value_{};
+    std::vector<lcb_IOV> value_ref_{};
     std::uint64_t cas_{0};
     std::uint32_t flags_{0};
     durability_mode durability_mode_{durability_mode::none};
@@ -397,6 +397,20 @@ struct lcb_CMDSUBDOC_ {
         return static_cast<std::uint32_t>(timeout_.count());
     }
 
+    lcb_STATUS priority(lcb_PRIORITY priority)
+    {
+        if (priority < LCB_PRIORITY_INTERACTIVE || priority >= LCB_PRIORITY__MAX) {
+            return LCB_ERR_INVALID_ARGUMENT;
+        }
+        priority_ = priority;
+        return LCB_SUCCESS;
+    }
+
+    lcb_PRIORITY priority() const
+    {
+        return priority_;
+    }
+
     lcbtrace_SPAN *parent_span() const
     {
         return parent_span_;
@@ -470,6 +484,7 @@ struct lcb_CMDSUBDOC_ {
     lcb::collection_qualifier collection_{};
     std::chrono::microseconds timeout_{0};
     std::chrono::nanoseconds start_time_{0};
+    lcb_PRIORITY priority_{LCB_PRIORITY_INTERACTIVE};
     std::uint32_t expiry_{0};
     lcbtrace_SPAN *parent_span_{nullptr};
     void *cookie_{nullptr};
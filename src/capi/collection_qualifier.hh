@@ -25,11 +25,28 @@
 
 namespace lcb
 {
+/**
+ * @private
+ *
+ * Hash of a "scope.collection" path, as used by the CollectionCache. Never
+ * zero, which marks empty slots of the cache.
+ */
+inline std::uint64_t collection_path_hash(const char *path, std::size_t path_len)
+{
+    /* FNV-1a */
+    std::uint64_t hash = 0xcbf29ce484222325ULL;
+    for (std::size_t i = 0; i < path_len; ++i) {
+        hash ^= static_cast<unsigned char>(path[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash ? hash : 1;
+}
+
 /**
  * @private
  */
 struct collection_qualifier {
-    collection_qualifier() = default;
+    collection_qualifier() : collection_qualifier(nullptr, 0, nullptr, 0) {}
 
     collection_qualifier(const char *scope_name, std::size_t scope_name_len, const char *collection_name,
                          std::size_t collection_name_len)
@@ -51,6 +68,7 @@ struct collection_qualifier {
         spec_ = (scope_.empty() ? "_default" : scope_) +
                 '.' +
                 (collection_.empty() ? "_default" : collection_);
+        spec_hash_ = collection_path_hash(spec_.data(), spec_.size());
     }
 
     const std::string &scope() const
@@ -94,6 +112,12 @@ struct collection_qualifier {
         return spec_;
     }
 
+    /** Precomputed collection_path_hash() of spec() */
+    std::uint64_t spec_hash() const
+    {
+        return spec_hash_;
+    }
+
   private:
     static bool is_valid_collection_char(char ch)
     {
@@ -133,6 +157,7 @@ struct collection_qualifier {
     std::string scope_{"_default"};
     std::string collection_{"_default"};
     std::string spec_{};
+    std::uint64_t spec_hash_{0};
     std::uint32_t resolved_collection_id_{0};
     bool resolved_{false};
 };
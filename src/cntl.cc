@@ -16,11 +16,13 @@
  */
 
 #include "internal.h"
+#include "nearcache.h"
 #include "bucketconfig/clconfig.h"
 #include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 #include <lcbio/iotable.h>
 #include <mcserver/negotiate.h>
 #include <lcbio/ssl.h>
+#include <rdb/poolalloc.h>
 #include "n1ql/query_utils.hh"
 
 #define LOGARGS(instance, lvl) instance->settings, "cntl", LCB_LOG_##lvl, __FILE__, __LINE__
@@ -117,6 +119,14 @@ static std::uint32_t *get_timeout_field(lcb_INSTANCE *instance, int cmd)
             return &settings->retry_nmv_interval;
         case LCB_CNTL_CONFIG_POLL_INTERVAL:
             return &settings->config_poll_interval;
+        case LCB_CNTL_COLLECTIONS_UNKNOWN_TTL:
+            return &settings->collections_unknown_ttl;
+        case LCB_CNTL_NEAR_CACHE_TTL:
+            return &settings->near_cache_ttl;
+        case LCB_CNTL_GET_HEDGE_DELAY:
+            return &settings->get_hedge_delay;
+        case LCB_CNTL_KV_FLUSH_DELAY:
+            return &settings->kv_flush_delay;
         case LCB_CNTL_TRACING_ORPHANED_QUEUE_FLUSH_INTERVAL:
             return &settings->tracer_orphaned_queue_flush_interval;
         case LCB_CNTL_TRACING_THRESHOLD_QUEUE_FLUSH_INTERVAL:
@@ -273,6 +283,157 @@ HANDLER(enable_errmap_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, use_er
 
 HANDLER(enable_op_metrics_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, op_metrics_enabled))}
 
+HANDLER(kv_connections_handler)
+{
+    auto *user = reinterpret_cast<std::uint32_t *>(arg);
+    if (mode == LCB_CNTL_SET && (*user < 1 || *user > LCB_MAX_KV_CONNECTIONS_PER_NODE)) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_connections_per_node))
+}
+
+HANDLER(kv_zerocopy_threshold_handler){RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_zerocopy_threshold))}
+
+HANDLER(inflate_stats_handler)
+{
+    (void)cmd;
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    const auto *pool = reinterpret_cast<const rdb_POOLALLOC *>(instance->inflate_pool);
+    auto *stats = reinterpret_cast<lcb_INFLATE_STATS *>(arg);
+    stats->requests = pool->n_requests;
+    stats->reused = pool->n_reused;
+    stats->allocated = pool->n_malloc;
+    stats->oversized = pool->n_oversized;
+    stats->outstanding = pool->n_outstanding;
+    stats->pooled_bytes = pool->nb_pooled;
+    return LCB_SUCCESS;
+}
+
+HANDLER(compression_adaptive_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, compress_adaptive))}
+
+HANDLER(config_push_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, enable_config_push))}
+
+HANDLER(get_single_flight_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, get_single_flight))}
+
+HANDLER(near_cache_size_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, near_cache_size) = *reinterpret_cast<std::uint32_t *>(arg);
+        instance->nearcache->trim(LCBT_SETTING(instance, near_cache_size));
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(std::uint32_t, LCBT_SETTING(instance, near_cache_size))
+}
+
+HANDLER(near_cache_revalidate_handler){RETURN_GET_SET(int, LCBT_SETTING(instance, near_cache_revalidate))}
+
+HANDLER(get_hedge_budget_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        std::uint32_t budget = *reinterpret_cast<std::uint32_t *>(arg);
+        if (budget > 100) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        LCBT_SETTING(instance, get_hedge_budget) = budget;
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(std::uint32_t, LCBT_SETTING(instance, get_hedge_budget))
+}
+
+HANDLER(retry_budget_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        std::uint32_t budget = *reinterpret_cast<std::uint32_t *>(arg);
+        if (budget > 100) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        LCBT_SETTING(instance, retry_budget) = budget;
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(std::uint32_t, LCBT_SETTING(instance, retry_budget))
+}
+
+HANDLER(kv_adaptive_window_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, kv_adaptive_window) = *reinterpret_cast<std::uint32_t *>(arg);
+        for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+            lcb::Server *server = instance->get_server(ii);
+            for (size_t jj = 0; jj < server->nconnections(); jj++) {
+                mcreq_pipeline_set_window(server->connection(jj), LCBT_SETTING(instance, kv_adaptive_window));
+            }
+        }
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(std::uint32_t, LCBT_SETTING(instance, kv_adaptive_window))
+}
+
+HANDLER(kv_priority_weight_handler)
+{
+    if (mode == LCB_CNTL_SET) {
+        LCBT_SETTING(instance, kv_priority_weight) = *reinterpret_cast<std::uint32_t *>(arg);
+        for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+            lcb::Server *server = instance->get_server(ii);
+            for (size_t jj = 0; jj < server->nconnections(); jj++) {
+                mcreq_pipeline_set_priority_weight(server->connection(jj), LCBT_SETTING(instance, kv_priority_weight));
+            }
+        }
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(std::uint32_t, LCBT_SETTING(instance, kv_priority_weight))
+}
+
+HANDLER(kv_priority_timings_handler)
+{
+    auto *timings = reinterpret_cast<lcb_PRIORITY_TIMINGS *>(arg);
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    if (timings->priority < 0 || timings->priority >= LCB_PRIORITY__MAX) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    timings->timings = instance->kv_priority_timings[timings->priority];
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
+HANDLER(kv_flush_bytes_handler){RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, kv_flush_bytes))}
+
+HANDLER(watermarks_handler)
+{
+    auto *user = reinterpret_cast<lcb_QUEUE_WATERMARKS *>(arg);
+    lcb_QUEUE_WATERMARKS *watermarks = cmd == LCB_CNTL_PIPELINE_WATERMARKS ? &instance->cmdq.pipeline_watermarks
+                                                                           : &instance->cmdq.queue_watermarks;
+    if (mode == LCB_CNTL_SET) {
+        if (user->low_bytes > user->high_bytes || user->low_packets > user->high_packets) {
+            return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+        }
+        *watermarks = *user;
+        mcreq_queue_check_congestion(&instance->cmdq);
+        return LCB_SUCCESS;
+    }
+    RETURN_GET_ONLY(lcb_QUEUE_WATERMARKS, *watermarks)
+}
+
+HANDLER(node_score_handler)
+{
+    auto *score = reinterpret_cast<lcb_NODE_SCORE *>(arg);
+    if (mode != LCB_CNTL_GET) {
+        return LCB_ERR_CONTROL_UNSUPPORTED_MODE;
+    }
+    if (score->index < 0 || score->index >= (int)LCBT_NSERVERS(instance)) {
+        return LCB_ERR_CONTROL_INVALID_ARGUMENT;
+    }
+    lcb::Server *server = instance->get_server(score->index);
+    score->latency = LCB_NS2US(server->response_time.value());
+    score->pending = server->pending();
+    score->score = LCB_NS2US(server->score());
+    (void)cmd;
+    return LCB_SUCCESS;
+}
+
 HANDLER(tracing_orphaned_queue_size_handler){
     RETURN_GET_SET(std::uint32_t, LCBT_SETTING(instance, tracer_orphaned_queue_size))}
 
@@ -701,6 +862,12 @@ HANDLER(metrics_handler)
         }
         return LCB_SUCCESS;
     } else if (mode == LCB_CNTL_GET) {
+        for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+            instance->get_server(ii)->update_connection_metrics();
+        }
+        if (instance->settings->metrics) {
+            lcb_metrics_update_packets_per_write(instance->settings->metrics);
+        }
         *(lcb_METRICS **)arg = instance->settings->metrics;
         return LCB_SUCCESS;
     } else {
@@ -860,6 +1027,27 @@ static ctl_handler handlers[] = {
     enable_errmap_handler,                /* LCB_CNTL_ENABLE_ERRMAP */
     timeout_common,                       /* LCB_CNTL_OP_METRICS_FLUSH_INTERVAL */
     enable_op_metrics_handler,            /* LCB_CNTL_ENABLE_OP_METRICS */
+    kv_connections_handler,               /* LCB_CNTL_KV_CONNECTIONS_PER_NODE */
+    kv_zerocopy_threshold_handler,        /* LCB_CNTL_KV_ZEROCOPY_THRESHOLD */
+    inflate_stats_handler,                /* LCB_CNTL_INFLATE_STATS */
+    compression_adaptive_handler,         /* LCB_CNTL_COMPRESSION_ADAPTIVE */
+    timeout_common,                       /* LCB_CNTL_COLLECTIONS_UNKNOWN_TTL */
+    config_push_handler,                  /* LCB_CNTL_ENABLE_CONFIG_PUSH */
+    get_single_flight_handler,            /* LCB_CNTL_GET_SINGLE_FLIGHT */
+    near_cache_size_handler,              /* LCB_CNTL_NEAR_CACHE_SIZE */
+    timeout_common,                       /* LCB_CNTL_NEAR_CACHE_TTL */
+    near_cache_revalidate_handler,        /* LCB_CNTL_NEAR_CACHE_REVALIDATE */
+    get_hedge_budget_handler,             /* LCB_CNTL_GET_HEDGE_BUDGET */
+    timeout_common,                       /* LCB_CNTL_GET_HEDGE_DELAY */
+    node_score_handler,                   /* LCB_CNTL_NODE_SCORE */
+    retry_budget_handler,                 /* LCB_CNTL_RETRY_BUDGET */
+    kv_adaptive_window_handler,           /* LCB_CNTL_KV_ADAPTIVE_WINDOW */
+    watermarks_handler,                   /* LCB_CNTL_PIPELINE_WATERMARKS */
+    watermarks_handler,                   /* LCB_CNTL_INSTANCE_WATERMARKS */
+    kv_priority_weight_handler,           /* LCB_CNTL_KV_PRIORITY_WEIGHT */
+    kv_priority_timings_handler,          /* LCB_CNTL_KV_PRIORITY_TIMINGS */
+    timeout_common,                       /* LCB_CNTL_KV_FLUSH_DELAY */
+    kv_flush_bytes_handler,               /* LCB_CNTL_KV_FLUSH_BYTES */
     nullptr
 };
 /* clang-format on */
@@ -1101,6 +1289,22 @@ static cntl_OPCODESTRS stropcode_map[] = {
     {"enable_errmap", LCB_CNTL_ENABLE_ERRMAP, convert_intbool},
     {"operation_metrics_flush_interval", LCB_CNTL_OP_METRICS_FLUSH_INTERVAL, convert_timevalue},
     {"enable_operation_metrics", LCB_CNTL_ENABLE_OP_METRICS, convert_intbool},
+    {"kv_connections_per_node", LCB_CNTL_KV_CONNECTIONS_PER_NODE, convert_u32},
+    {"kv_zerocopy_threshold", LCB_CNTL_KV_ZEROCOPY_THRESHOLD, convert_u32},
+    {"compression_adaptive", LCB_CNTL_COMPRESSION_ADAPTIVE, convert_intbool},
+    {"collections_unknown_ttl", LCB_CNTL_COLLECTIONS_UNKNOWN_TTL, convert_timevalue},
+    {"enable_config_push", LCB_CNTL_ENABLE_CONFIG_PUSH, convert_intbool},
+    {"get_single_flight", LCB_CNTL_GET_SINGLE_FLIGHT, convert_intbool},
+    {"near_cache_size", LCB_CNTL_NEAR_CACHE_SIZE, convert_u32},
+    {"near_cache_ttl", LCB_CNTL_NEAR_CACHE_TTL, convert_timevalue},
+    {"near_cache_revalidate", LCB_CNTL_NEAR_CACHE_REVALIDATE, convert_intbool},
+    {"get_hedge_budget", LCB_CNTL_GET_HEDGE_BUDGET, convert_u32},
+    {"get_hedge_delay", LCB_CNTL_GET_HEDGE_DELAY, convert_timevalue},
+    {"retry_budget", LCB_CNTL_RETRY_BUDGET, convert_u32},
+    {"kv_adaptive_window", LCB_CNTL_KV_ADAPTIVE_WINDOW, convert_u32},
+    {"kv_priority_weight", LCB_CNTL_KV_PRIORITY_WEIGHT, convert_u32},
+    {"kv_flush_delay", LCB_CNTL_KV_FLUSH_DELAY, convert_timevalue},
+    {"kv_flush_bytes", LCB_CNTL_KV_FLUSH_BYTES, convert_u32},
     {nullptr, -1}};
 
 #define CNTL_NUM_HANDLERS (sizeof(handlers) / sizeof(handlers[0]))
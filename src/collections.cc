@@ -19,7 +19,11 @@
 #include "collections.h"
 #include "mcserver/negotiate.h"
 
+#include <cstdlib>
 #include <string>
+#include <thread>
+
+#include "contrib/lcb-jsoncpp/lcb-jsoncpp.h"
 
 #include "capi/cmd_getcid.hh"
 #include "capi/cmd_getmanifest.hh"
@@ -28,45 +32,289 @@
 
 namespace lcb
 {
+namespace
+{
+enum SlotState : std::uint64_t { SLOT_EMPTY = 0, SLOT_FOUND = 1, SLOT_PINNED = 2 };
+
+const std::uint32_t generation_mask = 0x3fffffff;
+
+std::uint64_t pack(SlotState state, std::uint32_t generation, std::uint32_t payload)
+{
+    return (static_cast<std::uint64_t>(state) << 62) | (static_cast<std::uint64_t>(generation & generation_mask) << 32) |
+           payload;
+}
+
+SlotState slot_state(std::uint64_t value)
+{
+    return static_cast<SlotState>(value >> 62);
+}
+
+std::uint32_t slot_payload(std::uint64_t value)
+{
+    return static_cast<std::uint32_t>(value);
+}
+
+std::size_t id_position(std::uint32_t cid)
+{
+    return (cid * 0x9e3779b1U) & (CollectionCache::capacity - 1);
+}
+} // namespace
+
+const std::size_t CollectionCache::capacity;
+const std::size_t CollectionCache::unknown_capacity;
+
 CollectionCache::CollectionCache()
+    : slots_(new Slot[capacity]), ids_(new std::atomic<std::uint64_t>[capacity]())
 {
     static const std::string default_collection("_default._default");
-    put(default_collection, 0);
+    Slot *slot = find(collection_path_hash(default_collection.data(), default_collection.size()), default_collection,
+                      true);
+    slot->value.store(pack(SLOT_PINNED, 0, 0));
+    index_id(0, slot);
 }
 
-std::string CollectionCache::id_to_name(uint32_t cid)
+CollectionCache::~CollectionCache()
 {
-    std::map<uint32_t, std::string>::const_iterator pos = cache_i2n.find(cid);
-    if (pos != cache_i2n.end()) {
-        return pos->second;
+    for (std::size_t ii = 0; ii < capacity; ii++) {
+        delete slots_[ii].path.load();
     }
-    return "";
 }
 
-bool CollectionCache::get(const std::string &path, uint32_t *cid)
+CollectionCache::Slot *CollectionCache::find(std::uint64_t hash, const std::string &path, bool claim) const
+{
+    const std::size_t mask = capacity - 1;
+    std::size_t pos = hash & mask;
+    for (std::size_t ii = 0; ii < capacity; ii++, pos = (pos + 1) & mask) {
+        Slot &slot = slots_[pos];
+        std::uint64_t cur = slot.hash.load(std::memory_order_acquire);
+        if (cur == 0) {
+            if (!claim) {
+                return nullptr;
+            }
+            if (slot.hash.compare_exchange_strong(cur, hash)) {
+                slot.path.store(new std::string(path), std::memory_order_release);
+                return &slot;
+            }
+            /* claimed by another thread meanwhile, `cur` is its hash */
+        }
+        if (cur != hash) {
+            continue;
+        }
+        const std::string *slot_path;
+        while ((slot_path = slot.path.load(std::memory_order_acquire)) == nullptr) {
+            /* still being claimed by another thread, which sets the path right after */
+            std::this_thread::yield();
+        }
+        if (*slot_path == path) {
+            return &slot;
+        }
+    }
+    return nullptr;
+}
+
+void CollectionCache::index_id(std::uint32_t cid, const Slot *slot)
+{
+    const std::uint64_t entry = (static_cast<std::uint64_t>(cid) << 32) | (slot - slots_.get() + 1);
+    const std::size_t mask = capacity - 1;
+    std::size_t pos = id_position(cid);
+    for (std::size_t ii = 0; ii < capacity; ii++, pos = (pos + 1) & mask) {
+        std::uint64_t cur = ids_[pos].load();
+        if (cur == 0 && ids_[pos].compare_exchange_strong(cur, entry)) {
+            return;
+        }
+        if ((cur >> 32) == cid) {
+            ids_[pos].store(entry);
+            return;
+        }
+    }
+}
+
+bool CollectionCache::is_current(std::uint64_t value) const
+{
+    return ((value >> 32) & generation_mask) == (generation_.load() & generation_mask);
+}
+
+bool CollectionCache::get(std::uint64_t hash, const std::string &path, std::uint32_t *cid) const
+{
+    const Slot *slot = find(hash, path, false);
+    if (slot == nullptr) {
+        return false;
+    }
+    std::uint64_t value = slot->value.load(std::memory_order_acquire);
+    switch (slot_state(value)) {
+        case SLOT_PINNED:
+            break;
+        case SLOT_FOUND:
+            if (!is_current(value)) {
+                return false;
+            }
+            break;
+        default:
+            return false;
+    }
+    *cid = slot_payload(value);
+    return true;
+}
+
+lcb_STATUS CollectionCache::get_unknown(const std::string &path) const
+{
+    std::lock_guard<std::mutex> lock(unknown_mutex_);
+    auto pos = unknown_.find(path);
+    if (pos == unknown_.end()) {
+        return LCB_SUCCESS;
+    }
+    if (pos->second.generation != generation_.load() || gethrtime() >= pos->second.expires) {
+        unknown_.erase(pos);
+        return LCB_SUCCESS;
+    }
+    return pos->second.rc;
+}
+
+bool CollectionCache::set_manifest_uid(std::uint64_t manifest_uid)
 {
-    std::map<std::string, uint32_t>::const_iterator pos = cache_n2i.find(path);
-    if (pos != cache_n2i.end()) {
-        *cid = pos->second;
-        return true;
+    std::uint64_t cur = manifest_uid_.load();
+    while (manifest_uid > cur) {
+        if (manifest_uid_.compare_exchange_weak(cur, manifest_uid)) {
+            generation_++;
+            return true;
+        }
     }
     return false;
 }
 
-void CollectionCache::put(const std::string &path, uint32_t cid)
+void CollectionCache::put(const std::string &path, std::uint32_t cid, std::uint64_t manifest_uid)
+{
+    set_manifest_uid(manifest_uid);
+    /* The generation must be read before the manifest is checked, see set_manifest_uid() */
+    std::uint32_t generation = generation_.load();
+    if (manifest_uid < manifest_uid_.load()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(unknown_mutex_);
+        unknown_.erase(path);
+    }
+    Slot *slot = find(collection_path_hash(path.data(), path.size()), path, true);
+    if (slot == nullptr) {
+        overflows_++;
+        return;
+    }
+    if (slot_state(slot->value.load()) == SLOT_PINNED) {
+        return;
+    }
+    slot->value.store(pack(SLOT_FOUND, generation, cid), std::memory_order_release);
+    index_id(cid, slot);
+}
+
+void CollectionCache::put_unknown(const std::string &path, lcb_STATUS rc, hrtime_t expires)
+{
+    std::uint32_t generation = generation_.load();
+    std::lock_guard<std::mutex> lock(unknown_mutex_);
+    if (unknown_.size() >= unknown_capacity && unknown_.find(path) == unknown_.end()) {
+        hrtime_t now = gethrtime();
+        for (auto pos = unknown_.begin(); pos != unknown_.end();) {
+            if (pos->second.generation != generation || now >= pos->second.expires) {
+                pos = unknown_.erase(pos);
+            } else {
+                ++pos;
+            }
+        }
+        if (unknown_.size() >= unknown_capacity) {
+            /* all still valid, forget any one of them */
+            unknown_.erase(unknown_.begin());
+        }
+    }
+    unknown_[path] = Unknown{rc, expires, generation};
+}
+
+std::string CollectionCache::id_to_name(std::uint32_t cid) const
+{
+    const std::size_t mask = capacity - 1;
+    std::size_t pos = id_position(cid);
+    for (std::size_t ii = 0; ii < capacity; ii++, pos = (pos + 1) & mask) {
+        std::uint64_t cur = ids_[pos].load();
+        if (cur == 0) {
+            break;
+        }
+        if ((cur >> 32) != cid) {
+            continue;
+        }
+        const Slot &slot = slots_[(cur & 0xffffffff) - 1];
+        std::uint64_t value = slot.value.load(std::memory_order_acquire);
+        /* the collection may have been recreated with another ID */
+        if (slot_state(value) != SLOT_EMPTY && slot_payload(value) == cid) {
+            return *slot.path.load(std::memory_order_acquire);
+        }
+        break;
+    }
+    return "";
+}
+
+bool CollectionLookups::join(const std::string &path, Waiter &waiter)
+{
+    auto pos = lookups_.find(path);
+    if (pos == lookups_.end()) {
+        return false;
+    }
+    pos->second.emplace_back(std::move(waiter));
+    return true;
+}
+
+void CollectionLookups::start(const std::string &path, Waiter waiter)
+{
+    lookups_[path].emplace_back(std::move(waiter));
+}
+
+void CollectionLookups::complete(const std::string &path, lcb_STATUS rc, const lcb_RESPGETCID *resp)
+{
+    auto pos = lookups_.find(path);
+    if (pos == lookups_.end()) {
+        return;
+    }
+    /* The waiters may resolve collections again */
+    std::vector<Waiter> waiters(std::move(pos->second));
+    lookups_.erase(pos);
+    for (auto &waiter : waiters) {
+        waiter(rc, resp);
+    }
+}
+
+/* Cache a resolved collection, warning the first time the cache is full */
+static void cache_collection(lcb_INSTANCE *instance, const std::string &path, std::uint32_t cid,
+                             std::uint64_t manifest_uid)
 {
-    cache_n2i[path] = cid;
-    cache_i2n[cid] = path;
+    bool full = instance->collcache->overflows() != 0;
+    instance->collcache->put(path, cid, manifest_uid);
+    if (!full && instance->collcache->overflows() != 0) {
+        lcb_log(LOGARGS(instance, WARN),
+                "Collection cache is full (%u paths), other collections will be resolved for every command",
+                static_cast<unsigned>(CollectionCache::capacity));
+    }
 }
 
-void CollectionCache::erase(uint32_t cid)
+static void handle_getcid(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS rc, const void *rb)
 {
-    auto pos = cache_i2n.find(cid);
-    if (pos != cache_i2n.end()) {
-        cache_n2i.erase(pos->second);
-        cache_i2n.erase(pos);
+    auto *ctx = static_cast<GetCidCtx *>(pkt->u_rdata.exdata);
+    const auto *resp = (const lcb_RESPGETCID *)rb;
+    lcb_INSTANCE *instance = ctx->instance_;
+    if (resp->ctx.rc == LCB_SUCCESS) {
+        cache_collection(instance, ctx->path_, resp->collection_id, resp->manifest_id);
+    } else {
+        lcb_log(instance->settings, "collcache", LCB_LOG_DEBUG, __FILE__, __LINE__,
+                "failed to resolve collection, rc: %s", lcb_strerror_short(resp->ctx.rc));
     }
+    instance->colllookups->complete(ctx->path_, rc, resp);
+    delete ctx;
+}
+
+static void handle_getcid_schedfail(mc_PACKET *pkt)
+{
+    auto *ctx = static_cast<GetCidCtx *>(pkt->u_rdata.exdata);
+    ctx->instance_->colllookups->complete(ctx->path_, LCB_ERR_SHEDULE_FAILURE, nullptr);
+    delete ctx;
 }
+
+mc_REQDATAPROCS GetCidCtx::proctable = {handle_getcid, handle_getcid_schedfail};
 } // namespace lcb
 
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection)
@@ -103,18 +351,118 @@ lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscop
     return LCB_ERR_COLLECTION_NOT_FOUND;
 }
 
+lcb_STATUS collcache_send_getcid(lcb_INSTANCE *instance, const lcb_KEYBUF *key, std::string spec, uint32_t timeout_us,
+                                 lcb::CollectionLookups::Waiter waiter)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    int vbid, idx;
+    mcreq_map_key(cq, key, MCREQ_PKT_BASESIZE, &vbid, &idx);
+    if (idx < 0) {
+        return LCB_ERR_NO_MATCHING_SERVER;
+    }
+    mc_PIPELINE *pl = cq->pipelines[idx];
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    if (!pkt) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    mcreq_reserve_header(pl, pkt, MCREQ_PKT_BASESIZE);
+    pkt->flags |= MCREQ_F_NOCID;
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID;
+    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    hdr.request.opaque = pkt->opaque;
+    hdr.request.keylen = 0;
+    hdr.request.bodylen = htonl(spec.size());
+    mcreq_write_hdr(pkt, &hdr);
+    mcreq_reserve_value2(pl, pkt, spec.size());
+    memcpy(SPAN_BUFFER(&pkt->u_value.single), spec.data(), spec.size());
+
+    instance->colllookups->start(spec, std::move(waiter));
+    pkt->u_rdata.exdata = new lcb::GetCidCtx(instance, std::move(spec));
+    pkt->u_rdata.exdata->deadline =
+        pkt->u_rdata.exdata->start + LCB_US2NS(timeout_us ? timeout_us : LCBT_SETTING(instance, operation_timeout));
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    LCB_SCHED_ADD(instance, pl, pkt)
+    return LCB_SUCCESS;
+}
+
+static void handle_prefetch(lcb_INSTANCE *instance, int, const lcb_RESPBASE *rb)
+{
+    const auto *resp = (const lcb_RESPGETMANIFEST *)rb;
+    if (resp->ctx.rc != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, DEBUG), "Unable to prefetch collections manifest, rc: %s",
+                lcb_strerror_short(resp->ctx.rc));
+        return;
+    }
+
+    Json::Value manifest;
+    if (!Json::Reader().parse(resp->value, resp->value + resp->nvalue, manifest) ||
+        !manifest.isObject()) {
+        lcb_log(LOGARGS(instance, WARN), "Unable to parse collections manifest");
+        return;
+    }
+    uint64_t manifest_uid = 0;
+    if (manifest["uid"].isString()) {
+        manifest_uid = std::strtoull(manifest["uid"].asCString(), nullptr, 16);
+    }
+    unsigned ncollections = 0;
+    for (const auto &scope : manifest["scopes"]) {
+        if (!scope.isObject() || !scope["name"].isString()) {
+            continue;
+        }
+        for (const auto &collection : scope["collections"]) {
+            if (!collection.isObject() || !collection["name"].isString() || !collection["uid"].isString()) {
+                continue;
+            }
+            /* identifiers are hex-encoded */
+            auto cid = static_cast<uint32_t>(std::strtoul(collection["uid"].asCString(), nullptr, 16));
+            lcb::cache_collection(instance, scope["name"].asString() + "." + collection["name"].asString(), cid,
+                                  manifest_uid);
+            ncollections++;
+        }
+    }
+    lcb_log(LOGARGS(instance, DEBUG), "Prefetched %u collection(s) from manifest %" PRIx64, ncollections,
+            manifest_uid);
+}
+
+void collcache_prefetch(lcb_INSTANCE *instance)
+{
+    static lcb_RESPCALLBACK callback = handle_prefetch;
+    lcb_CMDGETMANIFEST cmd{};
+    cmd.cmdflags = LCB_CMD_F_INTERNAL_CALLBACK;
+    lcb_STATUS rc = lcb_getmanifest(instance, &callback, &cmd);
+    if (rc != LCB_SUCCESS) {
+        lcb_log(LOGARGS(instance, DEBUG), "Unable to prefetch collections manifest, rc: %s", lcb_strerror_short(rc));
+    }
+}
+
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection)
 {
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+    if (!LCBT_SETTING(instance, use_collections)) {
+        return LCB_ERR_UNSUPPORTED_OPERATION;
+    }
+
     uint32_t collection_id;
-    lcb_STATUS rc = collcache_get(instance, collection.scope().c_str(), collection.scope().size(),
-                                  collection.collection().c_str(), collection.collection().size(), &collection_id);
-    if (rc != LCB_SUCCESS) {
-        return rc;
+    if (!instance->collcache->get(collection.spec_hash(), collection.spec(), &collection_id)) {
+        return LCB_ERR_COLLECTION_NOT_FOUND;
     }
     collection.collection_id(collection_id);
     return LCB_SUCCESS;
 }
 
+void collcache_put_unknown(lcb_INSTANCE *instance, const std::string &path, lcb_STATUS rc)
+{
+    uint32_t ttl = LCBT_SETTING(instance, collections_unknown_ttl);
+    if (ttl) {
+        instance->collcache->put_unknown(path, rc, gethrtime() + LCB_US2NS(ttl));
+    }
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_respgetmanifest_status(const lcb_RESPGETMANIFEST *resp)
 {
     return resp->ctx.rc;
@@ -184,9 +532,11 @@ lcb_STATUS lcb_getmanifest(lcb_INSTANCE *instance, void *cookie, const lcb_CMDGE
     pkt->u_rdata.reqdata.start = gethrtime();
     pkt->u_rdata.reqdata.deadline =
         pkt->u_rdata.reqdata.start + LCB_US2NS(cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout));
+    if (cmd->cmdflags & LCB_CMD_F_INTERNAL_CALLBACK) {
+        pkt->flags |= MCREQ_F_PRIVCALLBACK;
+    }
 
     LCB_SCHED_ADD(instance, pl, pkt)
-    (void)cmd;
     return LCB_SUCCESS;
 }
 
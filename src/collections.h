@@ -19,31 +19,122 @@
 #define LCB_COLLECTIONS_H
 
 #ifdef __cplusplus
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 
 #include "capi/cmd_getcid.hh"
 #include "capi/collection_qualifier.hh"
-#include "capi/deferred_command_context.hh"
 
 namespace lcb
 {
+/**
+ * Maps "scope.collection" paths to collection IDs.
+ *
+ * This is a flat open-addressing table of fixed capacity, keyed by the
+ * collection_path_hash() of the path, so that the lookup done for every
+ * command neither allocates nor locks (the cache may be shared by the
+ * instances of a runtime group, running on different threads). A slot is
+ * claimed once for a path and never released. Rather than being erased one by
+ * one, all the entries are invalidated when a newer manifest is seen. Once
+ * the table is full, new paths are resolved by every command; this is
+ * counted by overflows().
+ *
+ * Collections which the server reported as unknown are remembered for a
+ * limited time, so that commands for them fail without a round trip. They do
+ * not take slots of the table: they are kept in a small map, guarded by a
+ * mutex since it is only consulted when the table misses, from which expired
+ * and outdated entries are evicted to make room for new ones.
+ */
 class CollectionCache
 {
-    std::map<std::string, uint32_t> cache_n2i{};
-    std::map<uint32_t, std::string> cache_i2n{};
-
   public:
+    /** Maximum number of paths cached. Paths beyond it are resolved every time */
+    static const std::size_t capacity = 2048;
+
+    /** Maximum number of collections remembered as unknown */
+    static const std::size_t unknown_capacity = 256;
+
     CollectionCache();
 
-    ~CollectionCache() = default;
+    ~CollectionCache();
 
-    bool get(const std::string &path, uint32_t *cid);
+    /** Looks up a path using its precomputed hash */
+    bool get(std::uint64_t hash, const std::string &path, std::uint32_t *cid) const;
 
-    void put(const std::string &path, uint32_t cid);
+    bool get(const std::string &path, std::uint32_t *cid) const
+    {
+        return get(collection_path_hash(path.data(), path.size()), path, cid);
+    }
 
-    std::string id_to_name(uint32_t cid);
+    /**
+     * @return the error reported by the server if the collection is
+     * remembered as unknown, LCB_SUCCESS otherwise
+     */
+    lcb_STATUS get_unknown(const std::string &path) const;
+
+    /**
+     * Stores the ID of a collection as of the given manifest. A newer manifest
+     * invalidates all the other entries, and IDs from older manifests are
+     * ignored.
+     */
+    void put(const std::string &path, std::uint32_t cid, std::uint64_t manifest_uid);
+
+    /** Remembers a collection as unknown until `expires` */
+    void put_unknown(const std::string &path, lcb_STATUS rc, hrtime_t expires);
+
+    /**
+     * Invalidates all the entries if the manifest is newer than the one the
+     * entries were stored with.
+     * @return true if the entries were invalidated
+     */
+    bool set_manifest_uid(std::uint64_t manifest_uid);
+
+    std::uint64_t manifest_uid() const
+    {
+        return manifest_uid_.load();
+    }
 
-    void erase(uint32_t cid);
+    std::string id_to_name(std::uint32_t cid) const;
+
+    /** @return number of paths which were not cached because the table was full */
+    std::uint64_t overflows() const
+    {
+        return overflows_.load();
+    }
+
+  private:
+    struct Slot {
+        /* collection_path_hash() of the path, or 0 if the slot is free */
+        std::atomic<std::uint64_t> hash{0};
+        /* set once the slot has been claimed */
+        std::atomic<const std::string *> path{nullptr};
+        /* state, generation and collection ID, see pack() */
+        std::atomic<std::uint64_t> value{0};
+    };
+
+    struct Unknown {
+        lcb_STATUS rc;
+        /* when the collection should be looked up again */
+        hrtime_t expires;
+        std::uint32_t generation;
+    };
+
+    Slot *find(std::uint64_t hash, const std::string &path, bool claim) const;
+    void index_id(std::uint32_t cid, const Slot *slot);
+    bool is_current(std::uint64_t value) const;
+
+    std::unique_ptr<Slot[]> slots_;
+    /* collection ID to slot index (plus one), for id_to_name() */
+    std::unique_ptr<std::atomic<std::uint64_t>[]> ids_;
+    std::atomic<std::uint64_t> manifest_uid_{0};
+    std::atomic<std::uint32_t> generation_{0};
+    std::atomic<std::uint64_t> overflows_{0};
+    mutable std::mutex unknown_mutex_;
+    mutable std::unordered_map<std::string, Unknown> unknown_;
 };
 } // namespace lcb
 typedef lcb::CollectionCache lcb_COLLCACHE;
@@ -51,70 +142,80 @@ typedef lcb::CollectionCache lcb_COLLCACHE;
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, const char *scope, size_t nscope, const char *collection,
                          size_t ncollection, uint32_t *cid);
 lcb_STATUS collcache_get(lcb_INSTANCE *instance, lcb::collection_qualifier &collection);
+/** Remembers the collection as unknown for LCB_CNTL_COLLECTIONS_UNKNOWN_TTL, if set */
+void collcache_put_unknown(lcb_INSTANCE *instance, const std::string &path, lcb_STATUS rc);
 std::string collcache_build_spec(const char *scope, size_t nscope, const char *collection, size_t ncollection);
 
-template <typename Command, typename Operation, typename Destructor>
+namespace lcb
+{
+/**
+ * Collection lookups (GET_CID requests) in flight for an instance. Commands
+ * for a collection which is already being resolved wait for the response of
+ * the same request instead of sending their own, and are released together.
+ *
+ * Unlike the CollectionCache, this is never shared between instances: the
+ * waiters are invoked on the thread of the instance which sent the request.
+ */
+class CollectionLookups
+{
+  public:
+    /**
+     * Invoked with the response of the lookup, or with a null response if the
+     * request could not be scheduled.
+     */
+    using Waiter = std::function<void(lcb_STATUS rc, const lcb_RESPGETCID *resp)>;
+
+    /**
+     * Waits for a lookup which is already in flight.
+     * @return false if the collection is not being resolved, in which case the
+     * waiter is left untouched
+     */
+    bool join(const std::string &path, Waiter &waiter);
+
+    /** Registers the first waiter of a new lookup */
+    void start(const std::string &path, Waiter waiter);
+
+    /** Removes the lookup and invokes its waiters, in order */
+    void complete(const std::string &path, lcb_STATUS rc, const lcb_RESPGETCID *resp);
+
+    /** @return number of collections being resolved */
+    std::size_t size() const
+    {
+        return lookups_.size();
+    }
+
+  private:
+    std::unordered_map<std::string, std::vector<Waiter>> lookups_{};
+};
+
+/** Context of the GET_CID request resolving a collection */
 struct GetCidCtx : mc_REQDATAEX {
+    lcb_INSTANCE *instance_;
     std::string path_;
-    Operation op_;
-    Command cmd_;
-    Destructor dtor_;
 
     static mc_REQDATAPROCS proctable;
 
-    GetCidCtx(std::string path, Operation op, Command cmd, Destructor dtor)
-        : mc_REQDATAEX(nullptr, proctable, gethrtime()), path_(std::move(path)), op_(op), cmd_(cmd), dtor_(dtor)
+    GetCidCtx(lcb_INSTANCE *instance, std::string path)
+        : mc_REQDATAEX(nullptr, proctable, gethrtime()), instance_(instance), path_(std::move(path))
     {
     }
-
-    ~GetCidCtx()
-    {
-        if (cmd_) {
-            dtor_(cmd_);
-            cmd_ = nullptr;
-        }
-    }
 };
+} // namespace lcb
 
-template <typename Command, typename Operation, typename Destructor>
-GetCidCtx<Command, Operation, Destructor> *make_cid_ctx(std::string path, Operation op, Command cmd, Destructor dtor)
-{
-    return new GetCidCtx<Command, Operation, Destructor>(path, op, cmd, dtor);
-}
-
-template <typename Command, typename Operation, typename Destructor>
-static void handle_collcache_proc(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TYPE /* cbtype */,
-                                  lcb_STATUS /* err */, const void *rb)
-{
-    auto *instance = reinterpret_cast<lcb_INSTANCE *>(pipeline->parent->cqdata);
-    auto *ctx = static_cast<GetCidCtx<Command, Operation, Destructor> *>(pkt->u_rdata.exdata);
-    const auto *resp = (const lcb_RESPGETCID *)rb;
-    uint32_t cid = resp->collection_id;
-    if (resp->ctx.rc == LCB_SUCCESS) {
-        instance->collcache->put(ctx->path_, cid);
-        ctx->cmd_->cid = cid;
-    } else {
-        lcb_log((instance)->settings, "collcache", LCB_LOG_DEBUG, __FILE__, __LINE__,
-                "failed to resolve collection, rc: %s", lcb_strerror_short(resp->ctx.rc));
-    }
-    ctx->op_(resp, ctx->cmd_);
-    delete ctx;
-}
+lcb_STATUS collcache_send_getcid(lcb_INSTANCE *instance, const lcb_KEYBUF *key, std::string spec, uint32_t timeout_us,
+                                 lcb::CollectionLookups::Waiter waiter);
 
-template <typename Command, typename Operation, typename Destructor>
-static void handle_collcache_schedfail(mc_PACKET *pkt)
-{
-    delete static_cast<GetCidCtx<Command, Operation, Destructor> *>(pkt->u_rdata.exdata);
-}
-
-template <typename Command, typename Operation, typename Destructor>
-mc_REQDATAPROCS GetCidCtx<Command, Operation, Destructor>::proctable = {
-    handle_collcache_proc<Command, Operation, Destructor>, handle_collcache_schedfail<Command, Operation, Destructor>};
+/**
+ * Schedules the warmup of the collection cache with the manifest of the bucket,
+ * so that the commands issued after connecting do not have to resolve their
+ * collections one by one.
+ */
+void collcache_prefetch(lcb_INSTANCE *instance);
 
 template <typename Command, typename Operation, typename Duplicator, typename Destructor>
 lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, Command cmd, Operation op, Duplicator dup, Destructor dtor)
 {
-    using MutableCommand = typename std::remove_const<typename std::remove_pointer<Command>::type>::type *;
+    using MutableCommand = typename std::remove_const<typename std::remove_pointer<Command>::type>::type;
 
     if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET) {
         return LCB_ERR_UNSUPPORTED_OPERATION;
@@ -122,47 +223,37 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, Command cmd, Operation op,
     if (!LCBT_SETTING(instance, use_collections)) {
         return LCB_ERR_UNSUPPORTED_OPERATION;
     }
-
-    std::string spec = collcache_build_spec(cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection);
-
-    mc_CMDQUEUE *cq = &instance->cmdq;
-    if (cq->config == nullptr) {
+    if (instance->cmdq.config == nullptr) {
         return LCB_ERR_NO_CONFIGURATION;
     }
 
-    int vbid, idx;
-    mcreq_map_key(cq, &cmd->key, MCREQ_PKT_BASESIZE, &vbid, &idx);
-    if (idx < 0) {
-        return LCB_ERR_NO_MATCHING_SERVER;
-    }
-    mc_PIPELINE *pl = cq->pipelines[idx];
-    mc_PACKET *pkt = mcreq_allocate_packet(pl);
-    if (!pkt) {
-        return LCB_ERR_NO_MEMORY;
+    std::string spec = collcache_build_spec(cmd->scope, cmd->nscope, cmd->collection, cmd->ncollection);
+    lcb_STATUS unknown = instance->collcache->get_unknown(spec);
+    if (unknown != LCB_SUCCESS) {
+        return unknown;
     }
-    mcreq_reserve_header(pl, pkt, MCREQ_PKT_BASESIZE);
-    pkt->flags |= MCREQ_F_NOCID;
-    protocol_binary_request_header hdr{};
-    hdr.request.magic = PROTOCOL_BINARY_REQ;
-    hdr.request.opcode = PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID;
-    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.opaque = pkt->opaque;
-    hdr.request.keylen = 0;
-    hdr.request.bodylen = htonl(spec.size());
-    mcreq_write_hdr(pkt, &hdr);
-    mcreq_reserve_value2(pl, pkt, spec.size());
-    memcpy(SPAN_BUFFER(&pkt->u_value.single), spec.data(), spec.size());
-
-    MutableCommand clone{};
+
+    MutableCommand *clone{};
     dup(cmd, &clone);
-    pkt->u_rdata.exdata = make_cid_ctx(spec, op, clone, dtor);
-    pkt->u_rdata.exdata->start = gethrtime();
-    pkt->u_rdata.exdata->deadline =
-        pkt->u_rdata.exdata->start + LCB_US2NS(cmd->timeout ? cmd->timeout : LCBT_SETTING(instance, operation_timeout));
-    pkt->flags |= MCREQ_F_REQEXT;
-
-    LCB_SCHED_ADD(instance, pl, pkt)
-    return LCB_SUCCESS;
+    std::shared_ptr<MutableCommand> operation(clone, dtor);
+    lcb::CollectionLookups::Waiter waiter = [op, operation](lcb_STATUS, const lcb_RESPGETCID *resp) {
+        if (resp == nullptr) {
+            /* the lookup could not be scheduled, which fails every command waiting for it */
+            lcb_RESPGETCID failed{};
+            failed.ctx.rc = LCB_ERR_SHEDULE_FAILURE;
+            op(&failed, operation.get());
+            return;
+        }
+        if (resp->ctx.rc == LCB_SUCCESS) {
+            operation->cid = resp->collection_id;
+        }
+        op(resp, operation.get());
+    };
+
+    if (instance->colllookups->join(spec, waiter)) {
+        return LCB_SUCCESS;
+    }
+    return collcache_send_getcid(instance, &cmd->key, std::move(spec), cmd->timeout, std::move(waiter));
 }
 
 template <typename Command, typename CommandScheduler>
@@ -174,57 +265,35 @@ lcb_STATUS collcache_resolve(lcb_INSTANCE *instance, std::shared_ptr<Command> cm
     if (!LCBT_SETTING(instance, use_collections)) {
         return LCB_ERR_UNSUPPORTED_OPERATION;
     }
-
-    const std::string &spec = cmd->collection().spec();
-
-    mc_CMDQUEUE *cq = &instance->cmdq;
-    if (cq->config == nullptr) {
+    if (instance->cmdq.config == nullptr) {
         return LCB_ERR_NO_CONFIGURATION;
     }
 
-    int vbid, idx;
-    lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
-    mcreq_map_key(cq, &keybuf, MCREQ_PKT_BASESIZE, &vbid, &idx);
-    if (idx < 0) {
-        return LCB_ERR_NO_MATCHING_SERVER;
+    lcb::CollectionLookups::Waiter waiter = [scheduler, cmd](lcb_STATUS rc, const lcb_RESPGETCID *resp) {
+        if (resp == nullptr) {
+            scheduler(LCB_ERR_SHEDULE_FAILURE, resp, cmd);
+            return;
+        }
+        if (resp->ctx.rc == LCB_SUCCESS) {
+            cmd->collection().collection_id(resp->collection_id);
+        }
+        scheduler(rc, resp, cmd);
+    };
+
+    const std::string &spec = cmd->collection().spec();
+    lcb_STATUS unknown = instance->collcache->get_unknown(spec);
+    if (unknown != LCB_SUCCESS) {
+        /* fail without a round trip, the server reported it recently */
+        return unknown;
     }
-    mc_PIPELINE *pl = cq->pipelines[idx];
-    mc_PACKET *pkt = mcreq_allocate_packet(pl);
-    if (!pkt) {
-        return LCB_ERR_NO_MEMORY;
+    if (instance->colllookups->join(spec, waiter)) {
+        return LCB_SUCCESS;
     }
-    mcreq_reserve_header(pl, pkt, MCREQ_PKT_BASESIZE);
-    pkt->flags |= MCREQ_F_NOCID;
-    protocol_binary_request_header hdr{};
-    hdr.request.magic = PROTOCOL_BINARY_REQ;
-    hdr.request.opcode = PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID;
-    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.opaque = pkt->opaque;
-    hdr.request.keylen = 0;
-    hdr.request.bodylen = htonl(spec.size());
-    mcreq_write_hdr(pkt, &hdr);
-    mcreq_reserve_value2(pl, pkt, spec.size());
-    memcpy(SPAN_BUFFER(&pkt->u_value.single), spec.data(), spec.size());
-
-    pkt->u_rdata.exdata = lcb::make_deferred_command_context<Command, lcb_RESPGETCID>(
-        cmd, [instance, scheduler](lcb_STATUS rc, const lcb_RESPGETCID *resp, std::shared_ptr<Command> operation) {
-            if (resp->ctx.rc == LCB_SUCCESS) {
-                auto &collection = operation->collection();
-                instance->collcache->put(collection.spec(), resp->collection_id);
-                collection.collection_id(resp->collection_id);
-            } else {
-                lcb_log((instance)->settings, "collcache", LCB_LOG_DEBUG, __FILE__, __LINE__,
-                        "failed to resolve collection, rc: %s", lcb_strerror_short(resp->ctx.rc));
-            }
-            scheduler(rc, resp, operation);
-        });
-    pkt->u_rdata.exdata->deadline =
-        pkt->u_rdata.exdata->start +
-        cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
-    pkt->flags |= MCREQ_F_REQEXT;
-
-    LCB_SCHED_ADD(instance, pl, pkt)
-    return LCB_SUCCESS;
+    lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
+    return collcache_send_getcid(
+        instance, &keybuf, spec,
+        LCB_NS2US(cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)))),
+        std::move(waiter));
 }
 
 #else
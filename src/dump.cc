@@ -64,35 +64,41 @@ void lcb_dump(lcb_INSTANCE *instance, FILE *fp, lcb_U32 flags)
 
     fprintf(fp, "=== BEGIN PIPELINE DUMP ===\n");
     for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
-        auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
-        fprintf(fp, "** [%u] SERVER %s:%s\n", ii, server->curhost->host, server->curhost->port);
-        if (server->connctx) {
-            fprintf(fp, "** == BEGIN SOCKET INFO\n");
-            lcbio_ctx_dump(server->connctx, fp);
-            fprintf(fp, "** == END SOCKET INFO\n");
-        } else if (server->connreq) {
-            fprintf(fp, "** == STILL CONNECTING\n");
-        } else {
-            fprintf(fp, "** == NOT CONNECTED\n");
-        }
-        if (flags & LCB_DUMP_BUFINFO) {
-            fprintf(fp, "** == DUMPING NETBUF INFO (For packet network data)\n");
-            netbuf_dump_status(&server->nbmgr, fp);
-            fprintf(fp, "** == DUMPING NETBUF INFO (For packet structures)\n");
-            netbuf_dump_status(&server->reqpool, fp);
-        } else {
-            fprintf(fp, "** == NOT DUMPING NETBUF INFO. LCB_DUMP_BUFINFO not passed\n");
-        }
-        if (flags & LCB_DUMP_PKTINFO) {
-            mcreq_dump_chain(server, fp, nullptr);
-        } else {
-            fprintf(fp, "** == NOT DUMPING PACKETS. LCB_DUMP_PKTINFO not passed\n");
-        }
-        if ((flags & LCB_DUMP_METRICS) && server->metrics) {
-            fprintf(fp, "=== SERVER METRICS ===\n");
-            lcb_metrics_dumpserver(server->metrics, fp);
+        auto *primary = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
+        for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+            lcb::Server *server = primary->connection(jj);
+            fprintf(fp, "** [%u] SERVER %s:%s (connection %u of %u)\n", ii, server->curhost->host,
+                    server->curhost->port, (unsigned)jj + 1, (unsigned)primary->nconnections());
+            if (server->connctx) {
+                fprintf(fp, "** == BEGIN SOCKET INFO\n");
+                lcbio_ctx_dump(server->connctx, fp);
+                fprintf(fp, "** == END SOCKET INFO\n");
+            } else if (server->connreq) {
+                fprintf(fp, "** == STILL CONNECTING\n");
+            } else {
+                fprintf(fp, "** == NOT CONNECTED\n");
+            }
+            if (flags & LCB_DUMP_BUFINFO) {
+                fprintf(fp, "** == DUMPING NETBUF INFO (For packet network data)\n");
+                netbuf_dump_status(&server->nbmgr, fp);
+                fprintf(fp, "** == DUMPING NETBUF INFO (For packet structures)\n");
+                netbuf_dump_status(&server->reqpool, fp);
+            } else {
+                fprintf(fp, "** == NOT DUMPING NETBUF INFO. LCB_DUMP_BUFINFO not passed\n");
+            }
+            if (flags & LCB_DUMP_PKTINFO) {
+                mcreq_dump_chain(server, fp, nullptr);
+            } else {
+                fprintf(fp, "** == NOT DUMPING PACKETS. LCB_DUMP_PKTINFO not passed\n");
+            }
+            /* The metrics are shared by all connections to the server */
+            if ((flags & LCB_DUMP_METRICS) && jj == 0 && server->metrics) {
+                primary->update_connection_metrics();
+                fprintf(fp, "=== SERVER METRICS ===\n");
+                lcb_metrics_dumpserver(server->metrics, fp);
+            }
+            fprintf(fp, "\n\n");
         }
-        fprintf(fp, "\n\n");
     }
     fprintf(fp, "=== END PIPELINE DUMP ===\n");
 
@@ -0,0 +1,88 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_GETFLIGHTS_H
+#define LCB_GETFLIGHTS_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "mc/mcreq.h"
+
+namespace lcb
+{
+/**
+ * Extended data of a GET packet which other GETs for the same key may join
+ * (see LCB_CNTL_GET_SINGLE_FLIGHT). The packet is sent on behalf of the
+ * first command, whose cookie is the one of the packet, and its response is
+ * delivered to the cookies of the commands which joined it afterwards.
+ */
+struct GetFlight : mc_REQDATAEX {
+    lcb_INSTANCE *instance_;
+    std::string key_;
+    std::vector<void *> waiters_{};
+
+    static mc_REQDATAPROCS proctable;
+
+    GetFlight(lcb_INSTANCE *instance, std::string key, void *cookie_, hrtime_t start_)
+        : mc_REQDATAEX(cookie_, proctable, start_), instance_(instance), key_(std::move(key))
+    {
+    }
+};
+
+/**
+ * GETs in flight which may be joined by other GETs for the same key, indexed
+ * by collection ID and key.
+ *
+ * Like the CollectionLookups, this belongs to a single instance, so that the
+ * response is delivered on the thread of the instance which sent the request.
+ */
+class GetFlights
+{
+  public:
+    /** @return the key under which a GET for @p key in collection @p cid is indexed */
+    static std::string make_key(std::uint32_t cid, const std::string &key);
+
+    /**
+     * Waits for the response of the GET which is already in flight for the key.
+     * @return false if there is none, in which case the command must be sent
+     */
+    bool join(const std::string &key, void *cookie);
+
+    /** Registers the packet of a GET which later commands may join */
+    void start(GetFlight *flight);
+
+    /**
+     * Stops accepting new commands for the GET. Called before the response is
+     * delivered, so that commands issued from the callbacks are sent again.
+     */
+    void finish(const GetFlight *flight);
+
+    /** @return number of GETs which may currently be joined */
+    std::size_t size() const
+    {
+        return flights_.size();
+    }
+
+  private:
+    std::unordered_map<std::string, GetFlight *> flights_{};
+};
+} // namespace lcb
+
+#endif /* LCB_GETFLIGHTS_H */
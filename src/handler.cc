@@ -21,6 +21,8 @@
 #include "mc/compress.h"
 #include "trace.h"
 #include "collections.h"
+#include "nearcache.h"
+#include "hedging.h"
 
 #include "capi/cmd_store.hh"
 #include "capi/cmd_get.hh"
@@ -373,15 +375,15 @@ void invoke_callback(const mc_PACKET *pkt, mc_PIPELINE *pipeline, T *resp, lcb_C
 /**
  * Optionally decompress an incoming payload.
  * @param o The instance
- * @param resp The response received
- * @param[out] bytes pointer to the final payload
- * @param[out] nbytes pointer to the size of the final payload
- * @param[out] freeptr pointer to free. This should be initialized to `nullptr`.
- * If temporary dynamic storage is required this will be set to the allocated
- * pointer upon return. Otherwise it will be set to nullptr. In any case it must
+ * @param respkt The response received
+ * @param[in,out] rescmd The response whose value, size and buffer are set
+ * @param[out] inflated segment holding the inflated value. This should be
+ * initialized to `nullptr`. If the value was inflated, it is set to a segment
+ * from lcb_INSTANCE::inflate_pool, which must be released with rdb_seg_unref()
+ * once the callback has returned.
  */
 template <typename T>
-static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, T *rescmd, void **freeptr)
+static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, T *rescmd, rdb_ROPESEG **inflated)
 {
     lcb_U8 dtype = 0;
     if (!respkt->vallen()) {
@@ -395,7 +397,13 @@ static void maybe_decompress(lcb_INSTANCE *o, const MemcachedResponse *respkt, T
     if (respkt->datatype() & PROTOCOL_BINARY_DATATYPE_COMPRESSED) {
         if (LCBT_SETTING(o, compressopts) & LCB_COMPRESS_IN) {
             /* if we inflate, we don't set the flag */
-            mcreq_inflate_value(respkt->value(), respkt->vallen(), &rescmd->value, &rescmd->nvalue, freeptr);
+            if (mcreq_inflate_value_seg(o->inflate_pool, respkt->value(), respkt->vallen(), inflated) == 0) {
+                /* the value is now backed by the segment, which the
+                 * application may retain just like a network buffer */
+                rescmd->value = *inflated ? RDB_SEG_RBUF(*inflated) : "";
+                rescmd->nvalue = *inflated ? (*inflated)->nused : 0;
+                rescmd->bufh = *inflated;
+            }
 
         } else {
             /* user doesn't want inflation. signal it's compressed */
@@ -425,8 +433,14 @@ static void H_get(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *
         }
     }
 
-    void *freeptr = nullptr;
-    maybe_decompress(o, response, &resp, &freeptr);
+    rdb_ROPESEG *inflated = nullptr;
+    maybe_decompress(o, response, &resp, &inflated);
+    if (response->opcode() == PROTOCOL_BINARY_CMD_GET) {
+        if (resp.ctx.rc == LCB_SUCCESS) {
+            nearcache_store(o, request, &resp);
+        }
+        hedge_record(o, pipeline, request, resp.ctx.rc);
+    }
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_GET_END(o, request, response, &resp);
     record_kv_op_latency("get", o, request);
@@ -435,7 +449,9 @@ static void H_get(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *
     } else {
         invoke_callback(request, o, &resp, LCB_CALLBACK_GET);
     }
-    free(freeptr);
+    if (inflated) {
+        rdb_seg_unref(inflated);
+    }
 }
 
 static void H_exists(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
@@ -464,14 +480,18 @@ static void H_exists(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
     lcb::trace::finish_kv_span(pipeline, request, response);
     TRACE_EXISTS_END(root, request, response, &resp);
     record_kv_op_latency("exists", root, request);
-    invoke_callback(request, root, &resp, LCB_CALLBACK_EXISTS);
+    if (request->flags & MCREQ_F_REQEXT) {
+        request->u_rdata.exdata->procs->handler(pipeline, request, LCB_CALLBACK_EXISTS, resp.ctx.rc, &resp);
+    } else {
+        invoke_callback(request, root, &resp, LCB_CALLBACK_EXISTS);
+    }
 }
 
 static void H_getreplica(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse *response, lcb_STATUS immerr)
 {
     lcb_RESPGETREPLICA resp{};
     lcb_INSTANCE *instance = get_instance(pipeline);
-    void *freeptr = nullptr;
+    rdb_ROPESEG *inflated = nullptr;
     mc_REQDATAEX *rd = request->u_rdata.exdata;
 
     init_resp(instance, pipeline, response, request, immerr, &resp);
@@ -488,9 +508,11 @@ static void H_getreplica(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
         }
     }
 
-    maybe_decompress(instance, response, &resp, &freeptr);
+    maybe_decompress(instance, response, &resp, &inflated);
     rd->procs->handler(pipeline, request, LCB_CALLBACK_GETREPLICA, resp.ctx.rc, &resp);
-    free(freeptr);
+    if (inflated) {
+        rdb_seg_unref(inflated);
+    }
 }
 
 static int lcb_sdresult_next(const lcb_RESPSUBDOC *resp, lcb_SDENTRY *ent, size_t *iter);
@@ -536,6 +558,7 @@ static void H_subdoc(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRespons
             break;
 
         default:
+            nearcache_invalidate(o, request);
             handle_mutation_token(o, response, request, &resp.mt);
             resp.rflags |= LCB_RESP_F_EXTDATA;
             cbtype = LCB_CALLBACK_SDMUTATE;
@@ -694,6 +717,7 @@ static void H_delete(mc_PIPELINE *pipeline, mc_PACKET *packet, MemcachedResponse
     resp.rflags |= LCB_RESP_F_EXTDATA | LCB_RESP_F_FINAL;
     init_resp(root, pipeline, response, packet, immerr, &resp);
     handle_error_info(response, resp);
+    nearcache_invalidate(root, packet);
     handle_mutation_token(root, response, packet, &resp.mt);
     lcb::trace::finish_kv_span(pipeline, packet, response);
     TRACE_REMOVE_END(root, packet, response, &resp);
@@ -814,6 +838,7 @@ static void H_store(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedResponse
     uint8_t opcode;
     init_resp(root, pipeline, response, request, immerr, &resp);
     handle_error_info(response, resp);
+    nearcache_invalidate(root, request);
     if (!immerr) {
         opcode = response->opcode();
     } else {
@@ -849,6 +874,7 @@ static void H_arithmetic(mc_PIPELINE *pipeline, mc_PACKET *request, MemcachedRes
     lcb_INSTANCE *root = get_instance(pipeline);
     lcb_RESPCOUNTER resp{};
     init_resp(root, pipeline, response, request, immerr, &resp);
+    nearcache_invalidate(root, request);
 
     if (resp.ctx.rc == LCB_SUCCESS) {
         memcpy(&resp.value, response->value(), sizeof(resp.value));
@@ -1024,7 +1050,11 @@ static void record_metrics(mc_PIPELINE *pipeline, mc_PACKET *req, MemcachedRespo
         MCREQ_PKT_RDATA(req)->dispatch = gethrtime();
     }
     if (instance->kv_timings) {
-        lcb_histogram_record(instance->kv_timings, MCREQ_PKT_RDATA(req)->dispatch - MCREQ_PKT_RDATA(req)->start);
+        hrtime_t latency = MCREQ_PKT_RDATA(req)->dispatch - MCREQ_PKT_RDATA(req)->start;
+        lcb_histogram_record(instance->kv_timings, latency);
+        lcb_histogram_record(
+            instance->kv_priority_timings[(req->flags & MCREQ_F_BULK) ? LCB_PRIORITY_BULK : LCB_PRIORITY_INTERACTIVE],
+            latency);
     }
 }
 
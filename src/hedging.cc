@@ -0,0 +1,245 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "internal.h"
+#include "collections.h"
+#include "hedging.h"
+#include "nodescore.h"
+
+#include "capi/cmd_get.hh"
+#include "capi/cmd_get_replica.hh"
+
+using namespace lcb;
+
+void LatencyWindow::add(hrtime_t latency)
+{
+    samples_[next_] = latency;
+    next_ = (next_ + 1) % capacity;
+    if (count_ < capacity) {
+        count_++;
+    }
+    stale_++;
+}
+
+hrtime_t LatencyWindow::p95()
+{
+    if (count_ < min_samples) {
+        return 0;
+    }
+    /* sorting the window for every GET would cost more than the GET itself */
+    if (p95_ == 0 || stale_ >= min_samples) {
+        hrtime_t sorted[capacity];
+        std::copy(samples_, samples_ + count_, sorted);
+        std::size_t rank = (count_ * 95 + 99) / 100 - 1;
+        std::nth_element(sorted, sorted + rank, sorted + count_);
+        p95_ = sorted[rank];
+        stale_ = 0;
+    }
+    return p95_;
+}
+
+void HedgeBudget::add_request(std::uint32_t percent)
+{
+    credit_ = std::min(credit_ + percent, burst * 100);
+}
+
+bool HedgeBudget::take()
+{
+    if (credit_ < 100) {
+        return false;
+    }
+    credit_ -= 100;
+    return true;
+}
+
+static void hedge_expired(lcbio_TWENTRY *, void *arg);
+
+HedgedGet::HedgedGet(lcb_INSTANCE *instance, std::string key, std::uint32_t cid, int vbid, mc_PIPELINE *pipeline,
+                     void *cookie_)
+    : mc_REQDATAEX(cookie_, proctable, 0), instance_(instance), key_(std::move(key)), cid_(cid), vbid_(vbid),
+      server_(static_cast<Server *>(pipeline)->node()->index)
+{
+    lcbio_twentry_init(&timer_, hedge_expired, this);
+}
+
+namespace lcb
+{
+static void hedge_release(HedgedGet *hedge)
+{
+    if (--hedge->remaining_ == 0) {
+        lcbio_timerwheel_disarm(hedge->instance_->timers, &hedge->timer_);
+        delete hedge;
+    }
+}
+
+/* Whether the response of the active node says nothing about the document,
+ * in which case the replica may still answer instead */
+static bool hedge_inconclusive(lcb_STATUS rc)
+{
+    switch (rc) {
+        case LCB_SUCCESS:
+        case LCB_ERR_DOCUMENT_NOT_FOUND:
+            return false;
+        case LCB_ERR_TIMEOUT:
+        case LCB_ERR_AMBIGUOUS_TIMEOUT:
+        case LCB_ERR_UNAMBIGUOUS_TIMEOUT:
+        case LCB_ERR_REQUEST_CANCELED:
+            return true;
+        default:
+            return LCB_ERROR_IS_NETWORK(rc) || LCB_ERROR_IS_TRANSIENT(rc);
+    }
+}
+
+static void handle_hedge(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE cbtype, lcb_STATUS rc, const void *arg)
+{
+    auto *hedge = static_cast<HedgedGet *>(pkt->u_rdata.exdata);
+    lcb_INSTANCE *instance = hedge->instance_;
+    bool replica = cbtype == LCB_CALLBACK_GETREPLICA;
+    if (!replica) {
+        /* H_get() has finished the span, the replica read must not touch it */
+        hedge->span = nullptr;
+    }
+
+    /* The active node's answer is authoritative, unless it failed to give one.
+     * Failures of the replica read are only delivered once nothing else may
+     * succeed. */
+    bool wait = replica ? rc != LCB_SUCCESS : hedge_inconclusive(rc);
+    if (hedge->done_ || (wait && hedge->remaining_ > 1)) {
+        hedge_release(hedge);
+        return;
+    }
+    hedge->done_ = true;
+    lcbio_timerwheel_disarm(instance->timers, &hedge->timer_);
+
+    lcb_RESPGET resp{};
+    if (replica) {
+        const auto *rresp = static_cast<const lcb_RESPGETREPLICA *>(arg);
+        resp.ctx = rresp->ctx;
+        resp.value = rresp->value;
+        resp.nvalue = rresp->nvalue;
+        resp.bufh = rresp->bufh;
+        resp.datatype = rresp->datatype;
+        resp.itmflags = rresp->itmflags;
+    } else {
+        resp = *static_cast<const lcb_RESPGET *>(arg);
+    }
+    resp.rflags |= LCB_RESP_F_FINAL;
+    std::string collection_path = instance->collcache->id_to_name(hedge->cid_);
+    size_t dot = collection_path.find('.');
+    if (dot != std::string::npos) {
+        resp.ctx.scope = collection_path.substr(0, dot);
+        resp.ctx.collection = collection_path.substr(dot + 1);
+    }
+
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (metrics && replica && rc == LCB_SUCCESS) {
+        metrics->get_hedges_won++;
+    }
+
+    resp.cookie = hedge->cookie;
+    lcb_find_callback(instance, LCB_CALLBACK_GET)(instance, LCB_CALLBACK_GET,
+                                                   reinterpret_cast<const lcb_RESPBASE *>(&resp));
+    hedge_release(hedge);
+}
+
+static void handle_hedge_schedfail(mc_PACKET *pkt)
+{
+    hedge_release(static_cast<HedgedGet *>(pkt->u_rdata.exdata));
+}
+
+mc_REQDATAPROCS HedgedGet::proctable = {handle_hedge, handle_hedge_schedfail};
+} // namespace lcb
+
+static void hedge_expired(lcbio_TWENTRY *, void *arg)
+{
+    auto *hedge = static_cast<HedgedGet *>(arg);
+    lcb_INSTANCE *instance = hedge->instance_;
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    if (cq->config == nullptr) {
+        return;
+    }
+
+    int ix = -1;
+    for (unsigned replica : replicas_by_score(instance, hedge->vbid_)) {
+        int cur = lcbvb_vbreplica(cq->config, hedge->vbid_, replica);
+        if (cur != hedge->server_) {
+            ix = cur;
+            break;
+        }
+    }
+    if (ix < 0 || !instance->hedges->take()) {
+        return;
+    }
+
+    mc_PIPELINE *pl = mcreq_pipeline_stripe(cq->pipelines[ix], hedge->vbid_, PROTOCOL_BINARY_CMD_GET_REPLICA);
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    if (pkt == nullptr) {
+        return;
+    }
+    pkt->u_rdata.exdata = hedge;
+    pkt->flags |= MCREQ_F_REQEXT;
+
+    protocol_binary_request_header req{};
+    req.request.magic = PROTOCOL_BINARY_REQ;
+    req.request.opcode = PROTOCOL_BINARY_CMD_GET_REPLICA;
+    req.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    req.request.vbucket = htons(static_cast<std::uint16_t>(hedge->vbid_));
+
+    lcb_KEYBUF keybuf{LCB_KV_COPY, {hedge->key_.c_str(), hedge->key_.size()}};
+    mcreq_reserve_key(pl, pkt, sizeof(req.bytes), &keybuf, hedge->cid_);
+    size_t nkey = pkt->kh_span.size - MCREQ_PKT_BASESIZE + pkt->extlen;
+    req.request.keylen = htons(static_cast<std::uint16_t>(nkey));
+    req.request.bodylen = htonl(static_cast<std::uint32_t>(nkey));
+    req.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &req);
+
+    hedge->remaining_++;
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (metrics) {
+        metrics->get_hedges_issued++;
+    }
+    LCB_SCHED_ADD(instance, pl, pkt)
+}
+
+hrtime_t hedge_delay(lcb_INSTANCE *instance, mc_PIPELINE *pipeline)
+{
+    if (LCBT_SETTING(instance, get_hedge_delay)) {
+        return LCB_US2NS(LCBT_SETTING(instance, get_hedge_delay));
+    }
+    return static_cast<Server *>(pipeline)->node()->get_latency.p95();
+}
+
+void hedge_arm(lcb_INSTANCE *instance, HedgedGet *hedge, hrtime_t delay)
+{
+    instance->hedges->add_request(LCBT_SETTING(instance, get_hedge_budget));
+    if (hedge->start + delay < hedge->deadline) {
+        lcbio_timerwheel_arm(instance->timers, &hedge->timer_, hedge->start + delay);
+    }
+}
+
+void hedge_record(lcb_INSTANCE *instance, mc_PIPELINE *pipeline, const mc_PACKET *request, lcb_STATUS rc)
+{
+    if (instance == nullptr || LCBT_SETTING(instance, get_hedge_budget) == 0 ||
+        (rc != LCB_SUCCESS && rc != LCB_ERR_DOCUMENT_NOT_FOUND)) {
+        return;
+    }
+    hrtime_t now = gethrtime();
+    hrtime_t start = MCREQ_PKT_RDATA(request)->start;
+    static_cast<Server *>(pipeline)->node()->get_latency.add(now > start ? now - start : 0);
+}
@@ -0,0 +1,118 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_HEDGING_H
+#define LCB_HEDGING_H
+
+#include <cstdint>
+#include <string>
+
+#include <lcbio/timerwheel.h>
+#include "mc/mcreq.h"
+
+namespace lcb
+{
+/**
+ * Latencies of the last GETs answered by a node. Their 95th percentile is
+ * the delay after which a GET to the node is hedged, unless
+ * LCB_CNTL_GET_HEDGE_DELAY is set.
+ */
+class LatencyWindow
+{
+  public:
+    static const std::size_t capacity = 64;
+    /** Percentiles are not estimated from fewer samples than this */
+    static const std::size_t min_samples = 16;
+
+    void add(hrtime_t latency);
+
+    /** @return the 95th percentile of the recent latencies, or 0 if there are too few of them */
+    hrtime_t p95();
+
+  private:
+    hrtime_t samples_[capacity]{};
+    std::size_t count_{0};
+    std::size_t next_{0};
+    /** Number of samples added since p95_ was computed */
+    std::size_t stale_{0};
+    hrtime_t p95_{0};
+};
+
+/**
+ * Limits hedged GETs to a percentage of the GETs which may be hedged (see
+ * LCB_CNTL_GET_HEDGE_BUDGET). Every GET earns that percentage of a hedge, and
+ * every hedge spends a whole one. Unused credit accumulates up to `burst`
+ * hedges, so that a short stall of a node can be hedged entirely.
+ */
+class HedgeBudget
+{
+  public:
+    static const std::uint32_t burst = 10;
+
+    /** Accounts a GET which may be hedged, with a budget of @p percent */
+    void add_request(std::uint32_t percent);
+
+    /** @return whether a hedge may be sent, in which case it is charged */
+    bool take();
+
+  private:
+    /** In hundredths of a hedge */
+    std::uint32_t credit_{0};
+};
+
+/**
+ * Extended data of a GET which is sent again to a replica if it is not
+ * answered within the hedging delay. It is shared by both packets. The first
+ * successful response, or a definitive one of the active node (e.g. the
+ * document was not found), is delivered; otherwise the last failed one.
+ */
+struct HedgedGet : mc_REQDATAEX {
+    lcb_INSTANCE *instance_;
+    std::string key_;
+    std::uint32_t cid_;
+    int vbid_;
+    /** Index of the server which the GET was sent to */
+    int server_;
+    lcbio_TWENTRY timer_{};
+    /** Number of packets which were not answered yet */
+    unsigned remaining_{1};
+    bool done_{false};
+
+    static mc_REQDATAPROCS proctable;
+
+    /** @param pipeline the pipeline which the GET is sent on */
+    HedgedGet(lcb_INSTANCE *instance, std::string key, std::uint32_t cid, int vbid, mc_PIPELINE *pipeline,
+              void *cookie_);
+};
+} // namespace lcb
+
+/**
+ * @return the time after which a GET sent to @p pipeline is hedged, or 0 if
+ * it is not known yet
+ */
+hrtime_t hedge_delay(lcb_INSTANCE *instance, mc_PIPELINE *pipeline);
+
+/**
+ * Arms the timer of a hedged GET, once its start time and deadline are set.
+ * @param delay the value returned by hedge_delay()
+ */
+void hedge_arm(lcb_INSTANCE *instance, lcb::HedgedGet *hedge, hrtime_t delay);
+
+/** Accounts the latency of a GET answered by the server of @p pipeline */
+void hedge_record(lcb_INSTANCE *instance, mc_PIPELINE *pipeline, const mc_PACKET *request, lcb_STATUS rc);
+
+#endif /* LCB_HEDGING_H */
@@ -22,6 +22,7 @@
 #include <lcbio/lcbio.h>
 #include <lcbio/timer-ng.h>
 #include <lcbio/timer-cxx.h>
+#include <lcbio/timerwheel.h>
 #include <lcbht/lcbht.h>
 #include "contrib/http_parser/http_parser.h"
 #include "http.h"
@@ -328,7 +329,7 @@ struct Request {
     // IO variables
     lcbio_pTABLE io;
     lcbio_pCTX ioctx;
-    lcbio_pTIMER timer;
+    lcbio_TWENTRY timer;
     lcb::io::ConnectionRequest *creq{};
 
     /** HTTP Protocol parser */
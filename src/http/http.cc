@@ -339,7 +339,7 @@ void Request::finish(lcb_STATUS error)
     }
 
     /* Cancel the timeout */
-    lcbio_timer_disarm(timer);
+    lcbio_timerwheel_disarm(instance->timers, &timer);
 
     /* Remove the initial refcount=1 (set from lcb_http3). Typically this will
      * also free the request (though this is dependent on pending I/O operations) */
@@ -726,7 +726,7 @@ Request::Request(lcb_INSTANCE *instance_, const void *cookie, const lcb_CMDHTTP
     : instance(instance_), body(cmd->body, cmd->body + cmd->nbody), method(cmd->method),
       chunked(cmd->cmdflags & LCB_CMDHTTP_F_STREAM), paused(false), command_cookie(cookie), refcount(1), redircount(0),
       span(nullptr), passed_data(false), last_vbcrev(-1), reqtype(cmd->type), status(ONGOING),
-      callback(lcb_find_callback(instance, LCB_CALLBACK_HTTP)), io(instance->iotable), ioctx(nullptr), timer(nullptr),
+      callback(lcb_find_callback(instance, LCB_CALLBACK_HTTP)), io(instance->iotable), ioctx(nullptr), timer(),
       parser(nullptr), user_timeout(cmd->cmdflags & LCB_CMDHTTP_F_CASTMO ? cmd->cas : 0)
 {
     for (const auto &pair : cmd->headers_) {
@@ -740,9 +740,10 @@ Request::~Request()
 
     delete parser;
 
-    if (timer) {
-        lcbio_timer_destroy(timer);
-        timer = nullptr;
+    /* finish() disarms the timer, so the instance is only touched while it
+     * is still alive */
+    if (lcbio_twentry_armed(&timer)) {
+        lcbio_timerwheel_disarm(instance->timers, &timer);
     }
 }
 
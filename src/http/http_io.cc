@@ -130,7 +130,7 @@ static void io_read(lcbio_CTX *ctx, unsigned nr)
     req->incref();
 
     /** Delay the timer */
-    lcbio_timer_rearm(req->timer, req->timeout());
+    lcbio_timerwheel_arm(instance->timers, &req->timer, gethrtime() + LCB_US2NS(req->timeout()));
 
     LCBIO_CTX_ITERFOR(ctx, &iter, nr)
     {
@@ -228,7 +228,7 @@ static void io_error(lcbio_CTX *ctx, lcb_STATUS err)
     req->finish_or_retry(err);
 }
 
-static void request_timed_out(void *arg)
+static void request_timed_out(lcbio_TWENTRY *, void *arg)
 {
     (reinterpret_cast<Request *>(arg))->finish(LCB_ERR_TIMEOUT);
 }
@@ -274,12 +274,9 @@ lcb_STATUS Request::start_io(lcb_host_t &dest)
         return LCB_ERR_CONNECT_ERROR;
     }
 
-    if (!timer) {
-        timer = lcbio_timer_new(io, this, request_timed_out);
-    }
-
-    if (!lcbio_timer_armed(timer)) {
-        lcbio_timer_rearm(timer, timeout());
+    if (!lcbio_twentry_armed(&timer)) {
+        lcbio_twentry_init(&timer, request_timed_out, this);
+        lcbio_timerwheel_arm(instance->timers, &timer, gethrtime() + LCB_US2NS(timeout()));
     }
 
     return LCB_SUCCESS;
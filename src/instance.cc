@@ -16,6 +16,11 @@
  */
 #include "internal.h"
 #include "collections.h"
+#include "mc/compresspolicy.h"
+#include "getflights.h"
+#include "nearcache.h"
+#include "hedging.h"
+#include "rtgroup.h"
 #include "auth-priv.h"
 #include "connspec.h"
 #include "logging.h"
@@ -413,6 +418,21 @@ static lcb_STATUS apply_env_options(lcb_INSTANCE *obj)
     return apply_spec_options(obj, tmpspec);
 }
 
+static void cmdq_congestion(mc_CMDQUEUE *cq, mc_PIPELINE *pipeline, int congested)
+{
+    auto *instance = reinterpret_cast<lcb_INSTANCE *>(cq->cqdata);
+    if (instance == nullptr || instance->destroying) {
+        return;
+    }
+    lcb_log(LOGARGS(instance, DEBUG), "Queue of %s %d %s (%u commands, %llu bytes)", pipeline ? "server" : "instance",
+            pipeline ? pipeline->index : -1, congested ? "congested" : "drained",
+            pipeline ? pipeline->npackets_pending : cq->npackets_pending,
+            (unsigned long long)(pipeline ? pipeline->nbytes_pending : cq->nbytes_pending));
+    if (instance->callbacks.congestion) {
+        instance->callbacks.congestion(instance, pipeline ? pipeline->index : -1, congested);
+    }
+}
+
 lcb_STATUS lcb_reinit(lcb_INSTANCE *obj, const char *connstr)
 {
     Connspec params;
@@ -553,6 +573,7 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     }
 
     obj->cmdq.cqdata = obj;
+    obj->cmdq.congestion_callback = cmdq_congestion;
     obj->iotable = lcbio_table_new(io_priv);
     obj->memd_sockpool = new io::Pool(settings, obj->iotable);
     obj->http_sockpool = new io::Pool(settings, obj->iotable);
@@ -569,11 +590,18 @@ lcb_STATUS lcb_create(lcb_INSTANCE **instance, const lcb_CREATEOPTS *options)
     obj->confmon = new clconfig::Confmon(settings, obj->iotable, obj);
     obj->ht_nodes = new Hostlist();
     obj->mc_nodes = new Hostlist();
-    obj->retryq = new RetryQueue(&obj->cmdq, obj->iotable, obj->settings);
+    obj->timers = lcbio_timerwheel_new(obj->iotable);
+    obj->inflate_pool = rdb_poolalloc_new();
+    obj->retryq = new RetryQueue(&obj->cmdq, obj->timers, obj->settings);
     obj->n1ql_cache = lcb_n1qlcache_create();
     lcb_initialize_packet_handlers(obj);
     lcb_aspend_init(&obj->pendops);
     obj->collcache = new lcb::CollectionCache();
+    obj->compress_policy = new lcb::CompressionPolicy();
+    obj->colllookups = new lcb::CollectionLookups();
+    obj->getflights = new lcb::GetFlights();
+    obj->nearcache = new lcb::NearCache(obj);
+    obj->hedges = new lcb::HedgeBudget();
 
     if ((err = setup_ssl(obj, spec)) != LCB_SUCCESS) {
         goto GT_DONE;
@@ -666,10 +694,12 @@ void lcb_destroy(lcb_INSTANCE *instance)
     lcb_ASPEND_SETTYPE *pendq;
 
     DESTROY(delete, bs_state)
+    DESTROY(lcbio_timer_destroy, flush_timer)
     DESTROY(delete, ht_nodes)
     DESTROY(delete, mc_nodes)
 
     lcb::cancel_deferred_operations(instance);
+    instance->nearcache->cancel();
     delete instance->deferred_operations;
 
     if ((pendq = po->items[LCB_PENDTYPE_DURABILITY])) {
@@ -693,6 +723,7 @@ void lcb_destroy(lcb_INSTANCE *instance)
     }
 
     DESTROY(delete, retryq)
+    DESTROY(lcbio_timerwheel_destroy, timers)
     DESTROY(delete, confmon)
     DESTROY(do_pool_shutdown, memd_sockpool)
     DESTROY(do_pool_shutdown, http_sockpool)
@@ -704,13 +735,26 @@ void lcb_destroy(lcb_INSTANCE *instance)
         for (ii = 0; ii < instance->cmdq.npipelines; ii++) {
             auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
             if (server) {
-                server->instance = nullptr;
-                server->parent = nullptr;
+                for (size_t jj = 0; jj < server->nconnections(); jj++) {
+                    server->connection(jj)->instance = nullptr;
+                    server->connection(jj)->parent = nullptr;
+                }
             }
         }
     }
     mcreq_queue_cleanup(&instance->cmdq);
+    DESTROY(delete, colllookups)
+    DESTROY(delete, getflights)
+    DESTROY(delete, nearcache)
+    DESTROY(delete, hedges)
+    lcb::rtgroup_leave(instance);
     DESTROY(delete, collcache)
+    DESTROY(delete, compress_policy)
+    if (instance->inflate_pool) {
+        /* Buffers retained by the application keep the pool alive */
+        instance->inflate_pool->a_release(instance->inflate_pool);
+        instance->inflate_pool = nullptr;
+    }
     if (instance->cur_configinfo) {
         instance->cur_configinfo->decref();
         instance->cur_configinfo = nullptr;
@@ -748,6 +792,12 @@ void lcb_destroy(lcb_INSTANCE *instance)
     DESTROY(lcbio_table_unref, iotable)
     DESTROY(lcb_settings_unref, settings)
     DESTROY(lcb_histogram_destroy, kv_timings)
+    for (auto &timings : instance->kv_priority_timings) {
+        if (timings != nullptr) {
+            lcb_histogram_destroy(timings);
+            timings = nullptr;
+        }
+    }
     if (instance->scratch) {
         delete instance->scratch;
         instance->scratch = nullptr;
@@ -819,15 +869,19 @@ lcb_STATUS lcb_open(lcb_INSTANCE *instance, const char *bucket, size_t bucket_le
     instance->settings->bucket = (char *)calloc(bucket_len + 1, sizeof(char));
     memcpy(instance->settings->bucket, bucket, bucket_len);
     for (unsigned ii = 0; ii < instance->cmdq.npipelines; ii++) {
-        auto *server = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
-        if (!server->selected_bucket && server->connctx) {
-            lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SELECT_BUCKET);
-            req.opaque(0xcafe);
-            req.sizes(0, bucket_len, 0);
-            lcbio_ctx_put(server->connctx, req.data(), req.size());
-            server->bucket.assign(bucket, bucket_len);
-            lcbio_ctx_put(server->connctx, bucket, bucket_len);
-            server->flush();
+        auto *primary = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
+        /* connections still negotiating select the bucket once they are ready */
+        for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+            lcb::Server *server = primary->connection(jj);
+            if (!server->selected_bucket && server->connctx) {
+                lcb::MemcachedRequest req(PROTOCOL_BINARY_CMD_SELECT_BUCKET);
+                req.opaque(0xcafe);
+                req.sizes(0, bucket_len, 0);
+                lcbio_ctx_put(server->connctx, req.data(), req.size());
+                server->bucket.assign(bucket, bucket_len);
+                lcbio_ctx_put(server->connctx, bucket, bucket_len);
+                server->flush();
+            }
         }
     }
 
@@ -900,9 +954,51 @@ void lcb_sched_enter(lcb_INSTANCE *instance)
 {
     mcreq_sched_enter(&instance->cmdq);
 }
+static void deferred_flush_cb(void *arg)
+{
+    lcb_sched_flush(static_cast<lcb_INSTANCE *>(arg));
+}
+
+/* Write the connections whose commands reached the flush size, and defer
+ * the others for up to the flush delay */
+static void sched_leave_deferred(lcb_INSTANCE *instance)
+{
+    bool deferred = false;
+
+    mcreq_sched_leave(&instance->cmdq, 0);
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        lcb::Server *primary = instance->get_server(ii);
+        for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+            lcb::Server *server = primary->connection(jj);
+            if (server->nbytes_queued == 0) {
+                continue;
+            }
+            if (server->nbytes_queued >= LCBT_SETTING(instance, kv_flush_bytes)) {
+                server->flush_start(server);
+            } else {
+                deferred = true;
+            }
+        }
+    }
+    if (!deferred || (instance->flush_timer && lcbio_timer_armed(instance->flush_timer))) {
+        return;
+    }
+    if (instance->flush_timer == nullptr) {
+        instance->flush_timer = lcbio_timer_new(instance->iotable, instance, deferred_flush_cb);
+    }
+    lcbio_timer_rearm(instance->flush_timer, LCBT_SETTING(instance, kv_flush_delay));
+    if (instance->settings->metrics) {
+        instance->settings->metrics->flushes_deferred++;
+    }
+}
+
 LIBCOUCHBASE_API
 void lcb_sched_leave(lcb_INSTANCE *instance)
 {
+    if (LCBT_SETTING(instance, kv_flush_delay) && LCBT_SETTING(instance, sched_implicit_flush)) {
+        sched_leave_deferred(instance);
+        return;
+    }
     mcreq_sched_leave(&instance->cmdq, LCBT_SETTING(instance, sched_implicit_flush));
 }
 LIBCOUCHBASE_API
@@ -1024,7 +1120,16 @@ lcb_STATUS lcb_enable_timings(lcb_INSTANCE *instance)
         return LCB_ERR_DOCUMENT_EXISTS;
     }
     instance->kv_timings = lcb_histogram_create();
-    return instance->kv_timings == nullptr ? LCB_ERR_NO_MEMORY : LCB_SUCCESS;
+    if (instance->kv_timings == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    for (auto &timings : instance->kv_priority_timings) {
+        if ((timings = lcb_histogram_create()) == nullptr) {
+            lcb_disable_timings(instance);
+            return LCB_ERR_NO_MEMORY;
+        }
+    }
+    return LCB_SUCCESS;
 }
 
 LIBCOUCHBASE_API
@@ -1035,6 +1140,12 @@ lcb_STATUS lcb_disable_timings(lcb_INSTANCE *instance)
     }
     lcb_histogram_destroy(instance->kv_timings);
     instance->kv_timings = nullptr;
+    for (auto &timings : instance->kv_priority_timings) {
+        if (timings != nullptr) {
+            lcb_histogram_destroy(timings);
+            timings = nullptr;
+        }
+    }
     return LCB_SUCCESS;
 }
 
@@ -71,6 +71,12 @@ struct Spechost;
 class RetryQueue;
 class Bootstrap;
 class CollectionCache;
+class CollectionLookups;
+class CompressionPolicy;
+class GetFlights;
+class NearCache;
+class HedgeBudget;
+class RuntimeGroupMember;
 namespace clconfig
 {
 struct Confmon;
@@ -82,8 +88,20 @@ extern "C" {
 
 #ifdef __cplusplus
 typedef lcb::CollectionCache lcb_COLLCACHE;
+typedef lcb::CollectionLookups lcb_COLLLOOKUPS;
+typedef lcb::CompressionPolicy lcb_COMPRESSPOLICY;
+typedef lcb::GetFlights lcb_GETFLIGHTS;
+typedef lcb::NearCache lcb_NEARCACHE;
+typedef lcb::HedgeBudget lcb_HEDGEBUDGET;
+typedef lcb::RuntimeGroupMember lcb_RTGROUPMEMBER;
 #else
 typedef struct lcb_CollectionCache_st lcb_COLLCACHE;
+typedef struct lcb_CollectionLookups_st lcb_COLLLOOKUPS;
+typedef struct lcb_CompressionPolicy_st lcb_COMPRESSPOLICY;
+typedef struct lcb_GetFlights_st lcb_GETFLIGHTS;
+typedef struct lcb_NearCache_st lcb_NEARCACHE;
+typedef struct lcb_HedgeBudget_st lcb_HEDGEBUDGET;
+typedef struct lcb_RuntimeGroupMember_st lcb_RTGROUPMEMBER;
 #endif
 
 struct lcb_callback_st {
@@ -93,6 +111,7 @@ struct lcb_callback_st {
     lcb_pktfwd_callback pktfwd;
     lcb_pktflushed_callback pktflushed;
     lcb_open_callback open;
+    lcb_congestion_callback congestion;
 };
 
 struct lcb_GUESSVB_st;
@@ -122,6 +141,7 @@ struct lcb_st {
     lcb_BOOTSTRAP *bs_state;          /**< Bootstrapping state */
     struct lcb_callback_st callbacks; /**< Callback table */
     lcb_HISTOGRAM *kv_timings;        /**< Histogram object (for timing) */
+    lcb_HISTOGRAM *kv_priority_timings[LCB_PRIORITY__MAX]; /**< Histograms of each priority class */
     lcb_ASPEND pendops;               /**< Pending asynchronous requests */
     int wait;                         /**< Are we in lcb_wait() ?*/
     lcbio_MGR *memd_sockpool;         /**< Connection pool for memcached connections */
@@ -130,13 +150,22 @@ struct lcb_st {
     lcb_settings *settings;           /**< User settings */
     lcbio_pTABLE iotable;             /**< IO Routine table */
     lcb_RETRYQ *retryq;               /**< Retry queue for failed operations */
+    lcbio_TIMERWHEEL *timers;         /**< Deadlines of pending operations */
+    rdb_ALLOCATOR *inflate_pool;      /**< Buffers for decompressed values */
     lcb_pSCRATCHBUF scratch;          /**< Generic buffer space */
     struct lcb_GUESSVB_st *vbguess;   /**< Heuristic masters for vbuckets */
     lcb_QUERY_CACHE *n1ql_cache;
     lcb_MUTATION_TOKEN *dcpinfo; /**< Mapping of known vbucket to {uuid,seqno} info */
     lcbio_pTIMER dtor_timer;     /**< Asynchronous destruction timer */
+    lcbio_pTIMER flush_timer;    /**< Writes the commands whose flush was deferred */
     lcb_BTYPE btype;             /**< Type of the bucket */
     lcb_COLLCACHE *collcache;    /**< Collection cache */
+    lcb_COLLLOOKUPS *colllookups; /**< Collection lookups in flight */
+    lcb_COMPRESSPOLICY *compress_policy; /**< Adaptive compression state */
+    lcb_GETFLIGHTS *getflights;          /**< GETs which other GETs may join */
+    lcb_NEARCACHE *nearcache;            /**< Recently read document values */
+    lcb_HEDGEBUDGET *hedges;             /**< Replica reads which GETs may send */
+    lcb_RTGROUPMEMBER *rtgroup;          /**< Membership in a runtime group, if any */
     int destroying;              /**< Are we in lcb_destroy() ?*/
 
 #ifdef __cplusplus
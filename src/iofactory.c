@@ -24,6 +24,9 @@
 #ifdef LCB_EMBED_PLUGIN_LIBEVENT
 LIBCOUCHBASE_API lcb_STATUS lcb_create_libevent_io_opts(int, lcb_io_opt_t *, void *);
 #endif
+#ifdef LCB_EMBED_PLUGIN_IOURING
+LIBCOUCHBASE_API lcb_STATUS lcb_create_iouring_io_opts(int, lcb_io_opt_t *, void *);
+#endif
 
 typedef lcb_STATUS (*create_func_t)(int version, lcb_io_opt_t *io, void *cookie);
 
@@ -103,6 +106,10 @@ static plugin_info builtin_plugins[] = {BUILTIN_CORE("select", LCB_IO_OPS_SELECT
                                         BUILTIN_DL("libev", LCB_IO_OPS_LIBEV),
                                         BUILTIN_DL("libuv", LCB_IO_OPS_LIBUV),
 
+#ifdef LCB_EMBED_PLUGIN_IOURING
+                                        BUILTIN_CORE("iouring", LCB_IO_OPS_IOURING, lcb_create_iouring_io_opts),
+#endif
+
                                         {NULL, LCB_IO_OPS_INVALID, NULL, NULL, NULL, {0}, {0}}};
 
 /**
@@ -28,11 +28,26 @@ class MetricsEntry : public lcb_SERVERMETRICS
 {
   public:
     std::string m_hostport;
+    std::vector<lcb_SIZE> m_conn_pending;
+    std::vector<lcb_SIZE> m_conn_queued;
     explicit MetricsEntry(std::string key) : lcb_SERVERMETRICS_st(), m_hostport(std::move(key))
     {
         iometrics.hostport = m_hostport.c_str();
     }
 
+    void set_connection(size_t nconns, size_t ix, lcb_SIZE npending, lcb_SIZE nqueued)
+    {
+        if (m_conn_pending.size() != nconns) {
+            m_conn_pending.assign(nconns, 0);
+            m_conn_queued.assign(nconns, 0);
+            nconnections = nconns;
+            connection_packets_pending = m_conn_pending.data();
+            connection_bytes_queued = m_conn_queued.data();
+        }
+        m_conn_pending[ix] = npending;
+        m_conn_queued[ix] = nqueued;
+    }
+
     MetricsEntry() = delete;
     MetricsEntry(const MetricsEntry &) = delete;
 };
@@ -105,6 +120,7 @@ void lcb_metrics_dumpio(const lcb_IOMETRICS *metrics, FILE *fp)
     fprintf(fp, "Bytes received: %lu\n", (unsigned long int)metrics->bytes_received);
     fprintf(fp, "IO Close: %lu\n", (unsigned long int)metrics->io_close);
     fprintf(fp, "IO Error: %lu\n", (unsigned long int)metrics->io_error);
+    fprintf(fp, "Writes: %lu\n", (unsigned long int)metrics->writes);
 }
 
 void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
@@ -117,7 +133,31 @@ void lcb_metrics_dumpserver(const lcb_SERVERMETRICS *metrics, FILE *fp)
     fprintf(fp, "Packets errored: %lu\n", (unsigned long int)metrics->packets_errored);
     fprintf(fp, "Packets NMV: %lu\n", (unsigned long int)metrics->packets_nmv);
     fprintf(fp, "Packets timeout: %lu\n", (unsigned long int)metrics->packets_timeout);
+    fprintf(fp, "Config pushes: %lu\n", (unsigned long int)metrics->packets_config_push);
+    fprintf(fp, "Retries rejected: %lu\n", (unsigned long int)metrics->packets_retry_rejected);
+    fprintf(fp, "Packets throttled: %lu\n", (unsigned long int)metrics->packets_throttled);
     fprintf(fp, "Packets orphaned: %lu", (unsigned long int)metrics->packets_ownerless);
+    for (size_t ii = 0; ii < metrics->nconnections; ii++) {
+        fprintf(fp, "\nConnection %lu: %lu pending, %lu bytes queued", (unsigned long int)ii,
+                (unsigned long int)metrics->connection_packets_pending[ii],
+                (unsigned long int)metrics->connection_bytes_queued[ii]);
+    }
+}
+
+void lcb_metrics_set_connection(lcb_SERVERMETRICS *metrics, size_t nconns, size_t ix, lcb_SIZE npending,
+                                lcb_SIZE nqueued)
+{
+    static_cast<MetricsEntry *>(metrics)->set_connection(nconns, ix, npending, nqueued);
+}
+
+void lcb_metrics_update_packets_per_write(lcb_METRICS *metrics)
+{
+    lcb_SIZE npackets = 0, nwrites = 0;
+    for (size_t ii = 0; ii < metrics->nservers; ii++) {
+        npackets += metrics->servers[ii]->packets_sent;
+        nwrites += metrics->servers[ii]->iometrics.writes;
+    }
+    metrics->packets_per_write = nwrites ? (double)npackets / (double)nwrites : 0;
 }
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics)
@@ -141,11 +141,18 @@ void lcbio_ctx_close_ex(lcbio_CTX *ctx, lcbio_CTXCLOSE_cb cb, void *arg, lcbio_C
             CTX_LOGFMT "Destroying context for SOCK=%016" PRIx64 ". Pending Writes=%d, Entered=%s, Socket Refcount=%d",
             CTX_LOGID(ctx), ctx->sock->id, (int)ctx->npending, (int)ctx->entered ? "true" : "false", oldrc);
 
+    if (ctx->zc_issued != ctx->zc_released) {
+        /* The kernel may still be reading buffers which the owner of the
+         * context is about to release */
+        lcbio_zc_abort(CTX_FD(ctx));
+    }
+
     if (cb) {
         int reusable = ctx->npending == 0 &&      /* no pending events */
                        ctx->err == LCB_SUCCESS && /* no socket errors */
                        ctx->rdwant == 0 &&        /* no expected input */
                        ctx->wwant == 0 &&         /* no expected output */
+                       ctx->zc_issued == ctx->zc_released && /* no pinned output */
                        (ctx->output == nullptr || ctx->output->rb.nbytes == 0);
         cb(ctx->sock, reusable, arg);
     }
@@ -262,12 +269,38 @@ static void send_io_error(lcbio_CTX *ctx, lcbio_IOSTATUS status)
     lcbio_ctx_senderr(ctx, rc);
 }
 
+/* Read the completions of zero-copy sends. Returns nonzero if more sends
+ * were released */
+static int zc_reap(lcbio_CTX *ctx)
+{
+    lcb_U32 released = ctx->zc_released;
+    if (ctx->zc_issued == released) {
+        return 0;
+    }
+    lcbio_zc_reap(CTX_FD(ctx), &released);
+    if (released == ctx->zc_released) {
+        return 0;
+    }
+    ctx->zc_released = released;
+    return ctx->procs.cb_zc_released != nullptr;
+}
+
 static void E_handler(lcb_socket_t sock, short which, void *arg)
 {
     auto *ctx = static_cast<lcbio_CTX *>(arg);
     lcbio_IOSTATUS status;
     (void)sock;
 
+    /* Completions are posted with POLLERR, which is reported as either event */
+    if (ctx->zerocopy && zc_reap(ctx)) {
+        ctx->entered++;
+        ctx->procs.cb_zc_released(ctx, ctx->zc_released);
+        ctx->entered--;
+        if (E_free_detached(ctx)) {
+            return;
+        }
+    }
+
     if (which & LCB_READ_EVENT) {
         unsigned nb;
         status = lcbio_E_rdb_slurp(ctx, &ctx->ior);
@@ -323,6 +356,7 @@ static void Cw_handler(lcb_sockdata_t *sd, int status, void *arg)
 
     ctx->npending--;
     CTX_INCR_METRIC(ctx, bytes_sent, erb->rb.nbytes);
+    CTX_INCR_METRIC(ctx, writes, 1);
 
     if (!ctx->output) {
         ctx->output = erb;
@@ -489,16 +523,27 @@ void lcbio_ctx_schedule(lcbio_CTX *ctx)
 }
 
 /** Extended function used for write-on-callback mode */
-static int E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
+static int E_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb, bool zerocopy)
 {
     lcb_ssize_t nw;
     lcbio_TABLE *iot = ctx->io;
     lcb_socket_t fd = CTX_FD(ctx);
 
 GT_WRITE_AGAIN:
-    nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov, niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
+    if (zerocopy) {
+        int issued = 0;
+        nw = lcbio_zc_sendv(fd, iov, niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE, &issued);
+        if (nw == -1) {
+            IOT_ERRNO(iot) = lcbio_syserrno;
+        } else if (issued) {
+            ctx->zc_issued++;
+        }
+    } else {
+        nw = IOT_V0IO(iot).sendv(IOT_ARG(iot), fd, iov, niov <= RWINL_IOVSIZE ? niov : RWINL_IOVSIZE);
+    }
     if (nw > 0) {
         CTX_INCR_METRIC(ctx, bytes_sent, nw);
+        CTX_INCR_METRIC(ctx, writes, 1);
         ctx->procs.cb_flush_done(ctx, nb, nw);
         return 1;
 
@@ -573,12 +618,30 @@ int lcbio_ctx_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
 {
     lcbio_TABLE *iot = ctx->io;
     if (IOT_IS_EVENT(iot)) {
-        return E_put_ex(ctx, iov, niov, nb);
+        return E_put_ex(ctx, iov, niov, nb, false);
     } else {
         return C_put_ex(ctx, iov, niov, nb);
     }
 }
 
+int lcbio_ctx_zc_enable(lcbio_CTX *ctx)
+{
+    if (!ctx->zerocopy && IOT_IS_EVENT(ctx->io) && !lcbio_ssl_check(ctx->sock)) {
+        ctx->zerocopy = lcbio_zc_enable(CTX_FD(ctx)) == 0;
+        lcb_log(LOGARGS(ctx, DEBUG), CTX_LOGFMT "Zero-copy sends %s", CTX_LOGID(ctx),
+                ctx->zerocopy ? "enabled" : "not supported");
+    }
+    return ctx->zerocopy;
+}
+
+int lcbio_ctx_put_zc(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb)
+{
+    if (ctx->zerocopy) {
+        return E_put_ex(ctx, iov, niov, nb, true);
+    }
+    return lcbio_ctx_put_ex(ctx, iov, niov, nb);
+}
+
 void lcbio_ctx_wwant(lcbio_CTX *ctx)
 {
     if ((IOT_IS_EVENT(ctx->io)) == 0 && ctx->entered == 0) {
@@ -112,6 +112,12 @@ typedef struct {
 
     /** Triggered when data has been flushed from lcbio_ctx_put_ex() */
     void (*cb_flush_done)(lcbio_pCTX, unsigned requested, unsigned nflushed);
+
+    /**
+     * Optional. Triggered when the kernel is done with sends issued by
+     * lcbio_ctx_put_zc(), with the number of such sends which are complete
+     */
+    void (*cb_zc_released)(lcbio_pCTX, lcb_U32 released);
 } lcbio_CTXPROCS;
 
 /**
@@ -149,6 +155,9 @@ typedef struct lcbio_CTX {
     lcbio_pASYNC as_err;   /**< async error handler */
     lcbio_CTXPROCS procs;  /**< callbacks */
     const char *subsys;    /**< Informational description of connection */
+    char zerocopy;         /**< whether lcbio_ctx_put_zc() may send without copying */
+    lcb_U32 zc_issued;     /**< number of zero-copy sends issued */
+    lcb_U32 zc_released;   /**< number of zero-copy sends the kernel is done with */
 } lcbio_CTX;
 
 /**@name Creating and Closing
@@ -309,6 +318,31 @@ void lcbio_ctx_wwant(lcbio_CTX *ctx);
  */
 int lcbio_ctx_put_ex(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb);
 
+/**
+ * @brief Enable zero-copy sends for lcbio_ctx_put_zc()
+ *
+ * This is only possible for plain (non-TLS) connections on Linux, with
+ * event-based I/O plugins.
+ *
+ * @param ctx
+ * @return nonzero if lcbio_ctx_put_zc() may send without copying
+ */
+int lcbio_ctx_zc_enable(lcbio_CTX *ctx);
+
+/**
+ * @brief Flush user buffers without copying them into the kernel
+ *
+ * Like lcbio_ctx_put_ex(), but the kernel may keep referencing the buffers
+ * after lcbio_CTXPROCS#cb_flush_done() is invoked. Each such send increments
+ * lcbio_CTX#zc_issued, and lcbio_CTXPROCS#cb_zc_released() is invoked once
+ * the kernel is done with it. The buffers must remain valid and unmodified
+ * until then, or until the context is closed: this resets the connection
+ * if sends are outstanding, which drops the references.
+ *
+ * If zero-copy sends are not enabled, this is the same as lcbio_ctx_put_ex().
+ */
+int lcbio_ctx_put_zc(lcbio_CTX *ctx, lcb_IOV *iov, unsigned niov, unsigned nb);
+
 /**
  * Require that the read callback not be invoked until at least `n`
  * bytes are available within the buffer.
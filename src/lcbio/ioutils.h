@@ -97,6 +97,37 @@ const char *lcbio_strsockopt(int cntl);
 
 void lcbio__load_socknames(lcbio_SOCKET *sock);
 
+/**@name Zero-copy sends
+ * These operate on the descriptor of an E-model socket, and are only
+ * functional on Linux.
+ *@{*/
+
+/** Enable `MSG_ZEROCOPY` on the socket. Returns 0 on success */
+int lcbio_zc_enable(lcb_socket_t fd);
+
+/**
+ * Send the buffers with `MSG_ZEROCOPY`, falling back to a copying send if
+ * the kernel cannot track the completion.
+ * @param[out] zerocopy set to nonzero if a zero-copy send was issued
+ * @return as for `sendmsg(2)`, with `errno` set on failure
+ */
+lcb_ssize_t lcbio_zc_sendv(lcb_socket_t fd, const lcb_IOV *iov, unsigned niov, int *zerocopy);
+
+/**
+ * Drain the completions from the error queue of the socket.
+ * @param[in,out] released the number of sends known to be complete; raised
+ *        to cover the completions read.
+ * @return the number of completions read
+ */
+int lcbio_zc_reap(lcb_socket_t fd, lcb_U32 *released);
+
+/**
+ * Make the socket reset the connection when it is closed, so that the kernel
+ * drops the data it did not send yet, and with it any pinned pages
+ */
+void lcbio_zc_abort(lcb_socket_t fd);
+/**@}*/
+
 #ifdef _WIN32
 #define lcbio_syserrno GetLastError()
 #else
@@ -128,6 +128,7 @@ static INLINE lcbio_IOSTATUS lcbio_E_rb_write(lcbio_CTX *ctx, ringbuffer_t *buf)
 #endif
             ringbuffer_consumed(buf, nw);
             CTX_INCR_METRIC(ctx, bytes_sent, nw);
+            CTX_INCR_METRIC(ctx, writes, 1);
         }
     }
     return LCBIO_COMPLETED;
@@ -0,0 +1,357 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "connect.h"
+#include "iotable.h"
+#include "timer-ng.h"
+#include "timerwheel.h"
+
+#define TW_TICK_NS LCB_US2NS(LCB_MS2US(1))
+#define TW_LEVELS 4
+#define TW_SLOTBITS 6
+#define TW_NSLOTS (1u << TW_SLOTBITS)
+#define TW_SLOTMASK (TW_NSLOTS - 1)
+#define TW_LEVEL_SHIFT(level) ((level)*TW_SLOTBITS)
+/** Number of ticks covered by all levels. Entries beyond that go to the overflow list */
+#define TW_SPAN_SHIFT TW_LEVEL_SHIFT(TW_LEVELS)
+#define TW_NO_TICK UINT64_MAX
+
+struct lcbio_TIMERWHEEL_st {
+    lcb_list_t slots[TW_LEVELS][TW_NSLOTS];
+    lcb_list_t overflow;
+    /** Bitmap of non-empty slots, per level */
+    uint64_t occupied[TW_LEVELS];
+    /** Time corresponding to tick 0 */
+    hrtime_t origin;
+    /** Current tick. All entries due at or before this tick have been fired */
+    uint64_t now;
+    /** Tick for which the timer is armed, or TW_NO_TICK */
+    uint64_t wakeup;
+    uint64_t pass;
+    size_t count;
+    lcbio_TIMER *timer;
+    int entered;
+};
+
+static unsigned tw_lowest_bit(uint64_t v)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(v);
+#else
+    unsigned ix = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        ix++;
+    }
+    return ix;
+#endif
+}
+
+static uint64_t tw_deadline_tick(const lcbio_TIMERWHEEL *wheel, hrtime_t deadline)
+{
+    if (deadline <= wheel->origin) {
+        return 0;
+    }
+    return (deadline - wheel->origin + TW_TICK_NS - 1) / TW_TICK_NS;
+}
+
+static uint64_t tw_current_tick(const lcbio_TIMERWHEEL *wheel, hrtime_t now)
+{
+    if (now <= wheel->origin) {
+        return 0;
+    }
+    return (now - wheel->origin) / TW_TICK_NS;
+}
+
+/**
+ * Place an entry according to its deadline, relative to the current tick.
+ * An entry always goes to the lowest level whose slots span both the current
+ * tick and the expiry tick, so each occupied slot of a level lies strictly
+ * after the slot of the current tick (the only exception being an entry due
+ * at the current tick while cascading, which lands on the level-0 slot about
+ * to be processed).
+ *
+ * @return the tick at which the entry's slot needs attention
+ */
+static uint64_t tw_place(lcbio_TIMERWHEEL *wheel, lcbio_TWENTRY *entry, uint64_t mintick)
+{
+    uint64_t tick = tw_deadline_tick(wheel, entry->deadline);
+    uint64_t diff;
+    if (tick < mintick) {
+        tick = mintick;
+    }
+
+    diff = tick ^ wheel->now;
+    for (unsigned level = 0; level < TW_LEVELS; level++) {
+        unsigned shift = TW_LEVEL_SHIFT(level);
+        if ((diff >> (shift + TW_SLOTBITS)) == 0) {
+            unsigned ix = (unsigned)(tick >> shift) & TW_SLOTMASK;
+            lcb_list_append(&wheel->slots[level][ix], &entry->slot);
+            wheel->occupied[level] |= (uint64_t)1 << ix;
+            return (tick >> shift) << shift;
+        }
+    }
+    lcb_list_append(&wheel->overflow, &entry->slot);
+    return ((wheel->now >> TW_SPAN_SHIFT) + 1) << TW_SPAN_SHIFT;
+}
+
+/** Find the next tick after the current one at which a slot needs attention */
+static uint64_t tw_next_tick(const lcbio_TIMERWHEEL *wheel)
+{
+    uint64_t best = TW_NO_TICK;
+    if (!wheel->count) {
+        return best;
+    }
+
+    for (unsigned level = 0; level < TW_LEVELS; level++) {
+        unsigned shift = TW_LEVEL_SHIFT(level);
+        unsigned cur = (unsigned)(wheel->now >> shift) & TW_SLOTMASK;
+        /* Only slots strictly after the current one. (2 << 63) wraps to 0 */
+        uint64_t mask = wheel->occupied[level] & ~((((uint64_t)2) << cur) - 1);
+        if (mask) {
+            uint64_t base = (wheel->now >> (shift + TW_SLOTBITS)) << (shift + TW_SLOTBITS);
+            uint64_t tick = base | ((uint64_t)tw_lowest_bit(mask) << shift);
+            if (tick < best) {
+                best = tick;
+            }
+        }
+    }
+    if (!LCB_LIST_IS_EMPTY(&wheel->overflow)) {
+        uint64_t tick = ((wheel->now >> TW_SPAN_SHIFT) + 1) << TW_SPAN_SHIFT;
+        if (tick < best) {
+            best = tick;
+        }
+    }
+    return best;
+}
+
+static void tw_schedule(lcbio_TIMERWHEEL *wheel, uint64_t tick)
+{
+    hrtime_t target, now;
+    uint32_t usec = 0;
+
+    if (!wheel->timer) {
+        wheel->wakeup = tick;
+        return;
+    }
+    if (tick == TW_NO_TICK) {
+        lcbio_timer_disarm(wheel->timer);
+        wheel->wakeup = TW_NO_TICK;
+        return;
+    }
+
+    target = wheel->origin + tick * TW_TICK_NS;
+    now = gethrtime();
+    if (target > now) {
+        hrtime_t diff = LCB_NS2US(target - now + LCB_US2NS(1) - 1);
+        usec = diff > UINT32_MAX ? UINT32_MAX : (uint32_t)diff;
+    }
+    lcbio_timer_rearm(wheel->timer, usec);
+    wheel->wakeup = tick;
+}
+
+/** Move all entries of a list to the tail of another one */
+static void tw_splice(lcb_list_t *src, lcb_list_t *dst)
+{
+    if (LCB_LIST_IS_EMPTY(src)) {
+        return;
+    }
+    src->next->prev = dst->prev;
+    dst->prev->next = src->next;
+    src->prev->next = dst;
+    dst->prev = src->prev;
+    lcb_list_init(src);
+}
+
+/** Move all entries of a slot to another list, clearing the slot */
+static void tw_take_slot(lcbio_TIMERWHEEL *wheel, unsigned level, unsigned ix, lcb_list_t *dst)
+{
+    wheel->occupied[level] &= ~((uint64_t)1 << ix);
+    tw_splice(&wheel->slots[level][ix], dst);
+}
+
+static void tw_replace_all(lcbio_TIMERWHEEL *wheel, lcb_list_t *from, uint64_t tick)
+{
+    lcb_list_t *ll;
+    while ((ll = lcb_list_shift(from)) != NULL) {
+        tw_place(wheel, LCB_LIST_ITEM(ll, lcbio_TWENTRY, slot), tick);
+    }
+}
+
+static void tw_timer_cb(void *arg)
+{
+    auto *wheel = static_cast<lcbio_TIMERWHEEL *>(arg);
+    lcbio_timerwheel_run(wheel, gethrtime());
+}
+
+lcbio_TIMERWHEEL *lcbio_timerwheel_new(lcbio_TABLE *iot)
+{
+    auto *wheel = new lcbio_TIMERWHEEL{};
+    for (auto &level : wheel->slots) {
+        for (auto &slot : level) {
+            lcb_list_init(&slot);
+        }
+    }
+    lcb_list_init(&wheel->overflow);
+    wheel->origin = gethrtime();
+    wheel->wakeup = TW_NO_TICK;
+    if (iot) {
+        wheel->timer = lcbio_timer_new(iot, wheel, tw_timer_cb);
+    }
+    return wheel;
+}
+
+static void tw_detach_all(lcb_list_t *list)
+{
+    lcb_list_t *ll;
+    while ((ll = lcb_list_shift(list)) != NULL) {
+        /* lcb_list_shift() leaves the entry unarmed */
+    }
+}
+
+void lcbio_timerwheel_destroy(lcbio_TIMERWHEEL *wheel)
+{
+    if (wheel->timer) {
+        lcbio_timer_destroy(wheel->timer);
+    }
+    for (auto &level : wheel->slots) {
+        for (auto &slot : level) {
+            tw_detach_all(&slot);
+        }
+    }
+    tw_detach_all(&wheel->overflow);
+    delete wheel;
+}
+
+void lcbio_twentry_init(lcbio_TWENTRY *entry, lcbio_TWENTRY_cb callback, void *arg)
+{
+    entry->slot.next = entry->slot.prev = NULL;
+    entry->deadline = 0;
+    entry->callback = callback;
+    entry->arg = arg;
+}
+
+void lcbio_timerwheel_disarm(lcbio_TIMERWHEEL *wheel, lcbio_TWENTRY *entry)
+{
+    lcb_list_t *prev;
+    if (!lcbio_twentry_armed(entry)) {
+        return;
+    }
+
+    prev = entry->slot.prev;
+    lcb_list_delete(&entry->slot);
+    wheel->count--;
+
+    /* If this emptied a slot, clear its bit so we do not wake up for it */
+    if (prev->next == prev && prev >= &wheel->slots[0][0] && prev <= &wheel->slots[TW_LEVELS - 1][TW_NSLOTS - 1]) {
+        size_t pos = (size_t)(prev - &wheel->slots[0][0]);
+        wheel->occupied[pos / TW_NSLOTS] &= ~((uint64_t)1 << (pos % TW_NSLOTS));
+    }
+
+    if (!wheel->count && !wheel->entered) {
+        tw_schedule(wheel, TW_NO_TICK);
+    }
+}
+
+void lcbio_timerwheel_arm(lcbio_TIMERWHEEL *wheel, lcbio_TWENTRY *entry, hrtime_t deadline)
+{
+    uint64_t tick;
+    lcbio_timerwheel_disarm(wheel, entry);
+
+    if (!wheel->count && !wheel->entered) {
+        /* Idle wheel: catch up with the clock so new entries land in low levels */
+        uint64_t cur = tw_current_tick(wheel, gethrtime());
+        if (cur > wheel->now) {
+            wheel->now = cur;
+        }
+    }
+
+    entry->deadline = deadline;
+    tick = tw_place(wheel, entry, wheel->now + 1);
+    wheel->count++;
+
+    if (!wheel->entered && tick < wheel->wakeup) {
+        tw_schedule(wheel, tick);
+    }
+}
+
+unsigned lcbio_timerwheel_run(lcbio_TIMERWHEEL *wheel, hrtime_t now)
+{
+    lcb_list_t expired, cascade;
+    lcb_list_t *ll;
+    uint64_t target = tw_current_tick(wheel, now);
+    unsigned nfired = 0;
+
+    lcb_list_init(&expired);
+    lcb_list_init(&cascade);
+    wheel->pass++;
+    wheel->entered = 1;
+
+    while (wheel->now < target) {
+        uint64_t tick = tw_next_tick(wheel);
+        if (tick > target) {
+            wheel->now = target;
+            break;
+        }
+        wheel->now = tick;
+
+        if ((tick & ((((uint64_t)1) << TW_SPAN_SHIFT) - 1)) == 0) {
+            /* entries still out of range go back to the overflow list */
+            tw_splice(&wheel->overflow, &cascade);
+            tw_replace_all(wheel, &cascade, tick);
+        }
+        for (unsigned level = TW_LEVELS - 1; level > 0; level--) {
+            unsigned shift = TW_LEVEL_SHIFT(level);
+            if ((tick & ((((uint64_t)1) << shift) - 1)) == 0) {
+                tw_take_slot(wheel, level, (unsigned)(tick >> shift) & TW_SLOTMASK, &cascade);
+                tw_replace_all(wheel, &cascade, tick);
+            }
+        }
+        tw_take_slot(wheel, 0, (unsigned)tick & TW_SLOTMASK, &expired);
+    }
+
+    /* Callbacks may arm or disarm any entry, including those in `expired` */
+    while ((ll = lcb_list_shift(&expired)) != NULL) {
+        lcbio_TWENTRY *entry = LCB_LIST_ITEM(ll, lcbio_TWENTRY, slot);
+        wheel->count--;
+        nfired++;
+        entry->callback(entry, entry->arg);
+    }
+
+    wheel->entered = 0;
+    tw_schedule(wheel, tw_next_tick(wheel));
+    return nfired;
+}
+
+hrtime_t lcbio_timerwheel_next(const lcbio_TIMERWHEEL *wheel)
+{
+    uint64_t tick = tw_next_tick(wheel);
+    if (tick == TW_NO_TICK) {
+        return 0;
+    }
+    return wheel->origin + tick * TW_TICK_NS;
+}
+
+size_t lcbio_timerwheel_count(const lcbio_TIMERWHEEL *wheel)
+{
+    return wheel->count;
+}
+
+uint64_t lcbio_timerwheel_pass(const lcbio_TIMERWHEEL *wheel)
+{
+    return wheel->pass;
+}
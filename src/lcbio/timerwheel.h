@@ -0,0 +1,149 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_TIMERWHEEL_H
+#define LCBIO_TIMERWHEEL_H
+
+#include <stddef.h>
+#include "list.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /** __cplusplus */
+
+/**
+ * @file
+ * @brief Hierarchical timer wheel
+ *
+ * @ingroup lcbio
+ * @defgroup lcbio-timerwheel Timer Wheel
+ *
+ * @details
+ *
+ * Every in-flight operation carries a deadline. Giving each of them its own
+ * lcbio_TIMER is too expensive, and keeping per-pipeline lists sorted by
+ * deadline costs O(n) for every scheduled command. The timer wheel keeps the
+ * deadlines of all operations of an instance in hashed slots with a
+ * resolution of one millisecond, so that arming and disarming an entry are
+ * constant time, and is driven by a single lcbio_TIMER which is armed for the
+ * earliest occupied slot.
+ *
+ * The wheel has four levels of 64 slots each, covering about 4.6 hours.
+ * Entries further away are parked in an overflow list which is revisited
+ * whenever the top level wraps around. Entries are never fired before their
+ * deadline, but may be fired up to one tick after it.
+ *
+ * Entries are intrusive: the structure embedding an lcbio_TWENTRY must not be
+ * freed (or the entry re-initialized) while the entry is armed.
+ *
+ * @addtogroup lcbio-timerwheel
+ * @{
+ */
+
+struct lcbio_TABLE;
+typedef struct lcbio_TIMERWHEEL_st lcbio_TIMERWHEEL;
+typedef struct lcbio_TWENTRY_st lcbio_TWENTRY;
+
+/**
+ * @brief Expiry callback
+ * @param entry the entry which expired. It is no longer armed and may be
+ * re-armed or freed from within the callback.
+ * @param arg the argument passed to lcbio_twentry_init()
+ */
+typedef void (*lcbio_TWENTRY_cb)(lcbio_TWENTRY *entry, void *arg);
+
+struct lcbio_TWENTRY_st {
+    lcb_list_t slot;   /**< Link within the wheel slot. `next` is NULL when not armed */
+    hrtime_t deadline; /**< Absolute deadline (see gethrtime()) */
+    lcbio_TWENTRY_cb callback;
+    void *arg;
+};
+
+/**
+ * @brief Create a new timer wheel
+ * @param iot the I/O table used to create the underlying timer. If NULL, the
+ * wheel is not driven automatically and lcbio_timerwheel_run() must be called
+ * explicitly.
+ * @return a new wheel. Destroy with lcbio_timerwheel_destroy()
+ */
+lcbio_TIMERWHEEL *lcbio_timerwheel_new(struct lcbio_TABLE *iot);
+
+/**
+ * @brief Destroy the wheel. Any entries still armed are disarmed without
+ * having their callbacks invoked.
+ */
+void lcbio_timerwheel_destroy(lcbio_TIMERWHEEL *wheel);
+
+/**
+ * @brief Initialize an entry. The entry must not be armed.
+ */
+void lcbio_twentry_init(lcbio_TWENTRY *entry, lcbio_TWENTRY_cb callback, void *arg);
+
+/**
+ * @brief Schedule an entry to expire at a given time.
+ * @param wheel the wheel
+ * @param entry the entry. If already armed it is rescheduled.
+ * @param deadline the absolute time (see gethrtime()). Deadlines in the past
+ * expire on the next tick of the wheel.
+ */
+void lcbio_timerwheel_arm(lcbio_TIMERWHEEL *wheel, lcbio_TWENTRY *entry, hrtime_t deadline);
+
+/**
+ * @brief Cancel an entry. This is a no-op if the entry is not armed.
+ */
+void lcbio_timerwheel_disarm(lcbio_TIMERWHEEL *wheel, lcbio_TWENTRY *entry);
+
+/**
+ * @brief Whether the entry is currently armed
+ */
+#define lcbio_twentry_armed(entry) ((entry)->slot.next != NULL)
+
+/**
+ * @brief Expire all entries whose deadline is at or before `now`.
+ *
+ * This is called from the wheel's own timer; it is only exposed for wheels
+ * created without an I/O table.
+ *
+ * @return the number of entries which were fired
+ */
+unsigned lcbio_timerwheel_run(lcbio_TIMERWHEEL *wheel, hrtime_t now);
+
+/**
+ * @brief Get the time at which the wheel next needs to be run
+ * @return the absolute time, or 0 if nothing is armed
+ */
+hrtime_t lcbio_timerwheel_next(const lcbio_TIMERWHEEL *wheel);
+
+/**
+ * @brief Number of entries currently armed
+ */
+size_t lcbio_timerwheel_count(const lcbio_TIMERWHEEL *wheel);
+
+/**
+ * @brief Get the sequence number of the current (or most recent) run.
+ *
+ * Callbacks may compare this value to coalesce work which should only happen
+ * once per batch of expirations.
+ */
+uint64_t lcbio_timerwheel_pass(const lcbio_TIMERWHEEL *wheel);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif /** __cplusplus */
+#endif /* LCBIO_TIMERWHEEL_H */
@@ -0,0 +1,195 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "connect.h"
+#include "iotable.h"
+#include "wakeup.h"
+
+#include <atomic>
+
+#ifndef _WIN32
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#endif
+
+struct lcbio_WAKEUP {
+    lcbio_pTABLE io{nullptr};
+    void *data{nullptr};
+    lcbio_TIMER_cb callback{nullptr};
+    std::atomic<bool> signalled{false};
+
+    /* Watched descriptors. Both are the same eventfd, or the ends of a pipe */
+    int rfd{-1};
+    int wfd{-1};
+    void *event{nullptr};
+
+    /* Used when the descriptors cannot be watched */
+    lcbio_TIMER *poll_timer{nullptr};
+
+    bool entered{false};
+    bool destroyed{false};
+};
+
+static void close_fds(lcbio_WAKEUP *wakeup)
+{
+#ifndef _WIN32
+    if (wakeup->wfd != -1 && wakeup->wfd != wakeup->rfd) {
+        close(wakeup->wfd);
+    }
+    if (wakeup->rfd != -1) {
+        close(wakeup->rfd);
+    }
+#endif
+    wakeup->rfd = wakeup->wfd = -1;
+}
+
+static void destroy_wakeup(lcbio_WAKEUP *wakeup)
+{
+    if (wakeup->event) {
+        wakeup->io->E_event_cancel(wakeup->rfd, wakeup->event);
+        wakeup->io->E_event_destroy(wakeup->event);
+    }
+    close_fds(wakeup);
+    if (wakeup->poll_timer) {
+        lcbio_timer_destroy(wakeup->poll_timer);
+    }
+    lcbio_table_unref(wakeup->io);
+    delete wakeup;
+}
+
+static void invoke(lcbio_WAKEUP *wakeup)
+{
+    /* Clear the flag first: signals racing with the callback wake it up again */
+    if (!wakeup->signalled.exchange(false)) {
+        return;
+    }
+    wakeup->entered = true;
+    wakeup->callback(wakeup->data);
+    wakeup->entered = false;
+}
+
+static void drain_fd(lcbio_WAKEUP *wakeup)
+{
+#ifndef _WIN32
+    char buf[64];
+    for (;;) {
+        ssize_t rv = read(wakeup->rfd, buf, sizeof buf);
+        if (rv > 0 || (rv == -1 && errno == EINTR)) {
+            continue;
+        }
+        break;
+    }
+#else
+    (void)wakeup;
+#endif
+}
+
+static void event_handler(lcb_socket_t, short, void *arg)
+{
+    auto *wakeup = static_cast<lcbio_WAKEUP *>(arg);
+    drain_fd(wakeup);
+    invoke(wakeup);
+    if (wakeup->destroyed) {
+        destroy_wakeup(wakeup);
+    }
+}
+
+static void poll_handler(void *arg)
+{
+    auto *wakeup = static_cast<lcbio_WAKEUP *>(arg);
+    invoke(wakeup);
+    if (wakeup->destroyed) {
+        destroy_wakeup(wakeup);
+    } else {
+        lcbio_timer_rearm(wakeup->poll_timer, LCBIO_WAKEUP_POLL_INTERVAL);
+    }
+}
+
+static bool open_fds(lcbio_WAKEUP *wakeup)
+{
+#if defined(_WIN32)
+    (void)wakeup;
+    return false;
+#elif defined(__linux__)
+    wakeup->rfd = wakeup->wfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    return wakeup->rfd != -1;
+#else
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+    wakeup->rfd = fds[0];
+    wakeup->wfd = fds[1];
+    for (int fd : fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    return true;
+#endif
+}
+
+lcbio_WAKEUP *lcbio_wakeup_new(lcbio_pTABLE iot, void *data, lcbio_TIMER_cb callback)
+{
+    auto *wakeup = new lcbio_WAKEUP{};
+    wakeup->io = iot;
+    wakeup->data = data;
+    wakeup->callback = callback;
+    lcbio_table_ref(iot);
+
+    if (iot->is_E()) {
+        if (!open_fds(wakeup)) {
+            destroy_wakeup(wakeup);
+            return nullptr;
+        }
+        wakeup->event = iot->E_event_create();
+        iot->E_event_watch(wakeup->rfd, wakeup->event, LCB_READ_EVENT, wakeup, event_handler);
+    } else {
+        wakeup->poll_timer = lcbio_timer_new(iot, wakeup, poll_handler);
+        lcbio_timer_rearm(wakeup->poll_timer, LCBIO_WAKEUP_POLL_INTERVAL);
+    }
+    return wakeup;
+}
+
+void lcbio_wakeup_signal(lcbio_WAKEUP *wakeup)
+{
+    if (wakeup->signalled.exchange(true)) {
+        return;
+    }
+#ifndef _WIN32
+    if (wakeup->wfd != -1) {
+        std::uint64_t one = 1;
+        ssize_t rv;
+        /* eventfd requires an 8 byte counter; a pipe takes anything */
+        do {
+            rv = write(wakeup->wfd, &one, sizeof one);
+        } while (rv == -1 && errno == EINTR);
+    }
+#endif
+}
+
+void lcbio_wakeup_destroy(lcbio_WAKEUP *wakeup)
+{
+    if (wakeup->entered) {
+        wakeup->destroyed = true;
+    } else {
+        destroy_wakeup(wakeup);
+    }
+}
@@ -0,0 +1,85 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCBIO_WAKEUP_H
+#define LCBIO_WAKEUP_H
+
+#include "timer-ng.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /** __cplusplus */
+
+/**
+ * @file
+ * @brief Cross-thread wakeup
+ */
+
+/**
+ * @ingroup lcbio
+ * @defgroup lcbio-wakeup Cross-thread Wakeup
+ *
+ * @details
+ *
+ * Unlike lcbio_async_signal(), which may only be called from the thread
+ * running the event loop, a wakeup may be signalled from any thread. Its
+ * callback is then invoked on the event loop thread, once for any number of
+ * signals received since the previous invocation.
+ *
+ * With event-model I/O plugins this watches an eventfd (or a pipe, where
+ * eventfd is not available). Other plugins cannot watch arbitrary
+ * descriptors, so the wakeup falls back to checking for signals every
+ * LCBIO_WAKEUP_POLL_INTERVAL microseconds.
+ *
+ * @addtogroup lcbio-wakeup
+ * @{
+ */
+
+/** Interval, in microseconds, at which signals are checked when they cannot be watched */
+#define LCBIO_WAKEUP_POLL_INTERVAL 1000
+
+typedef struct lcbio_WAKEUP lcbio_WAKEUP;
+
+/**
+ * @brief Creates a new wakeup object.
+ * @param iot
+ * @param data
+ * @param callback invoked on the event loop thread after the wakeup is signalled
+ * @return A new wakeup, or NULL if the descriptors could not be created.
+ * Destroy with lcbio_wakeup_destroy()
+ */
+lcbio_WAKEUP *lcbio_wakeup_new(lcbio_pTABLE iot, void *data, lcbio_TIMER_cb callback);
+
+/**
+ * @brief Signal the wakeup. This function is thread-safe.
+ * @param wakeup
+ */
+void lcbio_wakeup_signal(lcbio_WAKEUP *wakeup);
+
+/**
+ * @brief Release the wakeup. Must be called from the event loop thread, once
+ * no other thread may signal it.
+ * @param wakeup
+ */
+void lcbio_wakeup_destroy(lcbio_WAKEUP *wakeup);
+
+/**@}*/
+
+#ifdef __cplusplus
+}
+#endif /** __cplusplus */
+#endif /* LCBIO_WAKEUP_H */
@@ -0,0 +1,127 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Socket primitives for `MSG_ZEROCOPY` sends (Linux 4.14+). Pages referenced
+ * by such a send stay pinned until the kernel posts a completion for it on
+ * the socket's error queue. Completions carry the range of send calls they
+ * cover, counting from zero for each socket.
+ */
+
+#include "connect.h"
+#include "ioutils.h"
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define LCB_HAVE_ZEROCOPY 1
+#endif
+#endif
+
+#ifdef LCB_HAVE_ZEROCOPY
+int lcbio_zc_enable(lcb_socket_t fd)
+{
+    int one = 1;
+    return setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one));
+}
+
+lcb_ssize_t lcbio_zc_sendv(lcb_socket_t fd, const lcb_IOV *iov, unsigned niov, int *zerocopy)
+{
+    struct msghdr msg {
+    };
+    ssize_t nw;
+
+    msg.msg_iov = (struct iovec *)iov;
+    msg.msg_iovlen = niov;
+    nw = sendmsg(fd, &msg, MSG_ZEROCOPY | MSG_NOSIGNAL);
+    if (nw == -1 && errno == ENOBUFS) {
+        /* The socket's option memory, from which completions are allocated,
+         * is exhausted. Send a copy instead */
+        *zerocopy = 0;
+        return sendmsg(fd, &msg, MSG_NOSIGNAL);
+    }
+    *zerocopy = nw > 0;
+    return nw;
+}
+
+int lcbio_zc_reap(lcb_socket_t fd, lcb_U32 *released)
+{
+    int nreaped = 0;
+
+    for (;;) {
+        char control[128];
+        struct msghdr msg {
+        };
+        struct cmsghdr *cm;
+
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE) == -1) {
+            break;
+        }
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err serr;
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+            memcpy(&serr, CMSG_DATA(cm), sizeof(serr));
+            if (serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY || serr.ee_errno != 0) {
+                continue;
+            }
+            /* [ee_info, ee_data] is the (inclusive) range of completed sends.
+             * TCP completes them in order */
+            if ((int32_t)(serr.ee_data + 1 - *released) > 0) {
+                *released = serr.ee_data + 1;
+            }
+            nreaped++;
+        }
+    }
+    return nreaped;
+}
+
+void lcbio_zc_abort(lcb_socket_t fd)
+{
+    struct linger lg {
+    };
+    lg.l_onoff = 1;
+    lg.l_linger = 0;
+    setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+}
+#else
+int lcbio_zc_enable(lcb_socket_t)
+{
+    return -1;
+}
+
+lcb_ssize_t lcbio_zc_sendv(lcb_socket_t, const lcb_IOV *, unsigned, int *zerocopy)
+{
+    *zerocopy = 0;
+    return -1;
+}
+
+int lcbio_zc_reap(lcb_socket_t, lcb_U32 *)
+{
+    return 0;
+}
+
+void lcbio_zc_abort(lcb_socket_t) {}
+#endif
@@ -18,6 +18,7 @@
 #include "mcreq.h"
 #include "compress.h"
 
+#include <climits>
 #include <snappy.h>
 #include <snappy-sinksource.h>
 
@@ -84,8 +85,17 @@ class FragBufSource : public snappy::Source
 
 int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
                          int *should_compress)
+{
+    return mcreq_compress_value_ex(pl, pkt, vbuf, settings, should_compress, nullptr);
+}
+
+int mcreq_compress_value_ex(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
+                            int *should_compress, size_t *compressed_size)
 {
     std::size_t origsize = 0;
+    if (compressed_size) {
+        *compressed_size = 0;
+    }
     snappy::Source *source;
     switch (vbuf->vtype) {
         case LCB_KV_COPY:
@@ -130,6 +140,9 @@ int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf
     Compress(source, &sink);
     std::size_t compsize = sink.CurrentDestination() - SPAN_BUFFER(outspan);
     delete source;
+    if (compressed_size) {
+        *compressed_size = compsize;
+    }
 
     if (compsize == 0 || (((float)compsize / origsize) > settings->compress_min_ratio)) {
         netbuf_mblock_release(&pl->nbmgr, outspan);
@@ -167,3 +180,31 @@ int mcreq_inflate_value(const void *compressed, size_t ncompressed, const void *
     *nbytes = compsize;
     return 0;
 }
+
+int mcreq_inflate_value_seg(rdb_ALLOCATOR *allocator, const void *compressed, size_t ncompressed, rdb_ROPESEG **seg)
+{
+    size_t compsize = 0;
+
+    *seg = nullptr;
+    if (!snappy::GetUncompressedLength(static_cast<const char *>(compressed), ncompressed, &compsize) ||
+        compsize > UINT_MAX) {
+        return -1;
+    }
+    if (compsize == 0) {
+        return 0;
+    }
+    rdb_ROPESEG *newseg = allocator->s_alloc(allocator, static_cast<unsigned>(compsize));
+    if (newseg == nullptr) {
+        return -1;
+    }
+    if (!snappy::RawUncompress(static_cast<const char *>(compressed), ncompressed, newseg->root)) {
+        allocator->s_release(allocator, newseg);
+        return -1;
+    }
+    newseg->nused = static_cast<unsigned>(compsize);
+    /* Not part of a rope: the segment lives as long as it is referenced */
+    newseg->shflags &= ~RDB_ROPESEG_F_LIB;
+    rdb_seg_ref(newseg);
+    *seg = newseg;
+    return 0;
+}
@@ -17,6 +17,7 @@
 
 #include "mcreq.h"
 #include "settings.h"
+#include "rdb/rope.h"
 #ifndef LCB_MCCOMPRESS_H
 #define LCB_MCCOMPRESS_H
 
@@ -36,6 +37,15 @@ extern "C" {
 int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
                          int *should_compress);
 
+/**
+ * Like mcreq_compress_value(), but also reports the outcome of the compression
+ * @param compressed_size The pointer, which stores the size of the compressed
+ * value (even if it is not used, because of compress_min_ratio), or zero if
+ * compression was not attempted.
+ */
+int mcreq_compress_value_ex(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf, lcb_settings *settings,
+                            int *should_compress, size_t *compressed_size);
+
 /**
  * Inflate a compressed value
  * @param compressed The value to inflate
@@ -49,6 +59,18 @@ int mcreq_compress_value(mc_PIPELINE *pl, mc_PACKET *pkt, const lcb_VALBUF *vbuf
  */
 int mcreq_inflate_value(const void *compressed, size_t ncompressed, const void **bytes, size_t *nbytes, void **freeptr);
 
+/**
+ * Inflate a compressed value into a segment obtained from an allocator
+ * @param allocator The allocator for the segment
+ * @param compressed The value to inflate
+ * @param ncompressed Size of value to inflate
+ * @param[out] seg The segment containing the inflated value (at
+ * RDB_SEG_RBUF(), `nused` bytes long), or NULL if the value is empty. It
+ * holds a single reference, to be dropped with rdb_seg_unref().
+ * @return 0 if successful, nonzero on error.
+ */
+int mcreq_inflate_value_seg(rdb_ALLOCATOR *allocator, const void *compressed, size_t ncompressed, rdb_ROPESEG **seg);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,80 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "compresspolicy.h"
+#include <algorithm>
+
+using namespace lcb;
+
+const std::uint32_t CompressionPolicy::backoff_min;
+const std::uint32_t CompressionPolicy::backoff_max;
+const std::uint32_t CompressionPolicy::max_ns_per_byte_saved;
+
+/* Weight of the most recent sample in the moving averages */
+static const float sample_weight = 0.25F;
+
+bool CompressionPolicy::should_attempt(std::uint32_t stream)
+{
+    auto it = streams_.find(stream);
+    if (it == streams_.end() || it->second.skip_left == 0) {
+        return true;
+    }
+    it->second.skip_left--;
+    return false;
+}
+
+void CompressionPolicy::record(std::uint32_t stream, std::size_t origsize, std::size_t compsize, hrtime_t elapsed,
+                               float min_ratio)
+{
+    if (origsize == 0) {
+        return;
+    }
+    float ratio = static_cast<float>(compsize) / static_cast<float>(origsize);
+    float ns_per_byte_saved = compsize < origsize ? static_cast<float>(elapsed) / static_cast<float>(origsize - compsize)
+                                                  : static_cast<float>(max_ns_per_byte_saved) + 1;
+
+    auto res = streams_.emplace(stream, Stream{});
+    Stream &st = res.first->second;
+    if (res.second || st.backoff) {
+        /* First sample, or a probe: earlier samples no longer describe the stream */
+        st.ratio = ratio;
+        st.ns_per_byte_saved = ns_per_byte_saved;
+    } else {
+        st.ratio += sample_weight * (ratio - st.ratio);
+        st.ns_per_byte_saved += sample_weight * (ns_per_byte_saved - st.ns_per_byte_saved);
+    }
+
+    if (st.ratio <= min_ratio && st.ns_per_byte_saved <= max_ns_per_byte_saved) {
+        st.backoff = 0;
+        st.skip_left = 0;
+    } else {
+        st.backoff = st.backoff ? std::min(st.backoff * 2, backoff_max) : backoff_min;
+        st.skip_left = st.backoff;
+    }
+}
+
+bool CompressionPolicy::is_skipping(std::uint32_t stream) const
+{
+    auto it = streams_.find(stream);
+    return it != streams_.end() && it->second.skip_left > 0;
+}
+
+float CompressionPolicy::ratio(std::uint32_t stream) const
+{
+    auto it = streams_.find(stream);
+    return it == streams_.end() ? 0 : it->second.ratio;
+}
@@ -0,0 +1,82 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_MCCOMPRESSPOLICY_H
+#define LCB_MCCOMPRESSPOLICY_H
+
+#include "config.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+namespace lcb
+{
+/**
+ * Decides whether outgoing values should be compressed, based on how well
+ * compression worked for earlier values of the same stream (in practice,
+ * of the same collection).
+ *
+ * Each attempt is sampled: the compression ratio and the CPU time spent per
+ * byte saved are smoothed into moving averages. Once a stream stops paying
+ * off, the following values of that stream are sent as they are, and a
+ * single value is compressed again after a number of skipped values, which
+ * doubles each time the probe fails.
+ */
+class CompressionPolicy
+{
+  public:
+    /** Number of values skipped after a stream stops paying off */
+    static const std::uint32_t backoff_min = 16;
+    /** Upper bound for the number of values skipped between two probes */
+    static const std::uint32_t backoff_max = 4096;
+    /** Compression is not worth more than this CPU time for each byte saved */
+    static const std::uint32_t max_ns_per_byte_saved = 100;
+
+    /**
+     * @param stream the stream (collection ID) of the value
+     * @return whether the value should be compressed
+     */
+    bool should_attempt(std::uint32_t stream);
+
+    /**
+     * Records the outcome of an attempt
+     * @param stream the stream of the value
+     * @param origsize size of the value
+     * @param compsize size of the compressed value
+     * @param elapsed time spent compressing the value
+     * @param min_ratio the highest ratio for which compression pays off
+     */
+    void record(std::uint32_t stream, std::size_t origsize, std::size_t compsize, hrtime_t elapsed, float min_ratio);
+
+    /** @return whether values of the stream are currently sent uncompressed */
+    bool is_skipping(std::uint32_t stream) const;
+
+    /** @return the smoothed compression ratio of the stream, or 0 if unknown */
+    float ratio(std::uint32_t stream) const;
+
+  private:
+    struct Stream {
+        float ratio{0};
+        float ns_per_byte_saved{0};
+        std::uint32_t skip_left{0};
+        std::uint32_t backoff{0};
+    };
+    std::unordered_map<std::uint32_t, Stream> streams_;
+};
+} // namespace lcb
+
+#endif
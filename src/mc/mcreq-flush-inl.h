@@ -16,6 +16,7 @@
  */
 
 #include "mcreq.h"
+#include "sllist-inl.h"
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -43,6 +44,21 @@ static unsigned int mcreq_flush_iov_fill(mc_PIPELINE *pipeline, nb_IOV *iov, int
     return netbuf_start_flush(&pipeline->nbmgr, iov, niov, nused);
 }
 
+/**
+ * Like mcreq_flush_iov_fill(), but the IOVs filled in either all belong to
+ * values which may be sent with zero-copy sends, or none of them do
+ * @param pipeline the pipeline to flush
+ * @param iov the iov array to fill
+ * @param niov the number of input items
+ * @param nused set to the number of IOVs actually used
+ * @param zerocopy set to nonzero if the IOVs may be sent without copying
+ * @return the number of data inside all the IOVs
+ */
+static INLINE unsigned int mcreq_flush_iov_fill_ex(mc_PIPELINE *pipeline, nb_IOV *iov, int niov, int *nused, int *zerocopy)
+{
+    return netbuf_start_flush_ex(&pipeline->nbmgr, iov, niov, nused, zerocopy);
+}
+
 static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
 {
     nb_SIZE pktsize;
@@ -59,11 +75,22 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
         return pktsize;
     }
 
-    /** Packet is flushed */
-    pkt->flags |= MCREQ_F_FLUSHED;
+    info->pl->nbytes_queued -= pktsize;
+    if (pkt->flags & MCREQ_F_BULK) {
+        info->pl->bulk_writing = 0;
+    }
 
-    if (pkt->flags & MCREQ_F_INVOKED) {
-        mcreq_packet_done(info->pl, pkt);
+    if ((pkt->flags & MCREQ_F_ZEROCOPY) && info->pl->zc_issued != info->pl->zc_released) {
+        /** The kernel may still be reading the value of the packet */
+        pkt->flags |= MCREQ_F_PINNED;
+        pkt->pin_seq = info->pl->zc_issued;
+        sllist_append(&info->pl->pinned, &pkt->sl_flushq);
+    } else {
+        /** Packet is flushed */
+        pkt->flags |= MCREQ_F_FLUSHED;
+        if (pkt->flags & MCREQ_F_INVOKED) {
+            mcreq_packet_done(info->pl, pkt);
+        }
     }
     if (info->pl->metrics) {
         info->pl->metrics->packets_sent++;
@@ -85,8 +112,12 @@ static nb_SIZE mcreq__pktflush_callback(void *p, nb_SIZE hint, void *arg)
  *
  * This is a thin wrapper around netbuf_end_flush (and optionally
  * nebtuf_reset_flush())
+ *
+ * @return nonzero if a waiting bulk packet was written because the data
+ *         flushed made room for it, in which case the pipeline needs to be
+ *         flushed again
  */
-static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now)
+static int mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned expected, lcb_U64 now)
 {
     if (nflushed) {
         mc__FLUSHINFO info = {pl, now};
@@ -95,12 +126,16 @@ static void mcreq_flush_done_ex(mc_PIPELINE *pl, unsigned nflushed, unsigned exp
     if (nflushed < expected) {
         netbuf_reset_flush(&pl->nbmgr);
     }
+    if (SLLIST_IS_EMPTY(&pl->bulk)) {
+        return 0;
+    }
+    return mcreq_priority_wake(pl) != 0;
 }
 
 /* Mainly for tests */
-static void mcreq_flush_done(mc_PIPELINE *pl, unsigned nflushed, unsigned expected)
+static int mcreq_flush_done(mc_PIPELINE *pl, unsigned nflushed, unsigned expected)
 {
-    mcreq_flush_done_ex(pl, nflushed, expected, 0);
+    return mcreq_flush_done_ex(pl, nflushed, expected, 0);
 }
 
 #ifdef __cplusplus
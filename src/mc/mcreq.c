@@ -215,38 +215,744 @@ lcb_STATUS mcreq_reserve_value(mc_PIPELINE *pipeline, mc_PACKET *packet, const l
     return LCB_SUCCESS;
 }
 
-static int pkt_tmo_compar(sllist_node *a, sllist_node *b)
+static void pipeline_packet_expired(lcbio_TWENTRY *entry, void *arg);
+static void pipeline_write(mc_PIPELINE *pipeline, mc_PACKET *packet);
+static void pipeline_write_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
+
+/* Whether a command operating on a single document reads (0) or modifies (1)
+ * it. Returns -1 for other commands */
+static int opcode_access(uint8_t opcode)
+{
+    switch (opcode) {
+        case PROTOCOL_BINARY_CMD_GET:
+        case PROTOCOL_BINARY_CMD_GETQ:
+        case PROTOCOL_BINARY_CMD_GET_REPLICA:
+        case PROTOCOL_BINARY_CMD_GET_META:
+        case PROTOCOL_BINARY_CMD_SUBDOC_GET:
+        case PROTOCOL_BINARY_CMD_SUBDOC_EXISTS:
+        case PROTOCOL_BINARY_CMD_SUBDOC_GET_COUNT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP:
+            return 0;
+
+        case PROTOCOL_BINARY_CMD_SET:
+        case PROTOCOL_BINARY_CMD_ADD:
+        case PROTOCOL_BINARY_CMD_REPLACE:
+        case PROTOCOL_BINARY_CMD_DELETE:
+        case PROTOCOL_BINARY_CMD_INCREMENT:
+        case PROTOCOL_BINARY_CMD_DECREMENT:
+        case PROTOCOL_BINARY_CMD_APPEND:
+        case PROTOCOL_BINARY_CMD_PREPEND:
+        case PROTOCOL_BINARY_CMD_TOUCH:
+        case PROTOCOL_BINARY_CMD_GAT:
+        case PROTOCOL_BINARY_CMD_GET_LOCKED:
+        case PROTOCOL_BINARY_CMD_UNLOCK_KEY:
+        case PROTOCOL_BINARY_CMD_SUBDOC_DICT_ADD:
+        case PROTOCOL_BINARY_CMD_SUBDOC_DICT_UPSERT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_DELETE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_REPLACE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_LAST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_PUSH_FIRST:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_INSERT:
+        case PROTOCOL_BINARY_CMD_SUBDOC_ARRAY_ADD_UNIQUE:
+        case PROTOCOL_BINARY_CMD_SUBDOC_COUNTER:
+        case PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION:
+            return 1;
+
+        default:
+            return -1;
+    }
+}
+
+static int packet_is_mutation(const mc_PACKET *packet)
+{
+    protocol_binary_request_header hdr;
+    mcreq_read_hdr(packet, &hdr);
+    return opcode_access(hdr.request.opcode) == 1;
+}
+
+/* Register a packet which has just been added to the requests list */
+static void pipeline_track(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mcreq_opqindex_insert(&pipeline->opqindex, packet->opaque, packet);
+    if (packet_is_mutation(packet)) {
+        pipeline->nmutations++;
+    }
+    if (pipeline->timers) {
+        lcbio_twentry_init(&packet->tmo_entry, pipeline_packet_expired, pipeline);
+        lcbio_timerwheel_arm(pipeline->timers, &packet->tmo_entry, MCREQ_PKT_RDATA(packet)->deadline);
+    }
+}
+
+/* Forget a packet which has been removed from the requests list. The packet
+ * must still be valid memory */
+static void pipeline_untrack(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    mcreq_opqindex_remove(&pipeline->opqindex, packet->opaque, packet);
+    if (packet_is_mutation(packet)) {
+        pipeline->nmutations--;
+    }
+    if (pipeline->timers) {
+        lcbio_timerwheel_disarm(pipeline->timers, &packet->tmo_entry);
+    }
+}
+
+/*
+ * Pending packets
+ *
+ * Packets are pending from the time they are scheduled until they leave the
+ * requests list (or are discarded along with a failed scheduling context).
+ * Pipelines, and the queue as a whole, become congested when their pending
+ * packets reach a high watermark, and stay so until they drain to the low
+ * watermarks.
+ */
+static int pending_congested(const lcb_QUEUE_WATERMARKS *wm, uint64_t nbytes, unsigned npackets, int congested)
+{
+    if (!congested) {
+        return (wm->high_bytes && nbytes >= wm->high_bytes) || (wm->high_packets && npackets >= wm->high_packets);
+    }
+    return (wm->high_bytes && nbytes > wm->low_bytes) || (wm->high_packets && npackets > wm->low_packets);
+}
+
+static void pending_check_pipeline(mc_CMDQUEUE *cq, mc_PIPELINE *pipeline)
+{
+    int congested;
+    if (pipeline == cq->fallback) {
+        return;
+    }
+    congested = pending_congested(&cq->pipeline_watermarks, pipeline->nbytes_pending, pipeline->npackets_pending,
+                                  pipeline->congested);
+    if (congested != pipeline->congested) {
+        pipeline->congested = congested;
+        if (cq->congestion_callback) {
+            cq->congestion_callback(cq, pipeline, congested);
+        }
+    }
+}
+
+static void pending_check_queue(mc_CMDQUEUE *cq)
+{
+    int congested = pending_congested(&cq->queue_watermarks, cq->nbytes_pending, cq->npackets_pending, cq->congested);
+    if (congested != cq->congested) {
+        cq->congested = congested;
+        if (cq->congestion_callback) {
+            cq->congestion_callback(cq, NULL, congested);
+        }
+    }
+}
+
+static void pending_add(mc_PIPELINE *pipeline, uint32_t size)
+{
+    mc_CMDQUEUE *cq = pipeline->parent;
+    pipeline->nbytes_pending += size;
+    pipeline->npackets_pending++;
+    if (cq) {
+        cq->nbytes_pending += size;
+        cq->npackets_pending++;
+        pending_check_pipeline(cq, pipeline);
+        pending_check_queue(cq);
+    }
+}
+
+static void pending_remove(mc_PIPELINE *pipeline, uint32_t size)
+{
+    mc_CMDQUEUE *cq = pipeline->parent;
+    lcb_assert(pipeline->npackets_pending > 0 && pipeline->nbytes_pending >= size);
+    pipeline->nbytes_pending -= size;
+    pipeline->npackets_pending--;
+    if (cq) {
+        cq->nbytes_pending -= size;
+        cq->npackets_pending--;
+        pending_check_pipeline(cq, pipeline);
+        pending_check_queue(cq);
+    }
+}
+
+void mcreq_queue_check_congestion(mc_CMDQUEUE *queue)
+{
+    for (unsigned ii = 0; ii < queue->npipelines; ii++) {
+        mc_PIPELINE *pipeline = queue->pipelines[ii];
+        if (pipeline->nsubpipelines) {
+            for (unsigned jj = 0; jj < pipeline->nsubpipelines; jj++) {
+                pending_check_pipeline(queue, pipeline->subpipelines[jj]);
+            }
+        } else {
+            pending_check_pipeline(queue, pipeline);
+        }
+    }
+    pending_check_queue(queue);
+}
+
+static void pipeline_link(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    sllist_root *list = &pipeline->requests;
+    packet->slprev = SLLIST_IS_EMPTY(list) ? &list->first_prev : list->last;
+    sllist_append(list, &packet->slnode);
+}
+
+/* Join the neighbours of a packet being removed from the requests list. This
+ * does not touch the packet itself */
+static void pipeline_unlink_between(mc_PIPELINE *pipeline, sllist_node *prev, sllist_node *next)
+{
+    sllist_root *list = &pipeline->requests;
+
+    prev->next = next;
+    if (next) {
+        SLLIST_ITEM(next, mc_PACKET, slnode)->slprev = prev;
+    } else if (prev == &list->first_prev) {
+        list->last = NULL;
+    } else {
+        list->last = prev;
+    }
+}
+
+/* Responses may arrive in any order, so unlinking is constant time */
+static void pipeline_unlink(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    pipeline_unlink_between(pipeline, packet->slprev, packet->slnode.next);
+    packet->slnode.next = NULL;
+}
+
+/* Packets waiting to be written are linked through sl_flushq. They wait in
+ * one list at a time, and like `requests` may leave it in any order */
+static void waitq_append(sllist_root *list, mc_PACKET *packet)
+{
+    packet->flushq_prev = SLLIST_IS_EMPTY(list) ? &list->first_prev : list->last;
+    sllist_append(list, &packet->sl_flushq);
+}
+
+static void waitq_unlink(sllist_root *list, mc_PACKET *packet)
+{
+    sllist_node *prev = packet->flushq_prev;
+    sllist_node *next = packet->sl_flushq.next;
+
+    prev->next = next;
+    if (next) {
+        SLLIST_ITEM(next, mc_PACKET, sl_flushq)->flushq_prev = prev;
+    } else if (prev == &list->first_prev) {
+        list->last = NULL;
+    } else {
+        list->last = prev;
+    }
+    packet->sl_flushq.next = NULL;
+}
+
+/* Returns the first waiting packet, which is removed from the list */
+static mc_PACKET *waitq_shift(sllist_root *list)
 {
-    mc_PACKET *pa, *pb;
-    hrtime_t tmo_a, tmo_b;
+    mc_PACKET *packet = SLLIST_ITEM(SLLIST_FIRST(list), mc_PACKET, sl_flushq);
+    waitq_unlink(list, packet);
+    return packet;
+}
 
-    pa = SLLIST_ITEM(a, mc_PACKET, slnode);
-    pb = SLLIST_ITEM(b, mc_PACKET, slnode);
+/******************************************************************************
+ * Key ordering. When the server may execute commands out of order, commands
+ * for the same key which conflict with one another are written one after the
+ * other completes.
+ ******************************************************************************/
 
-    tmo_a = MCREQ_PKT_RDATA(pa)->start;
-    tmo_b = MCREQ_PKT_RDATA(pb)->start;
+/* Get the key slot of a packet, or -1 if the command does not operate on a
+ * single document and may be reordered freely */
+static int keyorder_classify(const mc_PACKET *packet, int *is_write)
+{
+    protocol_binary_request_header hdr;
+    const char *key = NULL;
+    size_t nkey = 0;
+    uint32_t hash = 2166136261u;
+
+    mcreq_read_hdr(packet, &hdr);
+    *is_write = opcode_access(hdr.request.opcode);
+    if (*is_write < 0) {
+        return -1;
+    }
 
-    if (tmo_a == tmo_b) {
+    /* The collection prefix is part of the hashed key */
+    mcreq_get_key(NULL, packet, &key, &nkey);
+    if (nkey == 0) {
+        return -1;
+    }
+    for (size_t ii = 0; ii < nkey; ii++) {
+        hash = (hash ^ (uint8_t)key[ii]) * 16777619u;
+    }
+    return (int)(hash % MCREQ_NKEYSLOTS);
+}
+
+static int keyorder_ready(const mc_KEYSLOT *slot, int is_write)
+{
+    if (is_write) {
+        return slot->nread == 0 && slot->nwrite == 0;
+    }
+    return slot->nwrite == 0;
+}
+
+static void keyorder_acquire(mc_PIPELINE *pipeline, mc_PACKET *packet, int ix, int is_write)
+{
+    if (is_write) {
+        pipeline->keyslots[ix].nwrite++;
+    } else {
+        pipeline->keyslots[ix].nread++;
+    }
+    packet->flags |= MCREQ_F_KEYSLOT;
+}
+
+/* Called for a packet which is about to be written. Returns nonzero if the
+ * packet has been held back instead */
+static int keyorder_hold(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    int is_write = 0;
+    int ix = keyorder_classify(packet, &is_write);
+    mc_KEYSLOT *slot;
+
+    if (ix < 0) {
+        return 0;
+    }
+
+    slot = pipeline->keyslots + ix;
+    /* Anything already held for the key goes first */
+    if (slot->nheld == 0 && keyorder_ready(slot, is_write)) {
+        keyorder_acquire(pipeline, packet, ix, is_write);
         return 0;
-    } else if (tmo_a < tmo_b) {
+    }
+    slot->nheld++;
+    packet->flags |= MCREQ_F_HELD;
+    waitq_append(&pipeline->held, packet);
+    return 1;
+}
+
+/* Drop the key ordering state of a packet leaving the requests list. Returns
+ * the slot which may now have held packets ready to be written, or -1 */
+static int keyorder_release(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    int is_write = 0;
+    int ix;
+    mc_KEYSLOT *slot;
+
+    if (!(packet->flags & (MCREQ_F_KEYSLOT | MCREQ_F_HELD))) {
         return -1;
+    }
+
+    ix = keyorder_classify(packet, &is_write);
+    slot = pipeline->keyslots + ix;
+    if (packet->flags & MCREQ_F_HELD) {
+        waitq_unlink(&pipeline->held, packet);
+        slot->nheld--;
+        /* Never written, so nothing in the write queue refers to it and
+         * mcreq_packet_handled() may release it */
+        packet->flags |= MCREQ_F_FLUSHED;
+    } else if (is_write) {
+        slot->nwrite--;
     } else {
-        return 1;
+        slot->nread--;
+    }
+    packet->flags &= ~(MCREQ_F_KEYSLOT | MCREQ_F_HELD);
+    return slot->nheld ? ix : -1;
+}
+
+/* Write the held packets which no longer conflict with commands in flight,
+ * preserving their order for each slot. All slots are considered if `ix` is
+ * negative. */
+static unsigned keyorder_admit(mc_PIPELINE *pipeline, int ix)
+{
+    sllist_iterator iter;
+    unsigned char blocked[MCREQ_NKEYSLOTS / 8] = {0};
+    unsigned nwritten = 0;
+
+    SLLIST_ITERFOR(&pipeline->held, &iter)
+    {
+        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, sl_flushq);
+        int is_write = 0;
+        int cur = keyorder_classify(pkt, &is_write);
+        mc_KEYSLOT *slot = pipeline->keyslots + cur;
+
+        if ((ix >= 0 && cur != ix) || (blocked[cur / 8] & (1u << (cur % 8)))) {
+            continue;
+        }
+        if (!keyorder_ready(slot, is_write)) {
+            if (ix >= 0) {
+                break;
+            }
+            blocked[cur / 8] |= 1u << (cur % 8);
+            continue;
+        }
+
+        sllist_iter_remove(&pipeline->held, &iter);
+        if (iter.next) {
+            SLLIST_ITEM(iter.next, mc_PACKET, sl_flushq)->flushq_prev = iter.prev;
+        }
+        pkt->flags &= ~MCREQ_F_HELD;
+        slot->nheld--;
+        keyorder_acquire(pipeline, pkt, cur, is_write);
+        pipeline_write(pipeline, pkt);
+        nwritten++;
     }
+    return nwritten;
+}
+
+/* Returns the number of packets written, which the caller should flush */
+static unsigned keyorder_wake(mc_PIPELINE *pipeline, int ix)
+{
+    if (ix < 0 && SLLIST_IS_EMPTY(&pipeline->held)) {
+        return 0;
+    }
+    return keyorder_admit(pipeline, ix);
+}
+
+/******************************************************************************
+ * Congestion window. Packets beyond the window are written as responses to
+ * the packets in flight make room for them.
+ ******************************************************************************/
+
+/* Packets in `requests` which are not throttled, including the ones held
+ * back for their key which will be written without a window check */
+static unsigned window_inflight(const mc_PIPELINE *pipeline)
+{
+    return pipeline->opqindex.nused - pipeline->nthrottled;
+}
+
+/* Called for a packet which is about to be written, once it is tracked.
+ * Returns nonzero if the packet has been held back instead */
+static int window_hold(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    /* Anything already throttled goes first */
+    if (SLLIST_IS_EMPTY(&pipeline->throttled) && window_inflight(pipeline) <= pipeline->window) {
+        return 0;
+    }
+    packet->flags |= MCREQ_F_THROTTLED;
+    waitq_append(&pipeline->throttled, packet);
+    pipeline->nthrottled++;
+    MC_INCR_METRIC(pipeline, packets_throttled, 1);
+    return 1;
+}
+
+/* Drop a packet leaving the requests list from the throttled packets */
+static void window_release(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    if (!(packet->flags & MCREQ_F_THROTTLED)) {
+        return;
+    }
+    waitq_unlink(&pipeline->throttled, packet);
+    pipeline->nthrottled--;
+    /* Never written, so nothing in the write queue refers to it */
+    packet->flags &= ~MCREQ_F_THROTTLED;
+    packet->flags |= MCREQ_F_FLUSHED;
+}
+
+/* Write the throttled packets which fit in the window. Returns the number of
+ * packets written, which the caller should flush */
+static unsigned window_wake(mc_PIPELINE *pipeline)
+{
+    unsigned nwritten = 0;
+
+    while (!SLLIST_IS_EMPTY(&pipeline->throttled) &&
+           (pipeline->window == 0 || window_inflight(pipeline) < pipeline->window)) {
+        mc_PACKET *pkt = waitq_shift(&pipeline->throttled);
+        pipeline->nthrottled--;
+        pkt->flags &= ~MCREQ_F_THROTTLED;
+        pipeline_write(pipeline, pkt);
+        nwritten++;
+    }
+    return nwritten;
+}
+
+/* Start flushing packets which were written by one of the wake functions */
+static void pipeline_flush_woken(mc_PIPELINE *pipeline, unsigned nwritten)
+{
+    if (nwritten && pipeline->flush_start) {
+        pipeline->flush_start(pipeline);
+    }
+}
+
+void mcreq_pipeline_flush_woken(mc_PIPELINE *pl)
+{
+    unsigned nwoken = pl->nwoken;
+    pl->nwoken = 0;
+    pipeline_flush_woken(pl, nwoken);
+}
+
+void mcreq_pipeline_set_window(mc_PIPELINE *pl, unsigned max)
+{
+    pl->window = max;
+    pl->window_max = max;
+    pl->window_acks = 0;
+    pipeline_flush_woken(pl, window_wake(pl));
+}
+
+void mcreq_window_grow(mc_PIPELINE *pl)
+{
+    if (pl->window == 0 || pl->window == pl->window_max) {
+        return;
+    }
+    if (++pl->window_acks >= pl->window) {
+        pl->window++;
+        pl->window_acks = 0;
+        /* called while reading responses, see mcreq_pipeline_flush_woken() */
+        pl->nwoken += window_wake(pl);
+    }
+}
+
+void mcreq_window_shrink(mc_PIPELINE *pl, const mc_PACKET *pkt)
+{
+    if (pl->window == 0 || (int32_t)(pkt->opaque - pl->window_recover) < 0) {
+        return;
+    }
+    pl->window = pl->window > 1 ? pl->window / 2 : 1;
+    pl->window_acks = 0;
+    if (pl->parent) {
+        pl->window_recover = pl->parent->seq;
+    }
+}
+
+/******************************************************************************
+ * Priority classes. Bulk packets wait in front of the write queue so that
+ * interactive packets enqueued after them are written first.
+ ******************************************************************************/
+
+/* Whether the next bulk packet may be written */
+static int priority_bulk_turn(const mc_PIPELINE *pipeline)
+{
+    if (pipeline->bulk_writing) {
+        return 0;
+    }
+    return pipeline->nbytes_queued == 0 || pipeline->interactive_run >= pipeline->bulk_weight;
+}
+
+/* Count a packet joining (delta 1) or leaving (delta -1) the waiting packets
+ * in the slot of its key */
+static void priority_account(mc_PIPELINE *pipeline, const mc_PACKET *packet, int delta)
+{
+    int is_write = 0;
+    int ix = keyorder_classify(packet, &is_write);
+    mc_KEYSLOT *slot;
+
+    if (ix < 0 || pipeline->bulkslots == NULL) {
+        return;
+    }
+    slot = pipeline->bulkslots + ix;
+    if (is_write) {
+        slot->nwrite += delta;
+    } else {
+        slot->nread += delta;
+    }
+}
+
+/* Whether a packet conflicts with a waiting packet for the same key, and so
+ * must not be written before it */
+static int priority_conflicts(const mc_PIPELINE *pipeline, const mc_PACKET *packet)
+{
+    int is_write = 0;
+    int ix;
+
+    if (pipeline->nbulk == 0 || pipeline->bulkslots == NULL) {
+        return 0;
+    }
+    ix = keyorder_classify(packet, &is_write);
+    return ix >= 0 && !keyorder_ready(pipeline->bulkslots + ix, is_write);
+}
+
+/* Called for a packet which is about to be written. Returns nonzero if the
+ * packet waits behind interactive packets instead, or (for an interactive
+ * packet) behind a waiting packet for the same key */
+static int priority_defer(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    if (packet->flags & MCREQ_F_BULK) {
+        /* Anything already waiting goes first */
+        if (SLLIST_IS_EMPTY(&pipeline->bulk) && priority_bulk_turn(pipeline)) {
+            return 0;
+        }
+    } else if (!priority_conflicts(pipeline, packet)) {
+        return 0;
+    }
+    packet->flags |= MCREQ_F_BULK_WAITING;
+    waitq_append(&pipeline->bulk, packet);
+    pipeline->nbulk++;
+    priority_account(pipeline, packet, 1);
+    return 1;
+}
+
+/* Drop a packet leaving the requests list from the waiting packets */
+static void priority_release(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    if (!(packet->flags & MCREQ_F_BULK_WAITING)) {
+        return;
+    }
+    waitq_unlink(&pipeline->bulk, packet);
+    pipeline->nbulk--;
+    priority_account(pipeline, packet, -1);
+    /* Never written, so nothing in the write queue refers to it */
+    packet->flags &= ~MCREQ_F_BULK_WAITING;
+    packet->flags |= MCREQ_F_FLUSHED;
+}
+
+/* Write the next waiting bulk packet if its turn has come (along with the
+ * interactive packets which only waited for it), or all of them if packets
+ * are no longer reordered. Returns the number of packets written */
+static unsigned priority_wake(mc_PIPELINE *pipeline)
+{
+    unsigned nwritten = 0;
+
+    while (!SLLIST_IS_EMPTY(&pipeline->bulk)) {
+        mc_PACKET *pkt = SLLIST_ITEM(SLLIST_FIRST(&pipeline->bulk), mc_PACKET, sl_flushq);
+        if ((pkt->flags & MCREQ_F_BULK) && pipeline->bulk_weight != 0 && !priority_bulk_turn(pipeline)) {
+            break;
+        }
+        waitq_unlink(&pipeline->bulk, pkt);
+        pipeline->nbulk--;
+        priority_account(pipeline, pkt, -1);
+        pkt->flags &= ~MCREQ_F_BULK_WAITING;
+        pipeline_write_packet(pipeline, pkt);
+        nwritten++;
+    }
+    return nwritten;
+}
+
+void mcreq_pipeline_set_priority_weight(mc_PIPELINE *pl, unsigned weight)
+{
+    if (weight && pl->bulkslots == NULL) {
+        pl->bulkslots = calloc(MCREQ_NKEYSLOTS, sizeof(*pl->bulkslots));
+        if (pl->bulkslots == NULL) {
+            weight = 0;
+        }
+    }
+    pl->bulk_weight = weight;
+    if (priority_wake(pl) && pl->flush_start) {
+        pl->flush_start(pl);
+    }
+    if (weight == 0) {
+        free(pl->bulkslots);
+        pl->bulkslots = NULL;
+    }
+}
+
+unsigned mcreq_priority_wake(mc_PIPELINE *pl)
+{
+    return priority_wake(pl);
+}
+
+mc_PIPELINE *mcreq_pipeline_stripe(mc_PIPELINE *pl, int vbid, uint8_t opcode)
+{
+    mc_PIPELINE *home, *best;
+
+    if (pl->nsubpipelines < 2) {
+        return pl;
+    }
+
+    home = pl->subpipelines[(unsigned)(vbid < 0 ? 0 : vbid) % pl->nsubpipelines];
+    /* A read must not overtake a mutation of the same document written
+     * before it */
+    if (opcode_access(opcode) != 0 || home->nmutations) {
+        return home;
+    }
+
+    best = home;
+    for (unsigned ii = 0; ii < pl->nsubpipelines; ii++) {
+        if (pl->subpipelines[ii]->nbytes_queued < best->nbytes_queued) {
+            best = pl->subpipelines[ii];
+        }
+    }
+    return best;
+}
+
+void mcreq_pipeline_set_unordered(mc_PIPELINE *pl, int enabled)
+{
+    sllist_node *nn;
+
+    if (!enabled == !pl->keyslots) {
+        return;
+    }
+
+    if (enabled) {
+        pl->keyslots = calloc(MCREQ_NKEYSLOTS, sizeof(*pl->keyslots));
+        /* Everything already in the pipeline counts as being in flight */
+        SLLIST_ITERBASIC(&pl->requests, nn)
+        {
+            mc_PACKET *pkt = SLLIST_ITEM(nn, mc_PACKET, slnode);
+            int is_write = 0;
+            int ix = keyorder_classify(pkt, &is_write);
+            if (ix >= 0) {
+                keyorder_acquire(pl, pkt, ix, is_write);
+            }
+        }
+        return;
+    }
+
+    while (!SLLIST_IS_EMPTY(&pl->held)) {
+        mc_PACKET *pkt = waitq_shift(&pl->held);
+        pkt->flags &= ~MCREQ_F_HELD;
+        /* no longer ordered by key, so like any new packet it must fit in the window */
+        if (pl->window && window_hold(pl, pkt)) {
+            continue;
+        }
+        pipeline_write(pl, pkt);
+    }
+    SLLIST_ITERBASIC(&pl->requests, nn)
+    {
+        SLLIST_ITEM(nn, mc_PACKET, slnode)->flags &= ~MCREQ_F_KEYSLOT;
+    }
+    free(pl->keyslots);
+    pl->keyslots = NULL;
+}
+
+static void pipeline_packet_expired(lcbio_TWENTRY *entry, void *arg)
+{
+    mc_PIPELINE *pipeline = arg;
+    mc_PACKET *packet = (mc_PACKET *)(void *)((char *)entry - offsetof(mc_PACKET, tmo_entry));
+    uint32_t size = mcreq_get_size(packet);
+    int ix;
+
+    pipeline_unlink(pipeline, packet);
+    mcreq_opqindex_remove(&pipeline->opqindex, packet->opaque, packet);
+    if (packet_is_mutation(packet)) {
+        pipeline->nmutations--;
+    }
+    ix = keyorder_release(pipeline, packet);
+    window_release(pipeline, packet);
+    priority_release(pipeline, packet);
+    pipeline->timeout_callback(pipeline, packet);
+    pipeline_flush_woken(pipeline, keyorder_wake(pipeline, ix) + window_wake(pipeline));
+    pending_remove(pipeline, size);
 }
 
 void mcreq_reenqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
-    sllist_root *reqs = &pipeline->requests;
     mcreq_enqueue_packet(pipeline, packet);
-    sllist_remove(reqs, &packet->slnode);
-    sllist_insert_sorted(reqs, &packet->slnode, pkt_tmo_compar);
+}
+
+/* Add a packet, which is already accounted as pending, to the requests list */
+static void pipeline_enqueue(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    pipeline_link(pipeline, packet);
+    pipeline_track(pipeline, packet);
+    if (pipeline->keyslots && keyorder_hold(pipeline, packet)) {
+        return;
+    }
+    if (pipeline->window && window_hold(pipeline, packet)) {
+        return;
+    }
+    pipeline_write(pipeline, packet);
 }
 
 void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    pipeline_enqueue(pipeline, packet);
+    pending_add(pipeline, mcreq_get_size(packet));
+}
+
+/* Queue the packet's buffers for writing, unless it waits for its priority
+ * class. Writing an interactive packet may let a bulk packet through */
+static void pipeline_write(mc_PIPELINE *pipeline, mc_PACKET *packet)
+{
+    if (pipeline->bulk_weight && priority_defer(pipeline, packet)) {
+        return;
+    }
+    pipeline_write_packet(pipeline, packet);
+    if (!SLLIST_IS_EMPTY(&pipeline->bulk)) {
+        priority_wake(pipeline);
+    }
+}
+
+/* Queue the packet's buffers for writing */
+static void pipeline_write_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
 {
     nb_SPAN *vspan = &packet->u_value.single;
-    sllist_append(&pipeline->requests, &packet->slnode);
     netbuf_enqueue_span(&pipeline->nbmgr, &packet->kh_span, packet);
     MC_INCR_METRIC(pipeline, bytes_queued, packet->kh_span.size);
 
@@ -257,18 +963,36 @@ void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
     if (packet->flags & MCREQ_F_VALUE_IOV) {
         lcb_FRAGBUF *multi = &packet->u_value.multi;
         for (unsigned int ii = 0; ii < multi->niov; ii++) {
-            netbuf_enqueue(&pipeline->nbmgr, (nb_IOV *)multi->iov + ii, packet);
+            if (packet->flags & MCREQ_F_ZEROCOPY) {
+                netbuf_enqueue_pinned(&pipeline->nbmgr, (nb_IOV *)multi->iov + ii, packet);
+            } else {
+                netbuf_enqueue(&pipeline->nbmgr, (nb_IOV *)multi->iov + ii, packet);
+            }
             MC_INCR_METRIC(pipeline, bytes_queued, multi->iov[ii].iov_len);
         }
 
     } else if (vspan->size) {
         MC_INCR_METRIC(pipeline, bytes_queued, vspan->size);
-        netbuf_enqueue_span(&pipeline->nbmgr, vspan, packet);
+        if (packet->flags & MCREQ_F_ZEROCOPY) {
+            nb_IOV iov;
+            iov.iov_base = SPAN_BUFFER(vspan);
+            iov.iov_len = vspan->size;
+            netbuf_enqueue_pinned(&pipeline->nbmgr, &iov, packet);
+        } else {
+            netbuf_enqueue_span(&pipeline->nbmgr, vspan, packet);
+        }
     }
 
 GT_ENQUEUE_PDU:
     netbuf_pdu_enqueue(&pipeline->nbmgr, packet, offsetof(mc_PACKET, sl_flushq));
+    pipeline->nbytes_queued += mcreq_get_size(packet);
     MC_INCR_METRIC(pipeline, packets_queued, 1);
+    if (packet->flags & MCREQ_F_BULK) {
+        pipeline->bulk_writing = 1;
+        pipeline->interactive_run = 0;
+    } else {
+        pipeline->interactive_run++;
+    }
 }
 
 void mcreq_wipe_packet(mc_PIPELINE *pipeline, mc_PACKET *packet)
@@ -319,6 +1043,7 @@ mc_PACKET *mcreq_allocate_packet(mc_PIPELINE *pipeline)
     ret->opaque = pipeline->parent->seq++;
     ret->u_rdata.reqdata.span = NULL;
     ret->u_rdata.reqdata.deadline = 0;
+    ret->tmo_entry.slot.next = ret->tmo_entry.slot.prev = NULL;
     return ret;
 }
 
@@ -362,11 +1087,12 @@ mc_PACKET *mcreq_renew_packet(const mc_PACKET *src)
     memcpy(kdata, SPAN_BUFFER(&src->kh_span), src->kh_span.size);
     CREATE_STANDALONE_SPAN(&dst->kh_span, kdata, src->kh_span.size);
 
-    dst->flags &= ~(MCREQ_F_KEY_NOCOPY | MCREQ_F_VALUE_NOCOPY | MCREQ_F_VALUE_IOV);
+    dst->flags &= ~(MCREQ_F_KEY_NOCOPY | MCREQ_F_VALUE_NOCOPY | MCREQ_F_VALUE_IOV | MCREQ_F_ZEROCOPY | MCREQ_F_PINNED);
     dst->flags |= MCREQ_F_DETACHED;
     dst->alloc_parent = NULL;
     dst->sl_flushq.next = NULL;
     dst->slnode.next = NULL;
+    dst->tmo_entry.slot.next = dst->tmo_entry.slot.prev = NULL;
     dst->retries = src->retries;
 
     if (src->flags & MCREQ_F_HASVALUE) {
@@ -515,7 +1241,7 @@ lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_
 
     mcreq_map_key(queue, key, sizeof(*req) + extlen + ffextlen, &vb, &srvix);
     if (srvix > -1 && srvix < (int)queue->npipelines) {
-        *pipeline = queue->pipelines[srvix];
+        *pipeline = mcreq_pipeline_stripe(queue->pipelines[srvix], vb, req->request.opcode);
 
     } else {
         if ((options & MCREQ_BASICPACKET_F_FALLBACKOK) && queue->fallback) {
@@ -524,6 +1250,9 @@ lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_
             return LCB_ERR_NO_MATCHING_SERVER;
         }
     }
+    if (queue->congested || (*pipeline)->congested) {
+        return LCB_ERR_QUEUE_CONGESTED;
+    }
 
     *packet = mcreq_allocate_packet(*pipeline);
     if (*packet == NULL) {
@@ -687,8 +1416,14 @@ uint32_t mcreq_get_size(const mc_PACKET *packet)
 
 void mcreq_pipeline_cleanup(mc_PIPELINE *pipeline)
 {
+    mcreq_pipeline_set_timers(pipeline, NULL, NULL);
+    free(pipeline->keyslots);
+    pipeline->keyslots = NULL;
+    free(pipeline->bulkslots);
+    pipeline->bulkslots = NULL;
     netbuf_cleanup(&pipeline->nbmgr);
     netbuf_cleanup(&pipeline->reqpool);
+    mcreq_opqindex_cleanup(&pipeline->opqindex);
 }
 
 int mcreq_pipeline_init(mc_PIPELINE *pipeline)
@@ -702,6 +1437,34 @@ int mcreq_pipeline_init(mc_PIPELINE *pipeline)
     pipeline->index = 0;
     memset(&pipeline->ctxqueued, 0, sizeof pipeline->ctxqueued);
     pipeline->buf_done_callback = NULL;
+    mcreq_opqindex_init(&pipeline->opqindex);
+    pipeline->timers = NULL;
+    pipeline->timeout_callback = NULL;
+    pipeline->keyslots = NULL;
+    memset(&pipeline->held, 0, sizeof pipeline->held);
+    pipeline->subpipelines = NULL;
+    pipeline->nsubpipelines = 0;
+    pipeline->nbytes_queued = 0;
+    pipeline->nmutations = 0;
+    pipeline->zc_issued = 0;
+    pipeline->zc_released = 0;
+    memset(&pipeline->pinned, 0, sizeof pipeline->pinned);
+    pipeline->window = 0;
+    pipeline->window_max = 0;
+    pipeline->window_acks = 0;
+    pipeline->window_recover = 0;
+    memset(&pipeline->throttled, 0, sizeof pipeline->throttled);
+    pipeline->nthrottled = 0;
+    pipeline->nwoken = 0;
+    pipeline->bulk_weight = 0;
+    pipeline->bulkslots = NULL;
+    pipeline->interactive_run = 0;
+    pipeline->bulk_writing = 0;
+    memset(&pipeline->bulk, 0, sizeof pipeline->bulk);
+    pipeline->nbulk = 0;
+    pipeline->nbytes_pending = 0;
+    pipeline->npackets_pending = 0;
+    pipeline->congested = 0;
 
     netbuf_default_settings(&settings);
 
@@ -733,6 +1496,10 @@ void mcreq_queue_add_pipelines(mc_CMDQUEUE *queue, mc_PIPELINE *const *pipelines
     for (unsigned ii = 0; ii < npipelines; ii++) {
         pipelines[ii]->parent = queue;
         pipelines[ii]->index = ii;
+        for (unsigned jj = 1; jj < pipelines[ii]->nsubpipelines; jj++) {
+            pipelines[ii]->subpipelines[jj]->parent = queue;
+            pipelines[ii]->subpipelines[jj]->index = ii;
+        }
     }
 
     if (queue->fallback) {
@@ -758,6 +1525,12 @@ int mcreq_queue_init(mc_CMDQUEUE *queue)
     queue->scheds = NULL;
     queue->fallback = NULL;
     queue->npipelines = 0;
+    memset(&queue->pipeline_watermarks, 0, sizeof queue->pipeline_watermarks);
+    memset(&queue->queue_watermarks, 0, sizeof queue->queue_watermarks);
+    queue->nbytes_pending = 0;
+    queue->npackets_pending = 0;
+    queue->congested = 0;
+    queue->congestion_callback = NULL;
     return 0;
 }
 
@@ -780,6 +1553,46 @@ void mcreq_sched_enter(mc_CMDQUEUE *queue)
     queue->ctxenter = 1;
 }
 
+static void pipeline_leave(mc_PIPELINE *pipeline, int success, int flush)
+{
+    sllist_node *ll_next, *ll;
+
+    if (SLLIST_IS_EMPTY(&pipeline->ctxqueued)) {
+        return;
+    }
+
+    ll = SLLIST_FIRST(&pipeline->ctxqueued);
+    while (ll) {
+        mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
+        ll_next = ll->next;
+
+        if (success) {
+            pipeline_enqueue(pipeline, pkt);
+        } else {
+            uint32_t size = mcreq_get_size(pkt);
+            if (lcbtrace_span_should_finish(MCREQ_PKT_RDATA(pkt)->span)) {
+                lcbtrace_span_finish(MCREQ_PKT_RDATA(pkt)->span, LCBTRACE_NOW);
+            }
+
+            if (pkt->flags & MCREQ_F_REQEXT) {
+                mc_REQDATAEX *rd = pkt->u_rdata.exdata;
+                if (rd->procs->fail_dtor) {
+                    rd->procs->fail_dtor(pkt);
+                }
+            }
+            mcreq_wipe_packet(pipeline, pkt);
+            mcreq_release_packet(pipeline, pkt);
+            pending_remove(pipeline, size);
+        }
+
+        ll = ll_next;
+    }
+    SLLIST_FIRST(&pipeline->ctxqueued) = pipeline->ctxqueued.last = NULL;
+    if (flush) {
+        pipeline->flush_start(pipeline);
+    }
+}
+
 static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 {
     if (queue->ctxenter) {
@@ -788,41 +1601,18 @@ static void queuectx_leave(mc_CMDQUEUE *queue, int success, int flush)
 
     for (unsigned ii = 0; ii < queue->_npipelines_ex; ii++) {
         mc_PIPELINE *pipeline;
-        sllist_node *ll_next, *ll;
 
         if (!queue->scheds[ii]) {
             continue;
         }
 
         pipeline = queue->pipelines[ii];
-        ll = SLLIST_FIRST(&pipeline->ctxqueued);
-
-        while (ll) {
-            mc_PACKET *pkt = SLLIST_ITEM(ll, mc_PACKET, slnode);
-            ll_next = ll->next;
-
-            if (success) {
-                mcreq_enqueue_packet(pipeline, pkt);
-            } else {
-                if (lcbtrace_span_should_finish(MCREQ_PKT_RDATA(pkt)->span)) {
-                    lcbtrace_span_finish(MCREQ_PKT_RDATA(pkt)->span, LCBTRACE_NOW);
-                }
-
-                if (pkt->flags & MCREQ_F_REQEXT) {
-                    mc_REQDATAEX *rd = pkt->u_rdata.exdata;
-                    if (rd->procs->fail_dtor) {
-                        rd->procs->fail_dtor(pkt);
-                    }
-                }
-                mcreq_wipe_packet(pipeline, pkt);
-                mcreq_release_packet(pipeline, pkt);
+        if (pipeline->nsubpipelines) {
+            for (unsigned jj = 0; jj < pipeline->nsubpipelines; jj++) {
+                pipeline_leave(pipeline->subpipelines[jj], success, flush);
             }
-
-            ll = ll_next;
-        }
-        SLLIST_FIRST(&pipeline->ctxqueued) = pipeline->ctxqueued.last = NULL;
-        if (flush) {
-            pipeline->flush_start(pipeline);
+        } else {
+            pipeline_leave(pipeline, success, flush);
         }
         queue->scheds[ii] = 0;
     }
@@ -850,23 +1640,28 @@ void mcreq_sched_add(mc_PIPELINE *pipeline, mc_PACKET *pkt)
         cq->scheds[pipeline->index] = 1;
     }
     sllist_append(&pipeline->ctxqueued, &pkt->slnode);
-    mcreq_rearm_timeout(pipeline);
+    pending_add(pipeline, mcreq_get_size(pkt));
 }
 
 static mc_PACKET *pipeline_find(mc_PIPELINE *pipeline, lcb_uint32_t opaque, int do_remove)
 {
-    sllist_iterator iter;
-    SLLIST_ITERFOR(&pipeline->requests, &iter)
-    {
-        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
-        if (pkt->opaque == opaque) {
-            if (do_remove) {
-                sllist_iter_remove(&pipeline->requests, &iter);
-            }
-            return pkt;
-        }
+    mc_PACKET *pkt = mcreq_opqindex_find(&pipeline->opqindex, opaque);
+    if (pkt == NULL || !do_remove) {
+        return pkt;
     }
-    return NULL;
+
+    pipeline_untrack(pipeline, pkt);
+    pipeline_unlink(pipeline, pkt);
+    if (pipeline->keyslots) {
+        pipeline->nwoken += keyorder_wake(pipeline, keyorder_release(pipeline, pkt));
+    }
+    window_release(pipeline, pkt);
+    priority_release(pipeline, pkt);
+    /* The response is still being handled, the packets written here are
+     * flushed by mcreq_pipeline_flush_woken() */
+    pipeline->nwoken += window_wake(pipeline);
+    pending_remove(pipeline, mcreq_get_size(pkt));
+    return pkt;
 }
 
 mc_PACKET *mcreq_pipeline_find(mc_PIPELINE *pipeline, lcb_uint32_t opaque)
@@ -918,25 +1713,64 @@ void mcreq_reset_timeouts(mc_PIPELINE *pl, lcb_U64 nstime)
         hrtime_t old_timeout = (MCREQ_PKT_RDATA(pkt)->deadline - MCREQ_PKT_RDATA(pkt)->start);
         MCREQ_PKT_RDATA(pkt)->start = nstime;
         MCREQ_PKT_RDATA(pkt)->deadline = nstime + old_timeout;
+        if (pl->timers) {
+            lcbio_timerwheel_arm(pl->timers, &pkt->tmo_entry, MCREQ_PKT_RDATA(pkt)->deadline);
+        }
+    }
+}
+
+void mcreq_pipeline_set_timers(mc_PIPELINE *pl, lcbio_TIMERWHEEL *timers, mcreq_pkttimeout_fn callback)
+{
+    sllist_node *nn;
+    if (pl->timers) {
+        SLLIST_ITERBASIC(&pl->requests, nn)
+        {
+            mc_PACKET *pkt = SLLIST_ITEM(nn, mc_PACKET, slnode);
+            lcbio_timerwheel_disarm(pl->timers, &pkt->tmo_entry);
+        }
+    }
+
+    pl->timers = timers;
+    pl->timeout_callback = callback;
+    if (timers) {
+        SLLIST_ITERBASIC(&pl->requests, nn)
+        {
+            mc_PACKET *pkt = SLLIST_ITEM(nn, mc_PACKET, slnode);
+            lcbio_twentry_init(&pkt->tmo_entry, pipeline_packet_expired, pl);
+            lcbio_timerwheel_arm(timers, &pkt->tmo_entry, MCREQ_PKT_RDATA(pkt)->deadline);
+        }
     }
 }
 
 unsigned mcreq_pipeline_timeout(mc_PIPELINE *pl, lcb_STATUS err, mcreq_pktfail_fn failcb, void *cbarg, hrtime_t now)
 {
-    sllist_iterator iter;
+    sllist_node *nn, *next;
     unsigned count = 0;
+    unsigned nwritten = 0;
 
-    SLLIST_ITERFOR(&pl->requests, &iter)
-    {
-        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+    for (nn = SLLIST_FIRST(&pl->requests); nn; nn = next) {
+        mc_PACKET *pkt = SLLIST_ITEM(nn, mc_PACKET, slnode);
         mc_REQDATA *rd = MCREQ_PKT_RDATA(pkt);
+        next = nn->next;
         if (now == 0 || rd->deadline <= now) {
-            sllist_iter_remove(&pl->requests, &iter);
+            uint32_t size = mcreq_get_size(pkt);
+            pipeline_unlink(pl, pkt);
+            pipeline_untrack(pl, pkt);
+            if (pl->keyslots) {
+                keyorder_release(pl, pkt);
+            }
+            window_release(pl, pkt);
+            priority_release(pl, pkt);
             failcb(pl, pkt, err, cbarg);
             mcreq_packet_handled(pl, pkt);
+            pending_remove(pl, size);
             count++;
         }
     }
+    if (pl->keyslots) {
+        nwritten = keyorder_wake(pl, -1);
+    }
+    pipeline_flush_woken(pl, nwritten + window_wake(pl));
     return count;
 }
 
@@ -945,19 +1779,81 @@ unsigned mcreq_pipeline_fail(mc_PIPELINE *pl, lcb_STATUS err, mcreq_pktfail_fn f
     return mcreq_pipeline_timeout(pl, err, failcb, arg, 0);
 }
 
+unsigned mcreq_pipeline_unpin(mc_PIPELINE *pl, uint32_t released)
+{
+    unsigned count = 0;
+    pl->zc_released = released;
+
+    while (!SLLIST_IS_EMPTY(&pl->pinned)) {
+        mc_PACKET *pkt = SLLIST_ITEM(SLLIST_FIRST(&pl->pinned), mc_PACKET, sl_flushq);
+        /* pin_seq is the number of sends issued when the packet was pinned */
+        if ((int32_t)(released - pkt->pin_seq) < 0) {
+            break;
+        }
+        sllist_remove_head(&pl->pinned);
+        pkt->flags &= ~MCREQ_F_PINNED;
+        pkt->flags |= MCREQ_F_FLUSHED;
+        if (pkt->flags & MCREQ_F_INVOKED) {
+            mcreq_packet_done(pl, pkt);
+        }
+        count++;
+    }
+    return count;
+}
+
 void mcreq_iterwipe(mc_CMDQUEUE *queue, mc_PIPELINE *src, mcreq_iterwipe_fn callback, void *arg)
 {
-    sllist_iterator iter;
+    sllist_node *nn, *next;
+    unsigned nwritten = 0;
 
-    SLLIST_ITERFOR(&src->requests, &iter)
-    {
+    for (nn = SLLIST_FIRST(&src->requests); nn; nn = next) {
         int rv;
-        mc_PACKET *orig = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+        mc_PACKET *orig = SLLIST_ITEM(nn, mc_PACKET, slnode);
+        sllist_node *prev = orig->slprev;
+        int held = orig->flags & MCREQ_F_HELD;
+        int throttled = orig->flags & MCREQ_F_THROTTLED;
+        int waiting = orig->flags & MCREQ_F_BULK_WAITING;
+        uint32_t size = mcreq_get_size(orig);
+        next = nn->next;
+        /* the callback may release the packet, so untrack it beforehand */
+        pipeline_untrack(src, orig);
+        if (src->keyslots) {
+            keyorder_release(src, orig);
+        }
+        window_release(src, orig);
+        priority_release(src, orig);
         rv = callback(queue, src, orig, arg);
         if (rv == MCREQ_REMOVE_PACKET) {
-            sllist_iter_remove(&src->requests, &iter);
+            pipeline_unlink_between(src, prev, next);
+            pending_remove(src, size);
+        } else {
+            int is_write = 0, ix;
+            pipeline_track(src, orig);
+            if (src->keyslots && held) {
+                orig->flags &= ~MCREQ_F_FLUSHED;
+                if (!keyorder_hold(src, orig)) {
+                    pipeline_write(src, orig);
+                }
+                continue;
+            }
+            if (src->keyslots && (ix = keyorder_classify(orig, &is_write)) >= 0) {
+                keyorder_acquire(src, orig, ix, is_write);
+            }
+            if (throttled) {
+                orig->flags &= ~MCREQ_F_FLUSHED;
+                if (!window_hold(src, orig)) {
+                    pipeline_write(src, orig);
+                }
+            } else if (waiting) {
+                orig->flags &= ~MCREQ_F_FLUSHED;
+                pipeline_write(src, orig);
+            }
         }
     }
+    if (src->keyslots) {
+        nwritten = keyorder_wake(src, -1);
+    }
+    pipeline_flush_woken(src, nwritten + window_wake(src));
 }
 
 #include "mcreq-flush-inl.h"
@@ -971,19 +1867,20 @@ static void do_fallback_flush(mc_PIPELINE *pipeline)
     nb_IOV iov;
     unsigned nb;
     int nused;
-    sllist_iterator iter;
     mc_FALLBACKPL *fpl = (mc_FALLBACKPL *)pipeline;
 
     while ((nb = mcreq_flush_iov_fill(pipeline, &iov, 1, &nused))) {
         mcreq_flush_done(pipeline, nb, nb);
     }
     /* Now handle all the packets, for real */
-    SLLIST_ITERFOR(&pipeline->requests, &iter)
-    {
-        mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
+    while (!SLLIST_IS_EMPTY(&pipeline->requests)) {
+        mc_PACKET *pkt = SLLIST_ITEM(SLLIST_FIRST(&pipeline->requests), mc_PACKET, slnode);
+        uint32_t size = mcreq_get_size(pkt);
+        pipeline_untrack(pipeline, pkt);
         fpl->handler(pipeline->parent, pkt);
-        sllist_iter_remove(&pipeline->requests, &iter);
+        pipeline_unlink(pipeline, pkt);
         mcreq_packet_handled(pipeline, pkt);
+        pending_remove(pipeline, size);
     }
 }
 
@@ -1016,7 +1913,14 @@ static void noop_dumpfn(const void *d, unsigned n, FILE *fp)
     X(UFWD)                                                                                                            \
     X(FLUSHED)                                                                                                         \
     X(INVOKED)                                                                                                         \
-    X(DETACHED)
+    X(DETACHED)                                                                                                        \
+    X(KEYSLOT)                                                                                                         \
+    X(HELD)                                                                                                            \
+    X(ZEROCOPY)                                                                                                        \
+    X(PINNED)                                                                                                          \
+    X(THROTTLED)                                                                                                       \
+    X(BULK)                                                                                                            \
+    X(BULK_WAITING)
 
 void mcreq_dump_packet(const mc_PACKET *packet, FILE *fp, mcreq_payload_dump_fn dumpfn)
 {
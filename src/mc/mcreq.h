@@ -23,8 +23,10 @@
 #include <memcached/protocol_binary.h>
 #include <libcouchbase/metrics.h>
 #include "netbuf/netbuf.h"
+#include "opqindex.h"
 #include "sllist.h"
 #include "config.h"
+#include "lcbio/timerwheel.h"
 #include "packetutils.h"
 
 #ifdef __cplusplus
@@ -295,7 +297,49 @@ typedef enum {
      * The request has "replace" store semantics.
      * Utilized during error translation to map DOCUMENT_EXISTS to CAS_MISMATCH (see make_error() in handler.cc)
      */
-    MCREQ_F_REPLACE_SEMANTICS = 1u << 11u
+    MCREQ_F_REPLACE_SEMANTICS = 1u << 11u,
+
+    /**
+     * The packet has been written to the pipeline and counts against its key
+     * in mc_PIPELINE::keyslots
+     */
+    MCREQ_F_KEYSLOT = 1u << 12u,
+
+    /**
+     * The packet is in mc_PIPELINE::requests but is held back in
+     * mc_PIPELINE::held until conflicting commands for its key complete
+     */
+    MCREQ_F_HELD = 1u << 13u,
+
+    /**
+     * The value is user-allocated (MCREQ_F_VALUE_NOCOPY) and may be sent
+     * without copying it into the kernel (i.e. `MSG_ZEROCOPY`). Its buffers
+     * are enqueued with netbuf_enqueue_pinned()
+     */
+    MCREQ_F_ZEROCOPY = 1u << 14u,
+
+    /**
+     * The packet has been written, but the kernel may still reference its
+     * value. The packet is in mc_PIPELINE::pinned and is only considered
+     * flushed once mcreq_pipeline_unpin() releases it
+     */
+    MCREQ_F_PINNED = 1u << 15u,
+
+    /**
+     * The packet is in mc_PIPELINE::requests but is held back in
+     * mc_PIPELINE::throttled until the pipeline's window has room for it
+     */
+    MCREQ_F_THROTTLED = 1u << 16u,
+
+    /** The command was scheduled with LCB_PRIORITY_BULK */
+    MCREQ_F_BULK = 1u << 17u,
+
+    /**
+     * The packet is in mc_PIPELINE::requests but waits in mc_PIPELINE::bulk
+     * for interactive packets to be written before it, or for a bulk packet
+     * for the same key to be written first
+     */
+    MCREQ_F_BULK_WAITING = 1u << 18u
 } mcreq_flags;
 
 /** @brief mask of flags indicating user-allocated buffers */
@@ -333,12 +377,25 @@ typedef struct mc_packet_st {
     /** Node in the linked list for logical command ordering */
     sllist_node slnode;
 
+    /**
+     * Node preceding this one in mc_PIPELINE::requests, so that packets may
+     * be unlinked in the order their responses arrive
+     */
+    sllist_node *slprev;
+
     /**
      * Node in the linked list for actual output ordering.
      * @see netbuf_end_flush2(), netbuf_pdu_enqueue()
      */
     sllist_node sl_flushq;
 
+    /**
+     * Node preceding this one in mc_PIPELINE::held, mc_PIPELINE::throttled
+     * or mc_PIPELINE::bulk while the packet waits to be written, so that it
+     * may leave in any order
+     */
+    sllist_node *flushq_prev;
+
     /** Span for key and header */
     nb_SPAN kh_span;
 
@@ -349,7 +406,7 @@ typedef struct mc_packet_st {
     uint8_t retries;
 
     /** flags for request. @see mcreq_flags */
-    uint16_t flags;
+    uint32_t flags;
 
     /** Cached opaque value */
     uint32_t opaque;
@@ -362,6 +419,12 @@ typedef struct mc_packet_st {
 
     /** Allocation data for the PACKET structure itself */
     nb_MBLOCK *alloc_parent;
+
+    /** Deadline registration while the packet is in mc_PIPELINE::requests */
+    lcbio_TWENTRY tmo_entry;
+
+    /** Value of mc_PIPELINE::zc_issued when the packet was pinned */
+    uint32_t pin_seq;
 } mc_PACKET;
 
 /**
@@ -379,12 +442,33 @@ typedef struct mc_packet_st {
 
 /**@}*/
 
+/** Number of slots used to track the keys of in-flight commands */
+#define MCREQ_NKEYSLOTS 1024
+
+/**
+ * Commands with keys hashing to the same slot which are in flight (or held
+ * back) on a pipeline. Distinct keys may share a slot, which only costs some
+ * needless serialization.
+ */
+typedef struct {
+    uint32_t nread;  /**< Reads written to the pipeline */
+    uint32_t nwrite; /**< Mutations written to the pipeline */
+    uint32_t nheld;  /**< Commands held back */
+} mc_KEYSLOT;
+
 /**
  * Callback invoked when APIs request that a pipeline start flushing. It
  * receives a pipeline object as its sole argument.
  */
 typedef void (*mcreq_flushstart_fn)(struct mc_pipeline_st *pipeline);
 
+/**
+ * Callback invoked when the deadline of a packet passes. The packet has
+ * already been removed from the pipeline's request list, and the callback is
+ * responsible for failing it.
+ */
+typedef void (*mcreq_pkttimeout_fn)(struct mc_pipeline_st *pipeline, struct mc_packet_st *packet);
+
 /**
  * @brief Structure representing a single input/output queue for memcached
  *
@@ -427,8 +511,137 @@ typedef struct mc_pipeline_st {
 
     /** Optional metrics structure for server */
     struct lcb_SERVERMETRICS_st *metrics;
+
+    /** Index of the packets in `requests` by their opaque */
+    mc_OPQINDEX opqindex;
+
+    /**
+     * Timer wheel on which the deadlines of packets in `requests` are
+     * registered. If NULL, packets only time out via mcreq_pipeline_timeout().
+     * @see mcreq_pipeline_set_timers()
+     */
+    lcbio_TIMERWHEEL *timers;
+
+    /** Invoked when the deadline of a packet registered on `timers` passes */
+    mcreq_pkttimeout_fn timeout_callback;
+
+    /**
+     * Keys of the commands in flight, or NULL if the server executes
+     * commands in the order they are written.
+     * @see mcreq_pipeline_set_unordered()
+     */
+    mc_KEYSLOT *keyslots;
+
+    /**
+     * Packets (linked through mc_PACKET::sl_flushq) which conflict with
+     * commands in flight for the same key, in the order they were enqueued
+     */
+    sllist_root held;
+
+    /**
+     * All connections to the server of this pipeline, starting with the
+     * pipeline itself, or NULL if there is only one. Each connection is a
+     * pipeline of its own, but only the first is in mc_CMDQUEUE::pipelines.
+     * @see mcreq_pipeline_stripe()
+     */
+    struct mc_pipeline_st **subpipelines;
+    unsigned nsubpipelines;
+
+    /** Size of the packets written to `nbmgr` which are not yet flushed */
+    nb_SIZE nbytes_queued;
+
+    /** Number of mutations in `requests` */
+    unsigned nmutations;
+
+    /**
+     * Number of zero-copy sends issued on the pipeline's connection, and the
+     * number of those the kernel is done with. While the two differ, packets
+     * with MCREQ_F_ZEROCOPY are pinned rather than flushed.
+     * @see mcreq_pipeline_unpin()
+     */
+    uint32_t zc_issued;
+    uint32_t zc_released;
+
+    /**
+     * Packets (linked through mc_PACKET::sl_flushq) which have been written
+     * with zero-copy sends which were not yet released, in the order they were
+     * written
+     */
+    sllist_root pinned;
+
+    /**
+     * Number of packets which may be written and awaiting a response, or 0 if
+     * it is not limited, and the largest it may grow to.
+     * @see mcreq_pipeline_set_window()
+     */
+    unsigned window;
+    unsigned window_max;
+
+    /** Responses received since the window last grew */
+    unsigned window_acks;
+
+    /** Opaque of the first packet allocated after the window last shrank */
+    uint32_t window_recover;
+
+    /**
+     * Packets (linked through mc_PACKET::sl_flushq) which do not fit in the
+     * window, in the order they were enqueued
+     */
+    sllist_root throttled;
+    unsigned nthrottled;
+
+    /**
+     * Number of packets written because responses made room for them, which
+     * are flushed once the responses are handled
+     * @see mcreq_pipeline_flush_woken()
+     */
+    unsigned nwoken;
+
+    /**
+     * Size and number of the packets scheduled on this pipeline which are
+     * not yet handled, whether in `ctxqueued` or in `requests`
+     * @see mc_CMDQUEUE::pipeline_watermarks
+     */
+    uint64_t nbytes_pending;
+    unsigned npackets_pending;
+
+    /** Whether the pending packets reached the high watermarks and did not yet drain */
+    int congested;
+
+    /**
+     * Number of interactive packets which may be written before a waiting
+     * bulk packet, or 0 if packets are written in the order they are enqueued.
+     * @see mcreq_pipeline_set_priority_weight()
+     */
+    unsigned bulk_weight;
+
+    /** Interactive packets written since the last bulk packet */
+    unsigned interactive_run;
+
+    /** Whether a bulk packet was written to `nbmgr` and is not yet flushed */
+    int bulk_writing;
+
+    /**
+     * Bulk packets (linked through mc_PACKET::sl_flushq) waiting to be
+     * written, in the order they were enqueued, along with the interactive
+     * packets enqueued after a waiting packet for the same key
+     */
+    sllist_root bulk;
+    unsigned nbulk;
+
+    /** Packets in `bulk` by key slot, allocated while `bulk_weight` is set */
+    mc_KEYSLOT *bulkslots;
 } mc_PIPELINE;
 
+/**
+ * Callback invoked when a pipeline, or the whole queue, becomes congested or
+ * drains.
+ * @param cq The queue
+ * @param pipeline The pipeline, or NULL for the limits of the queue
+ * @param congested Whether it became congested
+ */
+typedef void (*mcreq_congestion_fn)(struct mc_cmdqueue_st *cq, mc_PIPELINE *pipeline, int congested);
+
 typedef struct mc_cmdqueue_st {
     /** Indexed pipelines, i.e. server map target */
     mc_PIPELINE **pipelines;
@@ -462,6 +675,24 @@ typedef struct mc_cmdqueue_st {
     /**Special pipeline used to contain orphaned packets within a scheduling
      * context. This field is used by mcreq_set_fallback_handler() */
     mc_PIPELINE *fallback;
+
+    /**
+     * Limits on the pending packets of each pipeline, and of all of them. A
+     * high watermark of 0 does not limit packets.
+     * @see mcreq_queue_check_congestion()
+     */
+    lcb_QUEUE_WATERMARKS pipeline_watermarks;
+    lcb_QUEUE_WATERMARKS queue_watermarks;
+
+    /** Size and number of the pending packets of all pipelines */
+    uint64_t nbytes_pending;
+    unsigned npackets_pending;
+
+    /** Whether the queue reached its high watermarks and did not yet drain */
+    int congested;
+
+    /** Invoked when a pipeline or the queue becomes congested or drains */
+    mcreq_congestion_fn congestion_callback;
 } mc_CMDQUEUE;
 
 /**
@@ -607,12 +838,12 @@ lcb_STATUS mcreq_reserve_value2(mc_PIPELINE *pipeline, mc_PACKET *packet, lcb_si
 void mcreq_enqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
 
 /**
- * Like enqueue packet, except it will also inspect the packet's timeout field
- * and if necessary, restructure the command inside the request list so that
- * it appears before newer commands.
+ * Enqueue a packet which was relocated from another pipeline.
  *
- * The default enqueue_packet() just appends the command to the end of the
- * queue while this will perform an additional check (and is less efficient)
+ * Packet deadlines are tracked by the pipeline's timer wheel rather than by
+ * the position within the request list, so this is now equivalent to
+ * mcreq_enqueue_packet(). The relocated packet is appended, which is also the
+ * order in which its response is expected.
  */
 void mcreq_reenqueue_packet(mc_PIPELINE *pipeline, mc_PACKET *packet);
 
@@ -653,9 +884,10 @@ void mcreq_map_key(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, unsigned nhdr, int
  * @param queue the queue
  * @param cmd the command base structure
  *
- * @param[out] req the request header which will be set with key, vbucket, and extlen
+ * @param[in,out] req the request header which will be set with key, vbucket, and extlen
  *        fields. In other words, you do not need to initialize them once this
- *        function has completed.
+ *        function has completed. The opcode must already be set, since it
+ *        determines the connection the command is written on.
  *
  * @param extlen the size of extras for this command
  * @param[out] packet a pointer set to the address of the allocated packet
@@ -663,6 +895,8 @@ void mcreq_map_key(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, unsigned nhdr, int
  * @param options a set of options to control creation behavior. Currently the
  * only recognized options are `0` (i.e. default options), or @ref
  * MCREQ_BASICPACKET_F_FALLBACKOK
+ * @return LCB_ERR_QUEUE_CONGESTED if the target pipeline or the queue is
+ * congested (see mcreq_queue_check_congestion())
  */
 
 lcb_STATUS mcreq_basic_packet(mc_CMDQUEUE *queue, const lcb_KEYBUF *key, uint32_t collection_id,
@@ -771,15 +1005,27 @@ void mcreq_sched_leave(struct mc_cmdqueue_st *queue, int do_flush);
 void mcreq_sched_fail(struct mc_cmdqueue_st *queue);
 
 /**
- * Find a packet with the given opaque value
+ * Find a packet with the given opaque value. The lookup uses the pipeline's
+ * opaque index and does not depend on the number of pending packets.
  */
 mc_PACKET *mcreq_pipeline_find(mc_PIPELINE *pipeline, uint32_t opaque);
 
 /**
- * Find and remove the packet with the given opaque value
+ * Find and remove the packet with the given opaque value.
+ *
+ * Packets held back for the same key or by the window may be written as a
+ * result. They are not flushed until mcreq_pipeline_flush_woken() is called,
+ * so that the response is handled first.
  */
 mc_PACKET *mcreq_pipeline_remove(mc_PIPELINE *pipeline, uint32_t opaque);
 
+/**
+ * Invoke mc_PIPELINE::flush_start if removing packets or receiving responses
+ * (see mcreq_window_grow()) wrote packets which were waiting. Call it once
+ * done reading responses.
+ */
+void mcreq_pipeline_flush_woken(mc_PIPELINE *pipeline);
+
 /**
  * Handles a received packet in response to a command
  * @param pipeline the pipeline upon which the request was received
@@ -856,7 +1102,126 @@ void mcreq_packet_done(mc_PIPELINE *pipeline, mc_PACKET *pkt);
  */
 void mcreq_reset_timeouts(mc_PIPELINE *pl, lcb_U64 nstime);
 
-void mcreq_rearm_timeout(mc_PIPELINE *pipeline);
+/**
+ * Set the timer wheel on which the deadlines of the pipeline's packets are
+ * registered. Packets already in the pipeline are moved over to the new
+ * wheel.
+ *
+ * @param pl The pipeline
+ * @param timers The wheel, or NULL to stop tracking deadlines
+ * @param callback Invoked for each packet whose deadline passes
+ */
+void mcreq_pipeline_set_timers(mc_PIPELINE *pl, lcbio_TIMERWHEEL *timers, mcreq_pkttimeout_fn callback);
+
+/**
+ * Indicate whether the server may execute the commands written to this
+ * pipeline out of order (i.e. the UnorderedExecution HELLO feature).
+ *
+ * Responses are matched by opaque regardless of this setting. When enabled,
+ * the pipeline preserves the order of conflicting commands for the same key:
+ * a mutation is not written while other commands for its key are in flight,
+ * and a read is not written while a mutation for its key is in flight. Such
+ * packets remain in `requests` (and time out normally) but are only written
+ * once the commands they conflict with complete, and flushed by
+ * mcreq_pipeline_flush_woken().
+ *
+ * Disabling releases all held packets in order, subject to the window (see
+ * mcreq_pipeline_set_window()).
+ *
+ * @param pl The pipeline
+ * @param enabled Whether execution may be reordered by the server
+ */
+void mcreq_pipeline_set_unordered(mc_PIPELINE *pl, int enabled);
+
+/**
+ * Limit the number of packets written to this pipeline which are awaiting a
+ * response, adapting the limit to the load of the server.
+ *
+ * The window starts at @p max packets. It is halved when the server rejects
+ * a command because it is overloaded (see mcreq_window_shrink()), and grows
+ * by one packet for each window's worth of other responses (see
+ * mcreq_window_grow()), up to @p max again. Packets which do not fit remain
+ * in `requests` (and time out normally) but are only written once responses
+ * make room for them, and flushed by mcreq_pipeline_flush_woken().
+ *
+ * @param pl The pipeline
+ * @param max The largest window, or 0 to release all throttled packets and
+ * no longer limit the packets in flight
+ */
+void mcreq_pipeline_set_window(mc_PIPELINE *pl, unsigned max);
+
+/**
+ * Account a response to a packet of the pipeline which the server did not
+ * reject for overload.
+ */
+void mcreq_window_grow(mc_PIPELINE *pl);
+
+/**
+ * Account a response which the server rejected because it was overloaded
+ * (e.g. temporary failure or rate limit). Responses to packets written
+ * before the window last shrank are ignored, so that the window is halved
+ * once for each round trip rather than once for each rejected packet.
+ *
+ * @param pl The pipeline
+ * @param pkt The rejected packet
+ */
+void mcreq_window_shrink(mc_PIPELINE *pl, const mc_PACKET *pkt);
+
+/**
+ * Write bulk packets (MCREQ_F_BULK) behind the interactive ones.
+ *
+ * Bulk packets are written one at a time: the next one is only written once
+ * the previous one was flushed, and then only if no interactive packet is
+ * waiting to be flushed or after @p weight interactive packets were written
+ * since. Waiting bulk packets remain in `requests` (and time out normally).
+ * Since packets are only reordered before they are written, a large bulk
+ * value delays an interactive packet by at most the time to send it. An
+ * interactive packet which conflicts with a waiting packet for the same key
+ * (see mcreq_pipeline_set_unordered()) waits along with it, so that commands
+ * for a key are written in the order they were enqueued.
+ *
+ * @param pl The pipeline
+ * @param weight The number of interactive packets which may be written
+ * before a bulk one, or 0 to write all waiting bulk packets and no longer
+ * reorder packets by priority
+ */
+void mcreq_pipeline_set_priority_weight(mc_PIPELINE *pl, unsigned weight);
+
+/**
+ * Write the next waiting bulk packet if its turn has come, e.g. once the
+ * previous one was flushed.
+ * @return the number of packets written to the pipeline
+ */
+unsigned mcreq_priority_wake(mc_PIPELINE *pl);
+
+/**
+ * Re-evaluate whether the pipelines of the queue, and the queue itself, are
+ * congested, after their watermarks changed. Pipelines become congested once
+ * their pending packets reach either high watermark, and drain once they are
+ * back to both low watermarks, invoking mc_CMDQUEUE::congestion_callback on
+ * each change. mcreq_basic_packet() fails with LCB_ERR_QUEUE_CONGESTED while
+ * the pipeline of the key, or the queue, is congested.
+ */
+void mcreq_queue_check_congestion(mc_CMDQUEUE *queue);
+
+/**
+ * Select the connection on which to write a command, for servers with more
+ * than one connection (see mc_PIPELINE::subpipelines).
+ *
+ * Commands are striped by vBucket, so that commands for the same document are
+ * written on the same connection and executed in order. Reads are an exception:
+ * unless mutations are in flight on the vBucket's connection, they are written on
+ * the connection with the fewest bytes waiting to be flushed.
+ *
+ * This must be called before the packet is allocated, since packets are owned
+ * by the pipeline which allocated them.
+ *
+ * @param pl The pipeline in mc_CMDQUEUE::pipelines
+ * @param vbid The vBucket of the command
+ * @param opcode The opcode of the command
+ * @return the pipeline to use, which is `pl` itself if it has a single connection
+ */
+mc_PIPELINE *mcreq_pipeline_stripe(mc_PIPELINE *pl, int vbid, uint8_t opcode);
 
 /**
  * Callback to be invoked when a packet is about to be failed out from the
@@ -869,6 +1234,20 @@ void mcreq_rearm_timeout(mc_PIPELINE *pipeline);
  */
 typedef void (*mcreq_pktfail_fn)(mc_PIPELINE *pipeline, mc_PACKET *packet, lcb_STATUS err, void *arg);
 
+/**
+ * Release the packets pinned by zero-copy sends which the kernel is done
+ * with. Sends on a TCP connection complete in the order they were issued, so
+ * all the sends before the `released`th are complete as well. Released
+ * packets which were already handled are freed (invoking
+ * mc_PIPELINE::buf_done_callback).
+ *
+ * @param pipeline the pipeline
+ * @param released the number of sends released so far; this becomes the new
+ *        value of mc_PIPELINE::zc_released
+ * @return the number of packets released
+ */
+unsigned mcreq_pipeline_unpin(mc_PIPELINE *pipeline, uint32_t released);
+
 /**
  * Fail out a given pipeline. All commands in the pipeline will be removed
  * from the pipeline (though they may still not be freed if they are pending
@@ -0,0 +1,140 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "opqindex.h"
+#include <stdlib.h>
+#include <string.h>
+#include <libcouchbase/assert.h>
+
+#define OPQINDEX_MINBITS 6
+
+/* Opaques are sequential, so spread them with a multiplicative (Fibonacci)
+ * hash; using the low bits directly would form long clusters and make misses
+ * (i.e. replies for timed out commands) expensive. */
+#define OPQ_HASH(index, opaque) ((uint32_t)((opaque)*2654435769u) >> (32 - (index)->nbits))
+#define OPQ_NEXT(index, pos) (((pos) + 1) & ((index)->nslots - 1))
+
+void mcreq_opqindex_init(mc_OPQINDEX *index)
+{
+    index->slots = NULL;
+    index->nslots = 0;
+    index->nused = 0;
+    index->nbits = 0;
+}
+
+void mcreq_opqindex_cleanup(mc_OPQINDEX *index)
+{
+    free(index->slots);
+    mcreq_opqindex_init(index);
+}
+
+void mcreq_opqindex_clear(mc_OPQINDEX *index)
+{
+    if (index->slots) {
+        memset(index->slots, 0, sizeof(*index->slots) * index->nslots);
+    }
+    index->nused = 0;
+}
+
+static void opqindex_place(mc_OPQINDEX *index, uint32_t opaque, struct mc_packet_st *pkt)
+{
+    uint32_t pos = OPQ_HASH(index, opaque);
+    while (index->slots[pos].pkt != NULL) {
+        pos = OPQ_NEXT(index, pos);
+    }
+    index->slots[pos].opaque = opaque;
+    index->slots[pos].pkt = pkt;
+    index->nused++;
+}
+
+static void opqindex_grow(mc_OPQINDEX *index)
+{
+    mc_OPQSLOT *old = index->slots;
+    uint32_t nold = index->nslots;
+
+    index->nbits = index->nbits ? index->nbits + 1 : OPQINDEX_MINBITS;
+    index->nslots = 1u << index->nbits;
+    index->slots = calloc(index->nslots, sizeof(*index->slots));
+    index->nused = 0;
+    lcb_assert(index->slots);
+
+    for (uint32_t ii = 0; ii < nold; ii++) {
+        if (old[ii].pkt) {
+            opqindex_place(index, old[ii].opaque, old[ii].pkt);
+        }
+    }
+    free(old);
+}
+
+void mcreq_opqindex_insert(mc_OPQINDEX *index, uint32_t opaque, struct mc_packet_st *pkt)
+{
+    /* keep load factor at or below 1/2 */
+    if ((index->nused + 1) * 2 > index->nslots) {
+        opqindex_grow(index);
+    }
+    opqindex_place(index, opaque, pkt);
+}
+
+struct mc_packet_st *mcreq_opqindex_find(const mc_OPQINDEX *index, uint32_t opaque)
+{
+    uint32_t pos;
+    if (!index->nused) {
+        return NULL;
+    }
+    pos = OPQ_HASH(index, opaque);
+    while (index->slots[pos].pkt != NULL) {
+        if (index->slots[pos].opaque == opaque) {
+            return index->slots[pos].pkt;
+        }
+        pos = OPQ_NEXT(index, pos);
+    }
+    return NULL;
+}
+
+int mcreq_opqindex_remove(mc_OPQINDEX *index, uint32_t opaque, const struct mc_packet_st *pkt)
+{
+    uint32_t pos, next;
+    if (!index->nused) {
+        return 0;
+    }
+
+    pos = OPQ_HASH(index, opaque);
+    while (index->slots[pos].pkt != pkt || index->slots[pos].opaque != opaque) {
+        if (index->slots[pos].pkt == NULL) {
+            return 0;
+        }
+        pos = OPQ_NEXT(index, pos);
+    }
+
+    /* Backward-shift deletion: pull subsequent entries of the cluster into the
+     * hole unless doing so would move them before their home slot. */
+    next = OPQ_NEXT(index, pos);
+    while (index->slots[next].pkt != NULL) {
+        uint32_t home = OPQ_HASH(index, index->slots[next].opaque);
+        uint32_t dist_next = (next - home) & (index->nslots - 1);
+        uint32_t dist_hole = (pos - home) & (index->nslots - 1);
+        if (dist_hole < dist_next) {
+            index->slots[pos] = index->slots[next];
+            pos = next;
+        }
+        next = OPQ_NEXT(index, next);
+    }
+    index->slots[pos].pkt = NULL;
+    index->slots[pos].opaque = 0;
+    index->nused--;
+    return 1;
+}
@@ -0,0 +1,88 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_MC_OPQINDEX_H
+#define LCB_MC_OPQINDEX_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @file
+ * @brief Opaque-to-packet index for a pipeline
+ *
+ * Every response read from the socket must be matched with its request
+ * using the opaque field. Scanning the request list for the opaque is linear
+ * in the number of commands in flight, which turns into quadratic behavior
+ * when the pipeline is deep. This module maintains an open-addressing hash
+ * table (linear probing with backward-shift deletion) which maps opaques to
+ * packets so that the lookup does not depend on the queue depth.
+ *
+ * The index does not own the packets. It is kept in sync with the
+ * mc_PIPELINE::requests list by the mcreq routines.
+ */
+
+struct mc_packet_st;
+
+typedef struct {
+    uint32_t opaque;
+    struct mc_packet_st *pkt; /**< NULL if the slot is empty */
+} mc_OPQSLOT;
+
+typedef struct {
+    mc_OPQSLOT *slots;
+    uint32_t nslots; /**< Number of slots. Always zero or a power of two */
+    uint32_t nused;  /**< Number of occupied slots */
+    uint8_t nbits;   /**< log2(nslots) */
+} mc_OPQINDEX;
+
+void mcreq_opqindex_init(mc_OPQINDEX *index);
+void mcreq_opqindex_cleanup(mc_OPQINDEX *index);
+
+/**
+ * Add a packet to the index.
+ * @param index the index
+ * @param opaque the opaque by which the packet will be found
+ * @param pkt the packet
+ *
+ * If another packet with the same opaque is already present, the older
+ * packet remains the one returned by mcreq_opqindex_find().
+ */
+void mcreq_opqindex_insert(mc_OPQINDEX *index, uint32_t opaque, struct mc_packet_st *pkt);
+
+/**
+ * Locate a packet by its opaque
+ * @return the packet, or NULL if no such packet is indexed
+ */
+struct mc_packet_st *mcreq_opqindex_find(const mc_OPQINDEX *index, uint32_t opaque);
+
+/**
+ * Remove a specific packet from the index.
+ * @return nonzero if the packet was found and removed
+ */
+int mcreq_opqindex_remove(mc_OPQINDEX *index, uint32_t opaque, const struct mc_packet_st *pkt);
+
+/** Drop all entries (but keep the storage) */
+void mcreq_opqindex_clear(mc_OPQINDEX *index);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LCB_MC_OPQINDEX_H */
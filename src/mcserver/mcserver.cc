@@ -55,9 +55,14 @@ static void on_flush_ready(lcbio_CTX *ctx)
     int ready;
 
     do {
-        int niov = 0;
+        int niov = 0, zerocopy = 0;
         unsigned nb;
-        nb = mcreq_flush_iov_fill(server, iov, MCREQ_MAXIOV, &niov);
+        if (ctx->zerocopy) {
+            /* values to be sent without copying are flushed separately */
+            nb = mcreq_flush_iov_fill_ex(server, iov, MCREQ_MAXIOV, &niov, &zerocopy);
+        } else {
+            nb = mcreq_flush_iov_fill(server, iov, MCREQ_MAXIOV, &niov);
+        }
         if (!nb) {
             return;
         }
@@ -70,7 +75,11 @@ static void on_flush_ready(lcbio_CTX *ctx)
             free(b64);
         }
 #endif
-        ready = lcbio_ctx_put_ex(ctx, (lcb_IOV *)iov, niov, nb);
+        if (zerocopy) {
+            ready = lcbio_ctx_put_zc(ctx, (lcb_IOV *)iov, niov, nb);
+        } else {
+            ready = lcbio_ctx_put_ex(ctx, (lcb_IOV *)iov, niov, nb);
+        }
     } while (ready);
     lcbio_ctx_wwant(ctx);
 }
@@ -86,8 +95,21 @@ static void on_flush_done(lcbio_CTX *ctx, unsigned expected, unsigned actual)
 #ifdef LCB_DUMP_PACKETS
     lcb_log(LOGARGS(server, TRACE), LOGFMT "pkt,snd,flush: expected=%u, actual=%u", LOGID(server), expected, actual);
 #endif
-    mcreq_flush_done_ex(server, actual, expected, now);
-    server->check_closed();
+    server->zc_issued = ctx->zc_issued;
+    int admitted = mcreq_flush_done_ex(server, actual, expected, now);
+    if (!server->check_closed() && admitted) {
+        /* a bulk packet was let through behind the data just flushed */
+        server->flush();
+    }
+}
+
+static void on_zc_released(lcbio_CTX *ctx, lcb_U32 released)
+{
+    Server *server = Server::get(ctx);
+    if (server->check_closed()) {
+        return;
+    }
+    mcreq_pipeline_unpin(server, released);
 }
 
 void Server::flush()
@@ -99,26 +121,24 @@ void Server::flush()
 
     lcbio_ctx_wwant(connctx);
     lcbio_ctx_schedule(connctx);
-
-    if (!lcbio_timer_armed(io_timer)) {
-        /**
-         * XXX: Maybe use get_next_timeout(), although here we can assume
-         * that a command was just scheduled
-         */
-        lcbio_timer_rearm(io_timer, default_timeout());
-    }
 }
 
 LIBCOUCHBASE_API
 void lcb_sched_flush(lcb_INSTANCE *instance)
 {
+    if (instance->flush_timer) {
+        lcbio_timer_disarm(instance->flush_timer);
+    }
     for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
-        Server *server = instance->get_server(ii);
+        Server *primary = instance->get_server(ii);
 
-        if (!server->has_pending()) {
-            continue;
+        for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+            Server *server = primary->connection(jj);
+            if (!server->has_pending()) {
+                continue;
+            }
+            server->flush_start(server);
         }
-        server->flush_start(server);
     }
 }
 
@@ -181,6 +201,58 @@ bool Server::handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt)
     return true;
 }
 
+/**
+ * Invoked for a request initiated by the server. The only one handled is the
+ * notification of a new cluster map, which is applied as if it had been
+ * fetched with GET_CLUSTER_CONFIG. If the notification only carries the
+ * revision, the configuration is fetched when it is newer than the current one.
+ */
+void Server::handle_server_request(MemcachedResponse &req)
+{
+    if (req.opcode() != PROTOCOL_BINARY_CMD_SERVER_CLUSTERMAP_CHANGE_NOTIFICATION) {
+        lcb_log(LOGARGS_T(DEBUG), LOGFMT "Ignoring server request (OP=0x%x, SEQ=%u)", LOGID_T(), req.opcode(),
+                req.opaque());
+        return;
+    }
+
+    int64_t revepoch = -1, revid = -1;
+    if (req.extlen() == sizeof(uint32_t)) {
+        uint32_t rev;
+        memcpy(&rev, req.ext(), sizeof(rev));
+        revid = ntohl(rev);
+    } else if (req.extlen() == 2 * sizeof(uint64_t)) {
+        uint64_t rev[2];
+        memcpy(rev, req.ext(), sizeof(rev));
+        revepoch = static_cast<int64_t>(lcb_ntohll(rev[0]));
+        revid = static_cast<int64_t>(lcb_ntohll(rev[1]));
+    }
+
+    std::string name(req.key(), req.keylen());
+    const char *expected = settings->conntype == LCB_TYPE_BUCKET ? settings->bucket : nullptr;
+    if (name != (expected ? expected : "")) {
+        lcb_log(LOGARGS_T(TRACE), LOGFMT R"(Ignoring cluster map notification for "%s" (rev=%)" PRId64 ":%" PRId64 ")",
+                LOGID_T(), name.c_str(), revepoch, revid);
+        return;
+    }
+
+    MC_INCR_METRIC(this, packets_config_push, 1);
+    lcb_log(LOGARGS_T(DEBUG), LOGFMT "Cluster map notification (rev=%" PRId64 ":%" PRId64 ", size=%u)", LOGID_T(),
+            revepoch, revid, (unsigned)req.vallen());
+
+    lcb::clconfig::Provider *cccp = instance->confmon->get_provider(lcb::clconfig::CLCONFIG_CCCP);
+    if (req.vallen() && cccp->enabled) {
+        std::string s(req.value(), req.vallen());
+        if (lcb::clconfig::cccp_update(cccp, curhost->host, s.c_str()) == LCB_SUCCESS) {
+            return;
+        }
+    }
+
+    const lcb::clconfig::ConfigInfo *current = instance->cur_configinfo;
+    if (current == nullptr || revid < 0 || revepoch > current->vbc->revepoch || revid > current->vbc->revid) {
+        instance->bootstrap(BS_REFRESH_ALWAYS);
+    }
+}
+
 struct packet_wrapper {
     lcb_KEYBUF key{};
     const char *scope = nullptr;
@@ -264,6 +336,9 @@ bool Server::handle_unknown_collection(MemcachedResponse &resp, mc_PACKET *oldpk
     }
 
     if (req.request.opcode == PROTOCOL_BINARY_CMD_COLLECTIONS_GET_CID) {
+        /* Commands issued meanwhile fail without looking it up again */
+        collcache_put_unknown(instance,
+                              std::string(SPAN_BUFFER(&oldpkt->u_value.single), oldpkt->u_value.single.size), orig_err);
         mc_PACKET *newpkt = mcreq_renew_packet(oldpkt);
         newpkt->flags &= ~MCREQ_STATE_FLAGS;
         instance->retryq->ucadd((mc_EXPACKET *)newpkt, LCB_ERR_TIMEOUT, orig_status);
@@ -419,7 +494,9 @@ int Server::handle_unknown_error(const mc_PACKET *request, const MemcachedRespon
 
     int rv = 0;
 
-    if (err.hasAttribute(errmap::AUTO_RETRY)) {
+    if (err.hasAttribute(errmap::AUTO_RETRY) && !instance->retryq->admit(this)) {
+        newerr = LCB_ERR_RETRY_BUDGET_EXHAUSTED;
+    } else if (err.hasAttribute(errmap::AUTO_RETRY)) {
         errmap::RetrySpec *spec = err.getRetrySpec();
 
         mc_PACKET *newpkt = mcreq_renew_packet(request);
@@ -442,6 +519,22 @@ int Server::handle_unknown_error(const mc_PACKET *request, const MemcachedRespon
 
 lcb_STATUS lcb_map_error(lcb_INSTANCE *instance, int in);
 
+/* Statuses telling that the server would rather receive fewer commands */
+static bool is_overload_issue(uint16_t status)
+{
+    switch (status) {
+        case PROTOCOL_BINARY_RESPONSE_ETMPFAIL:
+        case PROTOCOL_BINARY_RESPONSE_EBUSY:
+        case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_INGRESS:
+        case PROTOCOL_BINARY_RATE_LIMITED_NETWORK_EGRESS:
+        case PROTOCOL_BINARY_RATE_LIMITED_MAX_CONNECTIONS:
+        case PROTOCOL_BINARY_RATE_LIMITED_MAX_COMMANDS:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static bool is_warmup_issue(uint16_t status)
 {
     return status == PROTOCOL_BINARY_RESPONSE_NO_BUCKET || status == PROTOCOL_BINARY_RESPONSE_NOT_INITIALIZED;
@@ -463,7 +556,7 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     unsigned pktsize = 24, is_last = 1;
 
 #define RETURN_NEED_MORE(n)                                                                                            \
-    if (has_pending()) {                                                                                               \
+    if (has_pending() || has_pinned() || config_push) {                                                                \
         lcbio_ctx_rwant(ctx, n);                                                                                       \
     }                                                                                                                  \
     return PKT_READ_PARTIAL
@@ -495,6 +588,13 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         RETURN_NEED_MORE(pktsize);
     }
 
+    if (mcresp.magic() == PROTOCOL_BINARY_SREQ) {
+        DO_ASSIGN_PAYLOAD()
+        handle_server_request(mcresp);
+        DO_SWALLOW_PAYLOAD()
+        return PKT_READ_COMPLETE;
+    }
+
     /* Find the packet */
     if (mcresp.opcode() == PROTOCOL_BINARY_CMD_STAT && mcresp.keylen() != 0) {
         is_last = 0;
@@ -533,11 +633,23 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         return PKT_READ_COMPLETE;
     }
 
+    if (request->retries == 0) {
+        /* the start of retried commands predates their last attempt */
+        hrtime_t now = gethrtime();
+        hrtime_t start = MCREQ_PKT_RDATA(request)->start;
+        node()->response_time.add(now > start ? now - start : 0, now);
+    }
+
     lcb_STATUS err_override = LCB_SUCCESS;
     ReadState rdstate = PKT_READ_COMPLETE;
     int unknown_err_rv;
 
     auto status = static_cast<protocol_binary_response_status>(mcresp.status());
+    if (is_overload_issue(status)) {
+        mcreq_window_shrink(this, request);
+    } else {
+        mcreq_window_grow(this);
+    }
     if (is_warmup_issue(status)) {
         DO_ASSIGN_PAYLOAD()
         mc_PACKET *newpkt = mcreq_renew_packet(request);
@@ -549,7 +661,7 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
     } else if (is_fastpath_error(status)) {
         /* Check if the status code is one which must be handled carefully by the client */
         lcb_STATUS err = lcb_map_error(instance, status);
-        if (err != LCB_SUCCESS && maybe_retry_packet(request, err, status)) {
+        if (err != LCB_SUCCESS && maybe_retry_packet(request, err, status, &err_override)) {
             DO_ASSIGN_PAYLOAD()
             DO_SWALLOW_PAYLOAD()
             goto GT_DONE;
@@ -583,6 +695,10 @@ Server::ReadState Server::try_read(lcbio_CTX *ctx, rdb_IOROPE *ior)
         goto GT_DONE;
     }
 
+    if (status == PROTOCOL_BINARY_RESPONSE_SUCCESS) {
+        instance->retryq->deposit(this);
+    }
+
     /* Figure out if the request is 'ufwd' or not */
     if (!(request->flags & MCREQ_F_UFWD)) {
         DO_ASSIGN_PAYLOAD()
@@ -627,6 +743,8 @@ static void on_read(lcbio_CTX *ctx, unsigned)
 
     while (server->try_read(ctx, ior) == Server::PKT_READ_COMPLETE)
         ;
+    /* the responses may have made room for packets which were waiting */
+    mcreq_pipeline_flush_woken(server);
     lcbio_ctx_schedule(ctx);
     lcb_maybe_breakout(server->instance);
 }
@@ -641,7 +759,8 @@ static void server_connect(Server *server)
     server->connect();
 }
 
-bool Server::maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status)
+bool Server::maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status,
+                                lcb_STATUS *rejected)
 {
     lcbvb_DISTMODE dist_t = lcbvb_get_distmode(parent->config);
 
@@ -653,6 +772,10 @@ bool Server::maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_
     if (!retry.should_retry) {
         return false;
     }
+    if (rejected != nullptr && !instance->retryq->admit(this)) {
+        *rejected = LCB_ERR_RETRY_BUDGET_EXHAUSTED;
+        return false;
+    }
 
     mc_PACKET *newpkt = mcreq_renew_packet(pkt);
     newpkt->flags &= ~MCREQ_STATE_FLAGS;
@@ -852,13 +975,10 @@ int Server::purge(lcb_STATUS error, hrtime_t now, RefreshPolicy policy)
     return affected;
 }
 
-static void flush_errdrain(mc_PIPELINE *pipeline)
+static void flush_errdrain(mc_PIPELINE *)
 {
-    /* Called when we are draining errors. */
-    auto *server = (Server *)pipeline;
-    if (!lcbio_timer_armed(server->io_timer)) {
-        lcbio_timer_rearm(server->io_timer, server->default_timeout());
-    }
+    /* Called when we are draining errors. Packets scheduled in the meantime
+     * still time out through the timer wheel */
 }
 
 uint32_t Server::next_timeout() const
@@ -892,36 +1012,25 @@ uint32_t Server::next_timeout() const
     return LCB_NS2US(diff);
 }
 
-void mcreq_rearm_timeout(mc_PIPELINE *pipeline)
+static void server_packet_timeout(mc_PIPELINE *pipeline, mc_PACKET *pkt)
 {
-    if ((unsigned)pipeline->index == pipeline->parent->npipelines) {
-        return; /* this is fallback pipeline, skip it */
-    }
-    auto *server = reinterpret_cast<Server *>(pipeline);
-    if (server->io_timer) {
-        lcbio_timer_rearm(server->io_timer, server->next_timeout());
-    }
+    static_cast<Server *>(pipeline)->packet_timeout(pkt);
 }
 
-static void timeout_server(void *arg)
+void Server::packet_timeout(mc_PACKET *pkt)
 {
-    reinterpret_cast<Server *>(arg)->io_timeout();
-}
-
-void Server::io_timeout()
-{
-    hrtime_t now = gethrtime();
-
-    int npurged = purge(LCB_ERR_TIMEOUT, now, Server::REFRESH_ONFAILED);
-    if (npurged) {
-        MC_INCR_METRIC(this, packets_timeout, npurged);
+    purge_single(pkt, LCB_ERR_TIMEOUT);
+    mcreq_packet_handled(this, pkt);
+    MC_INCR_METRIC(this, packets_errored, 1);
+    MC_INCR_METRIC(this, packets_timeout, 1);
+
+    /* Only count one failure per batch of expired commands */
+    uint64_t pass = lcbio_timerwheel_pass(timers);
+    if (pass != timeout_pass) {
+        timeout_pass = pass;
         lcb_log(LOGARGS_T(DEBUG), LOGFMT "Server timed out. Some commands have failed", LOGID_T());
+        instance->bootstrap(BS_REFRESH_THROTTLE | BS_REFRESH_INCRERR);
     }
-
-    uint32_t next_us = next_timeout();
-    lcb_log(LOGARGS_T(TRACE), LOGFMT "Scheduling next timeout for %u ms. This is not an error", LOGID_T(),
-            next_us / 1000);
-    lcbio_timer_rearm(io_timer, next_us);
     lcb_maybe_breakout(instance);
 }
 
@@ -995,6 +1104,10 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
         mutation_tokens = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_MUTATION_SEQNO);
         new_durability = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_SYNC_REPLICATION) &&
                          sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_ALT_REQUEST_SUPPORT);
+        unordered_execution = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION);
+        mcreq_pipeline_set_unordered(this, unordered_execution);
+        config_push = sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_DUPLEX) &&
+                      sessinfo->has_feature(PROTOCOL_BINARY_FEATURE_CLUSTERMAP_CHANGE_NOTIFICATION);
         selected_bucket = sessinfo->selected_bucket();
         if (selected_bucket) {
             bucket = sessinfo->bucket_name();
@@ -1003,9 +1116,10 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
         }
         lcb_log(
             LOGARGS_T(TRACE),
-            R"(<%s:%s> (SRV=%p) Got new KV connection (json=%s, snappy=%s, mt=%s, durability=%s, bucket=%s "%s"%s%s))",
+            R"(<%s:%s> (SRV=%p) Got new KV connection (json=%s, snappy=%s, mt=%s, durability=%s, unordered=%s, push=%s, bucket=%s "%s"%s%s))",
             curhost->host, curhost->port, (void *)this, jsonsupport ? "yes" : "no", compsupport ? "yes" : "no",
-            mutation_tokens ? "yes" : "no", new_durability ? "yes" : "no", selected_bucket ? "yes" : "no",
+            mutation_tokens ? "yes" : "no", new_durability ? "yes" : "no", unordered_execution ? "yes" : "no",
+            config_push ? "yes" : "no", selected_bucket ? "yes" : "no",
             selected_bucket ? bucket.c_str() : "-", try_to_select_bucket ? " selecting " : "",
             try_to_select_bucket ? settings->bucket : "");
     }
@@ -1015,8 +1129,12 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
     procs.cb_read = on_read;
     procs.cb_flush_done = on_flush_done;
     procs.cb_flush_ready = on_flush_ready;
+    procs.cb_zc_released = on_zc_released;
     connctx = lcbio_ctx_new(sock, this, &procs);
     connctx->subsys = "memcached";
+    if (settings->kv_zerocopy_threshold) {
+        lcbio_ctx_zc_enable(connctx);
+    }
     sock->service = LCBIO_SERVICE_KV;
     flush_start = (mcreq_flushstart_fn)mcserver_flush;
     if (try_to_select_bucket) {
@@ -1027,8 +1145,6 @@ void Server::handle_connected(lcbio_SOCKET *sock, lcb_STATUS err, lcbio_OSERR sy
         lcbio_ctx_put(connctx, req.data(), req.size());
         lcbio_ctx_put(connctx, bucket.c_str(), bucket.size());
     }
-    uint32_t tmo = next_timeout();
-    lcbio_timer_rearm(io_timer, tmo);
     flush();
 }
 
@@ -1042,15 +1158,23 @@ void Server::connect()
 static void buf_done_cb(mc_PIPELINE *pl, const void *cookie, void *, void *)
 {
     auto *server = static_cast<Server *>(pl);
-    server->instance->callbacks.pktflushed(server->instance, cookie);
+    if (server->instance) {
+        server->instance->callbacks.pktflushed(server->instance, cookie);
+    }
 }
 
-Server::Server(lcb_INSTANCE *instance_, int ix)
-    : mc_PIPELINE(), state(S_CLEAN), io_timer(lcbio_timer_new(instance_->iotable, this, timeout_server)),
-      instance(instance_), settings(lcb_settings_ref2(instance_->settings)), compsupport(0), jsonsupport(0),
-      mutation_tokens(0), new_durability(-1), selected_bucket(0), connctx(nullptr), curhost(new lcb_host_t())
+Server::Server(lcb_INSTANCE *instance_, int ix, Server *primary_)
+    : mc_PIPELINE(), state(S_CLEAN), timeout_pass(0), instance(instance_), settings(lcb_settings_ref2(instance_->settings)), compsupport(0), jsonsupport(0),
+      mutation_tokens(0), new_durability(-1), selected_bucket(0), connctx(nullptr), primary(primary_),
+      curhost(new lcb_host_t())
 {
     mcreq_pipeline_init(this);
+    mcreq_pipeline_set_timers(this, instance_->timers, server_packet_timeout);
+    /* Commands may be scheduled before the connection is negotiated, so
+     * preserve per-key ordering until we know what the server supports */
+    mcreq_pipeline_set_unordered(this, settings->enable_unordered_execution);
+    mcreq_pipeline_set_window(this, settings->kv_adaptive_window);
+    mcreq_pipeline_set_priority_weight(this, settings->kv_priority_weight);
     flush_start = (mcreq_flushstart_fn)server_connect;
     buf_done_callback = buf_done_cb;
     index = ix;
@@ -1066,12 +1190,23 @@ Server::Server(lcb_INSTANCE *instance_, int ix)
     if (settings->metrics) {
         /** Allocate / reinitialize the metrics here */
         metrics = lcb_metrics_getserver(settings->metrics, curhost->host, curhost->port, 1);
-        lcb_metrics_reset_pipeline_gauges(metrics);
+        if (primary == nullptr) {
+            lcb_metrics_reset_pipeline_gauges(metrics);
+        }
+    }
+
+    if (primary == nullptr && settings->kv_connections_per_node > 1) {
+        connections.push_back(this);
+        for (unsigned ii = 1; ii < settings->kv_connections_per_node; ii++) {
+            connections.push_back(new Server(instance_, ix, this));
+        }
+        subpipelines = connections.data();
+        nsubpipelines = connections.size();
     }
 }
 
 Server::Server()
-    : mc_pipeline_st(), state(S_TEMPORARY), io_timer(nullptr), instance(nullptr), settings(nullptr), compsupport(0),
+    : mc_pipeline_st(), state(S_TEMPORARY), timeout_pass(0), instance(nullptr), settings(nullptr), compsupport(0),
       jsonsupport(0), mutation_tokens(0), new_durability(0), connctx(nullptr), connreq(nullptr), curhost(nullptr)
 {
 }
@@ -1093,15 +1228,18 @@ Server::~Server()
             }
         }
     }
+    if (primary) {
+        primary->forget_connection(this);
+    }
+    for (size_t ii = 1; ii < connections.size(); ii++) {
+        static_cast<Server *>(connections[ii])->primary = nullptr;
+    }
     this->instance = nullptr;
     purge(LCB_ERR_REQUEST_CANCELED, 0, Server::REFRESH_NEVER);
+    mcreq_pipeline_unpin(this, zc_issued);
 
     mcreq_pipeline_cleanup(this);
 
-    if (io_timer) {
-        lcbio_timer_destroy(io_timer);
-    }
-
     delete curhost;
     lcb_settings_unref(settings);
 }
@@ -1140,9 +1278,76 @@ void Server::close()
 {
     /* Should never be called twice */
     lcb_assert(state != Server::S_CLOSED);
+    if (connections.size() > 1) {
+        /* Connections without a socket are destroyed right away */
+        std::vector<mc_PIPELINE *> lanes(connections.begin() + 1, connections.end());
+        for (auto *lane : lanes) {
+            static_cast<Server *>(lane)->close();
+        }
+    }
     start_errored_ctx(S_CLOSED);
 }
 
+/**
+ * Free a closed server. A server with additional connections is only freed
+ * once all of them are, since they refer to it.
+ */
+void Server::destroy()
+{
+    if (connections.size() > 1) {
+        destroy_pending = true;
+        return;
+    }
+    delete this;
+}
+
+void Server::forget_connection(Server *lane)
+{
+    for (auto it = connections.begin(); it != connections.end(); ++it) {
+        if (*it == lane) {
+            connections.erase(it);
+            break;
+        }
+    }
+    if (connections.size() > 1) {
+        subpipelines = connections.data();
+        nsubpipelines = connections.size();
+        return;
+    }
+
+    subpipelines = nullptr;
+    nsubpipelines = 0;
+    if (destroy_pending) {
+        delete this;
+    }
+}
+
+void Server::update_connection_metrics()
+{
+    if (metrics == nullptr) {
+        return;
+    }
+    for (size_t ii = 0; ii < nconnections(); ii++) {
+        const Server *conn = connection(ii);
+        lcb_metrics_set_connection(metrics, nconnections(), ii, conn->opqindex.nused, conn->nbytes_queued);
+    }
+}
+
+unsigned Server::pending()
+{
+    Server *owner = node();
+    unsigned npending = 0;
+    for (size_t ii = 0; ii < owner->nconnections(); ii++) {
+        npending += owner->connection(ii)->opqindex.nused;
+    }
+    return npending;
+}
+
+std::uint64_t Server::score()
+{
+    return node()->response_time.value() * (pending() + 1);
+}
+
 /**
  * Call to signal an error or similar on the current socket.
  * @param server The server
@@ -1156,23 +1361,20 @@ void Server::start_errored_ctx(State next_state)
     /* Cancel any pending connection attempt? */
     lcb::io::ConnectionRequest::cancel(&connreq);
 
-    /* If the server is being destroyed, silence the timer */
-    if (next_state == Server::S_CLOSED && io_timer != nullptr) {
-        lcbio_timer_destroy(io_timer);
-        io_timer = nullptr;
+    /* If the server is being destroyed, silence the timeouts. The instance
+     * (and its timer wheel) may be gone before the server is */
+    if (next_state == Server::S_CLOSED) {
+        mcreq_pipeline_set_timers(this, nullptr, nullptr);
     }
 
     if (ctx == nullptr) {
         if (next_state == Server::S_CLOSED) {
-            delete this;
+            destroy();
             return;
         } else {
             /* Not closed but don't have a current context */
             if (has_pending()) {
-                if (!lcbio_timer_armed(io_timer)) {
-                    /* TODO: Maybe throttle reconnection attempts? */
-                    lcbio_timer_rearm(io_timer, default_timeout());
-                }
+                /* TODO: Maybe throttle reconnection attempts? */
                 connect();
             } else {
                 // Connect once someone actually wants a connection.
@@ -1226,10 +1428,14 @@ void Server::finalize_errored_ctx()
     while ((toflush = mcreq_flush_iov_fill(this, &iov, 1, nullptr))) {
         mcreq_flush_done(this, toflush, toflush);
     }
+    /* Closing the context reset the connection, dropping the kernel's
+     * references to values sent without copying */
+    mcreq_pipeline_unpin(this, zc_issued);
+    zc_issued = zc_released = 0;
 
     if (state == Server::S_CLOSED) {
         /* If the server is closed, time to free it */
-        delete this;
+        destroy();
     } else {
         /* Otherwise, cycle the state back to CLEAN and reinit
          * the connection */
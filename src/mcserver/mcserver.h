@@ -24,6 +24,11 @@
 #include <netbuf/netbuf.h>
 
 #ifdef __cplusplus
+#include <vector>
+#include "hedging.h"
+#include "nodescore.h"
+#include "retrybudget.h"
+
 namespace lcb
 {
 
@@ -41,8 +46,11 @@ class Server : public mc_PIPELINE
      * connected
      * @param instance the instance to which the server belongs
      * @param ix the server index in the configuration
+     * @param primary if this is an additional connection to the server, the
+     * server object which owns it. Otherwise the object creates its own
+     * additional connections as per lcb_settings::kv_connections_per_node.
      */
-    Server(lcb_INSTANCE *, int);
+    Server(lcb_INSTANCE *, int, Server *primary = nullptr);
 
     /**
      * Close the server. The resources of the server may still continue to persist
@@ -86,6 +94,48 @@ class Server : public mc_PIPELINE
         return !SLLIST_IS_EMPTY(&requests);
     }
 
+    /**
+     * Returns true if commands were sent without copying their values, and the
+     * kernel may still reference them
+     */
+    bool has_pinned() const
+    {
+        return !SLLIST_IS_EMPTY(&pinned);
+    }
+
+    /**
+     * Number of connections to this server. Each connection is a Server
+     * object of its own; the first one is this object.
+     * @see mc_PIPELINE::subpipelines
+     */
+    size_t nconnections() const
+    {
+        return nsubpipelines ? nsubpipelines : 1;
+    }
+
+    Server *connection(size_t ix)
+    {
+        return nsubpipelines ? static_cast<Server *>(subpipelines[ix]) : this;
+    }
+
+    /** Copy the queue depth of each connection into the server metrics */
+    void update_connection_metrics();
+
+    /** The server object of the node, which owns the additional connections */
+    Server *node()
+    {
+        return primary ? primary : this;
+    }
+
+    /** @return the number of commands awaiting a response on all connections to the node */
+    unsigned pending();
+
+    /**
+     * @return the response time of the node, in nanoseconds, multiplied by
+     * the number of pending commands plus one (see LCB_CNTL_NODE_SCORE)
+     */
+    std::uint64_t score();
+
     int get_index() const
     {
         return mc_PIPELINE::index;
@@ -103,7 +153,9 @@ class Server : public mc_PIPELINE
 
     void set_new_index(int new_index)
     {
-        mc_PIPELINE::index = new_index;
+        for (size_t ii = 0; ii < nconnections(); ii++) {
+            connection(ii)->mc_PIPELINE::index = new_index;
+        }
     }
     bool has_valid_host() const
     {
@@ -135,6 +187,17 @@ class Server : public mc_PIPELINE
         return new_durability;
     }
 
+    bool supports_unordered_execution() const
+    {
+        return unordered_execution;
+    }
+
+    /** Whether the server notifies this connection of new cluster maps */
+    bool supports_config_push() const
+    {
+        return config_push;
+    }
+
     bool is_connected() const
     {
         return connctx != nullptr;
@@ -181,10 +244,13 @@ class Server : public mc_PIPELINE
     uint32_t next_timeout() const;
 
     bool check_closed();
+    void destroy();
+    void forget_connection(Server *lane);
     void start_errored_ctx(State next_state);
     void finalize_errored_ctx();
     void socket_failed(lcb_STATUS);
-    void io_timeout();
+    /** Fail a command whose deadline has passed */
+    void packet_timeout(mc_PACKET *pkt);
 
     enum RefreshPolicy { REFRESH_ALWAYS, REFRESH_ONFAILED, REFRESH_NEVER };
 
@@ -200,8 +266,15 @@ class Server : public mc_PIPELINE
     int handle_unknown_error(const mc_PACKET *request, const MemcachedResponse &resinfo, lcb_STATUS &newerr);
     bool handle_nmv(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
     bool handle_unknown_collection(MemcachedResponse &resinfo, mc_PACKET *oldpkt);
+    void handle_server_request(MemcachedResponse &req);
 
-    bool maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status);
+    /**
+     * @param[out] rejected if not null, the retry is charged to the retry
+     * budget, and this is set to LCB_ERR_RETRY_BUDGET_EXHAUSTED if it is spent
+     * @return true if the packet was retried
+     */
+    bool maybe_retry_packet(mc_PACKET *pkt, lcb_STATUS err, protocol_binary_response_status status,
+                            lcb_STATUS *rejected = nullptr);
     bool maybe_reconnect_on_fake_timeout(lcb_STATUS received_error);
 
     /** Disable */
@@ -209,8 +282,8 @@ class Server : public mc_PIPELINE
 
     State state;
 
-    /** IO/Operation timer */
-    lcbio_pTIMER io_timer;
+    /** Value of lcbio_timerwheel_pass() when commands last timed out */
+    uint64_t timeout_pass;
 
     /** Pointer back to the instance */
     lcb_INSTANCE *instance;
@@ -229,12 +302,39 @@ class Server : public mc_PIPELINE
     /** Whether new durability is supported */
     short new_durability;
 
+    /** Whether the server may execute commands out of order */
+    short unordered_execution{};
+
+    /** Whether the server pushes cluster map changes */
+    short config_push{};
+
     /** Whether bucket has been selected */
     short selected_bucket{};
 
     lcbio_CTX *connctx;
     lcb::io::ConnectionRequest *connreq{};
 
+    /**
+     * Additional connections to the same server. The first element is this
+     * object (see mc_PIPELINE::subpipelines). Empty for a single connection.
+     */
+    std::vector<mc_PIPELINE *> connections{};
+
+    /** For an additional connection, the server object which owns it */
+    Server *primary{};
+
+    /** Closed, but waiting for the additional connections to be destroyed */
+    bool destroy_pending{};
+
+    /** Latencies of the GETs answered by the server, when GETs may be hedged */
+    LatencyWindow get_latency{};
+
+    /** Response times of the node, for all commands */
+    PeakEwma response_time{};
+
+    /** Retries of commands which the node failed, when retries are limited */
+    RetryBudget retry_budget{};
+
     /** Request for current connection */
     lcb_host_t *curhost;
     std::string bucket{}; /** non-empty if bucket has been selected */
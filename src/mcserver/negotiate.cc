@@ -450,6 +450,10 @@ bool SessionRequestImpl::send_hello()
     if (settings->enable_unordered_execution) {
         features[nfeatures++] = PROTOCOL_BINARY_FEATURE_UNORDERED_EXECUTION;
     }
+    if (settings->enable_config_push) {
+        features[nfeatures++] = PROTOCOL_BINARY_FEATURE_DUPLEX;
+        features[nfeatures++] = PROTOCOL_BINARY_FEATURE_CLUSTERMAP_CHANGE_NOTIFICATION;
+    }
     features[nfeatures++] = PROTOCOL_BINARY_FEATURE_CREATE_AS_DELETED;
     features[nfeatures++] = PROTOCOL_BINARY_FEATURE_PRESERVE_TTL;
 
@@ -0,0 +1,299 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "nearcache.h"
+#include "getflights.h"
+
+#include "capi/cmd_get.hh"
+#include "capi/cmd_exists.hh"
+
+using namespace lcb;
+
+NearCache::~NearCache()
+{
+    if (timer_) {
+        lcbio_timer_destroy(timer_);
+    }
+}
+
+std::size_t NearCache::entry_size(const Entry &entry)
+{
+    /* the lookup index holds a second copy of the key */
+    return sizeof(Entry) + entry.key.size() * 2 + entry.value.size();
+}
+
+std::size_t NearCache::mutation_slot(const std::string &key)
+{
+    return std::hash<std::string>{}(key) % mutation_slots;
+}
+
+void NearCache::erase(std::list<Entry>::iterator entry)
+{
+    bytes_ -= entry_size(*entry);
+    index_.erase(entry->key);
+    entries_.erase(entry);
+}
+
+NearCache::Entry *NearCache::get(const std::string &key, hrtime_t oldest)
+{
+    auto pos = index_.find(key);
+    if (pos == index_.end()) {
+        return nullptr;
+    }
+    auto entry = pos->second;
+    if (entry->validated < oldest) {
+        erase(entry);
+        return nullptr;
+    }
+    entries_.splice(entries_.begin(), entries_, entry);
+    return &*entry;
+}
+
+std::size_t NearCache::put(const std::string &key, const char *value, std::size_t nvalue, std::uint32_t flags,
+                           std::uint8_t datatype, std::uint64_t cas, hrtime_t start, std::size_t capacity)
+{
+    if (start < last_mutation_[mutation_slot(key)]) {
+        return 0;
+    }
+    auto pos = index_.find(key);
+    if (pos != index_.end()) {
+        erase(pos->second);
+    }
+    Entry entry{key, std::string(value, nvalue), flags, datatype, cas, start, false};
+    if (entry_size(entry) > capacity) {
+        return 0;
+    }
+    bytes_ += entry_size(entry);
+    entries_.emplace_front(std::move(entry));
+    index_[key] = entries_.begin();
+    return trim(capacity);
+}
+
+void NearCache::remove(const std::string &key, hrtime_t now)
+{
+    last_mutation_[mutation_slot(key)] = now;
+    auto pos = index_.find(key);
+    if (pos != index_.end()) {
+        erase(pos->second);
+    }
+}
+
+void NearCache::revalidated(const std::string &key, std::uint64_t cas, hrtime_t start)
+{
+    auto pos = index_.find(key);
+    if (pos == index_.end()) {
+        return;
+    }
+    auto entry = pos->second;
+    entry->revalidating = false;
+    if (cas == 0 || cas != entry->cas) {
+        erase(entry);
+    } else if (start > entry->validated) {
+        entry->validated = start;
+    }
+}
+
+std::size_t NearCache::trim(std::size_t capacity)
+{
+    std::size_t nevicted = 0;
+    while (bytes_ > capacity && !entries_.empty()) {
+        erase(std::prev(entries_.end()));
+        nevicted++;
+    }
+    return nevicted;
+}
+
+void NearCache::deliver(const Entry &entry, lcb_CMDGET &cmd)
+{
+    if (timer_ == nullptr) {
+        timer_ = lcbio_timer_new(instance_->iotable, this, on_hits);
+    }
+    hits_.push_back(Hit{cmd.cookie(), cmd.key(), cmd.collection().scope(), cmd.collection().collection(), entry.value,
+                        entry.flags, entry.datatype, entry.cas});
+    lcb_aspend_add(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    lcbio_async_signal(timer_);
+}
+
+void NearCache::cancel()
+{
+    if (timer_) {
+        lcbio_timer_disarm(timer_);
+    }
+    flush_hits(LCB_ERR_REQUEST_CANCELED);
+}
+
+void NearCache::on_hits(void *arg)
+{
+    static_cast<NearCache *>(arg)->flush_hits(LCB_SUCCESS);
+}
+
+void NearCache::flush_hits(lcb_STATUS rc)
+{
+    if (hits_.empty()) {
+        return;
+    }
+    /* the callbacks may schedule more GETs */
+    std::vector<Hit> hits;
+    hits.swap(hits_);
+
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance_, LCB_CALLBACK_GET);
+    for (const auto &hit : hits) {
+        lcb_RESPGET resp{};
+        resp.ctx.rc = rc;
+        resp.ctx.key = hit.key;
+        resp.ctx.scope = hit.scope;
+        resp.ctx.collection = hit.collection;
+        if (LCBT_VBCONFIG(instance_)) {
+            resp.ctx.bucket.assign(LCBT_VBCONFIG(instance_)->bname, LCBT_VBCONFIG(instance_)->bname_len);
+        }
+        resp.cookie = hit.cookie;
+        resp.rflags = LCB_RESP_F_FINAL;
+        if (rc == LCB_SUCCESS) {
+            resp.ctx.cas = hit.cas;
+            resp.value = hit.value.data();
+            resp.nvalue = hit.value.size();
+            resp.itmflags = hit.flags;
+            resp.datatype = hit.datatype;
+        }
+        callback(instance_, LCB_CALLBACK_GET, reinterpret_cast<const lcb_RESPBASE *>(&resp));
+        lcb_aspend_del(&instance_->pendops, LCB_PENDTYPE_COUNTER, nullptr);
+    }
+    lcb_maybe_breakout(instance_);
+}
+
+namespace lcb
+{
+/** Context of the GET_META request confirming a cached value */
+struct NearCacheCheck : mc_REQDATAEX {
+    lcb_INSTANCE *instance_;
+    std::string key_;
+
+    static mc_REQDATAPROCS proctable;
+
+    NearCacheCheck(lcb_INSTANCE *instance, std::string key, hrtime_t start_)
+        : mc_REQDATAEX(nullptr, proctable, start_), instance_(instance), key_(std::move(key))
+    {
+    }
+};
+
+static void handle_check(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE, lcb_STATUS, const void *arg)
+{
+    auto *check = static_cast<NearCacheCheck *>(pkt->u_rdata.exdata);
+    const auto *resp = static_cast<const lcb_RESPEXISTS *>(arg);
+    bool found = resp->ctx.rc == LCB_SUCCESS && !resp->deleted;
+    check->instance_->nearcache->revalidated(check->key_, found ? resp->ctx.cas : 0, check->start);
+    delete check;
+}
+
+static void handle_check_schedfail(mc_PACKET *pkt)
+{
+    auto *check = static_cast<NearCacheCheck *>(pkt->u_rdata.exdata);
+    check->instance_->nearcache->revalidated(check->key_, 0, check->start);
+    delete check;
+}
+
+mc_REQDATAPROCS NearCacheCheck::proctable = {handle_check, handle_check_schedfail};
+} // namespace lcb
+
+static lcb_STATUS nearcache_revalidate(lcb_INSTANCE *instance, lcb_CMDGET &cmd, const std::string &doc_key,
+                                       hrtime_t now)
+{
+    mc_PIPELINE *pl;
+    mc_PACKET *pkt;
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_GET_META;
+
+    lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd.key().c_str(), cmd.key().size()}};
+    lcb_STATUS err = mcreq_basic_packet(&instance->cmdq, &keybuf, cmd.collection().collection_id(), &hdr, 0, 0, &pkt,
+                                        &pl, MCREQ_BASICPACKET_F_FALLBACKOK);
+    if (err != LCB_SUCCESS) {
+        return err;
+    }
+
+    hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
+    hdr.request.bodylen = htonl(mcreq_get_key_size(&hdr));
+    hdr.request.opaque = pkt->opaque;
+    hdr.request.cas = 0;
+    memcpy(SPAN_BUFFER(&pkt->kh_span), hdr.bytes, sizeof(hdr.bytes));
+
+    auto *check = new NearCacheCheck(instance, doc_key, now);
+    check->deadline = now + LCB_US2NS(LCBT_SETTING(instance, operation_timeout));
+    pkt->u_rdata.exdata = check;
+    pkt->flags |= MCREQ_F_REQEXT;
+    LCB_SCHED_ADD(instance, pl, pkt)
+    return LCB_SUCCESS;
+}
+
+bool nearcache_get(lcb_INSTANCE *instance, lcb_CMDGET &cmd, const std::string &doc_key)
+{
+    hrtime_t now = gethrtime();
+    hrtime_t ttl = LCB_US2NS(LCBT_SETTING(instance, near_cache_ttl));
+    NearCache::Entry *entry = instance->nearcache->get(doc_key, now > ttl ? now - ttl : 0);
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (entry == nullptr) {
+        if (metrics) {
+            metrics->near_cache_misses++;
+        }
+        return false;
+    }
+    if (metrics) {
+        metrics->near_cache_hits++;
+    }
+    if (LCBT_SETTING(instance, near_cache_revalidate) && !entry->revalidating && entry->validated + ttl / 2 < now) {
+        entry->revalidating = nearcache_revalidate(instance, cmd, doc_key, now) == LCB_SUCCESS;
+    }
+    instance->nearcache->deliver(*entry, cmd);
+    return true;
+}
+
+static std::string document_key(lcb_INSTANCE *instance, const mc_PACKET *request)
+{
+    const char *key = nullptr;
+    size_t nkey = 0;
+    mcreq_get_key(instance, request, &key, &nkey);
+    return GetFlights::make_key(mcreq_get_cid(instance, request), std::string(key, nkey));
+}
+
+void nearcache_store(lcb_INSTANCE *instance, const mc_PACKET *request, const lcb_RESPGET *resp)
+{
+    if (instance == nullptr || LCBT_SETTING(instance, near_cache_size) == 0) {
+        return;
+    }
+    protocol_binary_request_header hdr{};
+    mcreq_read_hdr(request, &hdr);
+    if (hdr.request.magic == PROTOCOL_BINARY_AREQ) {
+        /* impersonated or otherwise scoped to the requesting user */
+        return;
+    }
+    std::size_t nevicted = instance->nearcache->put(
+        document_key(instance, request), static_cast<const char *>(resp->value), resp->nvalue, resp->itmflags,
+        resp->datatype, resp->ctx.cas, MCREQ_PKT_RDATA(request)->start, LCBT_SETTING(instance, near_cache_size));
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (metrics) {
+        metrics->near_cache_evictions += nevicted;
+    }
+}
+
+void nearcache_invalidate(lcb_INSTANCE *instance, const mc_PACKET *request)
+{
+    if (instance == nullptr || LCBT_SETTING(instance, near_cache_size) == 0) {
+        return;
+    }
+    instance->nearcache->remove(document_key(instance, request), gethrtime());
+}
@@ -0,0 +1,165 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_NEARCACHE_H
+#define LCB_NEARCACHE_H
+
+#include <array>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <lcbio/lcbio.h>
+#include "mc/mcreq.h"
+
+namespace lcb
+{
+/**
+ * Values of recently read documents, which are returned to GETs without
+ * contacting the server (see LCB_CNTL_NEAR_CACHE_SIZE).
+ *
+ * Entries are indexed like GetFlights, by collection ID and key, and kept in
+ * least recently used order. Once their total size exceeds the capacity, they
+ * are evicted from the least recently used end. An entry is only returned
+ * for a limited time after the server last confirmed its value, and is
+ * dropped when a mutation of the document by this instance completes.
+ *
+ * Mutations are remembered by key slot rather than by key, so a GET racing
+ * with the mutation of another document hashing to the same slot is merely
+ * not cached.
+ */
+class NearCache
+{
+  public:
+    struct Entry {
+        std::string key;
+        std::string value;
+        std::uint32_t flags;
+        std::uint8_t datatype;
+        std::uint64_t cas;
+        /** When the value was last known to be current */
+        hrtime_t validated;
+        /** Whether a GET_META was sent to confirm the value */
+        bool revalidating;
+    };
+
+    explicit NearCache(lcb_INSTANCE *instance) : instance_(instance) {}
+    ~NearCache();
+
+    /**
+     * Looks up an entry, and makes it the most recently used one.
+     * @param oldest entries validated before this time are removed instead
+     * @return the entry, or null if the value is not cached
+     */
+    Entry *get(const std::string &key, hrtime_t oldest);
+
+    /**
+     * Stores the value read by a GET, unless a mutation of the document (or
+     * of one in the same key slot) completed after the GET was sent, in which
+     * case the value may be outdated already.
+     * @param start when the GET was sent
+     * @return the number of entries evicted to stay within @p capacity
+     */
+    std::size_t put(const std::string &key, const char *value, std::size_t nvalue, std::uint32_t flags,
+                    std::uint8_t datatype, std::uint64_t cas, hrtime_t start, std::size_t capacity);
+
+    /** Drops the entry of a document which was mutated at @p now */
+    void remove(const std::string &key, hrtime_t now);
+
+    /**
+     * Handles the response of the GET_META sent to confirm the value.
+     * @param cas CAS of the document on the server, or 0 if it could not be
+     * retrieved or the document was deleted
+     * @param start when the GET_META was sent
+     */
+    void revalidated(const std::string &key, std::uint64_t cas, hrtime_t start);
+
+    /** @return the number of entries evicted to stay within @p capacity */
+    std::size_t trim(std::size_t capacity);
+
+    /**
+     * Returns the value of the entry to the GET callback of the command, from
+     * the event loop rather than from within lcb_get().
+     */
+    void deliver(const Entry &entry, lcb_CMDGET &cmd);
+
+    /** Fails the GETs which are waiting for their value to be delivered */
+    void cancel();
+
+    std::size_t size() const
+    {
+        return index_.size();
+    }
+
+    /** @return the memory accounted to the entries */
+    std::size_t bytes() const
+    {
+        return bytes_;
+    }
+
+  private:
+    struct Hit {
+        void *cookie;
+        std::string key;
+        std::string scope;
+        std::string collection;
+        std::string value;
+        std::uint32_t flags;
+        std::uint8_t datatype;
+        std::uint64_t cas;
+    };
+
+    /** Number of slots remembering the time of the last mutation of their keys */
+    static constexpr std::size_t mutation_slots = 256;
+
+    static std::size_t entry_size(const Entry &entry);
+    static std::size_t mutation_slot(const std::string &key);
+    void erase(std::list<Entry>::iterator entry);
+    void flush_hits(lcb_STATUS rc);
+    static void on_hits(void *arg);
+
+    lcb_INSTANCE *instance_;
+    std::list<Entry> entries_{};
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_{};
+    std::size_t bytes_{0};
+    std::array<hrtime_t, mutation_slots> last_mutation_{};
+    std::vector<Hit> hits_{};
+    lcbio_pTIMER timer_{nullptr};
+};
+} // namespace lcb
+
+/**
+ * Returns the cached value of the document to the GET callback of the command,
+ * and confirms it with the server if LCB_CNTL_NEAR_CACHE_REVALIDATE is set.
+ * @param doc_key key of the document, as returned by GetFlights::make_key()
+ * @return false if the value is not cached, in which case the GET must be sent
+ */
+bool nearcache_get(lcb_INSTANCE *instance, lcb_CMDGET &cmd, const std::string &doc_key);
+
+/**
+ * Caches the value of a successful GET, if LCB_CNTL_NEAR_CACHE_SIZE is set.
+ * GETs sent with framing extras (e.g. on behalf of another user) are not
+ * cached, since their result may not be visible to other callers.
+ */
+void nearcache_store(lcb_INSTANCE *instance, const mc_PACKET *request, const lcb_RESPGET *resp);
+
+/** Drops the cached value of the document mutated by the request */
+void nearcache_invalidate(lcb_INSTANCE *instance, const mc_PACKET *request);
+
+#endif /* LCB_NEARCACHE_H */
@@ -222,9 +222,9 @@ typedef struct netbuf_mblock_st {
  * on it in an out-of-order fashion
  */
 typedef struct netbuf_mblock_dealloc_queue_st {
-    sllist_root pending;
-    nb_SIZE min_offset; /**< The first offset contained in the list */
-    nb_MBPOOL qpool;    /**< Used to allcate the nb_QDEALLOC structures themselves*/
+    sllist_root pending; /**< Ordered by position within the block */
+    nb_SIZE min_offset;  /**< The first offset contained in the list */
+    nb_MBPOOL qpool;     /**< Used to allcate the nb_QDEALLOC structures themselves*/
 } nb_DEALLOC_QUEUE;
 
 /**@}*/
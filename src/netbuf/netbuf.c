@@ -184,7 +184,9 @@ static int reserve_active_block(nb_MBLOCK *block, nb_SPAN *span)
             block->wrap = block->cursor;
             return 0;
 
-        } else if (block->start >= span->size) {
+        } else if (block->start > span->size) {
+            /* Strictly greater, since a wrapped cursor reaching the start
+             * would make the full block look empty */
             /** Wrap around the wrap */
             span->offset = 0;
             block->cursor = span->size;
@@ -195,7 +197,7 @@ static int reserve_active_block(nb_MBLOCK *block, nb_SPAN *span)
 
     } else {
         /* Already wrapped */
-        if (block->start - block->cursor >= span->size) {
+        if (block->start - block->cursor > span->size) {
             span->offset = block->cursor;
             block->cursor += span->size;
             return 0;
@@ -239,11 +241,23 @@ static int mblock_reserve_data(nb_MBPOOL *pool, nb_SPAN *span)
  ** Out-Of-Order Deallocation Functions                                      **
  ******************************************************************************
  ******************************************************************************/
+/* Position of an offset relative to the start of the used region. Offsets
+ * below the start lie in the wrapped region, which logically follows the
+ * tail of the block */
+static INLINE nb_SIZE ooo_distance(const nb_MBLOCK *block, nb_SIZE offset)
+{
+    if (offset >= block->start) {
+        return offset - block->start;
+    }
+    return offset + (block->wrap - block->start);
+}
+
 static void ooo_queue_dealoc(nb_MGR *mgr, nb_MBLOCK *block, nb_SPAN *span)
 {
     nb_QDEALLOC *qd;
     nb_DEALLOC_QUEUE *queue;
     nb_SPAN qespan;
+    nb_SIZE distance;
     int rv;
 
     if (!block->deallocs) {
@@ -257,10 +271,6 @@ static void ooo_queue_dealoc(nb_MGR *mgr, nb_MBLOCK *block, nb_SPAN *span)
 
     queue = block->deallocs;
 
-    if (SLLIST_IS_EMPTY(&queue->pending)) {
-        queue->min_offset = span->offset;
-    }
-
     qespan.size = sizeof(*qd);
     rv = mblock_reserve_data(&queue->qpool, &qespan);
     lcb_assert(rv == 0);
@@ -268,10 +278,26 @@ static void ooo_queue_dealoc(nb_MGR *mgr, nb_MBLOCK *block, nb_SPAN *span)
     qd = (nb_QDEALLOC *)(void *)SPAN_MBUFFER_NC(&qespan);
     qd->offset = span->offset;
     qd->size = span->size;
-    if (queue->min_offset > qd->offset) {
-        queue->min_offset = qd->offset;
+
+    /* Keep the queue ordered by position within the block, so that the spans
+     * which become contiguous with its start are always found at the head.
+     * Spans are mostly released in the order they were allocated */
+    distance = ooo_distance(block, qd->offset);
+    if (SLLIST_IS_EMPTY(&queue->pending) ||
+        ooo_distance(block, SLLIST_ITEM(queue->pending.last, nb_QDEALLOC, slnode)->offset) < distance) {
+        sllist_append(&queue->pending, &qd->slnode);
+    } else {
+        sllist_iterator iter;
+        SLLIST_ITERFOR(&queue->pending, &iter)
+        {
+            nb_QDEALLOC *cur = SLLIST_ITEM(iter.cur, nb_QDEALLOC, slnode);
+            if (ooo_distance(block, cur->offset) > distance) {
+                sllist_insert(&queue->pending, iter.prev, &qd->slnode);
+                break;
+            }
+        }
     }
-    sllist_append(&queue->pending, &qd->slnode);
+    queue->min_offset = SLLIST_ITEM(SLLIST_FIRST(&queue->pending), nb_QDEALLOC, slnode)->offset;
 }
 
 static INLINE void maybe_unwrap_block(nb_MBLOCK *block)
@@ -284,24 +310,22 @@ static INLINE void maybe_unwrap_block(nb_MBLOCK *block)
 
 static void ooo_apply_dealloc(nb_MBLOCK *block)
 {
-    nb_SIZE min_next = -1;
-    sllist_iterator iter;
     nb_DEALLOC_QUEUE *queue = block->deallocs;
 
-    SLLIST_ITERFOR(&queue->pending, &iter)
-    {
-        nb_QDEALLOC *cur = SLLIST_ITEM(iter.cur, nb_QDEALLOC, slnode);
-        if (cur->offset == block->start) {
-            block->start += cur->size;
-            maybe_unwrap_block(block);
-
-            sllist_iter_remove(&block->deallocs->pending, &iter);
-            mblock_release_ptr(&queue->qpool, (char *)cur, sizeof(*cur));
-        } else if (cur->offset < min_next) {
-            min_next = cur->offset;
+    /* The queue is ordered by offset: release its head for as long as it
+     * follows the start of the block */
+    while (!SLLIST_IS_EMPTY(&queue->pending)) {
+        nb_QDEALLOC *cur = SLLIST_ITEM(SLLIST_FIRST(&queue->pending), nb_QDEALLOC, slnode);
+        if (cur->offset != block->start) {
+            queue->min_offset = cur->offset;
+            return;
         }
+        block->start += cur->size;
+        maybe_unwrap_block(block);
+
+        sllist_remove_head(&queue->pending);
+        mblock_release_ptr(&queue->qpool, (char *)cur, sizeof(*cur));
     }
-    queue->min_offset = min_next;
 }
 
 static INLINE void mblock_release_data(nb_MBPOOL *pool, nb_MBLOCK *block, nb_SIZE size, nb_SIZE offset)
@@ -309,13 +333,13 @@ static INLINE void mblock_release_data(nb_MBPOOL *pool, nb_MBLOCK *block, nb_SIZ
     if (offset == block->start) {
         /** Removing from the beginning */
         block->start += size;
+        maybe_unwrap_block(block);
 
-        if (block->deallocs && block->deallocs->min_offset == block->start) {
+        if (block->deallocs && !SLLIST_IS_EMPTY(&block->deallocs->pending) &&
+            block->deallocs->min_offset == block->start) {
             ooo_apply_dealloc(block);
         }
 
-        maybe_unwrap_block(block);
-
     } else if (offset + size == block->cursor) {
         /** Removing from the end */
         if (block->cursor == block->wrap) {
@@ -528,7 +552,7 @@ static nb_SNDQELEM *get_sendqe(nb_SENDQ *sq, const nb_IOV *bufinfo)
     return sndqe;
 }
 
-void netbuf_enqueue(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent)
+static void enqueue_common(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent, short pinned)
 {
     nb_SENDQ *q = &mgr->sendq;
     nb_SNDQELEM *win;
@@ -539,7 +563,7 @@ void netbuf_enqueue(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent)
 
     } else {
         win = SLLIST_ITEM(q->pending.last, nb_SNDQELEM, slnode);
-        if (win->base + win->len == bufinfo->iov_base) {
+        if (!pinned && !win->pinned && win->base + win->len == bufinfo->iov_base) {
             win->len += bufinfo->iov_len;
 
         } else {
@@ -547,9 +571,20 @@ void netbuf_enqueue(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent)
             sllist_append(&q->pending, &win->slnode);
         }
     }
+    win->pinned = pinned;
     win->parent = parent;
 }
 
+void netbuf_enqueue(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent)
+{
+    enqueue_common(mgr, bufinfo, parent, 0);
+}
+
+void netbuf_enqueue_pinned(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent)
+{
+    enqueue_common(mgr, bufinfo, parent, 1);
+}
+
 void netbuf_enqueue_span(nb_MGR *mgr, nb_SPAN *span, const void *parent)
 {
     nb_IOV spinfo;
@@ -558,7 +593,9 @@ void netbuf_enqueue_span(nb_MGR *mgr, nb_SPAN *span, const void *parent)
     netbuf_enqueue(mgr, &spinfo, parent);
 }
 
-nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
+/* Fill IOVs from the send queue. If `pinned` is not NULL, stop at the first
+ * buffer which is pinned differently than the first one */
+static nb_SIZE start_flush_common(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused, int *pinned)
 {
     nb_SIZE ret = 0;
     nb_IOV *iov_end = iovs + niov, *iov_start = iovs;
@@ -576,6 +613,9 @@ nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
             iov->iov_base = win->base + sq->last_offset;
             ret += iov->iov_len;
             iov++;
+            if (pinned) {
+                *pinned = win->pinned;
+            }
         }
 
         ll = sq->last_requested->slnode.next;
@@ -585,7 +625,15 @@ nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
     }
 
     while (ll && iov != iov_end) {
-        win = SLLIST_ITEM(ll, nb_SNDQELEM, slnode);
+        nb_SNDQELEM *cur = SLLIST_ITEM(ll, nb_SNDQELEM, slnode);
+        if (pinned) {
+            if (iov == iov_start) {
+                *pinned = cur->pinned;
+            } else if (cur->pinned != *pinned) {
+                break;
+            }
+        }
+        win = cur;
         iov->iov_len = win->len;
         iov->iov_base = win->base;
 
@@ -605,6 +653,17 @@ nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
     return ret;
 }
 
+nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused)
+{
+    return start_flush_common(mgr, iovs, niov, nused, NULL);
+}
+
+nb_SIZE netbuf_start_flush_ex(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused, int *pinned)
+{
+    *pinned = 0;
+    return start_flush_common(mgr, iovs, niov, nused, pinned);
+}
+
 void netbuf_end_flush(nb_MGR *mgr, unsigned int nflushed)
 {
     nb_SENDQ *q = &mgr->sendq;
@@ -93,7 +93,8 @@ typedef struct {
     sllist_node slnode;
     char *base;
     nb_SIZE len;
-    /* Extra 4 bytes here. WHAT WE DO!!! */
+    /** Whether the buffer is owned by the user, see netbuf_enqueue_pinned() */
+    short pinned;
     const void *parent; /* mc_PACKET */
 } nb_SNDQELEM;
 
@@ -209,6 +210,18 @@ void netbuf_enqueue(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent);
 
 void netbuf_enqueue_span(nb_MGR *mgr, nb_SPAN *span, const void *parent);
 
+/**
+ * @brief Enqueue a buffer which may be sent without copying it
+ *
+ * Like netbuf_enqueue(), but the buffer is never coalesced with the buffers
+ * enqueued before or after it, so that netbuf_start_flush_ex() can keep it
+ * apart from the buffers owned by the manager. This is intended for user
+ * buffers which the kernel may keep referencing after they have been written
+ * (i.e. `MSG_ZEROCOPY`); buffers owned by the manager are recycled as soon as
+ * they are flushed and must therefore never be sent that way.
+ */
+void netbuf_enqueue_pinned(nb_MGR *mgr, const nb_IOV *bufinfo, const void *parent);
+
 /**
  * Gets the number of IOV structures required to flush the entire contents of
  * all buffers.
@@ -269,6 +282,22 @@ unsigned int netbuf_get_niov(nb_MGR *mgr);
  */
 nb_SIZE netbuf_start_flush(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused);
 
+/**
+ * @brief Populate IOVs with buffers which are either all pinned or all unpinned
+ *
+ * Like netbuf_start_flush(), but stops at the first buffer whose pinning
+ * differs from that of the first buffer filled in.
+ *
+ * @param mgr the manager object
+ * @param iovs an array of iovec structures
+ * @param niov the number of iovec structures allocated.
+ * @param[out] nused how many IOVs are actually required
+ * @param[out] pinned set to nonzero if the buffers were enqueued with
+ *  netbuf_enqueue_pinned()
+ * @return the number of bytes which can be flushed in this IOV
+ */
+nb_SIZE netbuf_start_flush_ex(nb_MGR *mgr, nb_IOV *iovs, int niov, int *nused, int *pinned);
+
 /**
  * @brief Indicate that a flush has completed.
  *
@@ -160,8 +160,9 @@ static int find_new_data_index(lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig,
 
 static void log_vbdiff(lcb_INSTANCE *instance, lcbvb_CONFIGDIFF *diff)
 {
-    lcb_log(LOGARGS(instance, INFO), "Config Diff: [ vBuckets Modified=%d ], [Sequence Changed=%d]", diff->n_vb_changes,
-            diff->sequence_changed);
+    lcb_log(LOGARGS(instance, INFO),
+            "Config Diff: [ vBuckets Modified=%d ], [ vBuckets Moved=%d ], [Sequence Changed=%d]", diff->n_vb_changes,
+            diff->n_vb_moved, diff->sequence_changed);
     if (diff->servers_added) {
         for (char **curserver = diff->servers_added; *curserver; curserver++) {
             lcb_log(LOGARGS(instance, INFO), "Detected server %s added", *curserver);
@@ -223,7 +224,11 @@ static int iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, v
     }
 
     mc_PIPELINE *newpl = cq->pipelines[newix];
-    if (newpl == oldpl || newpl == nullptr) {
+    if (newpl == nullptr) {
+        return MCREQ_KEEP_PACKET;
+    }
+    newpl = mcreq_pipeline_stripe(newpl, ntohs(hdr.request.vbucket), hdr.request.opcode);
+    if (newpl == oldpl) {
         return MCREQ_KEEP_PACKET;
     }
 
@@ -238,6 +243,31 @@ static int iterwipe_cb(mc_CMDQUEUE *cq, mc_PIPELINE *oldpl, mc_PACKET *oldpkt, v
     return MCREQ_REMOVE_PACKET;
 }
 
+/**
+ * Checks whether both configurations have the same data nodes at the same
+ * positions, in which case the current pipelines can be kept as they are.
+ */
+static bool same_data_nodes(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig)
+{
+    lcbvb_SVCMODE mode = LCBT_SETTING_SVCMODE(instance);
+
+    if (LCBVB_NSERVERS(oldconfig) != LCBVB_NSERVERS(newconfig) || instance->cmdq.npipelines != LCBVB_NSERVERS(newconfig)) {
+        return false;
+    }
+    for (size_t ii = 0; ii < LCBVB_NSERVERS(newconfig); ii++) {
+        const char *oldhost = lcbvb_get_hostport(oldconfig, ii, LCBVB_SVCTYPE_DATA, mode);
+        const char *newhost = lcbvb_get_hostport(newconfig, ii, LCBVB_SVCTYPE_DATA, mode);
+        if (oldhost == nullptr || newhost == nullptr) {
+            if (oldhost != newhost) {
+                return false;
+            }
+        } else if (strcmp(oldhost, newhost) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbvb_CONFIG *newconfig)
 {
     mc_CMDQUEUE *cq = &instance->cmdq;
@@ -246,6 +276,17 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
 
     lcb_assert(LCBT_VBCONFIG(instance) == newconfig);
 
+    /**
+     * If only the vBucket map changed, the servers and their connections stay
+     * untouched. Packets already written for vBuckets which moved get a
+     * NOT_MY_VBUCKET response and are then sent to their new master; the
+     * ones still waiting in the retry queue are signalled by the caller.
+     */
+    if (same_data_nodes(instance, oldconfig, newconfig)) {
+        lcb_log(LOGARGS(instance, DEBUG), "Data nodes unchanged. Keeping %u pipelines", cq->npipelines);
+        return;
+    }
+
     nnew = LCBVB_NSERVERS(newconfig);
     ppnew = reinterpret_cast<mc_PIPELINE **>(calloc(nnew, sizeof(*ppnew)));
     ppold = mcreq_queue_take_pipelines(cq, &nold);
@@ -293,14 +334,21 @@ static void replace_config(lcb_INSTANCE *instance, lcbvb_CONFIG *oldconfig, lcbv
             continue;
         }
 
-        mcreq_iterwipe(cq, ppold[ii], iterwipe_cb, nullptr);
-        static_cast<lcb::Server *>(ppold[ii])->purge(LCB_ERR_MAP_CHANGED);
-        static_cast<lcb::Server *>(ppold[ii])->close();
+        auto *server = static_cast<lcb::Server *>(ppold[ii]);
+        for (size_t jj = 0; jj < server->nconnections(); jj++) {
+            mcreq_iterwipe(cq, server->connection(jj), iterwipe_cb, nullptr);
+            server->connection(jj)->purge(LCB_ERR_MAP_CHANGED);
+        }
+        server->close();
     }
 
     for (ii = 0; ii < nnew; ii++) {
-        if (static_cast<lcb::Server *>(ppnew[ii])->has_pending()) {
-            ppnew[ii]->flush_start(ppnew[ii]);
+        auto *server = static_cast<lcb::Server *>(ppnew[ii]);
+        for (size_t jj = 0; jj < server->nconnections(); jj++) {
+            lcb::Server *conn = server->connection(jj);
+            if (conn->has_pending()) {
+                conn->flush_start(conn);
+            }
         }
     }
 
@@ -323,13 +371,18 @@ void lcb_update_vbconfig(lcb_INSTANCE *instance, lcb_pCONFIGINFO config)
 
         if (diff) {
             log_vbdiff(instance, diff);
-            lcbvb_free_diff(diff);
         }
 
         /* Apply the vb guesses */
         lcb_vbguess_newconfig(instance, config->vbc, instance->vbguess);
 
         replace_config(instance, old_config->vbc, config->vbc);
+        if (diff) {
+            if (diff->vb_moved && diff->n_vb_moved) {
+                instance->retryq->signal_moved(diff->vb_moved, config->vbc->nvb);
+            }
+            lcbvb_free_diff(diff);
+        }
         old_config->decref();
     } else {
         size_t nservers = VB_NSERVERS(config->vbc);
@@ -0,0 +1,60 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <algorithm>
+#include <cmath>
+
+#include "internal.h"
+#include "nodescore.h"
+
+using namespace lcb;
+
+void PeakEwma::add(hrtime_t latency, hrtime_t now)
+{
+    auto sample = static_cast<double>(latency);
+    if (sample > ewma_) {
+        ewma_ = sample;
+    } else {
+        double elapsed = now > stamp_ ? static_cast<double>(now - stamp_) : 0;
+        double weight = std::exp(-elapsed / static_cast<double>(decay));
+        ewma_ = ewma_ * weight + sample * (1 - weight);
+    }
+    stamp_ = now;
+}
+
+std::vector<unsigned> replicas_by_score(lcb_INSTANCE *instance, int vbid)
+{
+    mc_CMDQUEUE *cq = &instance->cmdq;
+    std::vector<std::pair<std::uint64_t, unsigned>> scored;
+    for (unsigned ii = 0; ii < LCBT_NREPLICAS(instance); ii++) {
+        int ix = lcbvb_vbreplica(cq->config, vbid, ii);
+        if (ix > -1 && ix < static_cast<int>(cq->npipelines)) {
+            scored.emplace_back(instance->get_server(ix)->score(), ii);
+        }
+    }
+    std::stable_sort(scored.begin(), scored.end(),
+                     [](const std::pair<std::uint64_t, unsigned> &a, const std::pair<std::uint64_t, unsigned> &b) {
+                         return a.first < b.first;
+                     });
+
+    std::vector<unsigned> replicas;
+    replicas.reserve(scored.size());
+    for (const auto &entry : scored) {
+        replicas.push_back(entry.second);
+    }
+    return replicas;
+}
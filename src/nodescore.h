@@ -0,0 +1,65 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_NODESCORE_H
+#define LCB_NODESCORE_H
+
+#include <cstdint>
+#include <vector>
+
+#include <libcouchbase/couchbase.h>
+#include <lcbio/lcbio.h>
+
+namespace lcb
+{
+/**
+ * Peak-EWMA of the response times of a node (see LCB_CNTL_NODE_SCORE).
+ *
+ * A response slower than the average replaces it at once, so that a node
+ * which starts to stall is avoided from its first slow response. Faster
+ * responses pull the average down gradually, each sample weighing according
+ * to the time elapsed since the previous one, so that the average reflects
+ * the last `decay` nanoseconds whatever the rate of responses.
+ */
+class PeakEwma
+{
+  public:
+    static const hrtime_t decay = 1000000000;
+
+    void add(hrtime_t latency, hrtime_t now);
+
+    /** @return the average response time in nanoseconds, 0 if none was measured */
+    std::uint64_t value() const
+    {
+        return static_cast<std::uint64_t>(ewma_);
+    }
+
+  private:
+    double ewma_{0};
+    hrtime_t stamp_{0};
+};
+} // namespace lcb
+
+/**
+ * Orders the replicas of a vBucket by the score of their node, lowest
+ * (fastest) first. Nodes with the same score keep the order of the map.
+ * @return the replica numbers (as passed to lcbvb_vbreplica()) of the
+ * replicas which have a node
+ */
+std::vector<unsigned> replicas_by_score(lcb_INSTANCE *instance, int vbid);
+
+#endif /* LCB_NODESCORE_H */
@@ -201,6 +201,7 @@ static lcb_STATUS counter_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_C
     hdr.request.magic = framing_extras.empty() ? PROTOCOL_BINARY_REQ : PROTOCOL_BINARY_AREQ;
 
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
+    hdr.request.opcode = cmd->delta() < 0 ? PROTOCOL_BINARY_CMD_DECREMENT : PROTOCOL_BINARY_CMD_INCREMENT;
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     err = mcreq_basic_packet(q, &keybuf, cmd->collection().collection_id(), &hdr, 20, ffextlen, &packet, &pipeline,
                              MCREQ_BASICPACKET_F_FALLBACKOK);
@@ -220,10 +221,8 @@ static lcb_STATUS counter_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_C
 
     std::uint64_t delta;
     if (cmd->delta() < 0) {
-        hdr.request.opcode = PROTOCOL_BINARY_CMD_DECREMENT;
         delta = lcb_htonll((std::uint64_t)(cmd->delta() * -1));
     } else {
-        hdr.request.opcode = PROTOCOL_BINARY_CMD_INCREMENT;
         delta = lcb_htonll(cmd->delta());
     }
 
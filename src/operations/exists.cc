@@ -156,6 +156,8 @@ static lcb_STATUS exists_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     hdr.request.magic = framing_extras.empty() ? PROTOCOL_BINARY_REQ : PROTOCOL_BINARY_AREQ;
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
 
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_GET_META;
+
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     err = mcreq_basic_packet(cq, &keybuf, cmd->collection().collection_id(), &hdr, 0, ffextlen, &pkt, &pipeline,
                              MCREQ_BASICPACKET_F_FALLBACKOK);
@@ -163,7 +165,6 @@ static lcb_STATUS exists_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
         return err;
     }
 
-    hdr.request.opcode = PROTOCOL_BINARY_CMD_GET_META;
     hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     hdr.request.bodylen = ntohl(mcreq_get_key_size(&hdr));
     hdr.request.opaque = pkt->opaque;
@@ -21,6 +21,9 @@
 #include "collections.h"
 #include "trace.h"
 #include "defer.h"
+#include "getflights.h"
+#include "nearcache.h"
+#include "hedging.h"
 
 #include "capi/cmd_get.hh"
 
@@ -73,6 +76,16 @@ LIBCOUCHBASE_API lcb_STATUS lcb_respget_value(const lcb_RESPGET *resp, const cha
     return LCB_SUCCESS;
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_respget_value_retain(const lcb_RESPGET *resp, lcb_BACKBUF *buf)
+{
+    if (resp->bufh == nullptr || resp->nvalue == 0) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    *buf = reinterpret_cast<lcb_BACKBUF>(resp->bufh);
+    lcb_backbuf_ref(*buf);
+    return LCB_SUCCESS;
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_create(lcb_CMDGET **cmd)
 {
     *cmd = new lcb_CMDGET{};
@@ -90,6 +103,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_timeout(lcb_CMDGET *cmd, uint32_t timeout
     return cmd->timeout_in_microseconds(timeout);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_priority(lcb_CMDGET *cmd, lcb_PRIORITY priority)
+{
+    return cmd->priority(priority);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdget_parent_span(lcb_CMDGET *cmd, lcbtrace_SPAN *span)
 {
     return cmd->parent_span(span);
@@ -148,6 +166,84 @@ static lcb_STATUS get_validate(lcb_INSTANCE *instance, const lcb_CMDGET *cmd)
     return LCB_SUCCESS;
 }
 
+namespace lcb
+{
+std::string GetFlights::make_key(std::uint32_t cid, const std::string &key)
+{
+    std::string res(reinterpret_cast<const char *>(&cid), sizeof(cid));
+    res.append(key);
+    return res;
+}
+
+bool GetFlights::join(const std::string &key, void *cookie)
+{
+    auto pos = flights_.find(key);
+    if (pos == flights_.end()) {
+        return false;
+    }
+    pos->second->waiters_.push_back(cookie);
+    return true;
+}
+
+void GetFlights::start(GetFlight *flight)
+{
+    flights_[flight->key_] = flight;
+}
+
+void GetFlights::finish(const GetFlight *flight)
+{
+    auto pos = flights_.find(flight->key_);
+    if (pos != flights_.end() && pos->second == flight) {
+        flights_.erase(pos);
+    }
+}
+
+static void handle_get_flight(mc_PIPELINE *, mc_PACKET *pkt, lcb_CALLBACK_TYPE cbtype, lcb_STATUS, const void *arg)
+{
+    auto *flight = static_cast<GetFlight *>(pkt->u_rdata.exdata);
+    lcb_INSTANCE *instance = flight->instance_;
+    instance->getflights->finish(flight);
+
+    lcb_RESPGET resp = *static_cast<const lcb_RESPGET *>(arg);
+    std::string collection_path = instance->collcache->id_to_name(mcreq_get_cid(instance, pkt));
+    size_t dot = collection_path.find('.');
+    if (dot != std::string::npos) {
+        resp.ctx.scope = collection_path.substr(0, dot);
+        resp.ctx.collection = collection_path.substr(dot + 1);
+    }
+
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (metrics) {
+        metrics->get_collapsed += flight->waiters_.size();
+    }
+
+    lcb_RESPCALLBACK callback = lcb_find_callback(instance, cbtype);
+    resp.cookie = flight->cookie;
+    callback(instance, cbtype, reinterpret_cast<const lcb_RESPBASE *>(&resp));
+    for (void *cookie : flight->waiters_) {
+        resp.cookie = cookie;
+        callback(instance, cbtype, reinterpret_cast<const lcb_RESPBASE *>(&resp));
+    }
+    delete flight;
+}
+
+static void handle_get_flight_schedfail(mc_PACKET *pkt)
+{
+    /* the commands which joined it are in the same scheduling context */
+    auto *flight = static_cast<GetFlight *>(pkt->u_rdata.exdata);
+    flight->instance_->getflights->finish(flight);
+    delete flight;
+}
+
+mc_REQDATAPROCS GetFlight::proctable = {handle_get_flight, handle_get_flight_schedfail};
+} // namespace lcb
+
+/* Whether the command may be answered with the value read for another one */
+static bool get_is_shareable(const lcb_CMDGET *cmd)
+{
+    return !cmd->with_lock() && !cmd->with_touch() && !cmd->want_impersonation() && !cmd->is_cookie_callback();
+}
+
 static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGET> cmd)
 {
     mc_PIPELINE *pl;
@@ -159,6 +255,21 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     protocol_binary_request_header hdr{};
     lcb_STATUS err;
 
+    bool single_flight = false;
+    bool shareable = get_is_shareable(cmd.get());
+    std::string doc_key;
+    if (shareable &&
+        (LCBT_SETTING(instance, near_cache_size) || LCBT_SETTING(instance, get_single_flight))) {
+        doc_key = lcb::GetFlights::make_key(cmd->collection().collection_id(), cmd->key());
+        if (LCBT_SETTING(instance, near_cache_size) && nearcache_get(instance, *cmd, doc_key)) {
+            return LCB_SUCCESS;
+        }
+        single_flight = LCBT_SETTING(instance, get_single_flight);
+        if (single_flight && instance->getflights->join(doc_key, cmd->cookie())) {
+            return LCB_SUCCESS;
+        }
+    }
+
     std::vector<std::uint8_t> framing_extras;
     if (cmd->want_impersonation()) {
         err = lcb::flexible_framing_extras::encode_impersonate_user(cmd->impostor(), framing_extras);
@@ -183,6 +294,7 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
         extlen = 4;
         opcode = PROTOCOL_BINARY_CMD_GAT;
     }
+    hdr.request.opcode = opcode;
 
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     err = mcreq_basic_packet(q, &keybuf, cmd->collection().collection_id(), &hdr, extlen, ffextlen, &pkt, &pl,
@@ -191,13 +303,31 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
         return err;
     }
 
-    rdata = &pkt->u_rdata.reqdata;
+    /* a GET which others may join is not hedged, so that a stale replica value is not fanned out */
+    hrtime_t hedge_after = 0;
+    if (single_flight) {
+        auto *flight = new lcb::GetFlight(instance, std::move(doc_key), cmd->cookie(), 0);
+        pkt->u_rdata.exdata = flight;
+        pkt->flags |= MCREQ_F_REQEXT;
+        instance->getflights->start(flight);
+    } else if (shareable && LCBT_SETTING(instance, get_hedge_budget) && LCBT_NREPLICAS(instance) > 0) {
+        hedge_after = hedge_delay(instance, pl);
+        if (hedge_after) {
+            pkt->u_rdata.exdata = new lcb::HedgedGet(instance, cmd->key(), cmd->collection().collection_id(),
+                                                     ntohs(hdr.request.vbucket), pl, cmd->cookie());
+            pkt->flags |= MCREQ_F_REQEXT;
+        }
+    }
+
+    rdata = MCREQ_PKT_RDATA(pkt);
     rdata->cookie = cmd->cookie();
     rdata->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
     rdata->deadline =
         rdata->start + cmd->timeout_or_default_in_nanoseconds(LCB_US2NS(LCBT_SETTING(instance, operation_timeout)));
+    if (hedge_after) {
+        hedge_arm(instance, static_cast<lcb::HedgedGet *>(pkt->u_rdata.exdata), hedge_after);
+    }
 
-    hdr.request.opcode = opcode;
     hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
     hdr.request.bodylen = htonl(extlen + ffextlen + mcreq_get_key_size(&hdr));
     hdr.request.opaque = pkt->opaque;
@@ -206,6 +336,9 @@ static lcb_STATUS get_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMDGE
     if (cmd->is_cookie_callback()) {
         pkt->flags |= MCREQ_F_PRIVCALLBACK;
     }
+    if (cmd->priority() == LCB_PRIORITY_BULK) {
+        pkt->flags |= MCREQ_F_BULK;
+    }
 
     memcpy(SPAN_BUFFER(&pkt->kh_span), &hdr, sizeof(hdr));
     std::size_t offset = sizeof(hdr);
@@ -20,6 +20,7 @@
 #include "internal.h"
 #include "collections.h"
 #include "defer.h"
+#include "nodescore.h"
 
 #include "capi/cmd_get.hh"
 #include "capi/cmd_get_replica.hh"
@@ -160,7 +161,8 @@ struct RGetCookie : mc_REQDATAEX {
     }
 
     unsigned r_cur{0};
-    unsigned r_max;
+    /** Replicas to try in turn for get_replica_mode::any, fastest first */
+    std::vector<unsigned> order{};
     int remaining{0};
     int vbucket;
     get_replica_mode strategy;
@@ -205,18 +207,16 @@ static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TY
         mc_PIPELINE *nextpl = nullptr;
 
         /** FIRST */
-        do {
-            int nextix;
-            rck->r_cur++;
-            nextix = lcbvb_vbreplica(cq->config, rck->vbucket, rck->r_cur);
+        while (++rck->r_cur < rck->order.size()) {
+            int nextix = lcbvb_vbreplica(cq->config, rck->vbucket, rck->order[rck->r_cur]);
             if (nextix > -1 && nextix < (int)cq->npipelines) {
                 /* have a valid next index? */
-                nextpl = cq->pipelines[nextix];
+                nextpl = mcreq_pipeline_stripe(cq->pipelines[nextix], rck->vbucket, PROTOCOL_BINARY_CMD_GET_REPLICA);
                 break;
             }
-        } while (rck->r_cur < rck->r_max);
+        }
 
-        if (err == LCB_SUCCESS || rck->r_cur == rck->r_max || nextpl == nullptr) {
+        if (err == LCB_SUCCESS || nextpl == nullptr) {
             resp->rflags |= LCB_RESP_F_FINAL;
             callback(instance, LCB_CALLBACK_GETREPLICA, (lcb_RESPBASE *)resp);
             /* refcount=1 . Free this now */
@@ -238,8 +238,7 @@ static void rget_callback(mc_PIPELINE *pipeline, mc_PACKET *pkt, lcb_CALLBACK_TY
 static const mc_REQDATAPROCS rget_procs = {rget_callback, rget_dtor};
 
 RGetCookie::RGetCookie(void *cookie_, lcb_INSTANCE *instance_, get_replica_mode strategy_, int vbucket_)
-    : mc_REQDATAEX(cookie_, rget_procs, gethrtime()), r_max(LCBT_NREPLICAS(instance_)), vbucket(vbucket_),
-      strategy(strategy_), instance(instance_)
+    : mc_REQDATAEX(cookie_, rget_procs, gethrtime()), vbucket(vbucket_), strategy(strategy_), instance(instance_)
 {
 }
 
@@ -311,6 +310,7 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
     int vbid, ixtmp;
     protocol_binary_request_header req{};
     unsigned r0 = 0, r1 = 0;
+    std::vector<unsigned> order;
 
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     mcreq_map_key(cq, &keybuf, MCREQ_PKT_BASESIZE, &vbid, &ixtmp);
@@ -339,15 +339,12 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
             break;
 
         case get_replica_mode::any:
-            for (r0 = 0; r0 < LCBT_NREPLICAS(instance); r0++) {
-                if ((ixtmp = lcbvb_vbreplica(cq->config, vbid, r0)) > -1) {
-                    r1 = r0;
-                    break;
-                }
-            }
-            if (r0 == LCBT_NREPLICAS(instance)) {
+            /* start with the replica whose node currently responds fastest */
+            order = replicas_by_score(instance, vbid);
+            if (order.empty()) {
                 return LCB_ERR_NO_MATCHING_SERVER;
             }
+            r0 = r1 = order[0];
             break;
     }
 
@@ -386,6 +383,11 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
 
     rck->r_cur = r0;
+    if (!order.empty()) {
+        /* for get_replica_mode::any, r_cur is the position within the order */
+        rck->order = std::move(order);
+        rck->r_cur = 0;
+    }
     do {
         int curix;
         mc_PIPELINE *pl;
@@ -396,7 +398,7 @@ static lcb_STATUS get_replica_schedule(lcb_INSTANCE *instance, std::shared_ptr<l
          * it will seek to the first valid index (checked above), and for the
          * ALL mode, it will fail if not all replicas are already online
          * (also checked above) */
-        pl = cq->pipelines[curix];
+        pl = mcreq_pipeline_stripe(cq->pipelines[curix], vbid, PROTOCOL_BINARY_CMD_GET_REPLICA);
         pkt = mcreq_allocate_packet(pl);
         if (!pkt) {
             delete rck;
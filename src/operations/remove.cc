@@ -176,6 +176,8 @@ static lcb_STATUS remove_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     hdr.request.magic = framing_extras.empty() ? PROTOCOL_BINARY_REQ : PROTOCOL_BINARY_AREQ;
     auto ffextlen = static_cast<std::uint8_t>(framing_extras.size());
 
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_DELETE;
+
     lcb_KEYBUF keybuf{LCB_KV_COPY, {cmd->key().c_str(), cmd->key().size()}};
     err = mcreq_basic_packet(cq, &keybuf, cmd->collection().collection_id(), &hdr, 0, ffextlen, &pkt, &pl,
                              MCREQ_BASICPACKET_F_FALLBACKOK);
@@ -184,7 +186,6 @@ static lcb_STATUS remove_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     }
 
     hdr.request.datatype = PROTOCOL_BINARY_RAW_BYTES;
-    hdr.request.opcode = PROTOCOL_BINARY_CMD_DELETE;
     hdr.request.cas = lcb_htonll(cmd->cas());
     hdr.request.opaque = pkt->opaque;
     hdr.request.bodylen = htonl(ffextlen + hdr.request.extlen + mcreq_get_key_size(&hdr));
@@ -17,6 +17,7 @@
 #include "internal.h"
 #include "collections.h"
 #include "mc/compress.h"
+#include "mc/compresspolicy.h"
 #include "trace.h"
 #include "defer.h"
 #include "durability_internal.h"
@@ -150,6 +151,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_timeout(lcb_CMDSTORE *cmd, uint32_t tim
     return cmd->timeout_in_microseconds(timeout);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_priority(lcb_CMDSTORE *cmd, lcb_PRIORITY priority)
+{
+    return cmd->priority(priority);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_parent_span(lcb_CMDSTORE *cmd, lcbtrace_SPAN *span)
 {
     return cmd->parent_span(span);
@@ -188,6 +194,23 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov(lcb_CMDSTORE *cmd, const lcb_
     return cmd->value(value, value_len);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_nocopy(lcb_CMDSTORE *cmd, const char *value, size_t value_len)
+{
+    if (value == nullptr || value_len == 0) {
+        return cmd->value(std::string());
+    }
+    lcb_IOV iov{const_cast<char *>(value), value_len};
+    return cmd->value_ref(&iov, 1);
+}
+
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_value_iov_nocopy(lcb_CMDSTORE *cmd, const lcb_IOV *value, size_t value_len)
+{
+    if (value == nullptr || value_len == 0) {
+        return cmd->value(std::string());
+    }
+    return cmd->value_ref(value, value_len);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdstore_expiry(lcb_CMDSTORE *cmd, uint32_t expiration)
 {
     return cmd->expiry(expiration);
@@ -426,15 +449,59 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
 
     int should_compress = can_compress(instance, pipeline, cmd->value_is_compressed());
     lcb_VALBUF valuebuf{LCB_KV_COPY, {{cmd->value().c_str(), cmd->value().size()}}};
+    if (cmd->value_is_referenced()) {
+        const std::vector<lcb_IOV> &iov = cmd->value_ref();
+        if (iov.size() == 1) {
+            valuebuf.vtype = LCB_KV_CONTIG;
+            valuebuf.u_buf.contig.bytes = iov[0].iov_base;
+            valuebuf.u_buf.contig.nbytes = iov[0].iov_len;
+        } else {
+            valuebuf.vtype = LCB_KV_IOV;
+            valuebuf.u_buf.multi.iov = const_cast<lcb_IOV *>(iov.data());
+            valuebuf.u_buf.multi.niov = static_cast<unsigned>(iov.size());
+            valuebuf.u_buf.multi.total_length = 0;
+        }
+    }
+    std::size_t value_size = cmd->value_size();
+    std::uint32_t stream = cmd->collection().collection_id();
+    bool adaptive = LCBT_SETTING(instance, compress_adaptive);
+    lcb_METRICS *metrics = LCBT_SETTING(instance, metrics);
+    if (should_compress && adaptive && value_size >= LCBT_SETTING(instance, compress_min_size) &&
+        !instance->compress_policy->should_attempt(stream)) {
+        should_compress = 0;
+        if (metrics) {
+            metrics->compression_skipped++;
+        }
+    }
     if (should_compress) {
-        int rv = mcreq_compress_value(pipeline, packet, &valuebuf, instance->settings, &should_compress);
+        std::size_t compressed_size = 0;
+        hrtime_t start = gethrtime();
+        int rv = mcreq_compress_value_ex(pipeline, packet, &valuebuf, instance->settings, &should_compress,
+                                         &compressed_size);
         if (rv != 0) {
             mcreq_release_packet(pipeline, packet);
             return LCB_ERR_NO_MEMORY;
         }
+        if (compressed_size) {
+            if (adaptive) {
+                instance->compress_policy->record(stream, value_size, compressed_size, gethrtime() - start,
+                                                  LCBT_SETTING(instance, compress_min_ratio));
+            }
+            if (metrics) {
+                metrics->compression_attempted++;
+                if (should_compress) {
+                    metrics->compression_succeeded++;
+                }
+            }
+        }
     } else {
         mcreq_reserve_value(pipeline, packet, &valuebuf);
     }
+    /* Compression copies the value, unless it did not pay off */
+    std::uint32_t zerocopy_threshold = LCBT_SETTING(instance, kv_zerocopy_threshold);
+    if ((packet->flags & MCREQ_F_VALUE_NOCOPY) && zerocopy_threshold && cmd->value_size() >= zerocopy_threshold) {
+        packet->flags |= MCREQ_F_ZEROCOPY;
+    }
 
     if (cmd->need_poll_durability()) {
         int duropts = 0;
@@ -476,6 +543,9 @@ static lcb_STATUS store_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CMD
     if (cmd->is_cookie_callback()) {
         packet->flags |= MCREQ_F_PRIVCALLBACK;
     }
+    if (cmd->priority() == LCB_PRIORITY_BULK) {
+        packet->flags |= MCREQ_F_BULK;
+    }
 
     memcpy(SPAN_BUFFER(&packet->kh_span), &hdr, sizeof(hdr));
 
@@ -110,6 +110,11 @@ LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_timeout(lcb_CMDSUBDOC *cmd, uint32_t t
     return cmd->timeout_in_microseconds(timeout);
 }
 
+LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_priority(lcb_CMDSUBDOC *cmd, lcb_PRIORITY priority)
+{
+    return cmd->priority(priority);
+}
+
 LIBCOUCHBASE_API lcb_STATUS lcb_cmdsubdoc_cas(lcb_CMDSUBDOC *cmd, uint64_t cas)
 {
     return cmd->cas(cas);
@@ -858,6 +863,9 @@ static lcb_STATUS subdoc_schedule(lcb_INSTANCE *instance, std::shared_ptr<lcb_CM
     if (ctx.is_mutate() && !cmd->options().insert_document) {
         pkt->flags |= MCREQ_F_REPLACE_SEMANTICS;
     }
+    if (cmd->priority() == LCB_PRIORITY_BULK) {
+        pkt->flags |= MCREQ_F_BULK;
+    }
 
     MCREQ_PKT_RDATA(pkt)->cookie = cmd->cookie();
     MCREQ_PKT_RDATA(pkt)->start = cmd->start_time_or_default_in_nanoseconds(gethrtime());
@@ -115,6 +115,11 @@ class MemcachedResponse
         return res.response.opcode;
     }
 
+    uint8_t magic() const
+    {
+        return res.response.magic;
+    }
+
     /**
      * Gets the CAS for the packet
      */
@@ -0,0 +1,203 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <stddef.h>
+#include <string.h>
+#include "rope.h"
+#include "poolalloc.h"
+
+/* Index of the smallest class which fits `size`, or -1 if it is too large */
+static int size_class(unsigned size)
+{
+    int ix = 0;
+    unsigned clsize = RDB_POOLALLOC_CLASS_MIN;
+    if (size > RDB_POOLALLOC_CLASS_MAX) {
+        return -1;
+    }
+    while (clsize < size) {
+        clsize <<= 1;
+        ix++;
+    }
+    return ix;
+}
+
+/* The segment header and its buffer are allocated together */
+static rdb_ROPESEG *seg_new(unsigned size)
+{
+    rdb_ROPESEG *seg = malloc(sizeof(*seg) + size);
+    if (seg == NULL) {
+        return NULL;
+    }
+    memset(seg, 0, sizeof(*seg));
+    seg->root = (char *)(seg + 1);
+    seg->nalloc = size;
+    return seg;
+}
+
+static void alloc_decref(rdb_ALLOCATOR *abase)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    unsigned ii;
+    if (--alloc->refcount) {
+        return;
+    }
+
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_list_t *llcur;
+        while ((llcur = lcb_clist_pop(&alloc->classes[ii])) != NULL) {
+            free(LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode));
+        }
+    }
+    free(alloc);
+}
+
+static rdb_ROPESEG *seg_alloc(rdb_ALLOCATOR *abase, unsigned size)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    rdb_ROPESEG *newseg = NULL;
+    int ix = size_class(size);
+
+    alloc->n_requests++;
+    if (ix < 0) {
+        alloc->n_oversized++;
+        alloc->n_malloc++;
+        newseg = seg_new(size);
+    } else {
+        lcb_list_t *llcur = lcb_clist_shift(&alloc->classes[ix]);
+        if (llcur) {
+            newseg = LCB_LIST_ITEM(llcur, rdb_ROPESEG, llnode);
+            alloc->nb_pooled -= newseg->nalloc;
+            alloc->n_reused++;
+        } else {
+            alloc->n_malloc++;
+            newseg = seg_new(RDB_POOLALLOC_CLASS_MIN << ix);
+        }
+    }
+    if (newseg == NULL) {
+        return NULL;
+    }
+
+    newseg->shflags = RDB_ROPESEG_F_LIB;
+    newseg->allocator = abase;
+    newseg->allocid = RDB_ALLOCATOR_POOLED;
+    newseg->start = 0;
+    newseg->nused = 0;
+    newseg->refcnt = 0;
+    alloc->n_outstanding++;
+    alloc->refcount++;
+    return newseg;
+}
+
+static void seg_release(rdb_ALLOCATOR *abase, rdb_ROPESEG *seg)
+{
+    rdb_POOLALLOC *alloc = (rdb_POOLALLOC *)abase;
+    int ix = size_class(seg->nalloc);
+    lcb_clist_t *cl = ix < 0 ? NULL : &alloc->classes[ix];
+
+    alloc->n_outstanding--;
+    if (cl && LCB_CLIST_SIZE(cl) < RDB_POOLALLOC_BLKCNT_MAX &&
+        alloc->nb_pooled + seg->nalloc <= RDB_POOLALLOC_POOLSZ_MAX) {
+        /* recently used buffers are more likely to be cached */
+        lcb_clist_prepend(cl, &seg->llnode);
+        alloc->nb_pooled += seg->nalloc;
+    } else {
+        free(seg);
+    }
+    alloc_decref(abase);
+}
+
+static rdb_ROPESEG *seg_realloc(rdb_ALLOCATOR *abase, rdb_ROPESEG *seg, unsigned size)
+{
+    rdb_ROPESEG *newseg;
+    if (size <= seg->nalloc) {
+        return seg;
+    }
+    newseg = seg_alloc(abase, size);
+    if (newseg == NULL) {
+        return NULL;
+    }
+    memcpy(newseg->root, seg->root, seg->start + seg->nused);
+    newseg->start = seg->start;
+    newseg->nused = seg->nused;
+    newseg->shflags = seg->shflags;
+    newseg->refcnt = seg->refcnt;
+    seg_release(abase, seg);
+    return newseg;
+}
+
+static void buf_reserve(rdb_pALLOCATOR abase, rdb_ROPEBUF *buf, unsigned cap)
+{
+    rdb_ROPESEG *newseg, *lastseg;
+    unsigned to_alloc;
+
+    lastseg = RDB_SEG_LAST(buf);
+    if (lastseg && RDB_SEG_SPACE(lastseg) + buf->nused >= cap) {
+        return;
+    }
+
+    to_alloc = cap;
+    if (lastseg) {
+        to_alloc -= lastseg->nalloc - lastseg->start;
+    }
+    newseg = seg_alloc(abase, to_alloc);
+    lcb_list_append(&buf->segments, &newseg->llnode);
+}
+
+static void dump_wrap(rdb_pALLOCATOR alloc, FILE *fp)
+{
+    rdb_poolalloc_dump((rdb_POOLALLOC *)alloc, fp);
+}
+
+rdb_ALLOCATOR *rdb_poolalloc_new(void)
+{
+    rdb_ALLOCATOR *abase;
+    unsigned ii;
+    rdb_POOLALLOC *alloc = calloc(1, sizeof(*alloc));
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        lcb_clist_init(&alloc->classes[ii]);
+    }
+    alloc->refcount = 1;
+
+    abase = &alloc->base;
+    abase->r_reserve = buf_reserve;
+    abase->s_release = seg_release;
+    abase->s_alloc = seg_alloc;
+    abase->s_realloc = seg_realloc;
+    abase->a_release = alloc_decref;
+    abase->dump = dump_wrap;
+    return &alloc->base;
+}
+
+void rdb_poolalloc_dump(rdb_POOLALLOC *alloc, FILE *fp)
+{
+    static const char *indent = "  ";
+    unsigned ii;
+    fprintf(fp, "POOLALLOC @%p\n", (void *)alloc);
+    for (ii = 0; ii < RDB_POOLALLOC_NCLASSES; ii++) {
+        if (LCB_CLIST_SIZE(&alloc->classes[ii])) {
+            fprintf(fp, "%sPooled Blocks (%u): %lu\n", indent, RDB_POOLALLOC_CLASS_MIN << ii,
+                    (unsigned long int)LCB_CLIST_SIZE(&alloc->classes[ii]));
+        }
+    }
+    fprintf(fp, "%sPooledBytes: %lu\n", indent, (unsigned long int)alloc->nb_pooled);
+    fprintf(fp, "%sTotalRequests: %lu\n", indent, (unsigned long int)alloc->n_requests);
+    fprintf(fp, "%sTotalReused: %lu\n", indent, (unsigned long int)alloc->n_reused);
+    fprintf(fp, "%sTotalMalloc: %lu\n", indent, (unsigned long int)alloc->n_malloc);
+    fprintf(fp, "%sTotalOversized: %lu\n", indent, (unsigned long int)alloc->n_oversized);
+    fprintf(fp, "%sOutstanding: %lu\n", indent, (unsigned long int)alloc->n_outstanding);
+}
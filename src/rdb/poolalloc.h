@@ -0,0 +1,74 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef RDB_POOLALLOC
+#define RDB_POOLALLOC
+#include "list.h"
+#include <stdio.h>
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Size-classed pool allocator. Segments are rounded up to a power of two
+ * between RDB_POOLALLOC_CLASS_MIN and RDB_POOLALLOC_CLASS_MAX bytes, and
+ * released segments are kept in a free list per size class, so that a
+ * steady stream of similarly sized requests is served without touching
+ * malloc(). Larger segments are not pooled.
+ *
+ * Segments may outlive the allocator's owner (e.g. when referenced with
+ * rdb_seg_ref()); the allocator is freed once its last segment is released.
+ *
+ * This header file exists for internal use. To create an allocator instance,
+ * refer to rdb_poolalloc_new() in rope.h
+ */
+
+#define RDB_POOLALLOC_CLASS_MIN 512
+#define RDB_POOLALLOC_NCLASSES 12
+#define RDB_POOLALLOC_CLASS_MAX (RDB_POOLALLOC_CLASS_MIN << (RDB_POOLALLOC_NCLASSES - 1))
+
+/** Maximum number of free segments kept for each class */
+#define RDB_POOLALLOC_BLKCNT_MAX 16
+
+/** Maximum number of bytes kept in all the free lists */
+#define RDB_POOLALLOC_POOLSZ_MAX (4 * 1024 * 1024)
+
+typedef struct {
+    rdb_ALLOCATOR base;
+    lcb_clist_t classes[RDB_POOLALLOC_NCLASSES]; /* free segments, by size class */
+    unsigned refcount;
+
+    lcb_U64 n_requests;    /* segments requested */
+    lcb_U64 n_reused;      /* requests served from a free list */
+    lcb_U64 n_malloc;      /* requests served with malloc() */
+    lcb_U64 n_oversized;   /* requests larger than RDB_POOLALLOC_CLASS_MAX */
+    lcb_U64 n_outstanding; /* segments not released yet */
+    lcb_U64 nb_pooled;     /* bytes in the free lists */
+} rdb_POOLALLOC;
+
+/**
+ * Dumps a textual representation of the specified allocator to a FILE
+ * @param alloc
+ * @param fp
+ */
+void rdb_poolalloc_dump(rdb_POOLALLOC *alloc, FILE *fp);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
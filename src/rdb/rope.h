@@ -167,6 +167,7 @@ enum rdb_ALLOCID {
     RDB_ALLOCATOR_BIGALLOC = 1,
     RDB_ALLOCATOR_CHUNKED,
     RDB_ALLOCATOR_LIBCALLOC,
+    RDB_ALLOCATOR_POOLED,
 
     /** use constants higher than this for your own allocator(s) */
     RDB_ALLOCATOR_MAX
@@ -438,6 +439,14 @@ rdb_ALLOCATOR *rdb_chunkalloc_new(unsigned chunksize);
 LCB_INTERNAL_API
 rdb_ALLOCATOR *rdb_libcalloc_new(void);
 
+/**
+ * Returns an allocator which pools segments by size class. It is intended
+ * for segments which are allocated and released one at a time, rather than
+ * for read-ahead.
+ */
+LCB_INTERNAL_API
+rdb_ALLOCATOR *rdb_poolalloc_new(void);
+
 /**
  * Dump information about the iorope structure to a file
  * @param ior The rope structure to dump
@@ -0,0 +1,35 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include <algorithm>
+
+#include "retrybudget.h"
+#include "rnd.h"
+
+using namespace lcb;
+
+void RetryBudget::deposit(std::uint32_t percent)
+{
+    credit_ = std::min(credit_ + percent, burst * 100);
+}
+
+hrtime_t lcb::decorrelated_jitter(hrtime_t base, hrtime_t prev, hrtime_t cap)
+{
+    hrtime_t high = std::max(prev, base) * 3;
+    hrtime_t delay = base + lcb_next_rand64() % (high - base + 1);
+    return std::min(delay, std::max(cap, base));
+}
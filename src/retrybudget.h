@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_RETRYBUDGET_H
+#define LCB_RETRYBUDGET_H
+
+#include <cstdint>
+
+#include <lcbio/lcbio.h>
+
+namespace lcb
+{
+/**
+ * Token bucket limiting the commands retried because the server was
+ * overloaded to a percentage of the commands it answered successfully (see
+ * LCB_CNTL_RETRY_BUDGET). Every success earns that percentage of a retry,
+ * and every retry spends a whole one. The bucket starts full and holds at
+ * most `burst` retries, so that occasional failures are always retried, and
+ * only the last successes count once a node starts failing.
+ */
+class RetryBudget
+{
+  public:
+    static const std::uint32_t burst = 10;
+
+    /** Accounts a successful response, with a budget of @p percent */
+    void deposit(std::uint32_t percent);
+
+    /** @return whether a retry may be charged */
+    bool available() const
+    {
+        return credit_ >= 100;
+    }
+
+    /** Charges a retry, which must be available() */
+    void withdraw()
+    {
+        credit_ -= 100;
+    }
+
+  private:
+    /** In hundredths of a retry */
+    std::uint32_t credit_{burst * 100};
+};
+
+/**
+ * Computes the next delay of a "decorrelated jitter" backoff: a random
+ * delay between @p base and three times the previous one, at most @p cap.
+ * Unlike a fixed schedule, clients which failed at the same time do not
+ * retry at the same time again.
+ *
+ * @param base the shortest delay
+ * @param prev the previous delay, or @p base for the first retry
+ * @param cap the longest delay
+ */
+hrtime_t decorrelated_jitter(hrtime_t base, hrtime_t prev, hrtime_t cap);
+} // namespace lcb
+
+#endif /* LCB_RETRYBUDGET_H */
@@ -30,16 +30,19 @@
 using namespace lcb;
 struct SchedNode : lcb_list_t {
 };
-struct TmoNode : lcb_list_t {
+struct SchedTimer : lcbio_TWENTRY {
+};
+struct TmoTimer : lcbio_TWENTRY {
 };
 
-struct lcb::RetryOp : mc_EPKTDATUM, SchedNode, TmoNode {
+struct lcb::RetryOp : mc_EPKTDATUM, SchedNode, SchedTimer, TmoTimer {
     /**Cache the actual start time of the command. Since the start time may
      * change if read_ts_wait is enabled, and we don't want to end up looping
      * on a command forever. */
     hrtime_t start;
     hrtime_t deadline;
     hrtime_t trytime; /**< Next retry time */
+    hrtime_t backoff; /**< Last delay between retries */
     mc_PACKET *pkt;
     lcb_STATUS origerr;
     protocol_binary_response_status origstatus;
@@ -57,21 +60,6 @@ static RetryOp *from_schednode(lcb_list_t *ll)
 {
     return static_cast<RetryOp *>(static_cast<SchedNode *>(ll));
 }
-static RetryOp *from_tmonode(lcb_list_t *ll)
-{
-    return static_cast<RetryOp *>(static_cast<TmoNode *>(ll));
-}
-template <typename T>
-int list_cmp(const T &a, const T &b)
-{
-    if (a == b) {
-        return 0;
-    } else if (a > b) {
-        return 1;
-    } else {
-        return -1;
-    }
-}
 
 hrtime_t RetryQueue::get_retry_interval() const
 {
@@ -88,8 +76,10 @@ hrtime_t RetryQueue::get_retry_interval() const
 void RetryQueue::update_trytime(RetryOp *op, hrtime_t now)
 {
     /**
-     * Estimate the next retry timestamp. This is:
-     * Base interval + (Number of retries x Backoff factor)
+     * Estimate the next retry timestamp. This is the interval given by the
+     * error map for the error, or else a random delay from the retry interval
+     * up to three times the previous one, so that commands which failed
+     * together (e.g. on a node in temporary failure) are spread out.
      */
     if (!now) {
         now = gethrtime();
@@ -106,19 +96,20 @@ void RetryQueue::update_trytime(RetryOp *op, hrtime_t now)
         op->trytime = now + (LCB_US2NS(us_trytime));
     } else {
     GT_DEFAULT:
-        op->trytime = now + (hrtime_t)((float)get_retry_interval() * (float)op->pkt->retries);
+        hrtime_t remaining = op->deadline > now ? op->deadline - now : 0;
+        op->backoff = decorrelated_jitter(get_retry_interval(), op->backoff, remaining);
+        op->trytime = now + op->backoff;
     }
 }
 
-/** Comparison routine for sorting by timeout */
-static int cmpfn_tmo(lcb_list_t *ll_a, lcb_list_t *ll_b)
+static void sched_expired(lcbio_TWENTRY *entry, void *arg)
 {
-    return list_cmp(from_tmonode(ll_a)->deadline, from_tmonode(ll_b)->deadline);
+    reinterpret_cast<RetryQueue *>(arg)->retry_ready(static_cast<RetryOp *>(static_cast<SchedTimer *>(entry)));
 }
 
-static int cmpfn_retry(lcb_list_t *ll_a, lcb_list_t *ll_b)
+static void tmo_expired(lcbio_TWENTRY *entry, void *arg)
 {
-    return list_cmp(from_schednode(ll_a)->trytime, from_schednode(ll_b)->trytime);
+    reinterpret_cast<RetryQueue *>(arg)->retry_timeout(static_cast<RetryOp *>(static_cast<TmoTimer *>(entry)));
 }
 
 static void assign_error(RetryOp *op, lcb_STATUS err)
@@ -146,7 +137,16 @@ static void assign_error(RetryOp *op, lcb_STATUS err)
 void RetryQueue::erase(RetryOp *op)
 {
     lcb_list_delete(static_cast<SchedNode *>(op));
-    lcb_list_delete(static_cast<TmoNode *>(op));
+    lcbio_timerwheel_disarm(timers, static_cast<SchedTimer *>(op));
+    lcbio_timerwheel_disarm(timers, static_cast<TmoTimer *>(op));
+}
+
+void RetryQueue::arm(RetryOp *op)
+{
+    /* Allow retrying slightly early, so that operations which became ready at
+     * about the same time are handled together */
+    lcbio_timerwheel_arm(timers, static_cast<SchedTimer *>(op), op->trytime - TIMEFUZZ_NS);
+    lcbio_timerwheel_arm(timers, static_cast<TmoTimer *>(op), op->deadline);
 }
 
 void RetryQueue::fail(RetryOp *op, lcb_STATUS err, hrtime_t now)
@@ -178,137 +178,109 @@ void RetryQueue::fail(RetryOp *op, lcb_STATUS err, hrtime_t now)
     lcb_maybe_breakout(get_instance());
 }
 
-void RetryQueue::schedule(hrtime_t now)
+/**
+ * Send an operation to the network, if the vBucket has a master. Otherwise
+ * either keep it until a new configuration arrives, or fail it.
+ */
+void RetryQueue::flush_op(RetryOp *op, hrtime_t now)
 {
-    if (empty()) {
-        lcbio_timer_disarm(timer);
-        return;
-    }
-
-    if (!now) {
-        now = gethrtime();
-    }
+    protocol_binary_request_header hdr;
+    int vbid, srvix;
 
-    /** Figure out which is first */
-    RetryOp *first_tmo = from_tmonode(LCB_LIST_HEAD(&tmoops));
-    RetryOp *first_sched = from_schednode(LCB_LIST_HEAD(&schedops));
+    mcreq_read_hdr(op->pkt, &hdr);
+    vbid = ntohs(hdr.request.vbucket);
+    srvix = lcbvb_vbmaster(cq->config, vbid);
 
-    hrtime_t schednext = first_sched->trytime;
-    hrtime_t tmonext = first_tmo->deadline;
-    hrtime_t selected = schednext > tmonext ? tmonext : schednext;
+    if (srvix < 0 || (unsigned)srvix >= cq->npipelines) {
+        /* No server found to map to */
+        assign_error(op, LCB_ERR_NO_MATCHING_SERVER);
 
-    hrtime_t diff;
-    if (selected <= now) {
-        diff = 0;
+        /* Request a new configuration. If it's time to request a new
+         * configuration (i.e. the attempt has not been throttled) then
+         * keep the command in there until it has a chance to be scheduled.
+         */
+        get_instance()->bootstrap(lcb::BS_REFRESH_THROTTLE);
+        if (get_instance()->confmon->is_refreshing() || settings->retry[LCB_RETRY_ON_MISSINGNODE]) {
+            op->pkt->retries++;
+            update_trytime(op, now);
+            lcbio_timerwheel_arm(timers, static_cast<SchedTimer *>(op), op->trytime - TIMEFUZZ_NS);
+        } else {
+            fail(op, LCB_ERR_NO_MATCHING_SERVER, now);
+        }
     } else {
-        diff = selected - now;
+        uint32_t cid = mcreq_get_cid(get_instance(), op->pkt);
+        lcb_log(LOGARGS(this, TRACE),
+                "Flush PKT=%p to network. retries=%u, cid=%u, opaque=%u, IX=%d, spent=%" PRIu64
+                "us, deadline_in=%" PRIu64 "us",
+                (void *)op->pkt, op->pkt->retries, cid, op->pkt->opaque, srvix, LCB_NS2US(now - op->start),
+                LCB_NS2US(op->deadline - now));
+        mc_PIPELINE *newpl = mcreq_pipeline_stripe(cq->pipelines[srvix], vbid, hdr.request.opcode);
+        erase(op);
+        mcreq_enqueue_packet(newpl, op->pkt);
+        newpl->flush_start(newpl);
     }
-
-    uint64_t us_interval = LCB_NS2US(diff);
-    lcb_log(LOGARGS(this, TRACE), "Next tick in %" PRIu64 " ms", us_interval / 1000);
-    lcbio_timer_rearm(timer, us_interval);
 }
 
 /**
- * Flush the queue
- * @param rq The queue to flush
- * @param throttle Whether to throttle operations to be retried. If this is
- * set to false then all operations will be attempted (assuming they have
+ * Flush the queue. All operations will be attempted (assuming they have
  * not timed out)
  */
-void RetryQueue::flush(bool throttle)
+void RetryQueue::flush()
 {
     hrtime_t now = gethrtime();
     lcb_list_t *ll, *ll_next;
-    lcb_list_t resched_next;
 
-    /** Check timeouts first */
-    LCB_LIST_SAFE_FOR(ll, ll_next, &tmoops)
+    LCB_LIST_SAFE_FOR(ll, ll_next, &schedops)
     {
-        RetryOp *op = from_tmonode(ll);
-        hrtime_t curtmo = op->deadline;
-
-        if (curtmo <= now) {
+        RetryOp *op = from_schednode(ll);
+        if (op->deadline <= now) {
             fail(op, LCB_ERR_TIMEOUT, now);
         } else {
-            break;
+            flush_op(op, now);
         }
     }
+}
+
+void RetryQueue::retry_ready(RetryOp *op)
+{
+    flush_op(op, gethrtime());
+}
+
+void RetryQueue::retry_timeout(RetryOp *op)
+{
+    fail(op, LCB_ERR_TIMEOUT, gethrtime());
+}
+
+void RetryQueue::signal()
+{
+    flush();
+}
+
+void RetryQueue::signal_moved(const unsigned char *moved, unsigned nvb)
+{
+    hrtime_t now = gethrtime();
+    lcb_list_t *ll, *ll_next;
 
-    lcb_list_init(&resched_next);
     LCB_LIST_SAFE_FOR(ll, ll_next, &schedops)
     {
         protocol_binary_request_header hdr;
-        int vbid, srvix;
-        hrtime_t curnext;
-
         RetryOp *op = from_schednode(ll);
-        curnext = op->trytime - TIMEFUZZ_NS;
+        unsigned vbid;
 
-        if (curnext > now && throttle) {
-            break;
+        if (op->origstatus != PROTOCOL_BINARY_RESPONSE_NOT_MY_VBUCKET) {
+            continue;
         }
-
         mcreq_read_hdr(op->pkt, &hdr);
         vbid = ntohs(hdr.request.vbucket);
-        srvix = lcbvb_vbmaster(cq->config, vbid);
-
-        if (srvix < 0 || (unsigned)srvix >= cq->npipelines) {
-            /* No server found to map to */
-            assign_error(op, LCB_ERR_NO_MATCHING_SERVER);
-
-            /* Request a new configuration. If it's time to request a new
-             * configuration (i.e. the attempt has not been throttled) then
-             * keep the command in there until it has a chance to be scheduled.
-             */
-            get_instance()->bootstrap(lcb::BS_REFRESH_THROTTLE);
-            if (get_instance()->confmon->is_refreshing() || settings->retry[LCB_RETRY_ON_MISSINGNODE]) {
-
-                lcb_list_delete(static_cast<SchedNode *>(op));
-                lcb_list_delete(static_cast<TmoNode *>(op));
-                lcb_list_append(&resched_next, static_cast<SchedNode *>(op));
-                op->pkt->retries++;
-                update_trytime(op, now);
-            } else {
-                fail(op, LCB_ERR_NO_MATCHING_SERVER, now);
-            }
+        if (vbid >= nvb || !moved[vbid]) {
+            continue;
+        }
+        if (op->deadline <= now) {
+            fail(op, LCB_ERR_TIMEOUT, now);
         } else {
-            uint32_t cid = mcreq_get_cid(get_instance(), op->pkt);
-            lcb_log(LOGARGS(this, TRACE),
-                    "Flush PKT=%p to network. retries=%u, cid=%u, opaque=%u, IX=%d, spent=%" PRIu64
-                    "us, deadline_in=%" PRIu64 "us",
-                    (void *)op->pkt, op->pkt->retries, cid, op->pkt->opaque, srvix, LCB_NS2US(now - op->start),
-                    LCB_NS2US(op->deadline - now));
-            mc_PIPELINE *newpl = cq->pipelines[srvix];
-            mcreq_enqueue_packet(newpl, op->pkt);
-            newpl->flush_start(newpl);
-            erase(op);
+            flush_op(op, now);
         }
     }
-
-    LCB_LIST_SAFE_FOR(ll, ll_next, &resched_next)
-    {
-        RetryOp *op = from_schednode(ll);
-        lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-        lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
-    }
-
-    schedule(now);
-}
-
-static void rq_tick(void *arg)
-{
-    reinterpret_cast<RetryQueue *>(arg)->tick();
-}
-
-void RetryQueue::tick()
-{
-    flush(true);
-}
-
-void RetryQueue::signal()
-{
-    flush(false);
 }
 
 static void op_dtorfn(mc_EPKTDATUM *d)
@@ -317,7 +289,7 @@ static void op_dtorfn(mc_EPKTDATUM *d)
 }
 
 RetryOp::RetryOp(errmap::RetrySpec *spec_)
-    : mc_EPKTDATUM(), start(0), deadline(0), trytime(0), pkt(nullptr), origerr(LCB_SUCCESS),
+    : mc_EPKTDATUM(), start(0), deadline(0), trytime(0), backoff(0), pkt(nullptr), origerr(LCB_SUCCESS),
       origstatus(PROTOCOL_BINARY_RESPONSE_SUCCESS), spec(spec_)
 {
     mc_EPKTDATUM::dtorfn = op_dtorfn;
@@ -337,6 +309,8 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
         op = static_cast<RetryOp *>(d);
     } else {
         op = new RetryOp(nullptr);
+        lcbio_twentry_init(static_cast<SchedTimer *>(op), sched_expired, this);
+        lcbio_twentry_init(static_cast<TmoTimer *>(op), tmo_expired, this);
         op->start = MCREQ_PKT_RDATA(&pkt->base)->start;
         op->deadline = MCREQ_PKT_RDATA(&pkt->base)->deadline;
         if (spec) {
@@ -361,44 +335,48 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
          * of the pipelines use it in the pending/flush queues
          */
         for (size_t ii = 0; ii < cq->npipelines; ii++) {
-            sllist_iterator iter;
-            auto *server = static_cast<lcb::Server *>(cq->pipelines[ii]);
-            if (server == nullptr) {
+            auto *primary = static_cast<lcb::Server *>(cq->pipelines[ii]);
+            if (primary == nullptr) {
                 continue;
             }
-
-            /* check pending queue */
-            {
-                nb_SENDQ *sq = &server->nbmgr.sendq;
-
-                /* in the case of completion IO, there is a chunk of the sendq which
-                 * has already been written to the network and cannot be cancelled,
-                 * we need to only scan to remove packets which have NOT been sent
-                 * yet.
-                 */
-                sllist_node *ll;
-                if (sq->last_requested) {
-                    ll = sq->last_requested->slnode.next;
-                } else {
-                    ll = SLLIST_FIRST(&sq->pending);
-                }
-                if (ll) {
-                    for (slist_iter_init_at(ll, &iter); !sllist_iter_end(&sq->pending, &iter);
-                         slist_iter_incr(&sq->pending, &iter)) {
-                        nb_SNDQELEM *el = SLLIST_ITEM(iter.cur, nb_SNDQELEM, slnode);
-                        if (el->parent == op->pkt) {
-                            sllist_iter_remove(&sq->pending, &iter);
+            for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+                sllist_iterator iter;
+                lcb::Server *server = primary->connection(jj);
+
+                /* check pending queue */
+                {
+                    nb_SENDQ *sq = &server->nbmgr.sendq;
+
+                    /* in the case of completion IO, there is a chunk of the sendq which
+                     * has already been written to the network and cannot be cancelled,
+                     * we need to only scan to remove packets which have NOT been sent
+                     * yet.
+                     */
+                    sllist_node *ll;
+                    if (sq->last_requested) {
+                        ll = sq->last_requested->slnode.next;
+                    } else {
+                        ll = SLLIST_FIRST(&sq->pending);
+                    }
+                    if (ll) {
+                        for (slist_iter_init_at(ll, &iter); !sllist_iter_end(&sq->pending, &iter);
+                             slist_iter_incr(&sq->pending, &iter)) {
+                            nb_SNDQELEM *el = SLLIST_ITEM(iter.cur, nb_SNDQELEM, slnode);
+                            if (el->parent == op->pkt) {
+                                sllist_iter_remove(&sq->pending, &iter);
+                            }
                         }
                     }
                 }
-            }
 
-            /* check flush queue */
-            SLLIST_ITERFOR(&server->nbmgr.sendq.pdus, &iter)
-            {
-                mc_PACKET *el = SLLIST_ITEM(iter.cur, mc_PACKET, sl_flushq);
-                if (el == op->pkt) {
-                    sllist_iter_remove(&server->nbmgr.sendq.pdus, &iter);
+                /* check flush queue */
+                SLLIST_ITERFOR(&server->nbmgr.sendq.pdus, &iter)
+                {
+                    mc_PACKET *el = SLLIST_ITEM(iter.cur, mc_PACKET, sl_flushq);
+                    if (el == op->pkt) {
+                        sllist_iter_remove(&server->nbmgr.sendq.pdus, &iter);
+                        server->nbytes_queued -= mcreq_get_size(el);
+                    }
                 }
             }
         }
@@ -419,8 +397,8 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
         update_trytime(op);
     }
 
-    lcb_list_add_sorted(&schedops, static_cast<SchedNode *>(op), cmpfn_retry);
-    lcb_list_add_sorted(&tmoops, static_cast<TmoNode *>(op), cmpfn_tmo);
+    lcb_list_append(&schedops, static_cast<SchedNode *>(op));
+    arm(op);
 
     uint32_t cid = mcreq_get_cid(get_instance(), &pkt->base);
     lcb_log(LOGARGS(this, DEBUG),
@@ -428,13 +406,40 @@ void RetryQueue::add(mc_EXPACKET *pkt, const lcb_STATUS err, protocol_binary_res
             "us, deadline_in=%" PRIu64 "us, status=0x%02x, rc=%s",
             (void *)pkt, pkt->base.retries, cid, pkt->base.opaque, LCB_NS2MS(now), LCB_NS2US(now - op->start),
             LCB_NS2US(op->deadline - now), status, lcb_strerror_short(err));
-    schedule();
 
     if (settings->metrics) {
         settings->metrics->packets_retried++;
     }
 }
 
+bool RetryQueue::admit(Server *server)
+{
+    if (settings->retry_budget == 0) {
+        return true;
+    }
+    Server *node = server->node();
+    if (budget.available() && node->retry_budget.available()) {
+        budget.withdraw();
+        node->retry_budget.withdraw();
+        return true;
+    }
+    lcb_log(LOGARGS(this, DEBUG), "Retry budget spent (node=%d), not retrying command", node->get_index());
+    if (settings->metrics) {
+        settings->metrics->retries_rejected++;
+    }
+    MC_INCR_METRIC(node, packets_retry_rejected, 1);
+    return false;
+}
+
+void RetryQueue::deposit(Server *server)
+{
+    if (settings->retry_budget == 0) {
+        return;
+    }
+    budget.deposit(settings->retry_budget);
+    server->node()->retry_budget.deposit(settings->retry_budget);
+}
+
 bool RetryQueue::empty(bool ignore_cfgreq) const
 {
     bool is_empty = LCB_LIST_IS_EMPTY(&schedops);
@@ -493,17 +498,17 @@ void RetryQueue::reset_timeouts(lcb_U64 now)
         RetryOp *op = from_schednode(ll);
         op->deadline = now + (op->deadline - op->start);
         op->start = now;
+        lcbio_timerwheel_arm(timers, static_cast<TmoTimer *>(op), op->deadline);
     }
 }
 
-RetryQueue::RetryQueue(mc_CMDQUEUE *cq_, lcbio_pTABLE table, lcb_settings *settings_)
+RetryQueue::RetryQueue(mc_CMDQUEUE *cq_, lcbio_TIMERWHEEL *timers_, lcb_settings *settings_)
 {
     settings = settings_;
     cq = cq_;
-    timer = lcbio_timer_new(table, this, rq_tick);
+    timers = timers_;
 
     lcb_settings_ref(settings);
-    lcb_list_init(&tmoops);
     lcb_list_init(&schedops);
     mcreq_set_fallback_handler(cq, fallback_handler);
 }
@@ -519,7 +524,6 @@ RetryQueue::~RetryQueue()
         fail(op, LCB_ERR_GENERIC, now);
     }
 
-    lcbio_timer_destroy(timer);
     lcb_settings_unref(settings);
 }
 
@@ -19,11 +19,12 @@
 #define LCB_RETRYQ_H
 
 #include <lcbio/lcbio.h>
-#include <lcbio/timer-ng.h>
+#include <lcbio/timerwheel.h>
 #include <mc/mcreq.h>
 #include "list.h"
 
 #ifdef __cplusplus
+#include "retrybudget.h"
 
 /**
  * @file
@@ -43,6 +44,7 @@ namespace lcb
 {
 
 struct RetryOp;
+class Server;
 
 class RetryQueue
 {
@@ -53,11 +55,11 @@ class RetryQueue
      * with a certain throttle.
      *
      * @param cq The parent cmdqueue object
-     * @param table used to create the timer
+     * @param timers the wheel on which retry times and deadlines are registered
      * @param settings Used for logging and interval timeouts
      * @return A new retry queue object
      */
-    RetryQueue(mc_CMDQUEUE *cq_, lcbio_pTABLE, lcb_settings *);
+    RetryQueue(mc_CMDQUEUE *cq_, lcbio_TIMERWHEEL *timers, lcb_settings *);
     ~RetryQueue();
 
     /**
@@ -99,6 +101,18 @@ class RetryQueue
      */
     void signal();
 
+    /**
+     * @brief Retry the operations which failed with NOT_MY_VBUCKET for the
+     * vBuckets which have moved to another node.
+     *
+     * These no longer need to wait for their retry interval, since the new
+     * configuration tells where they should go.
+     *
+     * @param moved flags for each vBucket, as in lcbvb_CONFIGDIFF::vb_moved
+     * @param nvb number of entries in `moved`
+     */
+    void signal_moved(const unsigned char *moved, unsigned nvb);
+
     /**
      * If this packet has been previously retried, this obtains the original error
      * which caused it to be enqueued in the first place. This eliminates spurious
@@ -117,6 +131,24 @@ class RetryQueue
      */
     void dump(FILE *fp, mcreq_payload_dump_fn dumpfn);
 
+    /**
+     * @brief Charge a retry to the retry budgets
+     *
+     * Commands which the server failed may be retried only while both the
+     * budget of the instance and that of the node have a retry to spare (see
+     * LCB_CNTL_RETRY_BUDGET).
+     *
+     * @param server the server which failed the command
+     * @return false if the command must fail with LCB_ERR_RETRY_BUDGET_EXHAUSTED
+     */
+    bool admit(Server *server);
+
+    /**
+     * @brief Account a successful response in the retry budgets
+     * @param server the server which sent the response
+     */
+    void deposit(Server *server);
+
     /**
      * @brief Check if there are operations to retry
      * @param ignore_cfgreq if true, consider queue with single 0xb5 request as empty
@@ -137,16 +169,20 @@ class RetryQueue
      */
     void reset_timeouts(uint64_t now = 0);
 
-    /** Event loop tick */
-    inline void tick();
+    /** Invoked when the retry time of an operation has been reached */
+    inline void retry_ready(RetryOp *op);
+
+    /** Invoked when the deadline of an operation has passed */
+    inline void retry_timeout(RetryOp *op);
 
     inline void add_fallback(mc_PACKET *pkt);
 
   private:
-    static void erase(RetryOp *);
+    void erase(RetryOp *);
     void fail(RetryOp *, lcb_STATUS, hrtime_t);
-    void schedule(hrtime_t now = 0);
-    void flush(bool throttle);
+    void flush();
+    void flush_op(RetryOp *, hrtime_t now);
+    void arm(RetryOp *);
     void update_trytime(RetryOp *op, hrtime_t now = 0);
     hrtime_t get_retry_interval() const;
     lcb_INSTANCE *get_instance() const
@@ -157,14 +193,15 @@ class RetryQueue
     enum AddOptions { RETRY_SCHED_IMM = 0x01 };
     void add(mc_EXPACKET *pkt, lcb_STATUS, protocol_binary_response_status, errmap::RetrySpec *, int options);
 
-    /** List of operations in retry ordering. Sorted by 'crtime' */
+    /** List of queued operations, in the order they were added. Their retry
+     * times and deadlines are tracked by `timers` */
     lcb_list_t schedops{};
-    /** List of operations in timeout ordering. Ordered by 'start_time' */
-    lcb_list_t tmoops{};
     /** Parent command queue */
     mc_CMDQUEUE *cq;
     lcb_settings *settings;
-    lcbio_pTIMER timer;
+    lcbio_TIMERWHEEL *timers;
+    /** Retries of the whole instance, when retries are limited */
+    RetryBudget budget{};
 };
 
 } // namespace lcb
@@ -0,0 +1,293 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include "collections.h"
+#include "rtgroup.h"
+#include <lcbio/wakeup.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#define LOGARGS(instance, lvl) (instance)->settings, "rtgroup", LCB_LOG_##lvl, __FILE__, __LINE__
+
+using lcb::clconfig::ConfigInfo;
+
+namespace lcb
+{
+class RuntimeGroupMember : public clconfig::Listener
+{
+  public:
+    RuntimeGroupMember(lcb_RUNTIME_GROUP *group_, lcb_INSTANCE *instance_) : group(group_), instance(instance_)
+    {
+        wakeup = lcbio_wakeup_new(instance->iotable, this, on_wakeup);
+    }
+
+    ~RuntimeGroupMember() override
+    {
+        if (wakeup) {
+            lcbio_wakeup_destroy(wakeup);
+        }
+    }
+
+    void clconfig_lsn(clconfig::EventType event, ConfigInfo *config) override
+    {
+        if (event == clconfig::CLCONFIG_EVENT_GOT_NEW_CONFIG) {
+            publish(config);
+        }
+    }
+
+    void publish(ConfigInfo *config);
+    void sync();
+
+    static void on_wakeup(void *arg)
+    {
+        static_cast<RuntimeGroupMember *>(arg)->sync();
+    }
+
+    lcb_RUNTIME_GROUP *group;
+    lcb_INSTANCE *instance;
+    lcbio_WAKEUP *wakeup{nullptr};
+};
+} // namespace lcb
+
+using lcb::RuntimeGroupMember;
+
+struct lcb_RUNTIME_GROUP_st {
+    /* Guards all the fields below, which are accessed from the threads of all the members */
+    std::mutex mutex;
+    unsigned refcount{1};
+    std::vector<RuntimeGroupMember *> members;
+    RuntimeGroupMember *poller{nullptr};
+
+    ConfigInfo *config{nullptr};
+    lcb::CollectionCache *collcache{nullptr};
+    lcb_AUTHENTICATOR *auth{nullptr};
+    std::string bucket;
+};
+
+static void group_decref(lcb_RUNTIME_GROUP *group)
+{
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (--group->refcount) {
+            return;
+        }
+    }
+    if (group->config) {
+        group->config->decref();
+    }
+    delete group->collcache;
+    if (group->auth) {
+        lcbauth_unref(group->auth);
+    }
+    delete group;
+}
+
+/* Whether `a` is a later revision than `b` */
+static bool is_newer(const lcbvb_CONFIG *a, const lcbvb_CONFIG *b)
+{
+    if (a->revepoch != b->revepoch) {
+        return a->revepoch > b->revepoch;
+    }
+    return a->revid > b->revid;
+}
+
+/* Builds the strings the config otherwise builds on first use, so that members only read it */
+static void prepare_shared(lcbvb_CONFIG *vbc)
+{
+    for (unsigned ii = 0; ii < vbc->nsrv; ii++) {
+        for (int mode = 0; mode < LCBVB_SVCMODE__MAX; mode++) {
+            for (int type = 0; type < LCBVB_SVCTYPE__MAX; type++) {
+                lcbvb_get_hostport(vbc, ii, static_cast<lcbvb_SVCTYPE>(type), static_cast<lcbvb_SVCMODE>(mode));
+                lcbvb_get_resturl(vbc, ii, static_cast<lcbvb_SVCTYPE>(type), static_cast<lcbvb_SVCMODE>(mode));
+            }
+        }
+    }
+}
+
+void RuntimeGroupMember::publish(ConfigInfo *config)
+{
+    ConfigInfo *old_config;
+    size_t nnotified = 0;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (group->config == config || (group->config && !is_newer(config->vbc, group->config->vbc))) {
+            return;
+        }
+        prepare_shared(config->vbc);
+        config->incref();
+        old_config = group->config;
+        group->config = config;
+        for (auto *member : group->members) {
+            if (member != this) {
+                lcbio_wakeup_signal(member->wakeup);
+                nnotified++;
+            }
+        }
+    }
+    lcb_log(LOGARGS(instance, DEBUG), "Shared configuration rev=%" PRId64 ":%" PRId64 " with %u other instance(s)",
+            config->vbc->revepoch, config->vbc->revid, (unsigned)nnotified);
+    if (old_config) {
+        old_config->decref();
+    }
+}
+
+void RuntimeGroupMember::sync()
+{
+    ConfigInfo *config;
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        config = group->config;
+        if (config) {
+            config->incref();
+        }
+    }
+    /* Nothing to apply until the application starts bootstrapping */
+    if (instance->bs_state == nullptr) {
+        if (config) {
+            config->decref();
+        }
+        return;
+    }
+    if (config) {
+        if (config != instance->confmon->get_config()) {
+            instance->confmon->do_set_next(config, false);
+        }
+        config->decref();
+    }
+    instance->bs_state->check_bgpoll();
+}
+
+bool lcb::rtgroup_is_poller(lcb_INSTANCE *instance)
+{
+    RuntimeGroupMember *member = instance->rtgroup;
+    if (member == nullptr) {
+        return true;
+    }
+    std::lock_guard<std::mutex> lock(member->group->mutex);
+    return member->group->poller == member;
+}
+
+bool lcb::rtgroup_bootstrap(lcb_INSTANCE *instance)
+{
+    RuntimeGroupMember *member = instance->rtgroup;
+    if (member == nullptr) {
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(member->group->mutex);
+        if (member->group->config == nullptr) {
+            return false;
+        }
+    }
+    lcb_log(LOGARGS(instance, INFO), "Bootstrapping from the configuration of the runtime group");
+    lcbio_wakeup_signal(member->wakeup);
+    return true;
+}
+
+void lcb::rtgroup_leave(lcb_INSTANCE *instance)
+{
+    RuntimeGroupMember *member = instance->rtgroup;
+    if (member == nullptr) {
+        return;
+    }
+    lcb_RUNTIME_GROUP *group = member->group;
+
+    if (instance->confmon) {
+        instance->confmon->remove_listener(member);
+    }
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        group->members.erase(std::find(group->members.begin(), group->members.end(), member));
+        if (group->poller == member) {
+            /* Hand polling over to another member, which starts it from its own thread */
+            group->poller = group->members.empty() ? nullptr : group->members.front();
+            if (group->poller) {
+                lcbio_wakeup_signal(group->poller->wakeup);
+            }
+        }
+    }
+    /* Owned by the group */
+    instance->collcache = nullptr;
+    instance->rtgroup = nullptr;
+    delete member;
+    group_decref(group);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_runtime_group_create(lcb_RUNTIME_GROUP **group)
+{
+    *group = new lcb_RUNTIME_GROUP{};
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+void lcb_runtime_group_destroy(lcb_RUNTIME_GROUP *group)
+{
+    group_decref(group);
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_runtime_group_join(lcb_RUNTIME_GROUP *group, lcb_INSTANCE *instance)
+{
+    if (instance->rtgroup || instance->bs_state) {
+        /* Already a member, or already bootstrapping on its own */
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+    if (LCBT_SETTING(instance, conntype) != LCB_TYPE_BUCKET || LCBT_SETTING(instance, bucket) == nullptr) {
+        return LCB_ERR_INVALID_ARGUMENT;
+    }
+
+    auto *member = new RuntimeGroupMember(group, instance);
+    if (member->wakeup == nullptr) {
+        delete member;
+        return LCB_ERR_SDK_INTERNAL;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(group->mutex);
+        if (group->collcache == nullptr) {
+            /* The first member provides the state shared by the group */
+            group->bucket = LCBT_SETTING(instance, bucket);
+            group->collcache = instance->collcache;
+            group->auth = LCBT_SETTING(instance, auth);
+            lcbauth_ref(group->auth);
+        } else {
+            if (group->bucket != LCBT_SETTING(instance, bucket)) {
+                delete member;
+                return LCB_ERR_INVALID_ARGUMENT;
+            }
+            delete instance->collcache;
+            instance->collcache = group->collcache;
+            lcbauth_ref(group->auth);
+            lcbauth_unref(LCBT_SETTING(instance, auth));
+            LCBT_SETTING(instance, auth) = group->auth;
+        }
+        group->refcount++;
+        group->members.push_back(member);
+        if (group->poller == nullptr) {
+            group->poller = member;
+        }
+    }
+
+    LCBT_SETTING(instance, vb_noremap) = 1;
+    instance->confmon->add_listener(member);
+    instance->rtgroup = member;
+    return LCB_SUCCESS;
+}
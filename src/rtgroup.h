@@ -0,0 +1,59 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_RTGROUP_H
+#define LCB_RTGROUP_H
+
+/**
+ * @file
+ * Runtime groups: instances running on different threads, which share their
+ * cluster map, collection cache and credentials.
+ *
+ * Whichever member receives a newer configuration publishes it to the group,
+ * and the other members are woken up on their own event loop thread to apply
+ * it. Only one member (the first one to join) polls for configuration
+ * updates in the background.
+ *
+ * Since the lcbvb_CONFIG is shared, its lazily-built strings are built before
+ * it is published, and members never modify it: the vbucket remapping
+ * heuristic (@ref LCB_CNTL_VBUCKET_NOREMAP) is disabled for them.
+ */
+
+namespace lcb
+{
+/**
+ * @return whether the instance should poll for configuration updates in the
+ * background, i.e. it is not a member of a group, or it is its poller
+ */
+bool rtgroup_is_poller(lcb_INSTANCE *instance);
+
+/**
+ * Starts the initial bootstrap using the configuration of the group. The
+ * configuration is applied asynchronously.
+ * @return true if the instance is a member of a group which has a
+ * configuration, false if it should bootstrap on its own.
+ */
+bool rtgroup_bootstrap(lcb_INSTANCE *instance);
+
+/**
+ * Removes the instance from its group, if any. Called when the instance is
+ * destroyed, once it no longer uses the shared collection cache.
+ */
+void rtgroup_leave(lcb_INSTANCE *instance);
+} // namespace lcb
+
+#endif
@@ -65,6 +65,16 @@ void lcb_default_settings(lcb_settings *settings)
     settings->tcp_keepalive = LCB_DEFAULT_TCP_KEEPALIVE;
     settings->config_poll_interval = LCB_DEFAULT_CONFIG_POLL_INTERVAL;
     settings->use_collections = 1;
+    settings->collections_unknown_ttl = LCB_DEFAULT_COLLECTIONS_UNKNOWN_TTL;
+    settings->near_cache_size = 0;
+    settings->near_cache_ttl = LCB_DEFAULT_NEAR_CACHE_TTL;
+    settings->get_hedge_budget = 0;
+    settings->get_hedge_delay = 0;
+    settings->retry_budget = 0;
+    settings->kv_adaptive_window = 0;
+    settings->kv_priority_weight = 8;
+    settings->kv_flush_delay = 0;
+    settings->kv_flush_bytes = 16384;
     settings->log_redaction = 0;
     settings->use_tracing = 1;
     settings->network = nullptr;
@@ -82,9 +92,13 @@ void lcb_default_settings(lcb_settings *settings)
     settings->enable_durable_write = 0;
     settings->retry_strategy = lcb_retry_strategy_best_effort;
     settings->enable_unordered_execution = 1;
+    settings->enable_config_push = 1;
+    settings->get_single_flight = 0;
+    settings->near_cache_revalidate = 0;
     settings->use_errmap = 1;
     settings->op_metrics_flush_interval = LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL;
     settings->op_metrics_enabled = 1;
+    settings->kv_connections_per_node = LCB_DEFAULT_KV_CONNECTIONS_PER_NODE;
 }
 
 LCB_INTERNAL_API
@@ -95,6 +95,10 @@
 #define LCB_DEFAULT_TCP_NODELAY 1
 #define LCB_DEFAULT_SELECT_BUCKET 1
 #define LCB_DEFAULT_TCP_KEEPALIVE 1
+/* 1 s */
+#define LCB_DEFAULT_COLLECTIONS_UNKNOWN_TTL LCB_MS2US(1000)
+/* 10 s */
+#define LCB_DEFAULT_NEAR_CACHE_TTL LCB_MS2US(10000)
 /* 2.5 s */
 #define LCB_DEFAULT_CONFIG_POLL_INTERVAL LCB_MS2US(2500)
 /* 50 ms */
@@ -112,6 +116,9 @@
 
 #define LCB_DEFAULT_OP_METRICS_FLUSH_INTERVAL LCB_MS2US(600000)
 
+#define LCB_DEFAULT_KV_CONNECTIONS_PER_NODE 1
+#define LCB_MAX_KV_CONNECTIONS_PER_NODE 64
+
 #define LCB_DEFAULT_PERSISTENCE_TIMEOUT_FLOOR 1500000
 
 #include "config.h"
@@ -200,6 +207,9 @@ typedef struct lcb_settings_st {
     unsigned wait_for_config : 1;
     unsigned enable_durable_write : 1;
     unsigned enable_unordered_execution : 1;
+    unsigned enable_config_push : 1;
+    unsigned get_single_flight : 1;
+    unsigned near_cache_revalidate : 1;
 
     lcb_RETRY_STRATEGY retry_strategy;
     short max_redir;
@@ -234,6 +244,32 @@ typedef struct lcb_settings_st {
     char *network; /** network resolution, AKA "Multi Network Configurations" */
     lcb_U32 op_metrics_flush_interval;
     unsigned op_metrics_enabled : 1;
+    /** Number of connections to open to each KV node */
+    lcb_U32 kv_connections_per_node;
+    /** Minimum size of values sent without copying them, 0 to disable */
+    lcb_U32 kv_zerocopy_threshold;
+    /** Stop compressing values of collections for which it does not pay off */
+    unsigned compress_adaptive : 1;
+    /** How long collections reported as unknown are remembered, 0 to disable */
+    lcb_U32 collections_unknown_ttl;
+    /** Memory available to cached document values, 0 to disable */
+    lcb_U32 near_cache_size;
+    /** How long cached document values are returned */
+    lcb_U32 near_cache_ttl;
+    /** Percentage of GETs which may be sent again to a replica, 0 to disable */
+    lcb_U32 get_hedge_budget;
+    /** Time after which a GET is sent to a replica, 0 for the p95 latency of the node */
+    lcb_U32 get_hedge_delay;
+    /** Percentage of successful responses which may be retried after overload errors, 0 to disable */
+    lcb_U32 retry_budget;
+    /** Largest number of commands in flight on a KV connection, 0 to disable */
+    lcb_U32 kv_adaptive_window;
+    /** Interactive commands written before a waiting bulk command, 0 to write commands in order */
+    lcb_U32 kv_priority_weight;
+    /** Time for which writing scheduled KV commands may be deferred, 0 to write them at once */
+    lcb_U32 kv_flush_delay;
+    /** Size of the deferred commands of a connection which are written at once */
+    lcb_U32 kv_flush_bytes;
 } lcb_settings;
 
 LCB_INTERNAL_API
@@ -264,6 +300,12 @@ lcb_SERVERMETRICS *lcb_metrics_getserver(lcb_METRICS *metrics, const char *host,
 
 void lcb_metrics_reset_pipeline_gauges(lcb_SERVERMETRICS *metrics);
 
+void lcb_metrics_set_connection(lcb_SERVERMETRICS *metrics, size_t nconns, size_t ix, lcb_SIZE npending,
+                                lcb_SIZE nqueued);
+
+/** Recompute lcb_METRICS::packets_per_write from the metrics of the servers */
+void lcb_metrics_update_packets_per_write(lcb_METRICS *metrics);
+
 #ifdef __cplusplus
 }
 #endif
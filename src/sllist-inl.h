@@ -15,6 +15,9 @@
  *   limitations under the License.
  */
 
+#ifndef LCB_SLLIST_INL_H
+#define LCB_SLLIST_INL_H
+
 #include "sllist.h"
 #include <libcouchbase/assert.h>
 #include <stdlib.h>
@@ -186,3 +189,5 @@ static INLINE void sllist_insert_sorted(sllist_root *list, sllist_node *item,
     }
     sllist_append(list, item);
 }
+
+#endif /* LCB_SLLIST_INL_H */
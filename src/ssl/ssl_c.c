@@ -54,7 +54,8 @@ typedef struct {
      */
     int rdactive;
 
-    int closed; /**< Pending delivery of close */
+    int closed;    /**< Pending delivery of close */
+    int sd_closed; /**< close() was called on the underlying socket */
     int entered;
 } lcbio_CSSL;
 
@@ -196,6 +197,22 @@ static void read_callback(lcb_sockdata_t *sd, lcb_ssize_t nr, void *arg)
 #endif
 
     cs->rdactive = 0;
+    if (cs->sd_closed) {
+        /* The owning lcbio_SOCKET (referenced by the SSL callbacks) may already
+         * be gone. Only fail the pending user read, if any */
+        lcb_ioC_read2_callback cb = cs->urd_cb;
+#if !LCB_CAN_OPTIMIZE_SSL_BIO
+        free(rb);
+#endif
+        if (cb) {
+            cs->urd_cb = NULL;
+            IOTSSL_ERRNO(cs) = ECONNRESET;
+            cb(cs->sd, -1, cs->urd_arg);
+        }
+        lcbio_table_unref(&cs->base_);
+        (void)sd;
+        return;
+    }
     cs->entered++;
 
     if (nr > 0) {
@@ -391,6 +408,7 @@ static unsigned Cssl_close(lcb_io_opt_t io, lcb_sockdata_t *sd)
     lcbio_CSSL *cs = CS_FROM_IOPS(io);
     IOT_V1(cs->orig).close(IOT_ARG(cs->orig), sd);
     cs->error = 1;
+    cs->sd_closed = 1;
     if (!SLLIST_IS_EMPTY(&cs->writes)) {
         /* It is possible that a prior call to SSL_write returned an SSL_want_read
          * and the next subsequent call to the underlying read API returned an
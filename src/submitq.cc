@@ -0,0 +1,151 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "internal.h"
+#include <lcbio/wakeup.h>
+
+#include <atomic>
+#include <new>
+
+namespace
+{
+struct Entry {
+    Entry *next;
+    lcb_SUBMIT_CALLBACK submit;
+    lcb_COMPLETION_CALLBACK complete;
+    void *arg;
+};
+
+/**
+ * Lock-free list with any number of producers and a single consumer. Entries
+ * are pushed onto a stack, which the consumer takes over as a whole, so the
+ * usual ABA problem of lock-free stacks does not arise.
+ */
+class MpscList
+{
+  public:
+    void push(Entry *entry)
+    {
+        entry->next = head_.load(std::memory_order_relaxed);
+        while (!head_.compare_exchange_weak(entry->next, entry, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+        }
+    }
+
+    /** Removes all the entries, and returns them oldest first */
+    Entry *take_all()
+    {
+        Entry *entry = head_.exchange(nullptr, std::memory_order_acquire);
+        Entry *fifo = nullptr;
+        while (entry) {
+            Entry *next = entry->next;
+            entry->next = fifo;
+            fifo = entry;
+            entry = next;
+        }
+        return fifo;
+    }
+
+  private:
+    std::atomic<Entry *> head_{nullptr};
+};
+} // namespace
+
+struct lcb_SUBMITQ_st {
+    lcb_INSTANCE *instance;
+    lcbio_WAKEUP *wakeup;
+    MpscList submissions;
+    MpscList completions;
+};
+
+static void run_submissions(void *arg)
+{
+    auto *queue = static_cast<lcb_SUBMITQ *>(arg);
+    Entry *entry = queue->submissions.take_all();
+    while (entry) {
+        Entry *next = entry->next;
+        entry->submit(queue->instance, entry->arg);
+        delete entry;
+        entry = next;
+    }
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_create(lcb_INSTANCE *instance, lcb_SUBMITQ **queue)
+{
+    auto *newq = new lcb_SUBMITQ{};
+    newq->instance = instance;
+    newq->wakeup = lcbio_wakeup_new(instance->iotable, newq, run_submissions);
+    if (newq->wakeup == nullptr) {
+        delete newq;
+        return LCB_ERR_SDK_INTERNAL;
+    }
+    *queue = newq;
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_post(lcb_SUBMITQ *queue, lcb_SUBMIT_CALLBACK callback, void *arg)
+{
+    auto *entry = new (std::nothrow) Entry{nullptr, callback, nullptr, arg};
+    if (entry == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    queue->submissions.push(entry);
+    lcbio_wakeup_signal(queue->wakeup);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+lcb_STATUS lcb_submitq_complete(lcb_SUBMITQ *queue, lcb_COMPLETION_CALLBACK callback, void *arg)
+{
+    auto *entry = new (std::nothrow) Entry{nullptr, nullptr, callback, arg};
+    if (entry == nullptr) {
+        return LCB_ERR_NO_MEMORY;
+    }
+    queue->completions.push(entry);
+    return LCB_SUCCESS;
+}
+
+LIBCOUCHBASE_API
+size_t lcb_submitq_poll(lcb_SUBMITQ *queue)
+{
+    size_t ncompleted = 0;
+    Entry *entry = queue->completions.take_all();
+    while (entry) {
+        Entry *next = entry->next;
+        entry->complete(entry->arg);
+        delete entry;
+        entry = next;
+        ncompleted++;
+    }
+    return ncompleted;
+}
+
+LIBCOUCHBASE_API
+void lcb_submitq_destroy(lcb_SUBMITQ *queue)
+{
+    run_submissions(queue);
+    lcbio_wakeup_destroy(queue->wakeup);
+    Entry *entry = queue->completions.take_all();
+    while (entry) {
+        Entry *next = entry->next;
+        delete entry;
+        entry = next;
+    }
+    delete queue;
+}
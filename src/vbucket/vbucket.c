@@ -586,6 +586,160 @@ static void guess_network(cJSON *jnodes, int nsrv, const char *source, char **ne
     *network = lcb_strdup("default");
 }
 
+/* Pre-scan of the top-level members, see lcbvb_peek_revision() */
+typedef struct {
+    const char *cur;
+    const char *end;
+} jscan;
+
+static void jscan_ws(jscan *js)
+{
+    while (js->cur < js->end && (*js->cur == ' ' || *js->cur == '\t' || *js->cur == '\n' || *js->cur == '\r')) {
+        js->cur++;
+    }
+}
+
+/* Skips a string, the cursor being on its opening quote */
+static int jscan_string(jscan *js)
+{
+    for (js->cur++; js->cur < js->end; js->cur++) {
+        if (*js->cur == '\\') {
+            js->cur++;
+        } else if (*js->cur == '"') {
+            js->cur++;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Skips a value of any type, nested objects and arrays included */
+static int jscan_value(jscan *js)
+{
+    unsigned depth = 0;
+    while (js->cur < js->end) {
+        switch (*js->cur) {
+            case '"':
+                if (jscan_string(js) != 0) {
+                    return -1;
+                }
+                if (depth == 0) {
+                    return 0;
+                }
+                continue;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+            case ',':
+                if (depth == 0) {
+                    /* end of a scalar */
+                    return 0;
+                }
+                if (*js->cur != ',' && --depth == 0) {
+                    js->cur++;
+                    return 0;
+                }
+                break;
+            default:
+                break;
+        }
+        js->cur++;
+    }
+    return -1;
+}
+
+static int jscan_int64(jscan *js, int64_t *value)
+{
+    int negative = 0;
+    uint64_t result = 0;
+    const char *begin;
+    if (js->cur < js->end && *js->cur == '-') {
+        negative = 1;
+        js->cur++;
+    }
+    begin = js->cur;
+    while (js->cur < js->end && *js->cur >= '0' && *js->cur <= '9') {
+        result = result * 10 + (*js->cur - '0');
+        js->cur++;
+    }
+    if (js->cur == begin) {
+        return -1;
+    }
+    *value = negative ? -(int64_t)result : (int64_t)result;
+    return 0;
+}
+
+LIBCOUCHBASE_API
+int lcbvb_peek_revision(const char *data, size_t ndata, int64_t *revepoch, int64_t *revid)
+{
+    jscan js;
+    int found_epoch = 0, found_rev = 0;
+
+    js.cur = data;
+    js.end = data + ndata;
+    *revepoch = -1;
+    *revid = -1;
+
+    jscan_ws(&js);
+    if (js.cur == js.end || *js.cur != '{') {
+        return -1;
+    }
+    js.cur++;
+
+    while (!(found_epoch && found_rev)) {
+        const char *key;
+        size_t nkey;
+        int64_t *target = NULL;
+
+        jscan_ws(&js);
+        if (js.cur < js.end && *js.cur == '}') {
+            return 0;
+        }
+        if (js.cur == js.end || *js.cur != '"') {
+            return -1;
+        }
+        key = js.cur + 1;
+        if (jscan_string(&js) != 0) {
+            return -1;
+        }
+        nkey = js.cur - key - 1;
+        if (nkey == 3 && memcmp(key, "rev", 3) == 0) {
+            target = revid;
+            found_rev = 1;
+        } else if (nkey == 8 && memcmp(key, "revEpoch", 8) == 0) {
+            target = revepoch;
+            found_epoch = 1;
+        }
+
+        jscan_ws(&js);
+        if (js.cur == js.end || *js.cur != ':') {
+            return -1;
+        }
+        js.cur++;
+        jscan_ws(&js);
+        if (target) {
+            if (jscan_int64(&js, target) != 0) {
+                return -1;
+            }
+        } else if (jscan_value(&js) != 0) {
+            return -1;
+        }
+
+        jscan_ws(&js);
+        if (js.cur < js.end && *js.cur == ',') {
+            js.cur++;
+        } else if (js.cur < js.end && *js.cur == '}') {
+            return 0;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source, char **network)
 {
     cJSON *cj = NULL, *jnodes_ext = NULL, *jnodes = NULL, *buckets = NULL;
@@ -752,7 +906,6 @@ int lcbvb_load_json_ex(lcbvb_CONFIG *cfg, const char *data, const char *source,
         }
     }
     cfg->servers = realloc(cfg->servers, sizeof(*cfg->servers) * cfg->nsrv);
-    cfg->randbuf = malloc(cfg->nsrv * sizeof(*cfg->randbuf));
     cJSON_Delete(cj);
     return 0;
 
@@ -1219,6 +1372,34 @@ int lcbvb_map_key(lcbvb_CONFIG *cfg, const void *key, lcb_SIZE nkey, int *vbid,
     return 0;
 }
 
+int lcbvb_map_keys(lcbvb_CONFIG *cfg, const void *const *keys, const lcb_SIZE *sizes, lcb_SIZE nkeys, int *vbids,
+                   int *srvixs)
+{
+    lcb_SIZE ii;
+
+    if (cfg->dtype == LCBVB_DIST_VBUCKET) {
+        for (ii = 0; ii < nkeys; ii++) {
+            int vb = (int)(hash_crc32(keys[ii], sizes[ii]) % cfg->nvb);
+            srvixs[ii] = cfg->vbuckets[vb].servers[0];
+            if (vbids) {
+                vbids[ii] = vb;
+            }
+        }
+    } else {
+        int srvix = -1;
+        for (ii = 0; ii < nkeys; ii++) {
+            if (cfg->dtype == LCBVB_DIST_KETAMA) {
+                srvix = map_ketama(cfg, keys[ii], sizes[ii]);
+            }
+            srvixs[ii] = srvix;
+            if (vbids) {
+                vbids[ii] = 0;
+            }
+        }
+    }
+    return 0;
+}
+
 int lcbvb_has_vbucket(lcbvb_CONFIG *vbc, int vbid, int ix)
 {
     unsigned ii;
@@ -1261,6 +1442,52 @@ static void compute_vb_list_diff(lcbvb_CONFIG *from, lcbvb_CONFIG *to, char **ou
     }
 }
 
+/* Flag the vBuckets whose master is on another node in the new map, matching
+ * nodes by their address rather than by their index */
+static void compute_vb_moved(const lcbvb_CONFIG *from, const lcbvb_CONFIG *to, lcbvb_CONFIGDIFF *diff)
+{
+    int *newix;
+    unsigned ii, jj;
+
+    if (from->nvb == 0 || from->nvb != to->nvb) {
+        return;
+    }
+
+    newix = malloc(sizeof(*newix) * (from->nsrv + 1));
+    diff->vb_moved = calloc(from->nvb, sizeof(*diff->vb_moved));
+    if (newix == NULL || diff->vb_moved == NULL) {
+        free(newix);
+        free(diff->vb_moved);
+        diff->vb_moved = NULL;
+        return;
+    }
+
+    for (ii = 0; ii < from->nsrv; ii++) {
+        newix[ii] = -1;
+        for (jj = 0; jj < to->nsrv; jj++) {
+            if (strcmp(from->servers[ii].authority, to->servers[jj].authority) == 0) {
+                newix[ii] = (int)jj;
+                break;
+            }
+        }
+    }
+
+    for (ii = 0; ii < from->nvb; ii++) {
+        int oldmaster = from->vbuckets[ii].servers[0];
+        int newmaster = to->vbuckets[ii].servers[0];
+        if (oldmaster >= 0 && (unsigned)oldmaster < from->nsrv) {
+            oldmaster = newix[oldmaster];
+        } else {
+            oldmaster = -1;
+        }
+        if (oldmaster != newmaster) {
+            diff->vb_moved[ii] = 1;
+            diff->n_vb_moved++;
+        }
+    }
+    free(newix);
+}
+
 lcbvb_CONFIGDIFF *lcbvb_compare(lcbvb_CONFIG *from, lcbvb_CONFIG *to)
 {
     unsigned nservers;
@@ -1307,6 +1534,7 @@ lcbvb_CONFIGDIFF *lcbvb_compare(lcbvb_CONFIG *from, lcbvb_CONFIG *to)
     } else {
         ret->n_vb_changes = -1;
     }
+    compute_vb_moved(from, to, ret);
     return ret;
 }
 
@@ -1324,6 +1552,7 @@ void lcbvb_free_diff(lcbvb_CONFIGDIFF *diff)
     lcb_assert(diff);
     free_array_helper(diff->servers_added);
     free_array_helper(diff->servers_removed);
+    free(diff->vb_moved);
     free(diff);
 }
 
@@ -1449,6 +1678,32 @@ const char *lcbvb_get_hostname(const lcbvb_CONFIG *cfg, unsigned ix)
     }
 }
 
+static int has_svc(const lcbvb_SERVICES *svcs, lcbvb_SVCTYPE type)
+{
+    switch (type) {
+        case LCBVB_SVCTYPE_DATA:
+            return svcs->data != 0;
+        case LCBVB_SVCTYPE_VIEWS:
+            return svcs->views != 0;
+        case LCBVB_SVCTYPE_MGMT:
+            return svcs->mgmt != 0;
+        case LCBVB_SVCTYPE_IXQUERY:
+            return svcs->ixquery != 0;
+        case LCBVB_SVCTYPE_IXADMIN:
+            return svcs->ixadmin != 0;
+        case LCBVB_SVCTYPE_QUERY:
+            return svcs->n1ql != 0;
+        case LCBVB_SVCTYPE_SEARCH:
+            return svcs->fts != 0;
+        case LCBVB_SVCTYPE_ANALYTICS:
+            return svcs->cbas != 0;
+        case LCBVB_SVCTYPE_EVENTING:
+            return svcs->eventing != 0;
+        default:
+            return 0;
+    }
+}
+
 LIBCOUCHBASE_API
 int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVCMODE mode, int *used)
 {
@@ -1460,53 +1715,14 @@ int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVC
 
     /*
      * Since not all nodes support all service types, we need to make it a
-     * fair selection by pre-filtering the nodes which actually support the
-     * service, and then proceed to actually select a suitable node.
+     * fair selection by counting the nodes which actually support the
+     * service, and then proceed to actually select a suitable node. The
+     * config is not modified, as it may be shared between threads.
      */
     for (nn = 0; nn < cfg->nsrv; nn++) {
-        const lcbvb_SERVER *server = cfg->servers + nn;
-        const lcbvb_SERVICES *svcs = get_svc(server, mode);
-
         // Check if this node is in the exclude list
-        if (used && used[nn]) {
-            continue;
-        }
-
-        int has_svc = 0;
-        switch (type) {
-            case LCBVB_SVCTYPE_DATA:
-                has_svc = svcs->data != 0;
-                break;
-            case LCBVB_SVCTYPE_VIEWS:
-                has_svc = svcs->views != 0;
-                break;
-            case LCBVB_SVCTYPE_MGMT:
-                has_svc = svcs->mgmt != 0;
-                break;
-            case LCBVB_SVCTYPE_IXQUERY:
-                has_svc = svcs->ixquery != 0;
-                break;
-            case LCBVB_SVCTYPE_IXADMIN:
-                has_svc = svcs->ixadmin != 0;
-                break;
-            case LCBVB_SVCTYPE_QUERY:
-                has_svc = svcs->n1ql != 0;
-                break;
-            case LCBVB_SVCTYPE_SEARCH:
-                has_svc = svcs->fts != 0;
-                break;
-            case LCBVB_SVCTYPE_ANALYTICS:
-                has_svc = svcs->cbas != 0;
-                break;
-            case LCBVB_SVCTYPE_EVENTING:
-                has_svc = svcs->eventing != 0;
-                break;
-            default:
-                break;
-        }
-
-        if (has_svc) {
-            cfg->randbuf[oix++] = (int)nn;
+        if ((used == NULL || !used[nn]) && has_svc(get_svc(cfg->servers + nn, mode), type)) {
+            oix++;
         }
     }
 
@@ -1515,9 +1731,13 @@ int lcbvb_get_randhost_ex(const lcbvb_CONFIG *cfg, lcbvb_SVCTYPE type, lcbvb_SVC
         return -1;
     }
 
-    nn = rand();
-    nn %= oix;
-    return cfg->randbuf[nn];
+    oix = rand() % oix;
+    for (nn = 0; nn < cfg->nsrv; nn++) {
+        if ((used == NULL || !used[nn]) && has_svc(get_svc(cfg->servers + nn, mode), type) && oix-- == 0) {
+            break;
+        }
+    }
+    return (int)nn;
 }
 
 LIBCOUCHBASE_API
@@ -1716,7 +1936,6 @@ int lcbvb_genconfig_ex(lcbvb_CONFIG *vb, const char *name, const char *uuid, con
     }
 
     vb->servers = calloc(vb->nsrv, sizeof(*vb->servers));
-    vb->randbuf = calloc(vb->nsrv, sizeof(*vb->randbuf));
 
     for (ii = 0; ii < vb->nsrv; ii++) {
         lcbvb_SERVER *dst = vb->servers + ii;
@@ -32,8 +32,11 @@ static bool has_pending(lcb_INSTANCE *instance)
     }
 
     for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
-        if (instance->get_server(ii)->has_pending()) {
-            return true;
+        lcb::Server *server = instance->get_server(ii);
+        for (size_t jj = 0; jj < server->nconnections(); jj++) {
+            if (server->connection(jj)->has_pending()) {
+                return true;
+            }
         }
     }
     return false;
@@ -48,7 +51,10 @@ static void maybe_reset_timeouts(lcb_INSTANCE *instance)
 
     uint64_t now = lcb_nstime();
     for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ++ii) {
-        mcreq_reset_timeouts(instance->get_server(ii), now);
+        lcb::Server *server = instance->get_server(ii);
+        for (size_t jj = 0; jj < server->nconnections(); jj++) {
+            mcreq_reset_timeouts(server->connection(jj), now);
+        }
     }
     instance->retryq->reset_timeouts(now);
 }
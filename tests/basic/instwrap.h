@@ -0,0 +1,82 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#ifndef LCB_TESTS_INSTWRAP_H
+#define LCB_TESTS_INSTWRAP_H
+
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "internal.h"
+#include "mcserver/mcserver.h"
+#include "bucketconfig/clconfig.h"
+
+/**
+ * An instance which is never connected, but is given a generated cluster map
+ * so that its servers and command queue exist. Settings may be changed on
+ * the instance before the map is applied with configure().
+ */
+struct InstanceWrap {
+    lcb_INSTANCE *instance{nullptr};
+
+    InstanceWrap()
+    {
+        EXPECT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    }
+
+    ~InstanceWrap()
+    {
+        destroy();
+    }
+
+    /** Generate a map of nservers nodes with nreplicas replicas of each of its 64 vBuckets */
+    static lcbvb_CONFIG *genconfig(unsigned nservers, unsigned nreplicas)
+    {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        EXPECT_EQ(0, lcbvb_genconfig(vbc, nservers, nreplicas, 64));
+        return vbc;
+    }
+
+    /** Apply the map to the instance, which takes ownership of it */
+    void configure(lcbvb_CONFIG *vbc)
+    {
+        auto *config = lcb::clconfig::ConfigInfo::create(vbc, lcb::clconfig::CLCONFIG_CCCP, "localhost:1000");
+        lcb_update_vbconfig(instance, config);
+        config->decref();
+    }
+
+    void configure(unsigned nservers, unsigned nreplicas)
+    {
+        configure(genconfig(nservers, nreplicas));
+    }
+
+    lcb::Server *server(unsigned ix)
+    {
+        return instance->get_server(ix);
+    }
+
+    /** Destroy the instance ahead of the wrapper, e.g. to check what it fails on the way */
+    void destroy()
+    {
+        if (instance != nullptr) {
+            lcb_destroy(instance);
+            instance = nullptr;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,312 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "instwrap.h"
+#include "collections.h"
+
+#include <thread>
+#include <vector>
+
+class CollectionLookupsTest : public ::testing::Test
+{
+};
+
+TEST_F(CollectionLookupsTest, testCoalesce)
+{
+    lcb::CollectionLookups lookups;
+    std::vector<int> released;
+    auto make_waiter = [&released](int id) -> lcb::CollectionLookups::Waiter {
+        return [&released, id](lcb_STATUS rc, const lcb_RESPGETCID *resp) {
+            ASSERT_EQ(LCB_SUCCESS, rc);
+            ASSERT_EQ(42, resp->collection_id);
+            released.push_back(id);
+        };
+    };
+
+    // Nothing in flight yet: the first command has to send the request
+    auto first = make_waiter(1);
+    ASSERT_FALSE(lookups.join("s.c", first));
+    lookups.start("s.c", std::move(first));
+
+    // Later commands for the same collection wait for it
+    for (int ii = 2; ii <= 4; ii++) {
+        auto waiter = make_waiter(ii);
+        ASSERT_TRUE(lookups.join("s.c", waiter));
+    }
+    auto other = make_waiter(10);
+    ASSERT_FALSE(lookups.join("s.other", other));
+    ASSERT_EQ(1, lookups.size());
+
+    lcb_RESPGETCID resp{};
+    resp.collection_id = 42;
+    lookups.complete("s.c", LCB_SUCCESS, &resp);
+    ASSERT_EQ(std::vector<int>({1, 2, 3, 4}), released);
+    ASSERT_EQ(0, lookups.size());
+
+    // Completing again is a no-op
+    lookups.complete("s.c", LCB_SUCCESS, &resp);
+    ASSERT_EQ(4, released.size());
+}
+
+TEST_F(CollectionLookupsTest, testResolveAgainFromWaiter)
+{
+    lcb::CollectionLookups lookups;
+    unsigned ncalled = 0;
+
+    // e.g. the collection was dropped, and the command resolves it again
+    lookups.start("s.c", [&](lcb_STATUS, const lcb_RESPGETCID *) {
+        ncalled++;
+        lookups.start("s.c", [&](lcb_STATUS, const lcb_RESPGETCID *) { ncalled++; });
+    });
+    lookups.complete("s.c", LCB_ERR_SHEDULE_FAILURE, nullptr);
+    ASSERT_EQ(1, ncalled);
+    ASSERT_EQ(1, lookups.size());
+
+    lookups.complete("s.c", LCB_ERR_SHEDULE_FAILURE, nullptr);
+    ASSERT_EQ(2, ncalled);
+    ASSERT_EQ(0, lookups.size());
+}
+
+/* Command of the callback-based collcache_resolve(), e.g. a packet resolving its collection again */
+struct LookupCommand {
+    lcb_KEYBUF key{};
+    const char *scope{nullptr};
+    std::size_t nscope{0};
+    const char *collection{nullptr};
+    std::size_t ncollection{0};
+    std::uint32_t timeout{0};
+    std::uint32_t cid{0};
+    int id{0};
+};
+
+static lcb_STATUS lookup_command_clone(const LookupCommand *src, LookupCommand **dst)
+{
+    *dst = new LookupCommand(*src);
+    return LCB_SUCCESS;
+}
+
+static lcb_STATUS lookup_command_destroy(LookupCommand *cmd)
+{
+    delete cmd;
+    return LCB_SUCCESS;
+}
+
+TEST_F(CollectionLookupsTest, testJoinedFailScheduling)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    iw.configure(1, 0);
+
+    std::vector<std::pair<int, lcb_STATUS>> failed;
+    auto operation = [&failed](const lcb_RESPGETCID *resp, LookupCommand *cmd) {
+        failed.emplace_back(cmd->id, resp->ctx.rc);
+        return LCB_SUCCESS;
+    };
+
+    LookupCommand cmd;
+    LCB_KREQ_SIMPLE(&cmd.key, "key", 3);
+    cmd.scope = "s";
+    cmd.nscope = 1;
+    cmd.collection = "c";
+    cmd.ncollection = 1;
+
+    lcb_sched_enter(instance);
+    for (int ii = 1; ii <= 3; ii++) {
+        cmd.id = ii;
+        ASSERT_EQ(LCB_SUCCESS,
+                  collcache_resolve(instance, &cmd, operation, lookup_command_clone, lookup_command_destroy));
+    }
+    ASSERT_EQ(1, instance->colllookups->size());
+
+    // The commands which joined the lookup fail along with the one which sent it
+    lcb_sched_fail(instance);
+    ASSERT_EQ(0, instance->colllookups->size());
+    ASSERT_EQ(3, failed.size());
+    for (int ii = 0; ii < 3; ii++) {
+        ASSERT_EQ(ii + 1, failed[ii].first);
+        ASSERT_EQ(LCB_ERR_SHEDULE_FAILURE, failed[ii].second);
+    }
+}
+
+class CollectionCacheTest : public ::testing::Test
+{
+};
+
+TEST_F(CollectionCacheTest, testGetPut)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid = 42;
+
+    // The default collection is always known
+    ASSERT_TRUE(cache.get("_default._default", &cid));
+    ASSERT_EQ(0, cid);
+    ASSERT_EQ("_default._default", cache.id_to_name(0));
+
+    ASSERT_FALSE(cache.get("s.c", &cid));
+    cache.put("s.c", 8, 1);
+    ASSERT_TRUE(cache.get("s.c", &cid));
+    ASSERT_EQ(8, cid);
+    ASSERT_EQ("s.c", cache.id_to_name(8));
+    ASSERT_EQ("", cache.id_to_name(9));
+
+    lcb::collection_qualifier qualifier("s", 1, "c", 1);
+    ASSERT_TRUE(cache.get(qualifier.spec_hash(), qualifier.spec(), &cid));
+    ASSERT_EQ(8, cid);
+    ASSERT_EQ(lcb::collection_path_hash("s.c", 3), qualifier.spec_hash());
+    lcb::collection_qualifier default_qualifier;
+    ASSERT_TRUE(cache.get(default_qualifier.spec_hash(), default_qualifier.spec(), &cid));
+    ASSERT_EQ(0, cid);
+}
+
+TEST_F(CollectionCacheTest, testManifestInvalidation)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid;
+
+    cache.put("s.a", 8, 1);
+    cache.put("s.b", 9, 1);
+    ASSERT_EQ(1, cache.manifest_uid());
+
+    // A newer manifest invalidates everything but the default collection
+    cache.put("s.a", 10, 2);
+    ASSERT_TRUE(cache.get("s.a", &cid));
+    ASSERT_EQ(10, cid);
+    ASSERT_FALSE(cache.get("s.b", &cid));
+    ASSERT_TRUE(cache.get("_default._default", &cid));
+
+    // The collection was recreated, its former ID is no longer known
+    ASSERT_EQ("s.a", cache.id_to_name(10));
+    ASSERT_EQ("", cache.id_to_name(8));
+
+    // IDs from older manifests are ignored
+    cache.put("s.b", 9, 1);
+    ASSERT_FALSE(cache.get("s.b", &cid));
+    ASSERT_FALSE(cache.set_manifest_uid(2));
+    ASSERT_TRUE(cache.set_manifest_uid(3));
+    ASSERT_FALSE(cache.get("s.a", &cid));
+}
+
+TEST_F(CollectionCacheTest, testUnknown)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid;
+    std::string path("s.missing");
+    uint64_t hash = lcb::collection_path_hash(path.data(), path.size());
+
+    ASSERT_EQ(LCB_SUCCESS, cache.get_unknown(path));
+    cache.put_unknown(path, LCB_ERR_COLLECTION_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    ASSERT_EQ(LCB_ERR_COLLECTION_NOT_FOUND, cache.get_unknown(path));
+    ASSERT_FALSE(cache.get(hash, path, &cid));
+
+    // Expired
+    cache.put_unknown(path, LCB_ERR_SCOPE_NOT_FOUND, gethrtime() - 1);
+    ASSERT_EQ(LCB_SUCCESS, cache.get_unknown(path));
+
+    // Forgotten once a newer manifest is seen
+    cache.put_unknown(path, LCB_ERR_SCOPE_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    ASSERT_EQ(LCB_ERR_SCOPE_NOT_FOUND, cache.get_unknown(path));
+    cache.set_manifest_uid(5);
+    ASSERT_EQ(LCB_SUCCESS, cache.get_unknown(path));
+
+    // Or once the collection is found
+    cache.put_unknown(path, LCB_ERR_COLLECTION_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    cache.put(path, 12, 5);
+    ASSERT_EQ(LCB_SUCCESS, cache.get_unknown(path));
+    ASSERT_TRUE(cache.get(hash, path, &cid));
+    ASSERT_EQ(12, cid);
+}
+
+TEST_F(CollectionCacheTest, testFull)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid;
+    for (uint32_t ii = 0; ii < lcb::CollectionCache::capacity + 10; ii++) {
+        cache.put("s.c" + std::to_string(ii), ii + 8, 1);
+    }
+    // The first entries are kept, the others are not cached
+    ASSERT_TRUE(cache.get("s.c0", &cid));
+    ASSERT_EQ(8, cid);
+    ASSERT_FALSE(cache.get("s.c" + std::to_string(lcb::CollectionCache::capacity + 5), &cid));
+    // One slot holds the default collection
+    ASSERT_EQ(11, cache.overflows());
+}
+
+TEST_F(CollectionCacheTest, testUnknownDoesNotFill)
+{
+    lcb::CollectionCache cache;
+    uint32_t cid;
+    ASSERT_TRUE(cache.set_manifest_uid(1));
+    for (uint32_t ii = 0; ii < lcb::CollectionCache::capacity + 10; ii++) {
+        cache.put_unknown("s.u" + std::to_string(ii), LCB_ERR_COLLECTION_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    }
+    // Unknown collections are not kept in the table, and only a bounded number is remembered
+    cache.put("s.found", 7, 1);
+    ASSERT_TRUE(cache.get("s.found", &cid));
+    ASSERT_EQ(7, cid);
+    ASSERT_EQ(0, cache.overflows());
+    ASSERT_EQ(LCB_ERR_COLLECTION_NOT_FOUND,
+              cache.get_unknown("s.u" + std::to_string(lcb::CollectionCache::capacity + 9)));
+    unsigned remembered = 0;
+    for (uint32_t ii = 0; ii < lcb::CollectionCache::capacity + 10; ii++) {
+        if (cache.get_unknown("s.u" + std::to_string(ii)) != LCB_SUCCESS) {
+            remembered++;
+        }
+    }
+    ASSERT_EQ(lcb::CollectionCache::unknown_capacity, remembered);
+
+    // Expired entries make room before valid ones are forgotten
+    lcb::CollectionCache expiring;
+    for (uint32_t ii = 0; ii < lcb::CollectionCache::unknown_capacity - 1; ii++) {
+        expiring.put_unknown("s.u" + std::to_string(ii), LCB_ERR_COLLECTION_NOT_FOUND, gethrtime() - 1);
+    }
+    expiring.put_unknown("s.kept", LCB_ERR_SCOPE_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    expiring.put_unknown("s.new", LCB_ERR_COLLECTION_NOT_FOUND, gethrtime() + LCB_S2NS(60));
+    ASSERT_EQ(LCB_ERR_SCOPE_NOT_FOUND, expiring.get_unknown("s.kept"));
+    ASSERT_EQ(LCB_ERR_COLLECTION_NOT_FOUND, expiring.get_unknown("s.new"));
+}
+
+TEST_F(CollectionCacheTest, testConcurrentAccess)
+{
+    lcb::CollectionCache cache;
+    const unsigned nthreads = 4;
+    const uint32_t ncollections = 200;
+    std::vector<std::thread> threads;
+    std::vector<unsigned> nwrong(nthreads);
+
+    for (unsigned tt = 0; tt < nthreads; tt++) {
+        threads.emplace_back([&cache, &nwrong, tt, ncollections]() {
+            for (uint32_t ii = 0; ii < ncollections; ii++) {
+                std::string path = "s.c" + std::to_string(ii);
+                cache.put(path, ii + 8, 1);
+                uint32_t cid;
+                if (!cache.get(path, &cid) || cid != ii + 8 || cache.id_to_name(cid) != path) {
+                    nwrong[tt]++;
+                }
+            }
+        });
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    for (unsigned tt = 0; tt < nthreads; tt++) {
+        ASSERT_EQ(0, nwrong[tt]);
+    }
+}
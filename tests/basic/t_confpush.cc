@@ -0,0 +1,86 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "instwrap.h"
+
+class ConfigPushTest : public ::testing::Test
+{
+};
+
+/* Feed a cluster map change notification, as the server sends it, to the server object */
+static void push_config(lcb::Server *server, const std::string &bucket, uint32_t revid, const std::string &config)
+{
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_SREQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_SERVER_CLUSTERMAP_CHANGE_NOTIFICATION;
+    hdr.request.extlen = sizeof(revid);
+    hdr.request.keylen = htons(static_cast<uint16_t>(bucket.size()));
+    hdr.request.bodylen = htonl(static_cast<uint32_t>(sizeof(revid) + bucket.size() + config.size()));
+    revid = htonl(revid);
+
+    rdb_IOROPE ior;
+    rdb_init(&ior, rdb_libcalloc_new());
+    rdb_copywrite(&ior, hdr.bytes, sizeof(hdr.bytes));
+    rdb_copywrite(&ior, &revid, sizeof(revid));
+    rdb_copywrite(&ior, const_cast<char *>(bucket.data()), bucket.size());
+    rdb_copywrite(&ior, const_cast<char *>(config.data()), config.size());
+
+    lcb::MemcachedResponse frame;
+    unsigned wanted;
+    ASSERT_TRUE(frame.load(&ior, &wanted));
+    ASSERT_EQ(PROTOCOL_BINARY_SREQ, frame.magic());
+    server->handle_server_request(frame);
+    frame.release(&ior);
+    rdb_cleanup(&ior);
+}
+
+TEST_F(ConfigPushTest, testHandleNotification)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+
+    lcbvb_CONFIG *vbc = InstanceWrap::genconfig(2, 1);
+    vbc->revid = 10;
+    iw.configure(vbc);
+    lcb::Server *server = iw.server(0);
+    ASSERT_NE(nullptr, server->metrics);
+    std::string bucket(instance->settings->bucket);
+
+    // Notifications for other buckets are ignored
+    push_config(server, bucket + "_other", 11, "");
+    ASSERT_EQ(0, server->metrics->packets_config_push);
+
+    // A revision which is not newer is accounted for, but changes nothing
+    push_config(server, bucket, 10, "");
+    ASSERT_EQ(1, server->metrics->packets_config_push);
+    ASSERT_EQ(10, instance->cur_configinfo->vbc->revid);
+
+    // A newer cluster map carried by the notification is handed to the
+    // configuration monitor straight away
+    lcbvb_CONFIG *pushed = InstanceWrap::genconfig(2, 1);
+    pushed->revid = 12;
+    char *json = lcbvb_save_json(pushed);
+    push_config(server, bucket, 12, json);
+    free(json);
+    lcbvb_destroy(pushed);
+    ASSERT_EQ(2, server->metrics->packets_config_push);
+    ASSERT_EQ(12, instance->confmon->get_config()->vbc->revid);
+}
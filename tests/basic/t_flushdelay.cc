@@ -0,0 +1,73 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "instwrap.h"
+
+class FlushDelayTest : public ::testing::Test
+{
+};
+
+static void schedule_deferred_get(lcb_INSTANCE *instance, const char *key)
+{
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key, strlen(key));
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, nullptr, cmd));
+    lcb_cmdget_destroy(cmd);
+}
+
+TEST_F(FlushDelayTest, testDefer)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_flush_delay", "0.0005"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    lcb_U32 delay = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_KV_FLUSH_DELAY, &delay));
+    ASSERT_EQ(500, delay);
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(1, 0);
+    lcb::Server *server = iw.server(0);
+
+    // Commands scheduled within the delay share the deferred flush
+    schedule_deferred_get(instance, "a");
+    schedule_deferred_get(instance, "b");
+    ASSERT_NE(nullptr, instance->flush_timer);
+    ASSERT_TRUE(lcbio_timer_armed(instance->flush_timer));
+    ASSERT_EQ(1, metrics->flushes_deferred);
+    ASSERT_NE(0, server->nbytes_queued);
+
+    lcb_sched_flush(instance);
+    ASSERT_FALSE(lcbio_timer_armed(instance->flush_timer));
+
+    // Reaching the flush size writes the commands at once
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_flush_bytes", "1"));
+    schedule_deferred_get(instance, "c");
+    ASSERT_FALSE(lcbio_timer_armed(instance->flush_timer));
+    ASSERT_EQ(1, metrics->flushes_deferred);
+
+    // Nothing was written yet
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+    ASSERT_EQ(0, metrics->packets_per_write);
+
+    server->purge(LCB_ERR_REQUEST_CANCELED);
+}
@@ -0,0 +1,147 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <vector>
+
+#include "instwrap.h"
+#include "getflights.h"
+
+class GetFlightsTest : public ::testing::Test
+{
+};
+
+TEST_F(GetFlightsTest, testJoin)
+{
+    lcb::GetFlights flights;
+    int cookies[3];
+
+    std::string key = lcb::GetFlights::make_key(8, "hot");
+    ASSERT_NE(lcb::GetFlights::make_key(9, "hot"), key);
+    ASSERT_FALSE(flights.join(key, &cookies[0]));
+
+    lcb::GetFlight flight(nullptr, key, &cookies[0], 0);
+    flights.start(&flight);
+    ASSERT_TRUE(flights.join(key, &cookies[1]));
+    ASSERT_TRUE(flights.join(key, &cookies[2]));
+    ASSERT_FALSE(flights.join(lcb::GetFlights::make_key(9, "hot"), &cookies[1]));
+    ASSERT_EQ(std::vector<void *>({&cookies[1], &cookies[2]}), flight.waiters_);
+
+    // A flight which was replaced for the key does not remove the new one
+    lcb::GetFlight stale(nullptr, key, &cookies[0], 0);
+    flights.finish(&stale);
+    ASSERT_EQ(1, flights.size());
+
+    flights.finish(&flight);
+    ASSERT_EQ(0, flights.size());
+    ASSERT_FALSE(flights.join(key, &cookies[1]));
+}
+
+struct GetResult {
+    std::vector<void *> cookies;
+    std::vector<std::string> keys;
+};
+
+extern "C" {
+static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
+{
+    auto *result = reinterpret_cast<GetResult *>(const_cast<void *>(lcb_get_cookie(instance)));
+    void *cookie = nullptr;
+    const char *key = nullptr;
+    size_t nkey = 0;
+    lcb_respget_cookie(resp, &cookie);
+    lcb_respget_key(resp, &key, &nkey);
+    EXPECT_EQ(LCB_ERR_REQUEST_CANCELED, lcb_respget_status(resp));
+    result->cookies.push_back(cookie);
+    result->keys.emplace_back(key, nkey);
+}
+}
+
+static void schedule_get(lcb_INSTANCE *instance, void *cookie, const std::string &key, bool lock = false)
+{
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    if (lock) {
+        lcb_cmdget_locktime(cmd, 10);
+    }
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, cookie, cmd));
+    lcb_cmdget_destroy(cmd);
+}
+
+static size_t count_queued(lcb_INSTANCE *instance)
+{
+    size_t nqueued = 0;
+    for (size_t ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        for (sllist_node *ll = SLLIST_FIRST(&instance->cmdq.pipelines[ii]->ctxqueued); ll; ll = ll->next) {
+            nqueued++;
+        }
+    }
+    return nqueued;
+}
+
+TEST_F(GetFlightsTest, testFanOut)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    GetResult result;
+    lcb_set_cookie(instance, &result);
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)get_callback);
+    int enabled = 1;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_GET_SINGLE_FLIGHT, &enabled));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_METRICS, &enabled));
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(2, 1);
+
+    int cookies[6];
+
+    // Not sent: no response is delivered, and the GET may be sent again
+    lcb_sched_enter(instance);
+    schedule_get(instance, &cookies[0], "hot");
+    schedule_get(instance, &cookies[1], "hot");
+    lcb_sched_fail(instance);
+    ASSERT_EQ(0, instance->getflights->size());
+    ASSERT_TRUE(result.cookies.empty());
+
+    lcb_sched_enter(instance);
+    schedule_get(instance, &cookies[0], "hot");
+    schedule_get(instance, &cookies[1], "hot");
+    schedule_get(instance, &cookies[2], "cold");
+    schedule_get(instance, &cookies[3], "hot", true);
+    schedule_get(instance, &cookies[4], "hot");
+    ASSERT_EQ(3, count_queued(instance));
+    lcb_sched_leave(instance);
+
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        iw.server(ii)->purge(LCB_ERR_REQUEST_CANCELED);
+    }
+    ASSERT_EQ(5, result.cookies.size());
+    ASSERT_EQ(2, metrics->get_collapsed);
+    ASSERT_EQ(0, instance->getflights->size());
+    std::vector<void *> hot;
+    for (size_t ii = 0; ii < result.cookies.size(); ii++) {
+        if (result.cookies[ii] != &cookies[2] && result.cookies[ii] != &cookies[3]) {
+            ASSERT_EQ("hot", result.keys[ii]);
+            hot.push_back(result.cookies[ii]);
+        }
+    }
+    // The command which sent the request is answered first
+    ASSERT_EQ(std::vector<void *>({&cookies[0], &cookies[1], &cookies[4]}), hot);
+}
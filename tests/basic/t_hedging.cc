@@ -0,0 +1,173 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <vector>
+
+#include "instwrap.h"
+#include "hedging.h"
+
+class HedgingTest : public ::testing::Test
+{
+};
+
+TEST_F(HedgingTest, testLatencyWindow)
+{
+    lcb::LatencyWindow window;
+    for (hrtime_t ii = 1; ii < lcb::LatencyWindow::min_samples; ii++) {
+        window.add(ii);
+    }
+    ASSERT_EQ(0, window.p95());
+
+    for (hrtime_t ii = lcb::LatencyWindow::min_samples; ii <= 100; ii++) {
+        window.add(ii);
+    }
+    // Only the last 64 samples (37..100) are kept
+    ASSERT_EQ(97, window.p95());
+
+    // The estimate is refreshed after a number of new samples
+    for (std::size_t ii = 0; ii < lcb::LatencyWindow::capacity; ii++) {
+        window.add(10);
+    }
+    ASSERT_EQ(10, window.p95());
+}
+
+TEST_F(HedgingTest, testBudget)
+{
+    lcb::HedgeBudget budget;
+    ASSERT_FALSE(budget.take());
+
+    for (int ii = 0; ii < 10; ii++) {
+        budget.add_request(10);
+    }
+    ASSERT_TRUE(budget.take());
+    ASSERT_FALSE(budget.take());
+
+    // Unused credit is limited
+    for (int ii = 0; ii < 1000; ii++) {
+        budget.add_request(100);
+    }
+    for (std::uint32_t ii = 0; ii < lcb::HedgeBudget::burst; ii++) {
+        ASSERT_TRUE(budget.take());
+    }
+    ASSERT_FALSE(budget.take());
+}
+
+struct HedgeResult {
+    std::vector<void *> cookies;
+    std::vector<lcb_STATUS> rcs;
+};
+
+extern "C" {
+static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
+{
+    auto *result = reinterpret_cast<HedgeResult *>(const_cast<void *>(lcb_get_cookie(instance)));
+    void *cookie = nullptr;
+    lcb_respget_cookie(resp, &cookie);
+    result->cookies.push_back(cookie);
+    result->rcs.push_back(lcb_respget_status(resp));
+}
+}
+
+static void schedule_get(lcb_INSTANCE *instance, void *cookie, const std::string &key)
+{
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, cookie, cmd));
+    lcb_cmdget_destroy(cmd);
+}
+
+TEST_F(HedgingTest, testHedge)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    HedgeResult result;
+    lcb_set_cookie(instance, &result);
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)get_callback);
+    ASSERT_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "get_hedge_budget", "101"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "get_hedge_budget", "50"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "get_hedge_delay", "0.001"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(2, 1);
+
+    // The budget allows one of the two GETs to be hedged
+    int cookies[2];
+    schedule_get(instance, &cookies[0], "a");
+    schedule_get(instance, &cookies[1], "b");
+    lcbio_timerwheel_run(instance->timers, gethrtime() + LCB_MS2NS(10));
+    ASSERT_EQ(1, metrics->get_hedges_issued);
+
+    // Each GET is answered once, by the last failed request
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        iw.server(ii)->purge(LCB_ERR_REQUEST_CANCELED);
+    }
+    ASSERT_EQ(2, result.cookies.size());
+    ASSERT_NE(result.cookies[0], result.cookies[1]);
+    ASSERT_EQ(std::vector<lcb_STATUS>({LCB_ERR_REQUEST_CANCELED, LCB_ERR_REQUEST_CANCELED}), result.rcs);
+    ASSERT_EQ(0, metrics->get_hedges_won);
+}
+
+/* Index of the server which the GET for the key is sent to */
+static int hedged_master(lcb_INSTANCE *instance, const std::string &key)
+{
+    int vbid, srvix;
+    lcbvb_map_key(LCBT_VBCONFIG(instance), key.c_str(), key.size(), &vbid, &srvix);
+    return srvix;
+}
+
+TEST_F(HedgingTest, testActiveAnswerWins)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    HedgeResult result;
+    lcb_set_cookie(instance, &result);
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)get_callback);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "get_hedge_budget", "100"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "get_hedge_delay", "0.001"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(2, 1);
+
+    // A missing document reported by the active node is delivered without
+    // waiting for the replica, which could still have an old value
+    int cookie;
+    schedule_get(instance, &cookie, "a");
+    lcbio_timerwheel_run(instance->timers, gethrtime() + LCB_MS2NS(10));
+    ASSERT_EQ(1, metrics->get_hedges_issued);
+    int master = hedged_master(instance, "a");
+    iw.server(master)->purge(LCB_ERR_DOCUMENT_NOT_FOUND);
+    ASSERT_EQ(std::vector<lcb_STATUS>({LCB_ERR_DOCUMENT_NOT_FOUND}), result.rcs);
+    iw.server(1 - master)->purge(LCB_ERR_REQUEST_CANCELED);
+    ASSERT_EQ(1, result.rcs.size());
+
+    // A timeout of the active node waits for the replica
+    schedule_get(instance, &cookie, "b");
+    lcbio_timerwheel_run(instance->timers, gethrtime() + LCB_MS2NS(20));
+    ASSERT_EQ(2, metrics->get_hedges_issued);
+    master = hedged_master(instance, "b");
+    iw.server(master)->purge(LCB_ERR_TIMEOUT);
+    ASSERT_EQ(1, result.rcs.size());
+    iw.server(1 - master)->purge(LCB_ERR_REQUEST_CANCELED);
+    ASSERT_EQ(std::vector<lcb_STATUS>({LCB_ERR_DOCUMENT_NOT_FOUND, LCB_ERR_REQUEST_CANCELED}), result.rcs);
+}
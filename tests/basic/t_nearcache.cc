@@ -0,0 +1,229 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <vector>
+
+#include "instwrap.h"
+#include "getflights.h"
+#include "nearcache.h"
+#include "capi/cmd_get.hh"
+
+class NearCacheTest : public ::testing::Test
+{
+};
+
+static std::size_t put(lcb::NearCache &cache, const std::string &key, const std::string &value, hrtime_t start,
+                       std::size_t capacity = 4096)
+{
+    return cache.put(key, value.c_str(), value.size(), 0, 0, 42, start, capacity);
+}
+
+TEST_F(NearCacheTest, testEvictLeastRecentlyUsed)
+{
+    lcb::NearCache cache(nullptr);
+    std::size_t capacity = 0;
+
+    ASSERT_EQ(0, put(cache, "a", std::string(100, 'a'), 1));
+    capacity = cache.bytes() * 3;
+    ASSERT_EQ(0, put(cache, "b", std::string(100, 'b'), 1, capacity));
+    ASSERT_EQ(0, put(cache, "c", std::string(100, 'c'), 1, capacity));
+    ASSERT_EQ(3, cache.size());
+
+    // "a" becomes the most recently used, so "b" is evicted
+    ASSERT_NE(nullptr, cache.get("a", 0));
+    ASSERT_EQ(1, put(cache, "d", std::string(100, 'd'), 1, capacity));
+    ASSERT_EQ(nullptr, cache.get("b", 0));
+    ASSERT_NE(nullptr, cache.get("c", 0));
+    ASSERT_EQ(3, cache.size());
+
+    // Storing the key again replaces its value
+    ASSERT_EQ(0, put(cache, "c", std::string(100, 'C'), 1, capacity));
+    ASSERT_EQ(std::string(100, 'C'), cache.get("c", 0)->value);
+    ASSERT_EQ(3, cache.size());
+
+    // Values which do not fit are not stored
+    ASSERT_EQ(0, put(cache, "e", std::string(capacity, 'e'), 1, capacity));
+    ASSERT_EQ(nullptr, cache.get("e", 0));
+
+    ASSERT_EQ(2, cache.trim(capacity / 2));
+    ASSERT_EQ(1, cache.size());
+    ASSERT_EQ(1, cache.trim(0));
+    ASSERT_EQ(0, cache.bytes());
+}
+
+TEST_F(NearCacheTest, testStaleness)
+{
+    lcb::NearCache cache(nullptr);
+
+    put(cache, "a", "value", 100);
+    ASSERT_NE(nullptr, cache.get("a", 100));
+    ASSERT_EQ(nullptr, cache.get("a", 101));
+    ASSERT_EQ(0, cache.size());
+
+    // The server confirms the value
+    put(cache, "a", "value", 100);
+    cache.get("a", 0)->revalidating = true;
+    cache.revalidated("a", 42, 200);
+    ASSERT_FALSE(cache.get("a", 0)->revalidating);
+    ASSERT_EQ(200, cache.get("a", 0)->validated);
+
+    // The document changed on the server
+    cache.revalidated("a", 43, 300);
+    ASSERT_EQ(nullptr, cache.get("a", 0));
+
+    // A GET sent before a mutation completed may return the previous value
+    put(cache, "a", "value", 400);
+    cache.remove("a", 500);
+    ASSERT_EQ(nullptr, cache.get("a", 0));
+    put(cache, "a", "value", 450);
+    ASSERT_EQ(nullptr, cache.get("a", 0));
+    // ...which does not concern the GETs of other documents
+    put(cache, "b", "value", 450);
+    ASSERT_NE(nullptr, cache.get("b", 0));
+    put(cache, "a", "value", 600);
+    ASSERT_NE(nullptr, cache.get("a", 0));
+}
+
+struct NearCacheResult {
+    std::vector<lcb_STATUS> rcs;
+    std::vector<std::string> values;
+};
+
+extern "C" {
+static void get_callback(lcb_INSTANCE *instance, int, const lcb_RESPGET *resp)
+{
+    auto *result = reinterpret_cast<NearCacheResult *>(const_cast<void *>(lcb_get_cookie(instance)));
+    const char *value = nullptr;
+    size_t nvalue = 0;
+    lcb_respget_value(resp, &value, &nvalue);
+    result->rcs.push_back(lcb_respget_status(resp));
+    result->values.emplace_back(value, nvalue);
+}
+
+static void store_callback(lcb_INSTANCE *, int, const lcb_RESPSTORE *) {}
+}
+
+static lcb_STATUS schedule_get(lcb_INSTANCE *instance, const std::string &key)
+{
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, key.c_str(), key.size());
+    lcb_STATUS rc = lcb_get(instance, nullptr, cmd);
+    lcb_cmdget_destroy(cmd);
+    return rc;
+}
+
+static size_t count_queued(lcb_INSTANCE *instance)
+{
+    size_t nqueued = 0;
+    for (size_t ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        for (sllist_node *ll = SLLIST_FIRST(&instance->cmdq.pipelines[ii]->ctxqueued); ll; ll = ll->next) {
+            nqueued++;
+        }
+    }
+    return nqueued;
+}
+
+TEST_F(NearCacheTest, testGet)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    NearCacheResult result;
+    lcb_set_cookie(instance, &result);
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)get_callback);
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)store_callback);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "65536"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(2, 1);
+
+    std::string key = lcb::GetFlights::make_key(0, "ref");
+    put(*instance->nearcache, key, "cached", gethrtime());
+
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, "other"));
+    ASSERT_EQ(1, count_queued(instance));
+    lcb_sched_fail(instance);
+    ASSERT_EQ(1, metrics->near_cache_misses);
+
+    // Answered from the cache, outside of lcb_get()
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, "ref"));
+    ASSERT_EQ(0, count_queued(instance));
+    ASSERT_TRUE(result.rcs.empty());
+    ASSERT_EQ(1, metrics->near_cache_hits);
+
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(std::vector<lcb_STATUS>({LCB_SUCCESS}), result.rcs);
+    ASSERT_EQ("cached", result.values[0]);
+
+    // Storing the document drops the value, whether it succeeds or not
+    lcb_CMDSTORE *cmd;
+    lcb_cmdstore_create(&cmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(cmd, "ref", 3);
+    lcb_cmdstore_value(cmd, "new", 3);
+    ASSERT_EQ(LCB_SUCCESS, lcb_store(instance, nullptr, cmd));
+    lcb_cmdstore_destroy(cmd);
+    for (size_t ii = 0; ii < LCBT_NSERVERS(instance); ii++) {
+        iw.server(ii)->purge(LCB_ERR_REQUEST_CANCELED);
+    }
+    ASSERT_EQ(0, instance->nearcache->size());
+
+    // Pending values are cancelled along with the instance
+    put(*instance->nearcache, key, "cached", gethrtime());
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, "ref"));
+    iw.destroy();
+    ASSERT_EQ(2, result.rcs.size());
+    ASSERT_EQ(LCB_ERR_REQUEST_CANCELED, result.rcs[1]);
+}
+
+TEST_F(NearCacheTest, testImpersonatedNotStored)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "near_cache_size", "65536"));
+    iw.configure(1, 0);
+
+    lcb_RESPGET resp{};
+    resp.value = "private";
+    resp.nvalue = 7;
+
+    // A value read on behalf of another user is not shared through the cache
+    lcb_sched_enter(instance);
+    lcb_CMDGET *cmd;
+    lcb_cmdget_create(&cmd);
+    lcb_cmdget_key(cmd, "doc", 3);
+    lcb_cmdget_on_behalf_of(cmd, "alice", 5);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get(instance, nullptr, cmd));
+    lcb_cmdget_destroy(cmd);
+    ASSERT_EQ(1, count_queued(instance));
+    mc_PACKET *pkt = SLLIST_ITEM(SLLIST_FIRST(&instance->cmdq.pipelines[0]->ctxqueued), mc_PACKET, slnode);
+    nearcache_store(instance, pkt, &resp);
+    ASSERT_EQ(0, instance->nearcache->size());
+    lcb_sched_fail(instance);
+
+    // The same read for the instance's own user is
+    lcb_sched_enter(instance);
+    ASSERT_EQ(LCB_SUCCESS, schedule_get(instance, "doc"));
+    pkt = SLLIST_ITEM(SLLIST_FIRST(&instance->cmdq.pipelines[0]->ctxqueued), mc_PACKET, slnode);
+    nearcache_store(instance, pkt, &resp);
+    ASSERT_EQ(1, instance->nearcache->size());
+    lcb_sched_fail(instance);
+}
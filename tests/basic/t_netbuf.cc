@@ -456,3 +456,124 @@ TEST_F(NetbufTest, testOutOfOrder)
 
     clean_check(&mgr);
 }
+
+/*
+ * Spans released in arbitrary order (as happens when the server completes
+ * requests out of order) must all be reclaimed, including once the block has
+ * wrapped around.
+ */
+TEST_F(NetbufTest, testOutOfOrderShuffled)
+{
+    nb_MGR mgr;
+    nb_SETTINGS settings;
+    const int nspans = 64;
+    nb_SPAN spans[nspans];
+    int order[nspans];
+    int ii;
+    unsigned seed = 1;
+
+    netbuf_default_settings(&settings);
+    settings.data_basealloc = 2048;
+    netbuf_init(&mgr, &settings);
+
+    for (int round = 0; round < 100; round++) {
+        for (ii = 0; ii < nspans; ii++) {
+            spans[ii].size = 8 + (ii % 5) * 8;
+            ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, spans + ii));
+            order[ii] = ii;
+        }
+        for (ii = nspans - 1; ii > 0; ii--) {
+            int jj, tmp;
+            seed = seed * 1103515245 + 12345;
+            jj = (int)((seed >> 16) % (unsigned)(ii + 1));
+            tmp = order[ii];
+            order[ii] = order[jj];
+            order[jj] = tmp;
+        }
+        /* Release half, allocate some more so that the block wraps, and
+         * release the rest */
+        for (ii = 0; ii < nspans / 2; ii++) {
+            netbuf_mblock_release(&mgr, spans + order[ii]);
+        }
+        for (ii = 0; ii < nspans / 2; ii++) {
+            int ix = order[ii];
+            ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, spans + ix));
+        }
+        for (ii = 0; ii < nspans; ii++) {
+            netbuf_mblock_release(&mgr, spans + order[(ii * 7) % nspans]);
+        }
+        ASSERT_NE(0, netbuf_is_clean(&mgr)) << "round " << round;
+    }
+    clean_check(&mgr);
+}
+
+/*
+ * Pinned buffers are neither coalesced with their neighbours nor filled into
+ * the same IOVs as unpinned ones by netbuf_start_flush_ex()
+ */
+TEST_F(NetbufTest, testPinnedFlush)
+{
+    nb_MGR mgr;
+    nb_SETTINGS settings;
+    nb_SPAN spans[2];
+    char user[64];
+    nb_IOV uiov[2], iov[10];
+    int nused = 0, pinned = -1;
+    unsigned sz;
+
+    netbuf_default_settings(&settings);
+    netbuf_init(&mgr, &settings);
+
+    for (int ii = 0; ii < 2; ii++) {
+        spans[ii].size = 24;
+        ASSERT_EQ(0, netbuf_mblock_reserve(&mgr, spans + ii));
+    }
+    /* Two adjacent user buffers */
+    uiov[0].iov_base = user;
+    uiov[0].iov_len = 32;
+    uiov[1].iov_base = user + 32;
+    uiov[1].iov_len = 32;
+
+    netbuf_enqueue_span(&mgr, &spans[0], NULL);
+    netbuf_enqueue_pinned(&mgr, &uiov[0], NULL);
+    netbuf_enqueue_pinned(&mgr, &uiov[1], NULL);
+    netbuf_enqueue_span(&mgr, &spans[1], NULL);
+    ASSERT_EQ(4, netbuf_get_niov(&mgr));
+
+    /* Without boundaries, everything is returned */
+    sz = netbuf_start_flush(&mgr, iov, 10, &nused);
+    ASSERT_EQ(24 + 64 + 24, sz);
+    ASSERT_EQ(4, nused);
+    netbuf_reset_flush(&mgr);
+
+    sz = netbuf_start_flush_ex(&mgr, iov, 10, &nused, &pinned);
+    ASSERT_EQ(24, sz);
+    ASSERT_EQ(1, nused);
+    ASSERT_EQ(0, pinned);
+    netbuf_end_flush(&mgr, sz);
+
+    /* A partially flushed pinned buffer continues as pinned */
+    sz = netbuf_start_flush_ex(&mgr, iov, 10, &nused, &pinned);
+    ASSERT_EQ(64, sz);
+    ASSERT_EQ(2, nused);
+    ASSERT_NE(0, pinned);
+    ASSERT_EQ(user, iov[0].iov_base);
+    netbuf_end_flush(&mgr, 10);
+    netbuf_reset_flush(&mgr);
+
+    sz = netbuf_start_flush_ex(&mgr, iov, 10, &nused, &pinned);
+    ASSERT_EQ(54, sz);
+    ASSERT_NE(0, pinned);
+    ASSERT_EQ(user + 10, iov[0].iov_base);
+    netbuf_end_flush(&mgr, sz);
+
+    sz = netbuf_start_flush_ex(&mgr, iov, 10, &nused, &pinned);
+    ASSERT_EQ(24, sz);
+    ASSERT_EQ(0, pinned);
+    netbuf_end_flush(&mgr, sz);
+    ASSERT_EQ(0, netbuf_start_flush_ex(&mgr, iov, 10, &nused, &pinned));
+
+    netbuf_mblock_release(&mgr, &spans[0]);
+    netbuf_mblock_release(&mgr, &spans[1]);
+    clean_check(&mgr);
+}
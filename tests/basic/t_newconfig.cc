@@ -0,0 +1,68 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include <vector>
+
+#include "instwrap.h"
+
+class NewConfigTest : public ::testing::Test
+{
+};
+
+static lcbvb_CONFIG *make_config(unsigned nservers, unsigned moved_vbid = 0)
+{
+    lcbvb_CONFIG *vbc = InstanceWrap::genconfig(nservers, 1);
+    if (moved_vbid) {
+        vbc->vbuckets[moved_vbid].servers[0] = (vbc->vbuckets[moved_vbid].servers[0] + 1) % nservers;
+    }
+    return vbc;
+}
+
+static std::vector<mc_PIPELINE *> current_pipelines(lcb_INSTANCE *instance)
+{
+    return std::vector<mc_PIPELINE *>(instance->cmdq.pipelines, instance->cmdq.pipelines + instance->cmdq.npipelines);
+}
+
+TEST_F(NewConfigTest, testKeepPipelinesOnMapChange)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+
+    iw.configure(make_config(4));
+    std::vector<mc_PIPELINE *> before = current_pipelines(instance);
+    char *scheds = instance->cmdq.scheds;
+    int master = lcbvb_vbmaster(LCBT_VBCONFIG(instance), 5);
+
+    // Only a vBucket moved: the servers are not rebuilt
+    iw.configure(make_config(4, 5));
+    ASSERT_EQ(before, current_pipelines(instance));
+    ASSERT_EQ(scheds, instance->cmdq.scheds);
+    ASSERT_EQ(LCBT_VBCONFIG(instance), instance->cmdq.config);
+    ASSERT_EQ((master + 1) % 4, lcbvb_vbmaster(LCBT_VBCONFIG(instance), 5));
+
+    // A node is removed: the remaining ones are reused
+    iw.configure(make_config(3));
+    std::vector<mc_PIPELINE *> after = current_pipelines(instance);
+    ASSERT_EQ(3, after.size());
+    for (size_t ii = 0; ii < after.size(); ii++) {
+        ASSERT_EQ(before[ii], after[ii]);
+        ASSERT_EQ(ii, after[ii]->index);
+    }
+}
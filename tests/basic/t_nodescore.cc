@@ -0,0 +1,88 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "instwrap.h"
+#include "nodescore.h"
+
+class NodeScoreTest : public ::testing::Test
+{
+};
+
+TEST_F(NodeScoreTest, testPeakEwma)
+{
+    lcb::PeakEwma ewma;
+    ASSERT_EQ(0, ewma.value());
+
+    hrtime_t now = lcb::PeakEwma::decay;
+    ewma.add(100, now);
+    ASSERT_EQ(100, ewma.value());
+
+    // A slower response is taken at once
+    ewma.add(1000, now);
+    ASSERT_EQ(1000, ewma.value());
+
+    // Faster responses weigh according to the time elapsed
+    ewma.add(100, now);
+    ASSERT_EQ(1000, ewma.value());
+    now += lcb::PeakEwma::decay;
+    ewma.add(100, now);
+    ASSERT_NEAR(431, ewma.value(), 1);
+    now += lcb::PeakEwma::decay * 10;
+    ewma.add(100, now);
+    ASSERT_NEAR(100, ewma.value(), 1);
+}
+
+TEST_F(NodeScoreTest, testReplicaOrder)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+
+    iw.configure(3, 2);
+
+    int vbid = 0, srvix = 0;
+    lcbvb_map_key(LCBT_VBCONFIG(instance), "key", 3, &vbid, &srvix);
+    int first = lcbvb_vbreplica(LCBT_VBCONFIG(instance), vbid, 0);
+    int second = lcbvb_vbreplica(LCBT_VBCONFIG(instance), vbid, 1);
+    ASSERT_EQ(std::vector<unsigned>({0, 1}), replicas_by_score(instance, vbid));
+
+    // The first replica becomes slow
+    iw.server(first)->response_time.add(LCB_MS2NS(5), gethrtime());
+    ASSERT_EQ(std::vector<unsigned>({1, 0}), replicas_by_score(instance, vbid));
+
+    lcb_NODE_SCORE score{};
+    score.index = first;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NODE_SCORE, &score));
+    ASSERT_EQ(5000, score.latency);
+    ASSERT_EQ(0, score.pending);
+    ASSERT_EQ(5000, score.score);
+    score.index = 3;
+    ASSERT_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_NODE_SCORE, &score));
+
+    // Reads from any replica go to the faster one
+    lcb_sched_enter(instance);
+    lcb_CMDGETREPLICA *cmd;
+    lcb_cmdgetreplica_create(&cmd, LCB_REPLICA_MODE_ANY);
+    lcb_cmdgetreplica_key(cmd, "key", 3);
+    ASSERT_EQ(LCB_SUCCESS, lcb_getreplica(instance, nullptr, cmd));
+    lcb_cmdgetreplica_destroy(cmd);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&instance->cmdq.pipelines[first]->ctxqueued));
+    ASSERT_FALSE(SLLIST_IS_EMPTY(&instance->cmdq.pipelines[second]->ctxqueued));
+    lcb_sched_fail(instance);
+}
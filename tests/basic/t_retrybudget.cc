@@ -0,0 +1,104 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "instwrap.h"
+#include "retrybudget.h"
+
+class RetryBudgetTest : public ::testing::Test
+{
+};
+
+TEST_F(RetryBudgetTest, testBudget)
+{
+    lcb::RetryBudget budget;
+    for (std::uint32_t ii = 0; ii < lcb::RetryBudget::burst; ii++) {
+        ASSERT_TRUE(budget.available());
+        budget.withdraw();
+    }
+    ASSERT_FALSE(budget.available());
+
+    for (int ii = 0; ii < 9; ii++) {
+        budget.deposit(10);
+    }
+    ASSERT_FALSE(budget.available());
+    budget.deposit(10);
+    ASSERT_TRUE(budget.available());
+
+    // Unused credit is limited
+    for (int ii = 0; ii < 1000; ii++) {
+        budget.deposit(100);
+    }
+    for (std::uint32_t ii = 0; ii < lcb::RetryBudget::burst; ii++) {
+        budget.withdraw();
+    }
+    ASSERT_FALSE(budget.available());
+}
+
+TEST_F(RetryBudgetTest, testJitter)
+{
+    hrtime_t prev = 10;
+    bool varied = false;
+    for (int ii = 0; ii < 100; ii++) {
+        hrtime_t delay = lcb::decorrelated_jitter(10, prev, 1000);
+        ASSERT_GE(delay, 10);
+        ASSERT_LE(delay, std::min<hrtime_t>(prev * 3, 1000));
+        varied = varied || delay != prev;
+        prev = delay;
+    }
+    ASSERT_TRUE(varied);
+
+    ASSERT_EQ(10, lcb::decorrelated_jitter(10, 10, 0));
+    ASSERT_EQ(0, lcb::decorrelated_jitter(0, 0, 1000));
+}
+
+TEST_F(RetryBudgetTest, testAdmit)
+{
+    InstanceWrap iw;
+    lcb_INSTANCE *instance = iw.instance;
+    ASSERT_EQ(LCB_ERR_CONTROL_INVALID_ARGUMENT, lcb_cntl_string(instance, "retry_budget", "101"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "metrics", "true"));
+    lcb_METRICS *metrics = nullptr;
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_METRICS, &metrics));
+
+    iw.configure(2, 1);
+    lcb::Server *first = iw.server(0);
+    lcb::Server *second = iw.server(1);
+
+    // Without a budget, retries are not limited
+    for (std::uint32_t ii = 0; ii < lcb::RetryBudget::burst * 2; ii++) {
+        ASSERT_TRUE(instance->retryq->admit(first));
+    }
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "retry_budget", "50"));
+    for (std::uint32_t ii = 0; ii < lcb::RetryBudget::burst; ii++) {
+        ASSERT_TRUE(instance->retryq->admit(first));
+    }
+    ASSERT_FALSE(instance->retryq->admit(first));
+    // The instance budget is shared by all the nodes
+    ASSERT_FALSE(instance->retryq->admit(second));
+    ASSERT_EQ(2, metrics->retries_rejected);
+
+    // Successes of a node earn retries for that node only
+    instance->retryq->deposit(second);
+    instance->retryq->deposit(second);
+    ASSERT_FALSE(instance->retryq->admit(first));
+    ASSERT_TRUE(instance->retryq->admit(second));
+    ASSERT_EQ(3, metrics->retries_rejected);
+}
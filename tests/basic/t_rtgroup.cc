@@ -0,0 +1,114 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "internal.h"
+#include "rtgroup.h"
+#include "bucketconfig/clconfig.h"
+
+class RuntimeGroupTest : public ::testing::Test
+{
+};
+
+static lcb_INSTANCE *create_instance(const char *connstr)
+{
+    lcb_INSTANCE *instance = nullptr;
+    lcb_CREATEOPTS *opts = nullptr;
+    lcb_createopts_create(&opts, LCB_TYPE_BUCKET);
+    lcb_createopts_connstr(opts, connstr, strlen(connstr));
+    EXPECT_EQ(LCB_SUCCESS, lcb_create(&instance, opts));
+    lcb_createopts_destroy(opts);
+    return instance;
+}
+
+TEST_F(RuntimeGroupTest, testJoin)
+{
+    lcb_RUNTIME_GROUP *group;
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_create(&group));
+
+    lcb_INSTANCE *first = create_instance("couchbase://localhost/default");
+    lcb_INSTANCE *second = create_instance("couchbase://localhost/default");
+    lcb_INSTANCE *other = create_instance("couchbase://localhost/other");
+
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, first));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_runtime_group_join(group, first));
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, second));
+    ASSERT_EQ(LCB_ERR_INVALID_ARGUMENT, lcb_runtime_group_join(group, other));
+
+    // Members share their collection cache and credentials
+    ASSERT_EQ(first->collcache, second->collcache);
+    ASSERT_EQ(LCBT_SETTING(first, auth), LCBT_SETTING(second, auth));
+    ASSERT_NE(0, LCBT_SETTING(second, vb_noremap));
+
+    // The group outlives the handle of its creator
+    lcb_runtime_group_destroy(group);
+    lcb_destroy(other);
+    lcb_destroy(first);
+    lcb_destroy(second);
+}
+
+TEST_F(RuntimeGroupTest, testPoller)
+{
+    lcb_RUNTIME_GROUP *group;
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_create(&group));
+
+    lcb_INSTANCE *first = create_instance("couchbase://localhost/default");
+    lcb_INSTANCE *second = create_instance("couchbase://localhost/default");
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, first));
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, second));
+    ASSERT_TRUE(lcb::rtgroup_is_poller(first));
+    ASSERT_FALSE(lcb::rtgroup_is_poller(second));
+
+    // Polling is handed over when the poller leaves
+    lcb_destroy(first);
+    ASSERT_TRUE(lcb::rtgroup_is_poller(second));
+    lcb_destroy(second);
+    lcb_runtime_group_destroy(group);
+}
+
+TEST_F(RuntimeGroupTest, testSharedConfig)
+{
+    lcb_RUNTIME_GROUP *group;
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_create(&group));
+
+    lcb_INSTANCE *first = create_instance("couchbase://localhost/default");
+    lcb_INSTANCE *second = create_instance("couchbase://localhost/default");
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, first));
+    ASSERT_EQ(LCB_SUCCESS, lcb_runtime_group_join(group, second));
+
+    // Nothing to bootstrap from yet
+    ASSERT_FALSE(lcb::rtgroup_bootstrap(second));
+
+    lcbvb_CONFIG *vbc = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(vbc, 4, 1, 64));
+    auto *config = lcb::clconfig::ConfigInfo::create(vbc, lcb::clconfig::CLCONFIG_CCCP, "localhost:11210");
+
+    // A configuration received by one member is published to the group
+    first->confmon->do_set_next(config, false);
+    config->decref();
+    ASSERT_TRUE(lcb::rtgroup_bootstrap(second));
+
+    // Its lazily-built strings were built before it was shared
+    ASSERT_NE(nullptr, vbc->servers[0].svc.hoststrs[LCBVB_SVCTYPE_DATA]);
+
+    lcb_destroy(first);
+    lcb_destroy(second);
+    lcb_runtime_group_destroy(group);
+}
@@ -0,0 +1,120 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+
+#include "internal.h"
+
+#include <thread>
+#include <vector>
+
+class SubmitqTest : public ::testing::Test
+{
+};
+
+static const unsigned nthreads = 4;
+static const unsigned nposts = 2000;
+
+struct SubmitState {
+    lcb_SUBMITQ *queue{nullptr};
+    unsigned nsubmitted{0};
+    bool ordered{true};
+    unsigned last_seen[nthreads]{};
+    std::size_t ncompleted{0};
+};
+
+struct Submission {
+    SubmitState *state;
+    unsigned thread;
+    unsigned seq;
+};
+
+static void on_complete(void *arg)
+{
+    auto *sub = static_cast<Submission *>(arg);
+    sub->state->ncompleted++;
+    delete sub;
+}
+
+static void on_submit(lcb_INSTANCE *instance, void *arg)
+{
+    auto *sub = static_cast<Submission *>(arg);
+    SubmitState *state = sub->state;
+    if (sub->seq != state->last_seen[sub->thread] + 1) {
+        state->ordered = false;
+    }
+    state->last_seen[sub->thread] = sub->seq;
+    lcb_submitq_complete(state->queue, on_complete, sub);
+    if (++state->nsubmitted == nthreads * nposts) {
+        lcb_stop_loop(instance);
+    }
+}
+
+TEST_F(SubmitqTest, testPostFromThreads)
+{
+    lcb_INSTANCE *instance;
+    SubmitState state;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_create(instance, &state.queue));
+
+    std::vector<std::thread> threads;
+    for (unsigned ii = 0; ii < nthreads; ii++) {
+        threads.emplace_back([&state, ii]() {
+            for (unsigned seq = 1; seq <= nposts; seq++) {
+                lcb_submitq_post(state.queue, on_submit, new Submission{&state, ii, seq});
+            }
+        });
+    }
+    lcb_run_loop(instance);
+    for (auto &thr : threads) {
+        thr.join();
+    }
+
+    ASSERT_EQ(nthreads * nposts, state.nsubmitted);
+    ASSERT_TRUE(state.ordered);
+    ASSERT_EQ(0, state.ncompleted);
+    ASSERT_EQ(nthreads * nposts, lcb_submitq_poll(state.queue));
+    ASSERT_EQ(nthreads * nposts, state.ncompleted);
+    ASSERT_EQ(0, lcb_submitq_poll(state.queue));
+
+    lcb_submitq_destroy(state.queue);
+    lcb_destroy(instance);
+}
+
+static void count_submit(lcb_INSTANCE *, void *arg)
+{
+    (*static_cast<unsigned *>(arg))++;
+}
+
+TEST_F(SubmitqTest, testDestroyRunsPending)
+{
+    lcb_INSTANCE *instance;
+    lcb_SUBMITQ *queue;
+    unsigned nsubmitted = 0;
+    ASSERT_EQ(LCB_SUCCESS, lcb_create(&instance, nullptr));
+    ASSERT_EQ(LCB_SUCCESS, lcb_submitq_create(instance, &queue));
+
+    for (unsigned ii = 0; ii < 10; ii++) {
+        lcb_submitq_post(queue, count_submit, &nsubmitted);
+    }
+    ASSERT_EQ(0, nsubmitted);
+    lcb_submitq_destroy(queue);
+    ASSERT_EQ(10, nsubmitted);
+    lcb_destroy(instance);
+}
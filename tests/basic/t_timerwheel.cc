@@ -0,0 +1,181 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "config.h"
+#include <gtest/gtest.h>
+#include <libcouchbase/couchbase.h>
+#include "lcbio/timerwheel.h"
+#include <vector>
+#include <random>
+
+#define MS(n) ((hrtime_t)(n)*1000000)
+
+struct TestEntry {
+    lcbio_TWENTRY entry;
+    unsigned fired = 0;
+    hrtime_t fired_at = 0;
+    hrtime_t *now = nullptr;
+    TestEntry *victim = nullptr;
+};
+
+static void on_expired(lcbio_TWENTRY *entry, void *arg)
+{
+    auto *te = reinterpret_cast<TestEntry *>(entry);
+    te->fired++;
+    te->fired_at = *te->now;
+    if (te->victim) {
+        lcbio_timerwheel_disarm(reinterpret_cast<lcbio_TIMERWHEEL *>(arg), &te->victim->entry);
+    }
+}
+
+class TimerWheel : public ::testing::Test
+{
+  protected:
+    void SetUp() override
+    {
+        wheel = lcbio_timerwheel_new(nullptr);
+        base = gethrtime();
+        now = base;
+    }
+
+    void TearDown() override
+    {
+        lcbio_timerwheel_destroy(wheel);
+    }
+
+    void init(TestEntry &te)
+    {
+        lcbio_twentry_init(&te.entry, on_expired, wheel);
+        te.now = &now;
+    }
+
+    lcbio_TIMERWHEEL *wheel{};
+    hrtime_t base{};
+    hrtime_t now{};
+};
+
+TEST_F(TimerWheel, testArmDisarm)
+{
+    TestEntry a, b;
+    init(a);
+    init(b);
+
+    ASSERT_EQ(0, lcbio_timerwheel_next(wheel));
+    lcbio_timerwheel_arm(wheel, &a.entry, base + MS(10));
+    lcbio_timerwheel_arm(wheel, &b.entry, base + MS(5));
+    ASSERT_TRUE(lcbio_twentry_armed(&a.entry));
+    ASSERT_EQ(2, lcbio_timerwheel_count(wheel));
+    ASSERT_NE(0, lcbio_timerwheel_next(wheel));
+    ASSERT_LE(lcbio_timerwheel_next(wheel), base + MS(6));
+
+    lcbio_timerwheel_disarm(wheel, &b.entry);
+    ASSERT_FALSE(lcbio_twentry_armed(&b.entry));
+    ASSERT_EQ(1, lcbio_timerwheel_count(wheel));
+    /* disarming twice is harmless */
+    lcbio_timerwheel_disarm(wheel, &b.entry);
+    ASSERT_GE(lcbio_timerwheel_next(wheel), base + MS(10));
+
+    now = base + MS(9);
+    ASSERT_EQ(0, lcbio_timerwheel_run(wheel, now));
+    now = base + MS(12);
+    ASSERT_EQ(1, lcbio_timerwheel_run(wheel, now));
+    ASSERT_EQ(1, a.fired);
+    ASSERT_EQ(0, b.fired);
+    ASSERT_FALSE(lcbio_twentry_armed(&a.entry));
+    ASSERT_EQ(0, lcbio_timerwheel_count(wheel));
+    ASSERT_EQ(0, lcbio_timerwheel_next(wheel));
+
+    /* Rearming moves the deadline */
+    lcbio_timerwheel_arm(wheel, &a.entry, now + MS(100));
+    lcbio_timerwheel_arm(wheel, &a.entry, now + MS(300));
+    ASSERT_EQ(1, lcbio_timerwheel_count(wheel));
+    ASSERT_EQ(0, lcbio_timerwheel_run(wheel, now + MS(200)));
+    ASSERT_EQ(1, lcbio_timerwheel_run(wheel, now + MS(302)));
+    ASSERT_EQ(2, a.fired);
+}
+
+TEST_F(TimerWheel, testPastDeadline)
+{
+    TestEntry a;
+    init(a);
+    now = base + MS(50);
+    lcbio_timerwheel_run(wheel, now);
+    lcbio_timerwheel_arm(wheel, &a.entry, base);
+    ASSERT_EQ(0, lcbio_timerwheel_run(wheel, now));
+    now += MS(1);
+    ASSERT_EQ(1, lcbio_timerwheel_run(wheel, now));
+}
+
+TEST_F(TimerWheel, testDisarmFromCallback)
+{
+    TestEntry a, b;
+    init(a);
+    init(b);
+    lcbio_timerwheel_arm(wheel, &a.entry, base + MS(3));
+    lcbio_timerwheel_arm(wheel, &b.entry, base + MS(3));
+    a.victim = &b;
+    now = base + MS(5);
+    ASSERT_EQ(1, lcbio_timerwheel_run(wheel, now));
+    ASSERT_EQ(1, a.fired);
+    ASSERT_EQ(0, b.fired);
+    ASSERT_EQ(0, lcbio_timerwheel_count(wheel));
+}
+
+/*
+ * Arm many entries with deadlines spread across all levels (and beyond the
+ * span of the wheel), then advance the clock in irregular steps. Entries must
+ * never fire before their deadline, nor more than one tick after the run
+ * which follows it.
+ */
+TEST_F(TimerWheel, testRandomDeadlines)
+{
+    const size_t nentries = 20000;
+    std::vector<TestEntry> entries(nentries);
+    std::mt19937_64 gen(42);
+    const hrtime_t spans[] = {MS(50), MS(5000), MS(600000), MS(4ULL * 3600 * 1000), MS(10ULL * 3600 * 1000)};
+
+    for (size_t ii = 0; ii < nentries; ii++) {
+        init(entries[ii]);
+        hrtime_t span = spans[ii % (sizeof(spans) / sizeof(spans[0]))];
+        lcbio_timerwheel_arm(wheel, &entries[ii].entry, base + gen() % span);
+    }
+    ASSERT_EQ(nentries, lcbio_timerwheel_count(wheel));
+
+    size_t nfired = 0;
+    hrtime_t end = base + MS(10ULL * 3600 * 1000) + MS(2);
+    const hrtime_t steps[] = {MS(1) / 3, MS(7), MS(130), MS(9000), MS(1200000)};
+    size_t iter = 0;
+    while (now < end) {
+        hrtime_t prev = now;
+        now += steps[iter++ % (sizeof(steps) / sizeof(steps[0]))] + gen() % MS(3);
+        nfired += lcbio_timerwheel_run(wheel, now);
+        for (auto &te : entries) {
+            if (te.fired) {
+                ASSERT_EQ(1, te.fired);
+                ASSERT_LE(te.entry.deadline, te.fired_at);
+            } else {
+                ASSERT_GT(te.entry.deadline + MS(1), now) << "prev run " << prev;
+            }
+        }
+        hrtime_t next = lcbio_timerwheel_next(wheel);
+        if (lcbio_timerwheel_count(wheel)) {
+            ASSERT_NE(0, next);
+        }
+    }
+    ASSERT_EQ(nentries, nfired);
+    ASSERT_EQ(0, lcbio_timerwheel_count(wheel));
+}
@@ -205,6 +205,32 @@ void MockEnvironment::setCompression(const std::string &mode, const std::string
     getResponse();
 }
 
+bool MockEnvironment::pushConfig(const std::string &bucket, const std::vector<int> *nodes, bool brief)
+{
+    MockCommand cmd(MockCommand::PUSH_CONFIG);
+    cmd.set("brief", brief);
+
+    if (!bucket.empty()) {
+        cmd.set("bucket", bucket);
+    }
+
+    if (nodes != nullptr) {
+        const std::vector<int> &v = *nodes;
+        Json::Value array(Json::arrayValue);
+
+        for (int ii : v) {
+            array.append(ii);
+        }
+
+        cmd.set("servers", array);
+    }
+
+    sendCommand(cmd);
+    MockResponse resp;
+    getResponse(resp);
+    return resp.isOk();
+}
+
 Json::Value MockEnvironment::getKeyInfo(std::string key, const std::string &bucket)
 {
     MockKeyCommand cmd(MockCommand::KEYINFO, key);
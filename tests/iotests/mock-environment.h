@@ -74,7 +74,8 @@ class MockCommand
     X(CHECK_RETRY_VERIFY)                                                                                              \
     X(SET_ENHANCED_ERRORS)                                                                                             \
     X(SET_COMPRESSION)                                                                                                 \
-    X(SET_SASL_MECHANISMS)
+    X(SET_SASL_MECHANISMS)                                                                                             \
+    X(PUSH_CONFIG)
 
   public:
     enum Code {
@@ -390,6 +391,18 @@ class MockEnvironment : public ::testing::Environment
     void setCompression(const std::string &mode, const std::string &bucket = "",
                         const std::vector<int> *nodes = nullptr);
 
+    /**
+     * Make the server push its current cluster map to the connections which
+     * enabled clustermap change notifications
+     *
+     * @param bucket the bucket whose cluster map is pushed
+     * @param nodes a list of by-index nodes which send the notification. If nullptr
+     * then all nodes send it
+     * @param brief send only the revision, without the cluster map itself
+     * @return false if the mock does not support pushing configurations
+     */
+    bool pushConfig(const std::string &bucket = "", const std::vector<int> *nodes = nullptr, bool brief = false);
+
     Json::Value getKeyInfo(std::string key, const std::string &bucket = "");
 
     int getKeyIndex(lcb_INSTANCE *instance, std::string &key, const std::string &bucket = "", int level = 0);
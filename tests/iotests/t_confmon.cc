@@ -225,3 +225,48 @@ TEST_F(ConfmonTest, testBootstrapMethods)
     ASSERT_TRUE(instance->confmon->is_refreshing());
     instance->confmon->stop();
 }
+
+static bool wait_for_revision(lcb_INSTANCE *instance, int64_t revid)
+{
+    for (int ii = 0; ii < 100; ii++) {
+        lcb_tick_nowait(instance);
+        if (instance->cur_configinfo->vbc->revid > revid) {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+TEST_F(ConfmonTest, testConfigPush)
+{
+    SKIP_UNLESS_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    MockEnvironment *mock = MockEnvironment::getInstance();
+
+    mock->createConnection(hw, &instance);
+    // Nothing but the notifications may bring a new configuration
+    lcb_U32 interval = 0;
+    lcb_cntl(instance, LCB_CNTL_SET, LCB_CNTL_CONFIG_POLL_INTERVAL, &interval);
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+    doDummyOp(instance);
+
+    if (!instance->get_server(0)->supports_config_push()) {
+        MockEnvironment::printSkipMessage(__FILE__, __LINE__, "mock does not push configuration changes");
+        return;
+    }
+
+    int64_t revid = instance->cur_configinfo->vbc->revid;
+    mock->failoverNode(1);
+    ASSERT_TRUE(mock->pushConfig());
+    ASSERT_TRUE(wait_for_revision(instance, revid));
+
+    // A notification without the cluster map makes the client fetch it
+    revid = instance->cur_configinfo->vbc->revid;
+    mock->respawnNode(1);
+    ASSERT_TRUE(mock->pushConfig("", nullptr, true));
+    ASSERT_TRUE(wait_for_revision(instance, revid));
+}
@@ -1003,3 +1003,37 @@ TEST_F(MockUnitTest, testExists)
     lcb_wait(instance, LCB_WAIT_DEFAULT);
     ASSERT_EQ(1, res);
 }
+
+TEST_F(MockUnitTest, testOpenBucketOnAllConnections)
+{
+    SKIP_IF_MOCK()
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+    lcb_CREATEOPTS *options = nullptr;
+    MockEnvironment::getInstance()->makeConnectParams(options, nullptr, LCB_TYPE_CLUSTER);
+    MockEnvironment::getInstance()->createConnection(hw, &instance, options);
+    lcb_createopts_destroy(options);
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl_string(instance, "kv_connections_per_node", "2"));
+    ASSERT_EQ(LCB_SUCCESS, lcb_connect(instance));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+    ASSERT_EQ(LCB_SUCCESS, lcb_get_bootstrap_status(instance));
+
+    std::string bucket = MockEnvironment::getInstance()->getBucket();
+    ASSERT_EQ(LCB_SUCCESS, lcb_open(instance, bucket.c_str(), bucket.size()));
+    lcb_wait(instance, LCB_WAIT_DEFAULT);
+
+    // Keys spread over the vBuckets, and so over both connections of each node
+    for (int ii = 0; ii < 32; ii++) {
+        storeKey(instance, "testOpenBucketOnAllConnections" + std::to_string(ii), "value");
+    }
+    for (unsigned ii = 0; ii < instance->cmdq.npipelines; ii++) {
+        auto *primary = static_cast<lcb::Server *>(instance->cmdq.pipelines[ii]);
+        ASSERT_EQ(2, primary->nconnections());
+        for (size_t jj = 0; jj < primary->nconnections(); jj++) {
+            lcb::Server *server = primary->connection(jj);
+            if (server->connctx) {
+                ASSERT_EQ(bucket, server->bucket);
+            }
+        }
+    }
+}
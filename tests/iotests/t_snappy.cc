@@ -77,6 +77,21 @@ static void getcb(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
     lcb_respget_value(resp, &value, &nvalue);
     cookie->value.assign(value, nvalue);
 }
+
+struct RetainCookie {
+    lcb_BACKBUF buf{nullptr};
+    const char *value{nullptr};
+    size_t nvalue{0};
+};
+
+static void retaincb(lcb_INSTANCE *, int, const lcb_RESPGET *resp)
+{
+    RetainCookie *cookie;
+    lcb_respget_cookie(resp, (void **)&cookie);
+    ASSERT_EQ(LCB_SUCCESS, lcb_respget_status(resp));
+    lcb_respget_value(resp, &cookie->value, &cookie->nvalue);
+    ASSERT_EQ(LCB_SUCCESS, lcb_respget_value_retain(resp, &cookie->buf));
+}
 }
 
 TEST_F(SnappyUnitTest, testSpec)
@@ -343,3 +358,60 @@ TEST_F(SnappyUnitTest, testSettings)
     ASSERT_STREQ(compressed.c_str(), cookie.value.c_str());
     lcb_cmdget_destroy(gcmd);
 }
+
+TEST_F(SnappyUnitTest, testRetainInflated)
+{
+    SKIP_UNLESS_MOCK();
+    HandleWrap hw;
+    lcb_INSTANCE *instance;
+
+    setCompression("passive");
+    createConnection(hw, &instance);
+    lcb_cntl_setu32(instance, LCB_CNTL_COMPRESSION_OPTS, LCB_COMPRESS_INOUT);
+    lcb_install_callback(instance, LCB_CALLBACK_STORE, (lcb_RESPCALLBACK)storecb);
+
+    std::string key("hello");
+    std::string value("A big black bug bit a big black bear, made the big black bear bleed blood");
+
+    SnappyCookie cookie;
+    lcb_CMDSTORE *scmd;
+    lcb_cmdstore_create(&scmd, LCB_STORE_UPSERT);
+    lcb_cmdstore_key(scmd, key.c_str(), key.size());
+    lcb_cmdstore_value(scmd, value.c_str(), value.size());
+    for (int ii = 0; ii < 2; ii++) {
+        /* the first store negotiates snappy */
+        cookie = SnappyCookie();
+        lcb_store(instance, &cookie, scmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_TRUE(cookie.called);
+        ASSERT_EQ(LCB_SUCCESS, cookie.rc);
+    }
+    lcb_cmdstore_destroy(scmd);
+    ASSERT_TRUE(isCompressed(key));
+
+    lcb_install_callback(instance, LCB_CALLBACK_GET, (lcb_RESPCALLBACK)retaincb);
+    lcb_CMDGET *gcmd;
+    lcb_cmdget_create(&gcmd);
+    lcb_cmdget_key(gcmd, key.c_str(), key.size());
+
+    RetainCookie retained[2];
+    for (auto &rc : retained) {
+        lcb_get(instance, &rc, gcmd);
+        lcb_wait(instance, LCB_WAIT_DEFAULT);
+        ASSERT_NE(nullptr, rc.buf);
+    }
+    lcb_cmdget_destroy(gcmd);
+
+    lcb_INFLATE_STATS stats{};
+    ASSERT_EQ(LCB_SUCCESS, lcb_cntl(instance, LCB_CNTL_GET, LCB_CNTL_INFLATE_STATS, &stats));
+    ASSERT_EQ(2, stats.requests);
+    ASSERT_EQ(2, stats.outstanding);
+    ASSERT_EQ(0, stats.reused);
+
+    /* the values remain valid after the callbacks, and even the instance */
+    hw.destroy();
+    for (auto &rc : retained) {
+        ASSERT_EQ(value, std::string(rc.value, rc.nvalue));
+        lcb_backbuf_unref(rc.buf);
+    }
+}
@@ -62,11 +62,9 @@ struct CQWrap : mc_CMDQUEUE {
     {
         for (unsigned ii = 0; ii < npipelines; ii++) {
             mc_PIPELINE *pipeline = pipelines[ii];
-            sllist_iterator iter;
-            SLLIST_ITERFOR(&pipeline->requests, &iter)
-            {
-                mc_PACKET *pkt = SLLIST_ITEM(iter.cur, mc_PACKET, slnode);
-                sllist_iter_remove(&pipeline->requests, &iter);
+            mc_PACKET *pkt;
+            while ((pkt = mcreq_first_packet(pipeline)) != nullptr) {
+                ASSERT_EQ(pkt, mcreq_pipeline_remove(pipeline, pkt->opaque));
                 mcreq_wipe_packet(pipeline, pkt);
                 mcreq_release_packet(pipeline, pkt);
             }
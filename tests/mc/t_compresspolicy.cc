@@ -0,0 +1,111 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/compresspolicy.h"
+
+using lcb::CompressionPolicy;
+
+class McCompressPolicy : public ::testing::Test
+{
+};
+
+static const float min_ratio = 0.83F;
+
+static unsigned count_skipped(CompressionPolicy &policy, std::uint32_t stream)
+{
+    unsigned nskipped = 0;
+    while (!policy.should_attempt(stream)) {
+        nskipped++;
+    }
+    return nskipped;
+}
+
+TEST_F(McCompressPolicy, testCompressibleStream)
+{
+    CompressionPolicy policy;
+    ASSERT_TRUE(policy.should_attempt(8));
+    for (unsigned ii = 0; ii < 100; ii++) {
+        ASSERT_TRUE(policy.should_attempt(8));
+        policy.record(8, 1000, 300, 1000, min_ratio);
+    }
+    ASSERT_FLOAT_EQ(0.3F, policy.ratio(8));
+    ASSERT_FALSE(policy.is_skipping(8));
+}
+
+TEST_F(McCompressPolicy, testBackoff)
+{
+    CompressionPolicy policy;
+
+    // Incompressible values, e.g. already compressed by the application
+    policy.record(8, 1000, 1010, 1000, min_ratio);
+    ASSERT_TRUE(policy.is_skipping(8));
+    ASSERT_EQ(CompressionPolicy::backoff_min, count_skipped(policy, 8));
+
+    // Each failed probe doubles the number of values skipped
+    policy.record(8, 1000, 1010, 1000, min_ratio);
+    ASSERT_EQ(CompressionPolicy::backoff_min * 2, count_skipped(policy, 8));
+    for (unsigned ii = 0; ii < 16; ii++) {
+        policy.record(8, 1000, 1010, 1000, min_ratio);
+        count_skipped(policy, 8);
+    }
+    policy.record(8, 1000, 1010, 1000, min_ratio);
+    ASSERT_EQ(CompressionPolicy::backoff_max, count_skipped(policy, 8));
+
+    // The contents changed: a successful probe resumes compression right away
+    policy.record(8, 1000, 300, 1000, min_ratio);
+    ASSERT_FALSE(policy.is_skipping(8));
+    ASSERT_FLOAT_EQ(0.3F, policy.ratio(8));
+    ASSERT_TRUE(policy.should_attempt(8));
+}
+
+TEST_F(McCompressPolicy, testSmoothing)
+{
+    CompressionPolicy policy;
+    policy.record(8, 1000, 300, 1000, min_ratio);
+
+    // An occasional incompressible value does not stop compression
+    policy.record(8, 1000, 1000, 1000, min_ratio);
+    ASSERT_FALSE(policy.is_skipping(8));
+
+    // But a run of them does
+    unsigned nrecorded = 1;
+    while (!policy.is_skipping(8)) {
+        policy.record(8, 1000, 1000, 1000, min_ratio);
+        nrecorded++;
+    }
+    ASSERT_GT(nrecorded, 1);
+    ASSERT_GT(policy.ratio(8), min_ratio);
+}
+
+TEST_F(McCompressPolicy, testCpuCost)
+{
+    CompressionPolicy policy;
+    // Good ratio, but too much CPU time for each byte saved
+    policy.record(8, 1000, 500, 500 * (CompressionPolicy::max_ns_per_byte_saved + 1), min_ratio);
+    ASSERT_TRUE(policy.is_skipping(8));
+}
+
+TEST_F(McCompressPolicy, testStreamsAreIndependent)
+{
+    CompressionPolicy policy;
+    policy.record(8, 1000, 1010, 1000, min_ratio);
+    policy.record(9, 1000, 300, 1000, min_ratio);
+    ASSERT_FALSE(policy.should_attempt(8));
+    ASSERT_TRUE(policy.should_attempt(9));
+    ASSERT_TRUE(policy.should_attempt(10));
+}
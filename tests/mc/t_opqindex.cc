@@ -0,0 +1,162 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <vector>
+#include <algorithm>
+
+class McOpaqueIndex : public ::testing::Test
+{
+};
+
+TEST_F(McOpaqueIndex, testInsertFindRemove)
+{
+    mc_OPQINDEX index;
+    mcreq_opqindex_init(&index);
+    const uint32_t nitems = 5000;
+    std::vector<mc_PACKET> pkts(nitems);
+
+    ASSERT_EQ(nullptr, mcreq_opqindex_find(&index, 42));
+    for (uint32_t ii = 0; ii < nitems; ii++) {
+        mcreq_opqindex_insert(&index, ii + 100, &pkts[ii]);
+    }
+    ASSERT_EQ(nitems, index.nused);
+    for (uint32_t ii = 0; ii < nitems; ii++) {
+        ASSERT_EQ(&pkts[ii], mcreq_opqindex_find(&index, ii + 100));
+    }
+    ASSERT_EQ(nullptr, mcreq_opqindex_find(&index, 99));
+    ASSERT_EQ(nullptr, mcreq_opqindex_find(&index, nitems + 100));
+
+    // Remove every other entry, and make sure the rest are still reachable
+    for (uint32_t ii = 0; ii < nitems; ii += 2) {
+        ASSERT_NE(0, mcreq_opqindex_remove(&index, ii + 100, &pkts[ii]));
+    }
+    for (uint32_t ii = 0; ii < nitems; ii++) {
+        if (ii % 2) {
+            ASSERT_EQ(&pkts[ii], mcreq_opqindex_find(&index, ii + 100));
+        } else {
+            ASSERT_EQ(nullptr, mcreq_opqindex_find(&index, ii + 100));
+            ASSERT_EQ(0, mcreq_opqindex_remove(&index, ii + 100, &pkts[ii]));
+        }
+    }
+    mcreq_opqindex_cleanup(&index);
+}
+
+TEST_F(McOpaqueIndex, testDuplicateOpaque)
+{
+    mc_OPQINDEX index;
+    mcreq_opqindex_init(&index);
+    mc_PACKET first, second;
+
+    mcreq_opqindex_insert(&index, 7, &first);
+    mcreq_opqindex_insert(&index, 7, &second);
+    ASSERT_EQ(&first, mcreq_opqindex_find(&index, 7));
+    ASSERT_EQ(0, mcreq_opqindex_remove(&index, 8, &first));
+    ASSERT_NE(0, mcreq_opqindex_remove(&index, 7, &first));
+    ASSERT_EQ(&second, mcreq_opqindex_find(&index, 7));
+    ASSERT_NE(0, mcreq_opqindex_remove(&index, 7, &second));
+    ASSERT_EQ(nullptr, mcreq_opqindex_find(&index, 7));
+    mcreq_opqindex_cleanup(&index);
+}
+
+static void enqueue_packets(CQWrap &cq, mc_PIPELINE *pl, unsigned count, std::vector<uint32_t> &opaques)
+{
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+    for (unsigned ii = 0; ii < count; ii++) {
+        mc_PACKET *pkt = mcreq_allocate_packet(pl);
+        ASSERT_NE(nullptr, pkt);
+        ASSERT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, 24));
+        hdr.request.opaque = pkt->opaque;
+        mcreq_write_hdr(pkt, &hdr);
+        mcreq_enqueue_packet(pl, pkt);
+        opaques.push_back(pkt->opaque);
+    }
+    (void)cq;
+}
+
+static void drain_pipeline(mc_PIPELINE *pl)
+{
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+}
+
+TEST_F(McOpaqueIndex, testPipelineOutOfOrder)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    std::vector<uint32_t> opaques;
+    enqueue_packets(cq, pl, 300, opaques);
+    drain_pipeline(pl);
+
+    // Match responses in a different order than the requests were written
+    std::vector<uint32_t> order(opaques.rbegin(), opaques.rend());
+    std::rotate(order.begin(), order.begin() + 100, order.end());
+    std::vector<mc_PACKET *> removed(opaques.size());
+    for (auto opaque : order) {
+        ASSERT_EQ(nullptr, mcreq_pipeline_find(pl, opaque + 100000));
+        mc_PACKET *pkt = mcreq_pipeline_find(pl, opaque);
+        ASSERT_NE(nullptr, pkt);
+        ASSERT_EQ(opaque, pkt->opaque);
+        ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, opaque));
+        ASSERT_EQ(nullptr, mcreq_pipeline_find(pl, opaque));
+        removed[opaque - opaques.front()] = pkt;
+    }
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+    ASSERT_EQ(0, pl->opqindex.nused);
+
+    // Release the packet memory in allocation order
+    for (auto pkt : removed) {
+        mcreq_packet_handled(pl, pkt);
+    }
+}
+
+/*
+ * Matching responses must keep working with many commands in flight: lookups
+ * of every pending opaque (as done for multi-response commands), lookups of
+ * opaques which are not pending (replies for timed out commands), and removal
+ * of every packet in the order responses would normally arrive.
+ */
+TEST_F(McOpaqueIndex, testDispatchByDepth)
+{
+    const unsigned depths[] = {1000, 10000, 50000};
+    for (unsigned depth : depths) {
+        CQWrap cq;
+        mc_PIPELINE *pl = cq.pipelines[0];
+        std::vector<uint32_t> opaques;
+        enqueue_packets(cq, pl, depth, opaques);
+        drain_pipeline(pl);
+
+        for (auto opaque : opaques) {
+            ASSERT_NE(nullptr, mcreq_pipeline_find(pl, opaque));
+        }
+        for (auto opaque : opaques) {
+            ASSERT_EQ(nullptr, mcreq_pipeline_find(pl, opaque + depth * 2));
+        }
+        for (auto opaque : opaques) {
+            mc_PACKET *pkt = mcreq_pipeline_remove(pl, opaque);
+            ASSERT_NE(nullptr, pkt);
+            mcreq_packet_handled(pl, pkt);
+        }
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+    }
+}
@@ -0,0 +1,185 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <string>
+#include <vector>
+
+class McPriority : public ::testing::Test
+{
+};
+
+typedef std::vector<std::string> PriorityKeys;
+
+/* Enqueue a command without a value for a two-character key */
+static mc_PACKET *enqueue_keyed(mc_PIPELINE *pl, const char *key, uint8_t opcode, bool bulk)
+{
+    protocol_binary_request_header hdr{};
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, 24 + 2));
+    pkt->extlen = 0;
+    if (bulk) {
+        pkt->flags |= MCREQ_F_BULK;
+    }
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.keylen = htons(2);
+    hdr.request.bodylen = htonl(2);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, key, 2);
+    mcreq_enqueue_packet(pl, pkt);
+    return pkt;
+}
+
+/* Enqueue a GET for a two-character key, bulk if the key starts with 'b' */
+static mc_PACKET *enqueue_prioritized(mc_PIPELINE *pl, const char *key)
+{
+    return enqueue_keyed(pl, key, PROTOCOL_BINARY_CMD_GET, key[0] == 'b');
+}
+
+/* Flush everything which may be written, returning the keys (and, if
+ * requested, the opcodes) in the order they were sent */
+static PriorityKeys flush_prioritized(mc_PIPELINE *pl, std::vector<uint8_t> *opcodes = nullptr)
+{
+    PriorityKeys keys;
+    std::string sent;
+    nb_IOV iov[16];
+    int niov = 0;
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, &niov))) {
+        for (int ii = 0; ii < niov; ii++) {
+            sent.append(static_cast<const char *>(iov[ii].iov_base), iov[ii].iov_len);
+        }
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+    for (size_t off = 0; off + 26 <= sent.size(); off += 26) {
+        keys.push_back(sent.substr(off + 24, 2));
+        if (opcodes) {
+            opcodes->push_back(static_cast<uint8_t>(sent[off + 1]));
+        }
+    }
+    return keys;
+}
+
+static void respond_prioritized(mc_PIPELINE *pl, const std::vector<mc_PACKET *> &pkts)
+{
+    for (auto *pkt : pkts) {
+        ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+        mcreq_packet_handled(pl, pkt);
+    }
+}
+
+static void fail_prioritized(mc_PIPELINE *, mc_PACKET *, lcb_STATUS, void *) {}
+
+TEST_F(McPriority, testWeight)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_priority_weight(pl, 2);
+
+    std::vector<mc_PACKET *> pkts;
+    pkts.push_back(enqueue_prioritized(pl, "i0"));
+    // Bulk packets wait while interactive ones are not yet flushed
+    pkts.push_back(enqueue_prioritized(pl, "b0"));
+    pkts.push_back(enqueue_prioritized(pl, "b1"));
+    ASSERT_EQ(2, pl->nbulk);
+    ASSERT_NE(0, pkts[1]->flags & MCREQ_F_BULK_WAITING);
+
+    // One is let through after two interactive packets, and only one at a time
+    pkts.push_back(enqueue_prioritized(pl, "i1"));
+    ASSERT_EQ(1, pl->nbulk);
+    ASSERT_EQ(0, pkts[1]->flags & MCREQ_F_BULK_WAITING);
+    pkts.push_back(enqueue_prioritized(pl, "i2"));
+    pkts.push_back(enqueue_prioritized(pl, "i3"));
+    ASSERT_EQ(1, pl->nbulk);
+
+    // The next one is written once the previous one was flushed
+    ASSERT_EQ(PriorityKeys({"i0", "i1", "b0", "i2", "i3", "b1"}), flush_prioritized(pl));
+    ASSERT_EQ(0, pl->nbulk);
+    ASSERT_EQ(0, pl->nbytes_queued);
+
+    // With nothing else to write, a bulk packet goes straight away
+    pkts.push_back(enqueue_prioritized(pl, "b2"));
+    ASSERT_EQ(0, pl->nbulk);
+    ASSERT_EQ(PriorityKeys({"b2"}), flush_prioritized(pl));
+    respond_prioritized(pl, pkts);
+}
+
+TEST_F(McPriority, testRelease)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_priority_weight(pl, 4);
+
+    // Disabling priorities writes the waiting packets in order
+    std::vector<mc_PACKET *> pkts;
+    pkts.push_back(enqueue_prioritized(pl, "i0"));
+    pkts.push_back(enqueue_prioritized(pl, "b0"));
+    pkts.push_back(enqueue_prioritized(pl, "b1"));
+    pkts.push_back(enqueue_prioritized(pl, "i1"));
+    ASSERT_EQ(2, pl->nbulk);
+    mcreq_pipeline_set_priority_weight(pl, 0);
+    ASSERT_EQ(0, pl->nbulk);
+    ASSERT_EQ(PriorityKeys({"i0", "i1", "b0", "b1"}), flush_prioritized(pl));
+    respond_prioritized(pl, pkts);
+
+    // Failing the pipeline drops its waiting packets
+    mcreq_pipeline_set_priority_weight(pl, 4);
+    enqueue_prioritized(pl, "i2");
+    enqueue_prioritized(pl, "b2");
+    enqueue_prioritized(pl, "b3");
+    ASSERT_EQ(2, pl->nbulk);
+    ASSERT_EQ(3, mcreq_pipeline_fail(pl, LCB_ERR_GENERIC, fail_prioritized, nullptr));
+    ASSERT_EQ(0, pl->nbulk);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->bulk));
+    ASSERT_EQ(PriorityKeys({"i2"}), flush_prioritized(pl));
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+}
+
+TEST_F(McPriority, testKeyOrder)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_priority_weight(pl, 4);
+
+    std::vector<mc_PACKET *> pkts;
+    pkts.push_back(enqueue_prioritized(pl, "i0"));
+    pkts.push_back(enqueue_keyed(pl, "kk", PROTOCOL_BINARY_CMD_SET, true));
+    ASSERT_NE(0, pkts[1]->flags & MCREQ_F_BULK_WAITING);
+
+    // An interactive read of the same key waits behind the bulk mutation,
+    // while other interactive packets are still written first
+    pkts.push_back(enqueue_keyed(pl, "kk", PROTOCOL_BINARY_CMD_GET, false));
+    ASSERT_NE(0, pkts[2]->flags & MCREQ_F_BULK_WAITING);
+    pkts.push_back(enqueue_prioritized(pl, "i1"));
+    ASSERT_EQ(0, pkts[3]->flags & MCREQ_F_BULK_WAITING);
+    ASSERT_EQ(2, pl->nbulk);
+
+    std::vector<uint8_t> opcodes;
+    ASSERT_EQ(PriorityKeys({"i0", "i1", "kk", "kk"}), flush_prioritized(pl, &opcodes));
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_SET, opcodes[2]);
+    ASSERT_EQ(PROTOCOL_BINARY_CMD_GET, opcodes[3]);
+    ASSERT_EQ(0, pl->nbulk);
+
+    // Once written, the key no longer holds back interactive packets
+    pkts.push_back(enqueue_keyed(pl, "kk", PROTOCOL_BINARY_CMD_SET, false));
+    ASSERT_EQ(0, pkts[4]->flags & MCREQ_F_BULK_WAITING);
+    ASSERT_EQ(PriorityKeys({"kk"}), flush_prioritized(pl));
+    respond_prioritized(pl, pkts);
+}
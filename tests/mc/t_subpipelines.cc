@@ -0,0 +1,226 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <map>
+#include <vector>
+
+#define NLANES 3
+
+static std::map<mc_PIPELINE *, unsigned> nflush_start;
+
+static void count_flush_start(mc_PIPELINE *pl)
+{
+    nflush_start[pl]++;
+}
+
+/* Gives the first pipeline of the queue additional connections */
+class McSubpipelines : public ::testing::Test
+{
+  protected:
+    void attach(CQWrap &cq)
+    {
+        lanes[0] = cq.pipelines[0];
+        for (unsigned ii = 1; ii < NLANES; ii++) {
+            lanes[ii] = new lcb::Server();
+            mcreq_pipeline_init(lanes[ii]);
+            lanes[ii]->parent = &cq;
+            lanes[ii]->index = 0;
+        }
+        for (auto pl : lanes) {
+            pl->flush_start = count_flush_start;
+        }
+        cq.pipelines[0]->subpipelines = lanes;
+        cq.pipelines[0]->nsubpipelines = NLANES;
+        nflush_start.clear();
+    }
+
+    void detach(CQWrap &cq)
+    {
+        cq.pipelines[0]->subpipelines = nullptr;
+        cq.pipelines[0]->nsubpipelines = 0;
+        for (unsigned ii = 1; ii < NLANES; ii++) {
+            EXPECT_NE(0, netbuf_is_clean(&lanes[ii]->nbmgr));
+            EXPECT_NE(0, netbuf_is_clean(&lanes[ii]->reqpool));
+            mcreq_pipeline_cleanup(lanes[ii]);
+            delete static_cast<lcb::Server *>(lanes[ii]);
+        }
+    }
+
+    mc_PIPELINE *lanes[NLANES]{};
+};
+
+static mc_PACKET *enqueue_cmd(mc_PIPELINE *pl, uint8_t opcode, const char *key)
+{
+    protocol_binary_request_header hdr{};
+    size_t nkey = strlen(key);
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, (uint8_t)(24 + nkey)));
+    pkt->extlen = 0;
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.keylen = htons((uint16_t)nkey);
+    hdr.request.bodylen = htonl((uint32_t)nkey);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, key, nkey);
+    mcreq_enqueue_packet(pl, pkt);
+    return pkt;
+}
+
+static void drain_pipeline(mc_PIPELINE *pl)
+{
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+}
+
+static void complete(mc_PIPELINE *pl, mc_PACKET *pkt)
+{
+    ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+    drain_pipeline(pl);
+    mcreq_packet_handled(pl, pkt);
+}
+
+TEST_F(McSubpipelines, testSingleConnection)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[1];
+    ASSERT_EQ(pl, mcreq_pipeline_stripe(pl, 7, PROTOCOL_BINARY_CMD_SET));
+    ASSERT_EQ(pl, mcreq_pipeline_stripe(pl, 7, PROTOCOL_BINARY_CMD_GET));
+}
+
+TEST_F(McSubpipelines, testStripeByVbucket)
+{
+    CQWrap cq;
+    attach(cq);
+    mc_PIPELINE *pl = cq.pipelines[0];
+
+    for (int vb = 0; vb < 64; vb++) {
+        ASSERT_EQ(lanes[vb % NLANES], mcreq_pipeline_stripe(pl, vb, PROTOCOL_BINARY_CMD_SET));
+        ASSERT_EQ(lanes[vb % NLANES], mcreq_pipeline_stripe(pl, vb, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_MUTATION));
+        ASSERT_EQ(lanes[vb % NLANES], mcreq_pipeline_stripe(pl, vb, PROTOCOL_BINARY_CMD_NOOP));
+        // Ties are broken in favour of the vBucket's own connection
+        ASSERT_EQ(lanes[vb % NLANES], mcreq_pipeline_stripe(pl, vb, PROTOCOL_BINARY_CMD_GET));
+    }
+    detach(cq);
+}
+
+TEST_F(McSubpipelines, testReadsUseLeastQueued)
+{
+    CQWrap cq;
+    attach(cq);
+    mc_PIPELINE *pl = cq.pipelines[0];
+
+    mc_PACKET *get0 = enqueue_cmd(lanes[0], PROTOCOL_BINARY_CMD_GET, "a_rather_long_key");
+    mc_PACKET *get1 = enqueue_cmd(lanes[1], PROTOCOL_BINARY_CMD_GET, "key");
+    ASSERT_EQ(mcreq_get_size(get0), lanes[0]->nbytes_queued);
+    ASSERT_EQ(0, lanes[0]->nmutations);
+
+    ASSERT_EQ(lanes[2], mcreq_pipeline_stripe(pl, 0, PROTOCOL_BINARY_CMD_GET));
+    ASSERT_EQ(lanes[2], mcreq_pipeline_stripe(pl, 1, PROTOCOL_BINARY_CMD_GET_META));
+    // Mutations still go to the vBucket's connection
+    ASSERT_EQ(lanes[0], mcreq_pipeline_stripe(pl, 0, PROTOCOL_BINARY_CMD_DELETE));
+
+    // Bytes no longer count once they are flushed
+    drain_pipeline(lanes[0]);
+    ASSERT_EQ(0, lanes[0]->nbytes_queued);
+    ASSERT_EQ(lanes[0], mcreq_pipeline_stripe(pl, 0, PROTOCOL_BINARY_CMD_GET));
+    ASSERT_EQ(lanes[0], mcreq_pipeline_stripe(pl, 1, PROTOCOL_BINARY_CMD_GET));
+
+    complete(lanes[0], get0);
+    complete(lanes[1], get1);
+    ASSERT_EQ(0, lanes[1]->nbytes_queued);
+    detach(cq);
+}
+
+TEST_F(McSubpipelines, testReadsFollowMutations)
+{
+    CQWrap cq;
+    attach(cq);
+    mc_PIPELINE *pl = cq.pipelines[0];
+
+    mc_PACKET *set = enqueue_cmd(lanes[1], PROTOCOL_BINARY_CMD_SET, "key");
+    drain_pipeline(lanes[1]);
+    mc_PACKET *get = enqueue_cmd(lanes[1], PROTOCOL_BINARY_CMD_GET, "other");
+    ASSERT_EQ(1, lanes[1]->nmutations);
+    ASSERT_NE(0, lanes[1]->nbytes_queued);
+
+    // While the mutation is in flight, reads for the vBucket must not be
+    // written on a connection where they could overtake it
+    ASSERT_EQ(lanes[1], mcreq_pipeline_stripe(pl, 1, PROTOCOL_BINARY_CMD_GET));
+    ASSERT_EQ(lanes[1], mcreq_pipeline_stripe(pl, 4, PROTOCOL_BINARY_CMD_SUBDOC_GET));
+
+    // The mutation was flushed already, so the read is still queued
+    ASSERT_EQ(set, mcreq_pipeline_remove(lanes[1], set->opaque));
+    mcreq_packet_handled(lanes[1], set);
+    ASSERT_EQ(0, lanes[1]->nmutations);
+    ASSERT_EQ(lanes[0], mcreq_pipeline_stripe(pl, 1, PROTOCOL_BINARY_CMD_GET));
+    complete(lanes[1], get);
+    detach(cq);
+}
+
+TEST_F(McSubpipelines, testScheduleOnConnections)
+{
+    CQWrap cq;
+    attach(cq);
+    std::vector<std::pair<mc_PIPELINE *, mc_PACKET *>> scheduled;
+    unsigned nmapped = 0;
+
+    mcreq_sched_enter(&cq);
+    for (unsigned ii = 0; nmapped < 30 && ii < 10000; ii++) {
+        char key[32];
+        int vb, srvix;
+        sprintf(key, "key_%u", ii);
+        lcb_KEYBUF kb = {LCB_KV_COPY, {key, strlen(key)}};
+        mcreq_map_key(&cq, &kb, 24, &vb, &srvix);
+        if (srvix != 0) {
+            continue;
+        }
+        nmapped++;
+
+        PacketWrap pw;
+        pw.setCopyKey(key);
+        pw.hdr.request.opcode = PROTOCOL_BINARY_CMD_SET;
+        ASSERT_TRUE(pw.reservePacket(&cq));
+        ASSERT_EQ(lanes[vb % NLANES], pw.pipeline);
+        pw.hdr.request.opaque = pw.pkt->opaque;
+        pw.setHeaderSize();
+        pw.copyHeader();
+        mcreq_sched_add(pw.pipeline, pw.pkt);
+        scheduled.emplace_back(pw.pipeline, pw.pkt);
+    }
+    ASSERT_EQ(30, nmapped);
+    mcreq_sched_leave(&cq, 1);
+
+    for (auto pl : lanes) {
+        bool used = false;
+        for (auto &ent : scheduled) {
+            used = used || ent.first == pl;
+        }
+        ASSERT_EQ(used ? 1 : 0, nflush_start[pl]);
+    }
+    for (auto &ent : scheduled) {
+        ASSERT_EQ(ent.second, mcreq_pipeline_find(ent.first, ent.second->opaque));
+        complete(ent.first, ent.second);
+    }
+    detach(cq);
+}
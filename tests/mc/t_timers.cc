@@ -0,0 +1,98 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <vector>
+
+#define MS(n) LCB_US2NS(LCB_MS2US((hrtime_t)(n)))
+
+class McTimers : public ::testing::Test
+{
+};
+
+static std::vector<mc_PACKET *> expired;
+
+static void record_timeout(mc_PIPELINE *pl, mc_PACKET *pkt)
+{
+    EXPECT_EQ(nullptr, mcreq_pipeline_find(pl, pkt->opaque));
+    expired.push_back(pkt);
+}
+
+TEST_F(McTimers, testPacketDeadlines)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    lcbio_TIMERWHEEL *wheel = lcbio_timerwheel_new(nullptr);
+    hrtime_t base = gethrtime();
+    std::vector<mc_PACKET *> pkts;
+    expired.clear();
+
+    mcreq_pipeline_set_timers(pl, wheel, record_timeout);
+
+    protocol_binary_request_header hdr{};
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_NOOP;
+    for (unsigned ii = 0; ii < 100; ii++) {
+        mc_PACKET *pkt = mcreq_allocate_packet(pl);
+        ASSERT_NE(nullptr, pkt);
+        ASSERT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, 24));
+        hdr.request.opaque = pkt->opaque;
+        mcreq_write_hdr(pkt, &hdr);
+        MCREQ_PKT_RDATA(pkt)->start = base;
+        MCREQ_PKT_RDATA(pkt)->deadline = base + MS(10 + (ii % 10) * 10);
+        mcreq_enqueue_packet(pl, pkt);
+        pkts.push_back(pkt);
+    }
+    ASSERT_EQ(100, lcbio_timerwheel_count(wheel));
+
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+
+    // A response for one of the earliest packets arrives in time
+    ASSERT_EQ(pkts[0], mcreq_pipeline_remove(pl, pkts[0]->opaque));
+    ASSERT_EQ(99, lcbio_timerwheel_count(wheel));
+
+    lcbio_timerwheel_run(wheel, base + MS(5));
+    ASSERT_TRUE(expired.empty());
+
+    // Packets 10, 20, ..., 90 and 1, 11, ..., 91
+    lcbio_timerwheel_run(wheel, base + MS(25));
+    ASSERT_EQ(19, expired.size());
+    for (auto pkt : expired) {
+        ASSERT_LE(MCREQ_PKT_RDATA(pkt)->deadline, base + MS(25));
+    }
+
+    // Moving the start time pushes the remaining deadlines back
+    mcreq_reset_timeouts(pl, base + MS(1000));
+    lcbio_timerwheel_run(wheel, base + MS(500));
+    ASSERT_EQ(19, expired.size());
+    lcbio_timerwheel_run(wheel, base + MS(1200));
+    ASSERT_EQ(99, expired.size());
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+    ASSERT_EQ(0, lcbio_timerwheel_count(wheel));
+
+    // Release the packet memory in allocation order
+    for (auto pkt : pkts) {
+        mcreq_packet_handled(pl, pkt);
+    }
+    mcreq_pipeline_set_timers(pl, nullptr, nullptr);
+    lcbio_timerwheel_destroy(wheel);
+}
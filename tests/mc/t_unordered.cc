@@ -0,0 +1,240 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <vector>
+#include <algorithm>
+#include <random>
+
+class McUnordered : public ::testing::Test
+{
+};
+
+static unsigned nflush_start = 0;
+
+static void count_flush_start(mc_PIPELINE *)
+{
+    nflush_start++;
+}
+
+static mc_PACKET *enqueue_cmd(mc_PIPELINE *pl, uint8_t opcode, const char *key)
+{
+    protocol_binary_request_header hdr{};
+    size_t nkey = strlen(key);
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, (uint8_t)(24 + nkey)));
+    pkt->extlen = 0;
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = opcode;
+    hdr.request.keylen = htons((uint16_t)nkey);
+    hdr.request.bodylen = htonl((uint32_t)nkey);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, key, nkey);
+    mcreq_enqueue_packet(pl, pkt);
+    return pkt;
+}
+
+static void drain_pipeline(mc_PIPELINE *pl)
+{
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+}
+
+static bool is_written(const mc_PACKET *pkt)
+{
+    return (pkt->flags & MCREQ_F_FLUSHED) != 0;
+}
+
+static void complete(mc_PIPELINE *pl, mc_PACKET *pkt)
+{
+    ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+    drain_pipeline(pl);
+    mcreq_packet_handled(pl, pkt);
+    mcreq_pipeline_flush_woken(pl);
+}
+
+TEST_F(McUnordered, testConflictingCommandsHeld)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    pl->flush_start = count_flush_start;
+    nflush_start = 0;
+    mcreq_pipeline_set_unordered(pl, 1);
+
+    mc_PACKET *set1 = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_SET, "k1");
+    mc_PACKET *get2 = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_GET, "k2");
+    mc_PACKET *set1b = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_SET, "k1");
+    mc_PACKET *get1 = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_GET, "k1");
+    mc_PACKET *get2b = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_GET, "k2");
+    mc_PACKET *noop = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_NOOP, "");
+    drain_pipeline(pl);
+
+    // Reads of the same key and commands without a key are not held
+    ASSERT_TRUE(is_written(set1));
+    ASSERT_TRUE(is_written(get2));
+    ASSERT_TRUE(is_written(get2b));
+    ASSERT_TRUE(is_written(noop));
+    // The second mutation waits for the first, and the read after it waits
+    // for the second
+    ASSERT_FALSE(is_written(set1b));
+    ASSERT_NE(0, set1b->flags & MCREQ_F_HELD);
+    ASSERT_FALSE(is_written(get1));
+    ASSERT_EQ(set1b, mcreq_pipeline_find(pl, set1b->opaque));
+
+    // Responses arrive in any order
+    complete(pl, get2b);
+    complete(pl, noop);
+    ASSERT_FALSE(is_written(set1b));
+    ASSERT_EQ(0, nflush_start);
+
+    // The released packet is only flushed once the response was handled
+    ASSERT_EQ(set1, mcreq_pipeline_remove(pl, set1->opaque));
+    ASSERT_EQ(0, nflush_start);
+    drain_pipeline(pl);
+    mcreq_packet_handled(pl, set1);
+    mcreq_pipeline_flush_woken(pl);
+    ASSERT_TRUE(is_written(set1b));
+    ASSERT_FALSE(is_written(get1));
+    ASSERT_EQ(1, nflush_start);
+
+    complete(pl, set1b);
+    ASSERT_TRUE(is_written(get1));
+    ASSERT_EQ(2, nflush_start);
+
+    complete(pl, get1);
+    complete(pl, get2);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->held));
+    mcreq_pipeline_set_unordered(pl, 0);
+}
+
+TEST_F(McUnordered, testMutationWaitsForReads)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_unordered(pl, 1);
+
+    mc_PACKET *get1 = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_GET, "key");
+    mc_PACKET *get2 = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_SUBDOC_MULTI_LOOKUP, "key");
+    mc_PACKET *del = enqueue_cmd(pl, PROTOCOL_BINARY_CMD_DELETE, "key");
+    drain_pipeline(pl);
+    ASSERT_FALSE(is_written(del));
+
+    complete(pl, get2);
+    ASSERT_FALSE(is_written(del));
+    complete(pl, get1);
+    ASSERT_TRUE(is_written(del));
+    complete(pl, del);
+    mcreq_pipeline_set_unordered(pl, 0);
+}
+
+TEST_F(McUnordered, testFailAndDisable)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_unordered(pl, 1);
+
+    std::vector<mc_PACKET *> pkts;
+    for (unsigned ii = 0; ii < 4; ii++) {
+        pkts.push_back(enqueue_cmd(pl, PROTOCOL_BINARY_CMD_APPEND, "key"));
+    }
+    drain_pipeline(pl);
+    ASSERT_TRUE(is_written(pkts[0]));
+    ASSERT_FALSE(is_written(pkts[1]));
+
+    // A held packet which is removed (e.g. timed out) does not block the
+    // others
+    complete(pl, pkts[1]);
+    complete(pl, pkts[0]);
+    ASSERT_TRUE(is_written(pkts[2]));
+    ASSERT_FALSE(is_written(pkts[3]));
+
+    // Without reordering, held packets are written straight away
+    mcreq_pipeline_set_unordered(pl, 0);
+    drain_pipeline(pl);
+    ASSERT_TRUE(is_written(pkts[3]));
+    ASSERT_EQ(nullptr, pl->keyslots);
+    complete(pl, pkts[3]);
+    complete(pl, pkts[2]);
+}
+
+TEST_F(McUnordered, testDisableWithinWindow)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_unordered(pl, 1);
+    mcreq_pipeline_set_window(pl, 2);
+
+    std::vector<mc_PACKET *> pkts;
+    for (unsigned ii = 0; ii < 3; ii++) {
+        pkts.push_back(enqueue_cmd(pl, PROTOCOL_BINARY_CMD_SET, "key"));
+    }
+    drain_pipeline(pl);
+    ASSERT_TRUE(is_written(pkts[0]));
+    ASSERT_NE(0, pkts[1]->flags & MCREQ_F_HELD);
+    ASSERT_NE(0, pkts[2]->flags & MCREQ_F_HELD);
+
+    // Released packets which do not fit in the window are throttled
+    mcreq_pipeline_set_unordered(pl, 0);
+    drain_pipeline(pl);
+    ASSERT_FALSE(is_written(pkts[1]));
+    ASSERT_FALSE(is_written(pkts[2]));
+    ASSERT_EQ(2, pl->nthrottled);
+
+    complete(pl, pkts[0]);
+    ASSERT_TRUE(is_written(pkts[1]));
+    ASSERT_TRUE(is_written(pkts[2]));
+    complete(pl, pkts[1]);
+    complete(pl, pkts[2]);
+    mcreq_pipeline_set_window(pl, 0);
+}
+
+/*
+ * Responses arriving in an arbitrary order must be matched, and the memory of
+ * their packets reclaimed, regardless of the order they were written in.
+ */
+TEST_F(McUnordered, testShuffledCompletion)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_unordered(pl, 1);
+
+    for (unsigned round = 0; round < 20; round++) {
+        std::vector<mc_PACKET *> pkts;
+        for (unsigned ii = 0; ii < 500; ii++) {
+            char key[32];
+            sprintf(key, "key_%u", ii);
+            pkts.push_back(enqueue_cmd(pl, PROTOCOL_BINARY_CMD_GET, key));
+        }
+        drain_pipeline(pl);
+        std::shuffle(pkts.begin(), pkts.end(), std::default_random_engine(round));
+        for (auto pkt : pkts) {
+            ASSERT_TRUE(is_written(pkt));
+            complete(pl, pkt);
+        }
+        ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+        ASSERT_NE(0, netbuf_is_clean(&pl->nbmgr));
+        ASSERT_NE(0, netbuf_is_clean(&pl->reqpool));
+    }
+    mcreq_pipeline_set_unordered(pl, 0);
+}
@@ -0,0 +1,171 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <utility>
+#include <vector>
+
+class McWatermarks : public ::testing::Test
+{
+};
+
+/* (pipeline index or -1 for the queue, congested) */
+typedef std::vector<std::pair<int, int>> CongestionEvents;
+static CongestionEvents congestion_events;
+
+static void record_congestion(mc_CMDQUEUE *, mc_PIPELINE *pl, int congested)
+{
+    congestion_events.emplace_back(pl ? pl->index : -1, congested);
+}
+
+static mc_PACKET *make_watermarked_get(mc_PIPELINE *pl)
+{
+    protocol_binary_request_header hdr{};
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, 24 + 3));
+    pkt->extlen = 0;
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+    hdr.request.keylen = htons(3);
+    hdr.request.bodylen = htonl(3);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, "key", 3);
+    return pkt;
+}
+
+static void respond_watermarked(mc_PIPELINE *pl, mc_PACKET *pkt)
+{
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+    ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+    mcreq_packet_handled(pl, pkt);
+}
+
+/* Reserve a packet for the first key which maps to @p srvix */
+static lcb_STATUS reserve_for_server(CQWrap &cq, PacketWrap &pw, int srvix)
+{
+    char key[16];
+    for (int ii = 0;; ii++) {
+        int vb, ix;
+        snprintf(key, sizeof key, "k%d", ii);
+        lcb_KEYBUF kb = {LCB_KV_COPY, {key, strlen(key)}};
+        mcreq_map_key(&cq, &kb, 24, &vb, &ix);
+        if (ix == srvix) {
+            break;
+        }
+    }
+    pw.setCopyKey(key);
+    pw.setHeaderSize();
+    return mcreq_basic_packet(&cq, &pw.keybuf, pw.cmd.collection().collection_id(), &pw.hdr, 0, 0, &pw.pkt,
+                              &pw.pipeline, 0);
+}
+
+TEST_F(McWatermarks, testPipeline)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    cq.congestion_callback = record_congestion;
+    congestion_events.clear();
+    cq.pipeline_watermarks.high_packets = 3;
+    cq.pipeline_watermarks.low_packets = 1;
+
+    std::vector<mc_PACKET *> pkts;
+    for (unsigned ii = 0; ii < 3; ii++) {
+        pkts.push_back(make_watermarked_get(pl));
+        mcreq_enqueue_packet(pl, pkts.back());
+    }
+    ASSERT_EQ(3, pl->npackets_pending);
+    ASSERT_EQ(3 * 27, pl->nbytes_pending);
+    ASSERT_EQ(CongestionEvents({{0, 1}}), congestion_events);
+
+    // New commands for the server are pushed back, others are accepted
+    PacketWrap congested;
+    ASSERT_EQ(LCB_ERR_QUEUE_CONGESTED, reserve_for_server(cq, congested, 0));
+    PacketWrap other;
+    ASSERT_EQ(LCB_SUCCESS, reserve_for_server(cq, other, 1));
+    mcreq_wipe_packet(other.pipeline, other.pkt);
+    mcreq_release_packet(other.pipeline, other.pkt);
+
+    // The pipeline drains once back to the low watermark
+    respond_watermarked(pl, pkts[0]);
+    ASSERT_TRUE(pl->congested);
+    respond_watermarked(pl, pkts[1]);
+    ASSERT_FALSE(pl->congested);
+    ASSERT_EQ(CongestionEvents({{0, 1}, {0, 0}}), congestion_events);
+    respond_watermarked(pl, pkts[2]);
+    ASSERT_EQ(0, pl->npackets_pending);
+    ASSERT_EQ(0, pl->nbytes_pending);
+    ASSERT_EQ(0, cq.npackets_pending);
+    ASSERT_EQ(2, congestion_events.size());
+}
+
+TEST_F(McWatermarks, testQueue)
+{
+    CQWrap cq;
+    cq.congestion_callback = record_congestion;
+    congestion_events.clear();
+    cq.queue_watermarks.high_bytes = 4 * 27;
+    cq.queue_watermarks.low_bytes = 27;
+
+    // Packets scheduled in a context count as soon as they are added
+    mcreq_sched_enter(&cq);
+    for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        mc_PIPELINE *pl = cq.pipelines[ii];
+        mcreq_sched_add(pl, make_watermarked_get(pl));
+    }
+    ASSERT_EQ(4 * 27, cq.nbytes_pending);
+    ASSERT_EQ(CongestionEvents({{-1, 1}}), congestion_events);
+    PacketWrap pw;
+    ASSERT_EQ(LCB_ERR_QUEUE_CONGESTED, reserve_for_server(cq, pw, 2));
+
+    mcreq_sched_fail(&cq);
+    ASSERT_EQ(0, cq.nbytes_pending);
+    ASSERT_EQ(0, cq.npackets_pending);
+    ASSERT_EQ(CongestionEvents({{-1, 1}, {-1, 0}}), congestion_events);
+
+    // Raising the watermarks releases the congestion at once
+    mcreq_sched_enter(&cq);
+    for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        mc_PIPELINE *pl = cq.pipelines[ii];
+        mcreq_sched_add(pl, make_watermarked_get(pl));
+    }
+    ASSERT_TRUE(cq.congested);
+    cq.queue_watermarks.high_bytes = 8 * 27;
+    cq.queue_watermarks.low_bytes = 4 * 27;
+    mcreq_queue_check_congestion(&cq);
+    ASSERT_FALSE(cq.congested);
+    PacketWrap accepted;
+    ASSERT_EQ(LCB_SUCCESS, reserve_for_server(cq, accepted, 2));
+    mcreq_wipe_packet(accepted.pipeline, accepted.pkt);
+    mcreq_release_packet(accepted.pipeline, accepted.pkt);
+
+    // Entering the requests list does not change the accounting
+    mcreq_sched_leave(&cq, 0);
+    ASSERT_EQ(4 * 27, cq.nbytes_pending);
+    ASSERT_EQ(4, congestion_events.size());
+    for (unsigned ii = 0; ii < NUM_PIPELINES; ii++) {
+        mc_PIPELINE *pl = cq.pipelines[ii];
+        respond_watermarked(pl, mcreq_first_packet(pl));
+    }
+    ASSERT_EQ(0, cq.nbytes_pending);
+    ASSERT_EQ(4, congestion_events.size());
+}
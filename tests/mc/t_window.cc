@@ -0,0 +1,180 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <vector>
+
+class McWindow : public ::testing::Test
+{
+};
+
+static unsigned nwindow_flushes = 0;
+
+static void count_window_flush(mc_PIPELINE *)
+{
+    nwindow_flushes++;
+}
+
+static mc_PACKET *enqueue_get(mc_PIPELINE *pl, const char *key)
+{
+    protocol_binary_request_header hdr{};
+    size_t nkey = strlen(key);
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, (uint8_t)(24 + nkey)));
+    pkt->extlen = 0;
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_GET;
+    hdr.request.keylen = htons((uint16_t)nkey);
+    hdr.request.bodylen = htonl((uint32_t)nkey);
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, key, nkey);
+    mcreq_enqueue_packet(pl, pkt);
+    return pkt;
+}
+
+static void drain_window(mc_PIPELINE *pl)
+{
+    nb_IOV iov[16];
+    unsigned toFlush;
+    while ((toFlush = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, toFlush, toFlush);
+    }
+}
+
+static bool is_sent(const mc_PACKET *pkt)
+{
+    return (pkt->flags & MCREQ_F_FLUSHED) != 0;
+}
+
+static void respond(mc_PIPELINE *pl, mc_PACKET *pkt)
+{
+    ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+    drain_window(pl);
+    mcreq_packet_handled(pl, pkt);
+    mcreq_pipeline_flush_woken(pl);
+}
+
+static void fail_throttled(mc_PIPELINE *, mc_PACKET *, lcb_STATUS, void *) {}
+
+TEST_F(McWindow, testAimd)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    pl->flush_start = count_window_flush;
+    nwindow_flushes = 0;
+    mcreq_pipeline_set_window(pl, 4);
+
+    std::vector<mc_PACKET *> pkts;
+    for (unsigned ii = 0; ii < 6; ii++) {
+        pkts.push_back(enqueue_get(pl, "key"));
+    }
+    drain_window(pl);
+    for (unsigned ii = 0; ii < 4; ii++) {
+        ASSERT_TRUE(is_sent(pkts[ii]));
+    }
+    ASSERT_FALSE(is_sent(pkts[4]));
+    ASSERT_NE(0, pkts[4]->flags & MCREQ_F_THROTTLED);
+    ASSERT_EQ(pkts[5], mcreq_pipeline_find(pl, pkts[5]->opaque));
+    ASSERT_EQ(2, pl->nthrottled);
+
+    // A response makes room for the next packet, which is flushed once the
+    // response has been handled
+    ASSERT_EQ(pkts[0], mcreq_pipeline_remove(pl, pkts[0]->opaque));
+    ASSERT_EQ(1, pl->nwoken);
+    ASSERT_EQ(0, nwindow_flushes);
+    drain_window(pl);
+    mcreq_packet_handled(pl, pkts[0]);
+    mcreq_pipeline_flush_woken(pl);
+    ASSERT_TRUE(is_sent(pkts[4]));
+    ASSERT_FALSE(is_sent(pkts[5]));
+    ASSERT_EQ(1, nwindow_flushes);
+    ASSERT_EQ(0, pl->nwoken);
+
+    // Rejections of packets written together halve the window once
+    mcreq_window_shrink(pl, pkts[1]);
+    ASSERT_EQ(2, pl->window);
+    mcreq_window_shrink(pl, pkts[2]);
+    ASSERT_EQ(2, pl->window);
+    respond(pl, pkts[1]);
+    respond(pl, pkts[2]);
+    ASSERT_FALSE(is_sent(pkts[5]));
+    respond(pl, pkts[3]);
+    ASSERT_TRUE(is_sent(pkts[5]));
+
+    // The window grows by one for each window's worth of responses
+    mcreq_window_grow(pl);
+    ASSERT_EQ(2, pl->window);
+    mcreq_window_grow(pl);
+    ASSERT_EQ(3, pl->window);
+    for (unsigned ii = 0; ii < 3; ii++) {
+        mcreq_window_grow(pl);
+    }
+    ASSERT_EQ(4, pl->window);
+    for (unsigned ii = 0; ii < 10; ii++) {
+        mcreq_window_grow(pl);
+    }
+    ASSERT_EQ(4, pl->window);
+
+    respond(pl, pkts[4]);
+    respond(pl, pkts[5]);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+    mcreq_pipeline_set_window(pl, 0);
+}
+
+TEST_F(McWindow, testFailAndDisable)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    mcreq_pipeline_set_window(pl, 1);
+
+    std::vector<mc_PACKET *> pkts;
+    for (unsigned ii = 0; ii < 4; ii++) {
+        pkts.push_back(enqueue_get(pl, "key"));
+    }
+    drain_window(pl);
+    ASSERT_TRUE(is_sent(pkts[0]));
+    ASSERT_EQ(3, pl->nthrottled);
+
+    // A throttled packet which is removed (e.g. timed out) is not written
+    respond(pl, pkts[2]);
+    ASSERT_EQ(2, pl->nthrottled);
+    ASSERT_FALSE(is_sent(pkts[1]));
+
+    // Without a window, throttled packets are written straight away
+    mcreq_pipeline_set_window(pl, 0);
+    drain_window(pl);
+    ASSERT_TRUE(is_sent(pkts[1]));
+    ASSERT_TRUE(is_sent(pkts[3]));
+    ASSERT_EQ(0, pl->nthrottled);
+    respond(pl, pkts[0]);
+    respond(pl, pkts[1]);
+    respond(pl, pkts[3]);
+
+    // Failing the pipeline drops its throttled packets
+    mcreq_pipeline_set_window(pl, 1);
+    pkts.clear();
+    for (unsigned ii = 0; ii < 3; ii++) {
+        pkts.push_back(enqueue_get(pl, "key"));
+    }
+    ASSERT_EQ(3, mcreq_pipeline_fail(pl, LCB_ERR_GENERIC, fail_throttled, nullptr));
+    drain_window(pl);
+    ASSERT_EQ(0, pl->nthrottled);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->throttled));
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->requests));
+}
@@ -0,0 +1,155 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "mctest.h"
+#include "mc/mcreq-flush-inl.h"
+#include <vector>
+
+class McZerocopy : public ::testing::Test
+{
+};
+
+static std::vector<const void *> released_cookies;
+
+static void record_buf_done(mc_PIPELINE *, const void *cookie, void *, void *)
+{
+    released_cookies.push_back(cookie);
+}
+
+static mc_PACKET *enqueue_set(mc_PIPELINE *pl, const char *key, const void *value, size_t nvalue, const void *cookie)
+{
+    protocol_binary_request_header hdr{};
+    size_t nkey = strlen(key);
+    lcb_VALBUF vbuf{};
+    mc_PACKET *pkt = mcreq_allocate_packet(pl);
+    EXPECT_NE(nullptr, pkt);
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_header(pl, pkt, (uint8_t)(24 + nkey)));
+    vbuf.vtype = LCB_KV_CONTIG;
+    vbuf.u_buf.contig.bytes = value;
+    vbuf.u_buf.contig.nbytes = nvalue;
+    EXPECT_EQ(LCB_SUCCESS, mcreq_reserve_value(pl, pkt, &vbuf));
+    pkt->flags |= MCREQ_F_ZEROCOPY;
+    pkt->extlen = 0;
+    pkt->u_rdata.reqdata.cookie = cookie;
+    hdr.request.magic = PROTOCOL_BINARY_REQ;
+    hdr.request.opcode = PROTOCOL_BINARY_CMD_SET;
+    hdr.request.keylen = htons((uint16_t)nkey);
+    hdr.request.bodylen = htonl((uint32_t)(nkey + nvalue));
+    hdr.request.opaque = pkt->opaque;
+    mcreq_write_hdr(pkt, &hdr);
+    memcpy(SPAN_BUFFER(&pkt->kh_span) + 24, key, nkey);
+    mcreq_enqueue_packet(pl, pkt);
+    return pkt;
+}
+
+TEST_F(McZerocopy, testPinnedUntilReleased)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    char value1[128], value2[64];
+    int cookie1, cookie2;
+    nb_IOV iov[16];
+    int niov = 0, zerocopy = -1;
+    unsigned nb;
+
+    cq.setBufFreeCallback(record_buf_done);
+    released_cookies.clear();
+    memset(value1, 'a', sizeof value1);
+    memset(value2, 'b', sizeof value2);
+
+    mc_PACKET *pkt1 = enqueue_set(pl, "k1", value1, sizeof value1, &cookie1);
+    mc_PACKET *pkt2 = enqueue_set(pl, "k2", value2, sizeof value2, &cookie2);
+
+    // The header of the first packet is flushed on its own
+    nb = mcreq_flush_iov_fill_ex(pl, iov, 16, &niov, &zerocopy);
+    ASSERT_EQ(26, nb);
+    ASSERT_EQ(0, zerocopy);
+    mcreq_flush_done(pl, nb, nb);
+
+    // Its value is flushed without copying; the "kernel" has not released it
+    nb = mcreq_flush_iov_fill_ex(pl, iov, 16, &niov, &zerocopy);
+    ASSERT_EQ(sizeof value1, nb);
+    ASSERT_EQ(1, niov);
+    ASSERT_NE(0, zerocopy);
+    ASSERT_EQ(value1, iov[0].iov_base);
+    pl->zc_issued = 1;
+    mcreq_flush_done(pl, nb, nb);
+    ASSERT_NE(0, pkt1->flags & MCREQ_F_PINNED);
+    ASSERT_EQ(0, pkt1->flags & MCREQ_F_FLUSHED);
+
+    // The response may arrive before the send is released
+    ASSERT_EQ(pkt1, mcreq_pipeline_remove(pl, pkt1->opaque));
+    mcreq_packet_handled(pl, pkt1);
+    ASSERT_TRUE(released_cookies.empty());
+
+    // Flush the second packet, both parts of it in a second send
+    nb = mcreq_flush_iov_fill_ex(pl, iov, 16, &niov, &zerocopy);
+    ASSERT_EQ(26, nb);
+    mcreq_flush_done(pl, nb, nb);
+    nb = mcreq_flush_iov_fill_ex(pl, iov, 16, &niov, &zerocopy);
+    ASSERT_EQ(sizeof value2, nb);
+    ASSERT_NE(0, zerocopy);
+    pl->zc_issued = 2;
+    mcreq_flush_done(pl, nb, nb);
+    ASSERT_NE(0, pkt2->flags & MCREQ_F_PINNED);
+    ASSERT_EQ(0, mcreq_flush_iov_fill_ex(pl, iov, 16, &niov, &zerocopy));
+
+    // The first send completes; only the first packet is released
+    ASSERT_EQ(0, mcreq_pipeline_unpin(pl, 0));
+    ASSERT_EQ(1, mcreq_pipeline_unpin(pl, 1));
+    ASSERT_EQ(1, released_cookies.size());
+    ASSERT_EQ(&cookie1, released_cookies[0]);
+    ASSERT_EQ(0, pkt2->flags & MCREQ_F_FLUSHED);
+
+    // The second packet is flushed, but still awaits its response
+    ASSERT_EQ(1, mcreq_pipeline_unpin(pl, 2));
+    ASSERT_EQ(0, pkt2->flags & MCREQ_F_PINNED);
+    ASSERT_NE(0, pkt2->flags & MCREQ_F_FLUSHED);
+    ASSERT_EQ(1, released_cookies.size());
+    ASSERT_EQ(pkt2, mcreq_pipeline_remove(pl, pkt2->opaque));
+    mcreq_packet_handled(pl, pkt2);
+    ASSERT_EQ(2, released_cookies.size());
+    ASSERT_EQ(&cookie2, released_cookies[1]);
+    ASSERT_NE(0, netbuf_is_clean(&pl->nbmgr));
+}
+
+TEST_F(McZerocopy, testNotPinnedWithoutOutstandingSends)
+{
+    CQWrap cq;
+    mc_PIPELINE *pl = cq.pipelines[0];
+    char value[32] = {};
+    int cookie;
+    nb_IOV iov[16];
+    unsigned nb;
+
+    cq.setBufFreeCallback(record_buf_done);
+    released_cookies.clear();
+
+    // e.g. the send fell back to copying, so the kernel holds no reference
+    mc_PACKET *pkt = enqueue_set(pl, "k1", value, sizeof value, &cookie);
+    while ((nb = mcreq_flush_iov_fill(pl, iov, 16, nullptr))) {
+        mcreq_flush_done(pl, nb, nb);
+    }
+    ASSERT_EQ(0, pkt->flags & MCREQ_F_PINNED);
+    ASSERT_NE(0, pkt->flags & MCREQ_F_FLUSHED);
+    ASSERT_TRUE(SLLIST_IS_EMPTY(&pl->pinned));
+
+    ASSERT_EQ(pkt, mcreq_pipeline_remove(pl, pkt->opaque));
+    mcreq_packet_handled(pl, pkt);
+    ASSERT_EQ(1, released_cookies.size());
+    ASSERT_NE(0, netbuf_is_clean(&pl->nbmgr));
+}
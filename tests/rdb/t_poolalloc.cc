@@ -0,0 +1,126 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "rdbtest.h"
+#include <rdb/poolalloc.h>
+#include <vector>
+
+class PoolallocTest : public ::testing::Test
+{
+};
+
+TEST_F(PoolallocTest, testSizeClasses)
+{
+    RdbAllocator a(rdb_poolalloc_new());
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+
+    rdb_ROPESEG *seg = a.alloc(1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN, seg->nalloc);
+    ASSERT_EQ(1, pa->n_outstanding);
+    a.free(seg);
+
+    seg = a.alloc(RDB_POOLALLOC_CLASS_MIN + 1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 2, seg->nalloc);
+    a.free(seg);
+
+    // Too large to be pooled
+    seg = a.alloc(RDB_POOLALLOC_CLASS_MAX + 1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MAX + 1, seg->nalloc);
+    memset(seg->root, '*', seg->nalloc);
+    a.free(seg);
+
+    ASSERT_EQ(3, pa->n_requests);
+    ASSERT_EQ(3, pa->n_malloc);
+    ASSERT_EQ(1, pa->n_oversized);
+    ASSERT_EQ(0, pa->n_outstanding);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 3, pa->nb_pooled);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testReuse)
+{
+    RdbAllocator a(rdb_poolalloc_new());
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+
+    rdb_ROPESEG *seg = a.alloc(1000);
+    seg->nused = 10;
+    seg->start = 5;
+    a.free(seg);
+
+    // A request of the same class gets the same buffer back, reset
+    rdb_ROPESEG *newseg = a.alloc(700);
+    ASSERT_EQ(seg, newseg);
+    ASSERT_EQ(0, newseg->nused);
+    ASSERT_EQ(0, newseg->start);
+    ASSERT_EQ(RDB_ROPESEG_F_LIB, newseg->shflags);
+    ASSERT_EQ(1, pa->n_reused);
+    ASSERT_EQ(1, pa->n_malloc);
+    ASSERT_EQ(0, pa->nb_pooled);
+
+    // But not one of another class
+    rdb_ROPESEG *other = a.alloc(100);
+    ASSERT_NE(seg, other);
+    a.free(other);
+    a.free(newseg);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testPoolLimit)
+{
+    RdbAllocator a(rdb_poolalloc_new());
+    rdb_POOLALLOC *pa = (rdb_POOLALLOC *)a._inner;
+    std::vector<rdb_ROPESEG *> segs;
+
+    for (unsigned ii = 0; ii < RDB_POOLALLOC_BLKCNT_MAX * 2; ii++) {
+        segs.push_back(a.alloc(1));
+    }
+    for (auto *seg : segs) {
+        a.free(seg);
+    }
+    ASSERT_EQ(RDB_POOLALLOC_BLKCNT_MAX, LCB_CLIST_SIZE(&pa->classes[0]));
+    ASSERT_EQ(0, pa->n_outstanding);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testRealloc)
+{
+    RdbAllocator a(rdb_poolalloc_new());
+    rdb_ROPESEG *seg = a.alloc(5);
+    memcpy(seg->root, "hello", 5);
+    seg->nused = 5;
+
+    ASSERT_EQ(seg, a.realloc(seg, seg->nalloc));
+    seg = a.realloc(seg, seg->nalloc + 1);
+    ASSERT_EQ(RDB_POOLALLOC_CLASS_MIN * 2, seg->nalloc);
+    ASSERT_EQ(5, seg->nused);
+    ASSERT_EQ(0, memcmp(seg->root, "hello", 5));
+    a.free(seg);
+    a.release();
+}
+
+TEST_F(PoolallocTest, testOutlivesOwner)
+{
+    RdbAllocator a(rdb_poolalloc_new());
+    rdb_ROPESEG *seg = a.alloc(100);
+    seg->shflags &= ~RDB_ROPESEG_F_LIB;
+    rdb_seg_ref(seg);
+
+    // The owner goes away while the segment is still referenced
+    a.release();
+    memset(seg->root, '*', seg->nalloc);
+    rdb_seg_unref(seg);
+}
@@ -0,0 +1,186 @@
+/* -*- Mode: C++; tab-width: 4; c-basic-offset: 4; indent-tabs-mode: nil -*- */
+/*
+ *     Copyright 2021 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "socktest.h"
+#include <cstdlib>
+
+using namespace LCBTest;
+
+/**
+ * Loopback throughput benchmark for the I/O plugins.
+ *
+ * The client pipelines batches of small messages to a blocking echo server
+ * and verifies what it reads back. The plugin is chosen the usual way (i.e.
+ * `LCB_IOPS_NAME`), so that the `check-<plugin>-sock-tests` targets compare
+ * e.g. select, libev and iouring. The number of round trips may be raised via
+ * `LCB_LOOPBACK_ROUNDS`, which also reports the rate; the default only serves
+ * as a smoke test.
+ */
+
+#define MSG_SIZE 64
+#define BATCH_DEPTH 16
+
+struct EchoServer {
+    SockFD *listener;
+    size_t nbytes; /**< Number of bytes to echo back before exiting */
+};
+
+static void echo_server(void *arg)
+{
+    EchoServer *info = static_cast<EchoServer *>(arg);
+    SockFD *client = info->listener->acceptClient();
+    size_t nechoed = 0;
+    char buf[8192];
+    ssize_t nr;
+
+    while (nechoed < info->nbytes && (nr = client->recv(buf, sizeof(buf))) > 0) {
+        ssize_t nw = 0;
+        while (nw < nr) {
+            ssize_t rv = client->send(buf + nw, nr - nw);
+            if (rv <= 0) {
+                break;
+            }
+            nw += rv;
+        }
+        nechoed += nr;
+    }
+    delete client;
+}
+
+static inline char stream_byte(size_t pos)
+{
+    return static_cast<char>(pos % 251);
+}
+
+class EchoActions : public IOActions
+{
+  public:
+    EchoActions(unsigned nrounds) : roundsLeft(nrounds) {}
+
+    void sendBatch(ESocket *s)
+    {
+        char msg[MSG_SIZE];
+        for (unsigned ii = 0; ii < BATCH_DEPTH; ii++) {
+            for (char &c : msg) {
+                c = stream_byte(nsent++);
+            }
+            s->put(msg, sizeof(msg));
+        }
+        s->reqrd(MSG_SIZE * BATCH_DEPTH);
+        s->schedule();
+    }
+
+    void onRead(ESocket *s, size_t nr) override
+    {
+        lcbio_CTXRDITER iter;
+        LCBIO_CTX_ITERFOR(s->ctx, &iter, nr)
+        {
+            const char *buf = static_cast<const char *>(lcbio_ctx_ribuf(&iter));
+            unsigned nbuf = lcbio_ctx_risize(&iter);
+            for (unsigned ii = 0; ii < nbuf; ii++) {
+                if (buf[ii] != stream_byte(nreceived + ii)) {
+                    corrupted = true;
+                }
+            }
+            nreceived += nbuf;
+        }
+
+        if (corrupted) {
+            s->parent->stop();
+        } else if (nreceived == nsent && --roundsLeft) {
+            sendBatch(s);
+        } else if (nreceived == nsent) {
+            s->parent->stop();
+        } else {
+            s->reqrd(nsent - nreceived);
+            s->schedule();
+        }
+    }
+
+    void onError(ESocket *s) override
+    {
+        s->parent->stop();
+    }
+
+    unsigned roundsLeft;
+    size_t nsent = 0;
+    size_t nreceived = 0;
+    bool corrupted = false;
+};
+
+extern "C" {
+static void loopback_connected(lcbio_SOCKET *sock, void *data, lcb_STATUS err, lcbio_OSERR oserr)
+{
+    ESocket *s = static_cast<ESocket *>(data);
+    s->assign(sock, err);
+    s->syserr = oserr;
+    s->parent->stop();
+}
+}
+
+class SockLoopbackTest : public SockTest
+{
+};
+
+TEST_F(SockLoopbackTest, testEchoThroughput)
+{
+    unsigned nrounds = 200;
+    bool benchmark = false;
+    const char *env = getenv("LCB_LOOPBACK_ROUNDS");
+    if (env && atoi(env) > 0) {
+        nrounds = static_cast<unsigned>(atoi(env));
+        benchmark = true;
+    }
+
+    EchoServer info;
+    info.listener = SockFD::newListener();
+    info.nbytes = static_cast<size_t>(nrounds) * BATCH_DEPTH * MSG_SIZE;
+    Thread server(echo_server, &info);
+
+    lcb_host_t host{};
+    hostFromSockFD(info.listener, &host);
+    ESocket sock;
+    sock.parent = loop;
+    sock.creq = lcbio_connect(loop->iot, loop->settings, &host, LCB_MS2US(1000), loopback_connected, &sock);
+    loop->start();
+    ASSERT_FALSE(sock.sock == nullptr) << lcb_strerror_short(sock.lasterr);
+
+    EchoActions actions(nrounds);
+    sock.setActions(&actions);
+    hrtime_t begin = gethrtime();
+    actions.sendBatch(&sock);
+    loop->start();
+    hrtime_t elapsed = gethrtime() - begin;
+
+    ASSERT_EQ(LCB_SUCCESS, sock.lasterr);
+    ASSERT_FALSE(actions.corrupted);
+    ASSERT_EQ(0, actions.roundsLeft);
+    ASSERT_EQ(info.nbytes, actions.nreceived);
+
+    if (benchmark) {
+        double seconds = elapsed / 1e9;
+        unsigned long nops = static_cast<unsigned long>(nrounds) * BATCH_DEPTH;
+        const char *plugin = getenv("LCB_IOPS_NAME");
+        printf("[loopback] plugin=%s rounds=%u messages=%lu elapsed=%.3fs rate=%.0f msg/s\n",
+               plugin ? plugin : "default", nrounds, nops, seconds, seconds > 0 ? nops / seconds : 0.0);
+        RecordProperty("messages_per_second", static_cast<int>(seconds > 0 ? nops / seconds : 0));
+    }
+
+    sock.close();
+    server.join();
+    delete info.listener;
+}
@@ -17,6 +17,8 @@
 
 #include <libcouchbase/vbucket.h>
 #include <gtest/gtest.h>
+#include <chrono>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <vector>
@@ -456,3 +458,259 @@ TEST_F(ConfigTest, testLargeRevision)
         ASSERT_EQ(18446744073709551615UL, json["max_uint64"].asUInt64());
     }
 }
+
+TEST_F(ConfigTest, testPeekRevision)
+{
+    const char *files[] = {"full_25.json", "terse_25.json", "terse_30.json", "memd_30.json", "terse_long_hostname.json"};
+    for (const char *fname : files) {
+        string testData = getConfigFile(fname);
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_load_json(vbc, testData.c_str()));
+        int64_t revepoch, revid;
+        ASSERT_EQ(0, lcbvb_peek_revision(testData.c_str(), testData.size(), &revepoch, &revid)) << fname;
+        ASSERT_EQ(vbc->revepoch, revepoch) << fname;
+        ASSERT_EQ(vbc->revid, revid) << fname;
+        lcbvb_destroy(vbc);
+    }
+
+    int64_t revepoch, revid;
+    // Only top-level members are considered
+    string js = "{\"name\":\"a,}\\\"rev\",\"nested\":{\"rev\":1,\"x\":[{\"revEpoch\":9}]},\"rev\":-42 , \"revEpoch\":7}";
+    ASSERT_EQ(0, lcbvb_peek_revision(js.c_str(), js.size(), &revepoch, &revid));
+    ASSERT_EQ(-42, revid);
+    ASSERT_EQ(7, revepoch);
+
+    js = "{\"rev\":5,\"nodes\":[]}";
+    ASSERT_EQ(0, lcbvb_peek_revision(js.c_str(), js.size(), &revepoch, &revid));
+    ASSERT_EQ(5, revid);
+    ASSERT_EQ(-1, revepoch);
+
+    js = "{}";
+    ASSERT_EQ(0, lcbvb_peek_revision(js.c_str(), js.size(), &revepoch, &revid));
+    ASSERT_EQ(-1, revid);
+
+    const char *bad[] = {"", "[]", "{\"rev\":}", "{\"rev\":\"5\"}", "{\"nodes\":[1,2", "{\"rev\" 5}"};
+    for (const char *input : bad) {
+        ASSERT_NE(0, lcbvb_peek_revision(input, strlen(input), &revepoch, &revid)) << input;
+    }
+}
+
+static string generate_large_config()
+{
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    lcbvb_genconfig(cfg, 100, 2, 1024);
+    cfg->revid = 1000;
+    cfg->revepoch = 1;
+    char *js = lcbvb_save_json(cfg);
+    string result(js);
+    free(js);
+    lcbvb_destroy(cfg);
+    return result;
+}
+
+// Compares the cost of discarding a stale configuration by peeking at its
+// revision with the cost of parsing it. Run with --gtest_also_run_disabled_tests
+TEST_F(ConfigTest, DISABLED_benchPeekRevision)
+{
+    const unsigned niter = 200;
+    string js = generate_large_config();
+
+    auto begin = std::chrono::steady_clock::now();
+    for (unsigned ii = 0; ii < niter; ii++) {
+        lcbvb_CONFIG *vbc = lcbvb_create();
+        ASSERT_EQ(0, lcbvb_load_json(vbc, js.c_str()));
+        ASSERT_EQ(1000, vbc->revid);
+        lcbvb_destroy(vbc);
+    }
+    auto parse_time = std::chrono::steady_clock::now() - begin;
+
+    begin = std::chrono::steady_clock::now();
+    for (unsigned ii = 0; ii < niter; ii++) {
+        int64_t revepoch, revid;
+        ASSERT_EQ(0, lcbvb_peek_revision(js.c_str(), js.size(), &revepoch, &revid));
+        ASSERT_EQ(1000, revid);
+    }
+    auto peek_time = std::chrono::steady_clock::now() - begin;
+
+    std::cout << "config size: " << js.size() << " bytes" << std::endl;
+    std::cout << "lcbvb_load_json: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(parse_time).count() / niter << "us/config"
+              << std::endl;
+    std::cout << "lcbvb_peek_revision: "
+              << std::chrono::duration_cast<std::chrono::microseconds>(peek_time).count() / niter << "us/config"
+              << std::endl;
+}
+
+TEST_F(ConfigTest, testCompareMoved)
+{
+    lcbvb_CONFIG *cfg_a = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(cfg_a, 4, 1, 64));
+    char *js = lcbvb_save_json(cfg_a);
+    lcbvb_CONFIG *cfg_b = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg_b, js));
+    free(js);
+
+    // Swap the positions of the first two nodes; no vBucket changes owner
+    std::swap(cfg_b->servers[0], cfg_b->servers[1]);
+    for (unsigned ii = 0; ii < cfg_b->nvb; ii++) {
+        for (int &ix : cfg_b->vbuckets[ii].servers) {
+            if (ix == 0 || ix == 1) {
+                ix = 1 - ix;
+            }
+        }
+    }
+    lcbvb_CONFIGDIFF *diff = lcbvb_compare(cfg_a, cfg_b);
+    ASSERT_NE(nullptr, diff->vb_moved);
+    ASSERT_EQ(0, diff->n_vb_moved);
+    ASSERT_NE(0, diff->sequence_changed);
+    lcbvb_free_diff(diff);
+
+    // Move two vBuckets to another node
+    cfg_b->vbuckets[5].servers[0] = (cfg_b->vbuckets[5].servers[0] + 1) % 4;
+    cfg_b->vbuckets[63].servers[0] = -1;
+    diff = lcbvb_compare(cfg_a, cfg_b);
+    ASSERT_EQ(2, diff->n_vb_moved);
+    for (unsigned ii = 0; ii < cfg_b->nvb; ii++) {
+        ASSERT_EQ(ii == 5 || ii == 63, diff->vb_moved[ii] != 0) << ii;
+    }
+    lcbvb_free_diff(diff);
+
+    // Maps of different sizes cannot be compared
+    lcbvb_CONFIG *cfg_c = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(cfg_c, 4, 1, 128));
+    diff = lcbvb_compare(cfg_a, cfg_c);
+    ASSERT_EQ(nullptr, diff->vb_moved);
+    ASSERT_EQ(0, diff->n_vb_moved);
+    ASSERT_EQ(-1, diff->n_vb_changes);
+    lcbvb_free_diff(diff);
+
+    lcbvb_destroy(cfg_a);
+    lcbvb_destroy(cfg_b);
+    lcbvb_destroy(cfg_c);
+}
+
+/* The byte-at-a-time table CRC32 used to map keys before slicing-by-8 */
+static uint32_t reference_crc32(const char *key, size_t nkey)
+{
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> tab(256);
+        for (uint32_t ii = 0; ii < 256; ii++) {
+            uint32_t crc = ii;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+            }
+            tab[ii] = crc;
+        }
+        return tab;
+    }();
+    uint32_t crc = UINT32_MAX;
+    for (size_t ii = 0; ii < nkey; ii++) {
+        crc = (crc >> 8) ^ table[(crc ^ (uint8_t)key[ii]) & 0xff];
+    }
+    return ((~crc) >> 16) & 0x7fff;
+}
+
+TEST_F(ConfigTest, testKeyHash)
+{
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    // One vBucket for each possible digest
+    ASSERT_EQ(0, lcbvb_genconfig(cfg, 4, 1, 32768));
+
+    char buf[300];
+    for (size_t ii = 0; ii < sizeof buf; ii++) {
+        buf[ii] = (char)(ii * 131 + 7);
+    }
+    // Every length, at every alignment of the tail
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t nkey = 0; nkey + offset <= 260; nkey++) {
+            ASSERT_EQ((int)reference_crc32(buf + offset, nkey), lcbvb_k2vb(cfg, buf + offset, nkey))
+                << "offset=" << offset << ", nkey=" << nkey;
+        }
+    }
+    ASSERT_EQ((int)reference_crc32("foo", 3), lcbvb_k2vb(cfg, "foo", 3));
+    lcbvb_destroy(cfg);
+}
+
+static void check_map_keys(lcbvb_CONFIG *cfg)
+{
+    std::vector<std::string> keys;
+    std::vector<const void *> ptrs;
+    std::vector<lcb_SIZE> sizes;
+    for (int ii = 0; ii < 1000; ii++) {
+        keys.push_back("key_" + std::to_string(ii * 7919));
+    }
+    for (const auto &key : keys) {
+        ptrs.push_back(key.c_str());
+        sizes.push_back(key.size());
+    }
+
+    std::vector<int> vbids(keys.size()), srvixs(keys.size());
+    ASSERT_EQ(0, lcbvb_map_keys(cfg, ptrs.data(), sizes.data(), keys.size(), vbids.data(), srvixs.data()));
+    for (size_t ii = 0; ii < keys.size(); ii++) {
+        int vbid, srvix;
+        lcbvb_map_key(cfg, keys[ii].c_str(), keys[ii].size(), &vbid, &srvix);
+        ASSERT_EQ(vbid, vbids[ii]) << keys[ii];
+        ASSERT_EQ(srvix, srvixs[ii]) << keys[ii];
+    }
+
+    // The vBuckets are optional
+    std::vector<int> srvixs2(keys.size());
+    ASSERT_EQ(0, lcbvb_map_keys(cfg, ptrs.data(), sizes.data(), keys.size(), nullptr, srvixs2.data()));
+    ASSERT_EQ(srvixs, srvixs2);
+}
+
+TEST_F(ConfigTest, testMapKeys)
+{
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(cfg, 4, 1, 1024));
+    check_map_keys(cfg);
+    lcbvb_destroy(cfg);
+
+    string testData = getConfigFile("memd_ketama_config.json");
+    cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_load_json(cfg, testData.c_str()));
+    ASSERT_EQ(LCBVB_DIST_KETAMA, cfg->dtype);
+    lcbvb_replace_host(cfg, "localhost");
+    check_map_keys(cfg);
+    lcbvb_destroy(cfg);
+}
+
+// Compares mapping keys one at a time with the byte-wise CRC32 against the
+// batch API. Run with --gtest_also_run_disabled_tests
+TEST_F(ConfigTest, DISABLED_benchMapKeys)
+{
+    const size_t nkeys = 1000000;
+    lcbvb_CONFIG *cfg = lcbvb_create();
+    ASSERT_EQ(0, lcbvb_genconfig(cfg, 4, 1, 1024));
+
+    std::vector<std::string> keys;
+    std::vector<const void *> ptrs;
+    std::vector<lcb_SIZE> sizes;
+    for (size_t ii = 0; ii < nkeys; ii++) {
+        keys.push_back("customer::" + std::to_string(ii) + "::order-history");
+    }
+    for (const auto &key : keys) {
+        ptrs.push_back(key.c_str());
+        sizes.push_back(key.size());
+    }
+    std::vector<int> vbids(nkeys), srvixs(nkeys);
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t ii = 0; ii < nkeys; ii++) {
+        vbids[ii] = (int)(reference_crc32(keys[ii].c_str(), keys[ii].size()) % cfg->nvb);
+        srvixs[ii] = lcbvb_vbmaster(cfg, vbids[ii]);
+    }
+    auto bytewise_time = std::chrono::steady_clock::now() - begin;
+
+    std::vector<int> vbids2(nkeys), srvixs2(nkeys);
+    begin = std::chrono::steady_clock::now();
+    lcbvb_map_keys(cfg, ptrs.data(), sizes.data(), nkeys, vbids2.data(), srvixs2.data());
+    auto batch_time = std::chrono::steady_clock::now() - begin;
+    ASSERT_EQ(vbids, vbids2);
+
+    std::cout << "byte-wise: " << std::chrono::duration_cast<std::chrono::nanoseconds>(bytewise_time).count() / nkeys
+              << "ns/key" << std::endl;
+    std::cout << "lcbvb_map_keys: " << std::chrono::duration_cast<std::chrono::nanoseconds>(batch_time).count() / nkeys
+              << "ns/key" << std::endl;
+    lcbvb_destroy(cfg);
+}
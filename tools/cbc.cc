@@ -1208,6 +1208,8 @@ static const char *iops_to_string(lcb_io_ops_type_t type)
             return "select";
         case LCB_IO_OPS_WINIOCP:
             return "iocp";
+        case LCB_IO_OPS_IOURING:
+            return "iouring";
         case LCB_IO_OPS_INVALID:
             return "user-defined";
         default:
@@ -1246,7 +1248,7 @@ void VersionHandler::run()
         size_t ii;
         char buf[256] = {0}, *p = buf;
         lcb_io_ops_type_t known_io[] = {LCB_IO_OPS_WINIOCP, LCB_IO_OPS_LIBEVENT, LCB_IO_OPS_LIBUV, LCB_IO_OPS_LIBEV,
-                                        LCB_IO_OPS_SELECT};
+                                        LCB_IO_OPS_SELECT, LCB_IO_OPS_IOURING};
 
         for (ii = 0; ii < sizeof(known_io) / sizeof(known_io[0]); ii++) {
             struct lcb_create_io_ops_st cio = {0};